@@ -19,7 +19,12 @@
 
 #include "krecursivefilterproxymodel.h"
 
+#include <QAtomicInt>
+#include <QBitArray>
 #include <QMetaMethod>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
 
 // Maintainability note:
 // This class invokes some Q_PRIVATE_SLOTs in QSortFilterProxyModel which are
@@ -40,6 +45,110 @@ inline static bool passRolesToDataChanged()
     return passRoles;
 }
 
+static int loadGeneration(const QAtomicInt &generation)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    return generation.load();
+#else
+    return generation;
+#endif
+}
+
+// Same semantics as QSortFilterProxyModel::filterAcceptsRow(), based on the filter keys of a row
+static bool keysMatch(const QVector<QString> &keys, const QRegExp &regExp, int keyColumn)
+{
+    if (regExp.isEmpty())
+        return true;
+    if (keyColumn < 0) {
+        Q_FOREACH (const QString &key, keys) {
+            if (key.contains(regExp))
+                return true;
+        }
+        return false;
+    }
+    if (keyColumn >= keys.size())
+        return true; // QSFPM accepts rows without the key column too
+    return keys.at(keyColumn).contains(regExp);
+}
+
+// Mirror of the source tree, caching whether a row matches the filter itself (selfMatch)
+// and how many of its children have a match in their subtree (matchingChildren).
+// Nodes don't know their parent, updates walk up the chain of nodes found while looking them up.
+// With background filtering, nodes also hold the filter keys of their row, and their position in
+// the snapshot of the keys that is being evaluated, if any.
+struct KRecursiveFilterNode
+{
+    KRecursiveFilterNode()
+        : matchingChildren(0),
+          snapshotIndex(-1),
+          selfMatch(false)
+    {
+    }
+
+    ~KRecursiveFilterNode()
+    {
+        qDeleteAll(children);
+    }
+
+    bool subtreeMatch() const
+    {
+        return selfMatch || matchingChildren > 0;
+    }
+
+    QVector<KRecursiveFilterNode *> children;
+    QVector<QString> keys; // per column
+    int matchingChildren;
+    int snapshotIndex; // -1 if not part of the snapshot, or changed since
+    bool selfMatch;
+};
+
+typedef QVector<KRecursiveFilterNode *> KRecursiveFilterNodeChain;
+
+namespace {
+/** Evaluates a filter expression against a snapshot of the filter keys, without accessing the source model. */
+class KRecursiveFilterJob : public QRunnable
+{
+public:
+    KRecursiveFilterJob(QObject *receiver, const QAtomicInt *currentGeneration)
+        : receiver(receiver),
+          currentGeneration(currentGeneration),
+          generation(0),
+          keyColumn(0)
+    {
+    }
+
+    void run() override
+    {
+        QBitArray matches(keys.size());
+        for (int i = 0; i < keys.size(); ++i) {
+            if ((i & 0x3ff) == 0 && isCancelled())
+                return;
+            if (keysMatch(keys.at(i), regExp, keyColumn))
+                matches.setBit(i);
+        }
+
+        if (isCancelled())
+            return;
+        QMetaObject::invokeMethod(receiver, "applyBackgroundFilter", Qt::QueuedConnection,
+                                  Q_ARG(int, generation), Q_ARG(QBitArray, matches));
+    }
+
+    bool isCancelled() const
+    {
+        return loadGeneration(*currentGeneration) != generation;
+    }
+
+    // the receiver outlives us, its destructor waits for all jobs to finish
+    QObject *receiver;
+    const QAtomicInt *currentGeneration;
+
+    int generation;
+    QVector<QVector<QString> > keys; // in the pre-order of the nodes
+    QRegExp regExp;
+    int keyColumn;
+};
+}
+
 class KRecursiveFilterProxyModelPrivate
 {
     Q_DECLARE_PUBLIC(KRecursiveFilterProxyModel)
@@ -47,11 +156,23 @@ class KRecursiveFilterProxyModelPrivate
 public:
     KRecursiveFilterProxyModelPrivate(KRecursiveFilterProxyModel *model)
         : q_ptr(model),
-          completeInsert(false)
+          completeInsert(false),
+          root(nullptr),
+          cachedFilterKeyColumn(0),
+          cachedFilterRole(Qt::DisplayRole),
+          backgroundFiltering(false),
+          filterPending(false),
+          threadPool(nullptr),
+          generation(0)
     {
         qRegisterMetaType<QModelIndex>("QModelIndex");
     }
 
+    ~KRecursiveFilterProxyModelPrivate()
+    {
+        dropCache();
+    }
+
     inline QMetaMethod findMethod(const char *signature) const
     {
         Q_Q(const KRecursiveFilterProxyModel);
@@ -145,37 +266,359 @@ public:
 
     QModelIndex lastFilteredOutAscendant(const QModelIndex &index);
 
+    void sourceRowsAboutToBeMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row);
+    void sourceRowsMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row);
+
+    /** Whether every row is accepted anyway, so there is no need to keep track of matches. */
+    bool acceptsEverything() const;
+    /** Whether the cache holds the filter keys, for evaluating filter changes in the background. */
+    bool usesKeys() const;
+    bool cacheValid() const;
+    void dropCache();
+    void rebuildCache();
+    KRecursiveFilterNode *createNode(int row, const QModelIndex &sourceParent);
+    void updateSelfMatch(KRecursiveFilterNode *node, int row, const QModelIndex &sourceParent);
+
+    void startBackgroundFilter(const QRegExp &regExp);
+    /** Adds the keys of all nodes below @p node to @p keys, remembering where they went. */
+    void snapshotKeys(KRecursiveFilterNode *node, QVector<QVector<QString> > &keys);
+    void applyBackgroundFilter(int jobGeneration, const QBitArray &matches);
+    /** Updates the matches of all nodes below @p node, taking those in the snapshot from @p matches. */
+    void updateMatches(KRecursiveFilterNode *node, const QBitArray &matches);
+    /** Cancels the background evaluation, and applies its filter synchronously instead. */
+    void applyPendingFilter();
+    /** Looks up the nodes from the root down to @p sourceParent. */
+    bool findChain(const QModelIndex &sourceParent, KRecursiveFilterNodeChain &chain);
+    /** Updates the match counts for a child of chain.last() that started or stopped matching,
+     *  returns the number of ascendants whose subtree match changed as a result. */
+    int updateMatchCounts(const KRecursiveFilterNodeChain &chain, bool childMatches);
+    /** Answers filterAcceptsRow() from the cache, returns @c false if that's not possible. */
+    bool cachedSubtreeMatch(int sourceRow, const QModelIndex &sourceParent, bool *accepted);
+    /** The uncached filterAcceptsRow() implementation, visiting all descendants. */
+    bool recursiveAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
+
     bool completeInsert;
     QModelIndex lastHiddenAscendantForInsert;
+
+    KRecursiveFilterNode *root; // null if the cache needs to be rebuilt
+    QRegExp cachedFilterRegExp;
+    int cachedFilterKeyColumn;
+    int cachedFilterRole;
+    // QSFPM queries all children of a parent in a row, so remember the last lookup
+    // this is only valid until the next structural change
+    QModelIndex lastParent;
+    KRecursiveFilterNodeChain lastChain;
+    // subtrees detached between rowsAboutToBeMoved and rowsMoved
+    QVector<KRecursiveFilterNode *> movingNodes;
+
+    bool backgroundFiltering;
+    bool filterPending;
+    QRegExp pendingRegExp; // being evaluated in the background, not yet set on QSFPM
+    QThreadPool *threadPool;
+    QAtomicInt generation; // shared with the worker thread
 };
 
+bool KRecursiveFilterProxyModelPrivate::acceptsEverything() const
+{
+    Q_Q(const KRecursiveFilterProxyModel);
+    // only if filterAcceptsRow/acceptRow isn't overridden, otherwise we don't know if we are filtering or not
+    return q->filterRegExp().isEmpty() && q->metaObject() == &KRecursiveFilterProxyModel::staticMetaObject;
+}
+
+bool KRecursiveFilterProxyModelPrivate::usesKeys() const
+{
+    Q_Q(const KRecursiveFilterProxyModel);
+    // a reimplemented acceptRow() can't be evaluated in the background
+    return backgroundFiltering && q->metaObject() == &KRecursiveFilterProxyModel::staticMetaObject;
+}
+
+bool KRecursiveFilterProxyModelPrivate::cacheValid() const
+{
+    Q_Q(const KRecursiveFilterProxyModel);
+    // changing the QSFPM filter properties doesn't go through invalidateFilter(), so check those here
+    return root
+           && cachedFilterKeyColumn == q->filterKeyColumn()
+           && cachedFilterRole == q->filterRole()
+           && cachedFilterRegExp == q->filterRegExp();
+}
+
+void KRecursiveFilterProxyModelPrivate::dropCache()
+{
+    delete root;
+    root = nullptr;
+    qDeleteAll(movingNodes);
+    movingNodes.clear();
+    lastParent = QModelIndex();
+    lastChain.clear();
+}
+
+void KRecursiveFilterProxyModelPrivate::rebuildCache()
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    dropCache();
+    if (!q->sourceModel())
+        return;
+
+    cachedFilterRegExp = q->filterRegExp();
+    cachedFilterKeyColumn = q->filterKeyColumn();
+    cachedFilterRole = q->filterRole();
+
+    root = new KRecursiveFilterNode;
+    const int rows = q->sourceModel()->rowCount();
+    root->children.reserve(rows);
+    for (int row = 0; row < rows; ++row) {
+        KRecursiveFilterNode *node = createNode(row, QModelIndex());
+        root->children.push_back(node);
+        if (node->subtreeMatch())
+            ++root->matchingChildren;
+    }
+}
+
+KRecursiveFilterNode *KRecursiveFilterProxyModelPrivate::createNode(int row, const QModelIndex &sourceParent)
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    KRecursiveFilterNode *node = new KRecursiveFilterNode;
+    updateSelfMatch(node, row, sourceParent);
+
+    const QModelIndex index = q->sourceModel()->index(row, 0, sourceParent);
+    const int rows = q->sourceModel()->rowCount(index);
+    node->children.reserve(rows);
+    for (int childRow = 0; childRow < rows; ++childRow) {
+        KRecursiveFilterNode *child = createNode(childRow, index);
+        node->children.push_back(child);
+        if (child->subtreeMatch())
+            ++node->matchingChildren;
+    }
+    return node;
+}
+
+void KRecursiveFilterProxyModelPrivate::updateSelfMatch(KRecursiveFilterNode *node, int row, const QModelIndex &sourceParent)
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    if (!usesKeys()) {
+        node->selfMatch = q->acceptRow(row, sourceParent);
+        return;
+    }
+
+    const int columns = q->sourceModel()->columnCount(sourceParent);
+    node->keys.resize(columns);
+    for (int column = 0; column < columns; ++column)
+        node->keys[column] = q->sourceModel()->index(row, column, sourceParent).data(cachedFilterRole).toString();
+    node->selfMatch = keysMatch(node->keys, cachedFilterRegExp, cachedFilterKeyColumn);
+    // a pending evaluation has seen the old keys, if any
+    node->snapshotIndex = -1;
+}
+
+void KRecursiveFilterProxyModelPrivate::startBackgroundFilter(const QRegExp &regExp)
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    generation.fetchAndAddOrdered(1);
+    filterPending = false;
+    if (regExp == q->filterRegExp())
+        return;
+
+    // Collecting the keys needs the source model, so this part can't be done in the background.
+    // The keys are kept up to date from then on though, so this only happens for the first filter.
+    if (!cacheValid())
+        rebuildCache();
+    if (!root) {
+        q->QSortFilterProxyModel::setFilterRegExp(regExp);
+        return;
+    }
+
+    pendingRegExp = regExp;
+    filterPending = true;
+    if (regExp.isEmpty()) {
+        // everything matches, nothing to evaluate
+        applyBackgroundFilter(loadGeneration(generation), QBitArray());
+        return;
+    }
+
+    KRecursiveFilterJob *job = new KRecursiveFilterJob(q, &generation);
+    job->generation = loadGeneration(generation);
+    job->regExp = regExp;
+    job->keyColumn = cachedFilterKeyColumn;
+    snapshotKeys(root, job->keys);
+
+    if (!threadPool) {
+        threadPool = new QThreadPool(q);
+        // a single worker is enough, anything but the latest evaluation is cancelled anyway
+        threadPool->setMaxThreadCount(1);
+    }
+    threadPool->start(job);
+}
+
+void KRecursiveFilterProxyModelPrivate::snapshotKeys(KRecursiveFilterNode *node, QVector<QVector<QString> > &keys)
+{
+    Q_FOREACH (KRecursiveFilterNode *child, node->children) {
+        child->snapshotIndex = keys.size();
+        keys.push_back(child->keys);
+        snapshotKeys(child, keys);
+    }
+}
+
+void KRecursiveFilterProxyModelPrivate::applyBackgroundFilter(int jobGeneration, const QBitArray &matches)
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    if (!filterPending || jobGeneration != loadGeneration(generation))
+        return; // superseded
+    filterPending = false;
+
+    // Nodes added or changed in the mean time are evaluated here, as they are not part of the snapshot.
+    // If the cache was dropped in the mean time, QSFPM rebuilds it synchronously when asking for matches.
+    if (cacheValid()) {
+        cachedFilterRegExp = pendingRegExp;
+        updateMatches(root, matches);
+    }
+    q->QSortFilterProxyModel::setFilterRegExp(pendingRegExp);
+}
+
+void KRecursiveFilterProxyModelPrivate::updateMatches(KRecursiveFilterNode *node, const QBitArray &matches)
+{
+    node->matchingChildren = 0;
+    Q_FOREACH (KRecursiveFilterNode *child, node->children) {
+        if (child->snapshotIndex >= 0 && child->snapshotIndex < matches.size())
+            child->selfMatch = matches.testBit(child->snapshotIndex);
+        else
+            child->selfMatch = keysMatch(child->keys, cachedFilterRegExp, cachedFilterKeyColumn);
+        child->snapshotIndex = -1;
+        updateMatches(child, matches);
+        if (child->subtreeMatch())
+            ++node->matchingChildren;
+    }
+}
+
+void KRecursiveFilterProxyModelPrivate::applyPendingFilter()
+{
+    Q_Q(KRecursiveFilterProxyModel);
+    if (!filterPending)
+        return;
+    generation.fetchAndAddOrdered(1);
+    filterPending = false;
+    q->QSortFilterProxyModel::setFilterRegExp(pendingRegExp);
+}
+
+bool KRecursiveFilterProxyModelPrivate::findChain(const QModelIndex &sourceParent, KRecursiveFilterNodeChain &chain)
+{
+    Q_ASSERT(root);
+    if (sourceParent == lastParent && !lastChain.isEmpty()) {
+        chain = lastChain;
+        return true;
+    }
+
+    QVector<int> rows;
+    for (QModelIndex index = sourceParent; index.isValid(); index = index.parent())
+        rows.push_back(index.row());
+
+    chain.clear();
+    chain.reserve(rows.size() + 1);
+    chain.push_back(root);
+    for (int i = rows.size() - 1; i >= 0; --i) {
+        const KRecursiveFilterNode *node = chain.last();
+        if (rows.at(i) >= node->children.size())
+            return false;
+        chain.push_back(node->children.at(rows.at(i)));
+    }
+
+    lastParent = sourceParent;
+    lastChain = chain;
+    return true;
+}
+
+int KRecursiveFilterProxyModelPrivate::updateMatchCounts(const KRecursiveFilterNodeChain &chain, bool childMatches)
+{
+    int changedAscendants = 0;
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        KRecursiveFilterNode *node = chain.at(i);
+        const bool matched = node->subtreeMatch();
+        node->matchingChildren += childMatches ? 1 : -1;
+        Q_ASSERT(node->matchingChildren >= 0);
+        // the root node doesn't correspond to a row, so it doesn't count
+        if (i == 0 || node->subtreeMatch() == matched)
+            break;
+        ++changedAscendants;
+    }
+    return changedAscendants;
+}
+
+bool KRecursiveFilterProxyModelPrivate::cachedSubtreeMatch(int sourceRow, const QModelIndex &sourceParent, bool *accepted)
+{
+    if (!cacheValid())
+        rebuildCache();
+    if (!root)
+        return false;
+
+    KRecursiveFilterNodeChain chain;
+    if (!findChain(sourceParent, chain) || sourceRow >= chain.last()->children.size()) {
+        // we somehow got out of sync with the source model, start over
+        rebuildCache();
+        if (!findChain(sourceParent, chain) || sourceRow >= chain.last()->children.size())
+            return false;
+    }
+
+    *accepted = chain.last()->children.at(sourceRow)->subtreeMatch();
+    return true;
+}
+
+bool KRecursiveFilterProxyModelPrivate::recursiveAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    Q_Q(const KRecursiveFilterProxyModel);
+    if (q->acceptRow(sourceRow, sourceParent)) {
+        return true;
+    }
+
+    QModelIndex source_index = q->sourceModel()->index(sourceRow, 0, sourceParent);
+    Q_ASSERT(source_index.isValid());
+    const int numChildren = q->sourceModel()->rowCount(source_index);
+    for (int row = 0, rows = numChildren; row < rows; ++row) {
+        if (recursiveAcceptsRow(row, source_index)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void KRecursiveFilterProxyModelPrivate::sourceDataChanged(const QModelIndex &source_top_left, const QModelIndex &source_bottom_right, const QVector<int> &roles)
 {
     Q_Q(KRecursiveFilterProxyModel);
     QModelIndex source_parent = source_top_left.parent();
     Q_ASSERT(source_bottom_right.parent() == source_parent); // don't know how to handle different parents in this code...
 
+    // Update the cached matches first, QSFPM is going to ask for them.
+    // -1 means we don't know how many ascendants changed their subtree match.
+    int changedAscendants = -1;
+    if (cacheValid()) {
+        KRecursiveFilterNodeChain chain;
+        if (findChain(source_parent, chain) && source_bottom_right.row() < chain.last()->children.size()) {
+            changedAscendants = 0;
+            for (int row = source_top_left.row(); row <= source_bottom_right.row(); ++row) {
+                KRecursiveFilterNode *node = chain.last()->children.at(row);
+                const bool matched = node->subtreeMatch();
+                updateSelfMatch(node, row, source_parent);
+                if (node->subtreeMatch() != matched)
+                    changedAscendants = qMax(changedAscendants, updateMatchCounts(chain, node->subtreeMatch()));
+            }
+        } else {
+            dropCache();
+        }
+    }
+
     // Tell the world.
     invokeDataChanged(source_top_left, source_bottom_right, roles);
 
-    // We can't find out if the change really matters to us or not, for a lack of a dataAboutToBeChanged signal (or a cache).
-    // TODO: add a set of roles that we care for, so we can at least ignore the rest.
-
     // If we are not actually filtering, we don't need to propagate this upwards,
     // which avoids QSFPM emitting layoutChanged unnecessarily.
-    // However, this only works if filterAcceptsRow isn't overridden, otherwise
-    // we don't know if we are filtering or not.
-    if (q->filterRegExp().isEmpty() && q->metaObject() == &KRecursiveFilterProxyModel::staticMetaObject)
+    if (acceptsEverything())
         return;
 
-    // Even if we knew the visibility was just toggled, we also can't find out what
-    // was the last filtered out ascendant (on show, like sourceRowsAboutToBeInserted does)
-    // or the last to-be-filtered-out ascendant (on hide, like sourceRowsRemoved does)
-    // So we have to refresh all parents.
+    // Refresh the ascendants whose visibility might have been toggled by this. Without the cache, we
+    // can't find out what was the last filtered out ascendant (on show, like sourceRowsAboutToBeInserted does)
+    // or the last to-be-filtered-out ascendant (on hide, like sourceRowsRemoved does), so we refresh all of them.
     QModelIndex sourceParent = source_parent;
-    while (sourceParent.isValid()) {
+    while (sourceParent.isValid() && changedAscendants != 0) {
         invokeDataChanged(sourceParent, sourceParent, roles);
         sourceParent = sourceParent.parent();
+        --changedAscendants;
     }
 }
 
@@ -210,6 +653,22 @@ void KRecursiveFilterProxyModelPrivate::sourceRowsInserted(const QModelIndex &so
 {
     Q_Q(KRecursiveFilterProxyModel);
 
+    // Add the new subtrees to the cache, before QSFPM asks for them.
+    lastParent = QModelIndex();
+    if (cacheValid()) {
+        KRecursiveFilterNodeChain chain;
+        if (findChain(source_parent, chain) && start <= chain.last()->children.size()) {
+            for (int row = start; row <= end; ++row) {
+                KRecursiveFilterNode *node = createNode(row, source_parent);
+                chain.last()->children.insert(row, node);
+                if (node->subtreeMatch())
+                    updateMatchCounts(chain, true);
+            }
+        } else {
+            dropCache();
+        }
+    }
+
     if (completeInsert) {
         // If the parent is already in the model, we can just pass on the signal.
         completeInsert = false;
@@ -243,6 +702,22 @@ void KRecursiveFilterProxyModelPrivate::sourceRowsRemoved(const QModelIndex &sou
 {
     Q_Q(KRecursiveFilterProxyModel);
 
+    lastParent = QModelIndex();
+    if (cacheValid()) {
+        KRecursiveFilterNodeChain chain;
+        if (findChain(source_parent, chain) && end < chain.last()->children.size()) {
+            for (int row = end; row >= start; --row) {
+                KRecursiveFilterNode *node = chain.last()->children.at(row);
+                chain.last()->children.remove(row);
+                if (node->subtreeMatch())
+                    updateMatchCounts(chain, false);
+                delete node;
+            }
+        } else {
+            dropCache();
+        }
+    }
+
     invokeRowsRemoved(source_parent, start, end);
 
     // Find out if removing this visible row means that some ascendant
@@ -264,6 +739,61 @@ void KRecursiveFilterProxyModelPrivate::sourceRowsRemoved(const QModelIndex &sou
     }
 }
 
+void KRecursiveFilterProxyModelPrivate::sourceRowsAboutToBeMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row)
+{
+    Q_UNUSED(destination_parent);
+    Q_UNUSED(destination_row);
+
+    // Detach the moved subtrees, they are attached again at their destination in sourceRowsMoved.
+    // This is connected after QSFPM, which doesn't ask for matches before the move is complete.
+    lastParent = QModelIndex();
+    qDeleteAll(movingNodes);
+    movingNodes.clear();
+    if (!cacheValid())
+        return;
+
+    KRecursiveFilterNodeChain chain;
+    if (!findChain(source_parent, chain) || end >= chain.last()->children.size()) {
+        dropCache();
+        return;
+    }
+    for (int row = start; row <= end; ++row) {
+        KRecursiveFilterNode *node = chain.last()->children.at(row);
+        movingNodes.push_back(node);
+        if (node->subtreeMatch())
+            updateMatchCounts(chain, false);
+    }
+    chain.last()->children.remove(start, end - start + 1);
+}
+
+void KRecursiveFilterProxyModelPrivate::sourceRowsMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row)
+{
+    // This is connected before QSFPM, so the cache is up to date again once it asks for matches.
+    lastParent = QModelIndex();
+    if (movingNodes.isEmpty())
+        return;
+    if (!cacheValid()) {
+        dropCache();
+        return;
+    }
+
+    // the remaining tree matches the source model without the moved rows now
+    KRecursiveFilterNodeChain chain;
+    int row = destination_row;
+    if (source_parent == destination_parent && destination_row > end)
+        row -= end - start + 1;
+    if (!findChain(destination_parent, chain) || row > chain.last()->children.size()) {
+        dropCache();
+        return;
+    }
+    Q_FOREACH (KRecursiveFilterNode *node, movingNodes) {
+        chain.last()->children.insert(row++, node);
+        if (node->subtreeMatch())
+            updateMatchCounts(chain, true);
+    }
+    movingNodes.clear();
+}
+
 KRecursiveFilterProxyModel::KRecursiveFilterProxyModel(QObject *parent)
     : QSortFilterProxyModel(parent), d_ptr(new KRecursiveFilterProxyModelPrivate(this))
 {
@@ -272,30 +802,84 @@ KRecursiveFilterProxyModel::KRecursiveFilterProxyModel(QObject *parent)
 
 KRecursiveFilterProxyModel::~KRecursiveFilterProxyModel()
 {
+    // the worker delivers its result to us
+    d_ptr->generation.fetchAndAddOrdered(1);
+    if (d_ptr->threadPool)
+        d_ptr->threadPool->waitForDone();
     delete d_ptr;
 }
 
+void KRecursiveFilterProxyModel::setBackgroundFilteringEnabled(bool enabled)
+{
+    Q_D(KRecursiveFilterProxyModel);
+    if (d->backgroundFiltering == enabled)
+        return;
+    d->applyPendingFilter();
+    d->backgroundFiltering = enabled;
+    d->dropCache(); // nodes with or without keys
+}
+
+bool KRecursiveFilterProxyModel::isBackgroundFilteringEnabled() const
+{
+    Q_D(const KRecursiveFilterProxyModel);
+    return d->backgroundFiltering;
+}
+
+bool KRecursiveFilterProxyModel::isFilterPending() const
+{
+    Q_D(const KRecursiveFilterProxyModel);
+    return d->filterPending;
+}
+
+void KRecursiveFilterProxyModel::setFilterRegExp(const QRegExp &regExp)
+{
+    Q_D(KRecursiveFilterProxyModel);
+    if (!d->usesKeys() || !sourceModel()) {
+        d->applyPendingFilter();
+        QSortFilterProxyModel::setFilterRegExp(regExp);
+        return;
+    }
+    d->startBackgroundFilter(regExp);
+}
+
+void KRecursiveFilterProxyModel::setFilterCaseSensitivity(Qt::CaseSensitivity caseSensitivity)
+{
+    Q_D(KRecursiveFilterProxyModel);
+    QRegExp regExp = d->filterPending ? d->pendingRegExp : filterRegExp();
+    regExp.setCaseSensitivity(caseSensitivity);
+    setFilterRegExp(regExp);
+}
+
 bool KRecursiveFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
-    // TODO: Implement some caching so that if one match is found on the first pass, we can return early results
-    // when the subtrees are checked by QSFPM.
-    if (acceptRow(sourceRow, sourceParent)) {
+    // the cache is logically const, d_ptr isn't
+    KRecursiveFilterProxyModelPrivate *d = d_ptr;
+    if (d->acceptsEverything()) {
+        // keep the filter keys around for evaluating the next filter in the background
+        if (!d->usesKeys())
+            d->dropCache();
         return true;
     }
 
-    QModelIndex source_index = sourceModel()->index(sourceRow, 0, sourceParent);
-    Q_ASSERT(source_index.isValid());
     bool accepted = false;
-
-    const int numChildren = sourceModel()->rowCount(source_index);
-    for (int row = 0, rows = numChildren; row < rows; ++row) {
-        if (filterAcceptsRow(row, source_index)) {
-            accepted = true;
-            break;
-        }
+    if (d->cachedSubtreeMatch(sourceRow, sourceParent, &accepted)) {
+        return accepted;
     }
+    return d->recursiveAcceptsRow(sourceRow, sourceParent);
+}
+
+void KRecursiveFilterProxyModel::invalidate()
+{
+    Q_D(KRecursiveFilterProxyModel);
+    d->dropCache();
+    QSortFilterProxyModel::invalidate();
+}
 
-    return accepted;
+void KRecursiveFilterProxyModel::invalidateFilter()
+{
+    Q_D(KRecursiveFilterProxyModel);
+    d->dropCache();
+    QSortFilterProxyModel::invalidateFilter();
 }
 
 QModelIndexList KRecursiveFilterProxyModel::match(const QModelIndex &start, int role, const QVariant &value, int hits, Qt::MatchFlags flags) const
@@ -347,10 +931,37 @@ void KRecursiveFilterProxyModel::setSourceModel(QAbstractItemModel *model)
 
         disconnect(sourceModel(), SIGNAL(rowsRemoved(QModelIndex,int,int)),
                 this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+
+        disconnect(sourceModel(), SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceRowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
+        disconnect(sourceModel(), SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+        disconnect(sourceModel(), nullptr, this, SLOT(dropCache()));
+    }
+
+    Q_D(KRecursiveFilterProxyModel);
+    d->dropCache();
+
+    // The cached matches need to be updated before QSFPM asks for them after a move,
+    // and discarded before QSFPM asks for them after a layout change or a reset.
+    // So those need to be connected before QSFPM connects to them.
+    if (model) {
+        connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+        connect(model, SIGNAL(layoutAboutToBeChanged()), this, SLOT(dropCache()));
+        connect(model, SIGNAL(layoutChanged()), this, SLOT(dropCache()));
+        connect(model, SIGNAL(modelAboutToBeReset()), this, SLOT(dropCache()));
+        connect(model, SIGNAL(modelReset()), this, SLOT(dropCache()));
+        connect(model, SIGNAL(columnsInserted(QModelIndex,int,int)), this, SLOT(dropCache()));
+        connect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)), this, SLOT(dropCache()));
+        connect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(dropCache()));
     }
 
     QSortFilterProxyModel::setSourceModel(model);
 
+    // a filter still being evaluated for the previous source model is applied to the new one right away
+    d->applyPendingFilter();
+
     // Disconnect in the QSortFilterProxyModel. These methods will be invoked manually
     // in invokeDataChanged, invokeRowsInserted etc.
     //
@@ -460,6 +1071,9 @@ void KRecursiveFilterProxyModel::setSourceModel(QAbstractItemModel *model)
     connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
             this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
 
+    // Connected after QSFPM, see sourceRowsAboutToBeMoved.
+    connect(model, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+            this, SLOT(sourceRowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
 }
 
 #include "moc_krecursivefilterproxymodel.cpp"
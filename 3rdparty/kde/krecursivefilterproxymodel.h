@@ -77,7 +77,16 @@ class KRecursiveFilterProxyModelPrivate;
   Custom filter implementations can be written for KRecuriveFilterProxyModel using the acceptRow virtual method.
 
   Note that using this proxy model is additional overhead compared to QSortFilterProxyModel as every index in the
-  model must be visited and queried.
+  model must be visited and queried. To keep that overhead linear, whether a row matches the filter itself and
+  how many of its children contain a match is cached for the entire source tree, and updated incrementally when
+  rows are inserted, removed, moved or changed. Custom filter implementations therefore need to call
+  invalidateFilter() when their filter criteria change.
+
+  With background filtering enabled, the cache also keeps the filter keys of all rows, and filter
+  expression changes are evaluated against a snapshot of those in a worker thread. The previous filter
+  stays in effect until the result is applied in one go. Source changes in the mean time are applied
+  on top of the result, and evaluations that became stale due to another filter change are cancelled.
+  This is not used if acceptRow() is reimplemented.
 
   @author Stephen Kelly <steveire@gmail.com>
 
@@ -101,13 +110,48 @@ public:
     /** @reimp */
     void setSourceModel(QAbstractItemModel *model);
 
+    /**
+      Evaluate changes of the filter expression in a worker thread, disabled by default.
+      Starting that thread happens in setFilterRegExp(), so that's where the caller needs to
+      take care of it being created in a specific context, if necessary.
+    */
+    void setBackgroundFilteringEnabled(bool enabled);
+    bool isBackgroundFilteringEnabled() const;
+
+    /**
+      Returns @c true while a filter expression change is being evaluated in the background.
+    */
+    bool isFilterPending() const;
+
+    using QSortFilterProxyModel::setFilterRegExp;
+    /**
+      Hides QSortFilterProxyModel::setFilterRegExp() to evaluate the new filter in the background, if enabled.
+    */
+    void setFilterRegExp(const QRegExp &regExp);
+    /**
+      Hides QSortFilterProxyModel::setFilterCaseSensitivity() to evaluate the new filter in the background,
+      if enabled.
+    */
+    void setFilterCaseSensitivity(Qt::CaseSensitivity caseSensitivity);
+
     /**
      * @reimplemented
      */
     virtual QModelIndexList match(const QModelIndex &start, int role, const QVariant &value, int hits = 1,
                                   Qt::MatchFlags flags = Qt::MatchFlags(Qt::MatchStartsWith | Qt::MatchWrap)) const;
 
+public Q_SLOTS:
+    /**
+      Hides QSortFilterProxyModel::invalidate() to also discard the cached filter matches.
+    */
+    void invalidate();
+
 protected:
+    /**
+      Hides QSortFilterProxyModel::invalidateFilter() to also discard the cached filter matches.
+    */
+    void invalidateFilter();
+
     /**
       Reimplement this method for custom filtering strategies.
     */
@@ -127,6 +171,10 @@ private:
     Q_PRIVATE_SLOT(d_func(), void sourceRowsInserted(const QModelIndex &source_parent, int start, int end))
     Q_PRIVATE_SLOT(d_func(), void sourceRowsAboutToBeRemoved(const QModelIndex &source_parent, int start, int end))
     Q_PRIVATE_SLOT(d_func(), void sourceRowsRemoved(const QModelIndex &source_parent, int start, int end))
+    Q_PRIVATE_SLOT(d_func(), void sourceRowsAboutToBeMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row))
+    Q_PRIVATE_SLOT(d_func(), void sourceRowsMoved(const QModelIndex &source_parent, int start, int end, const QModelIndex &destination_parent, int destination_row))
+    Q_PRIVATE_SLOT(d_func(), void dropCache())
+    Q_PRIVATE_SLOT(d_func(), void applyBackgroundFilter(int, const QBitArray &))
     //@endcond
 };
 
@@ -52,6 +52,7 @@ Client::Client(QObject *parent)
     connect(this, SIGNAL(disconnected()), SLOT(socketDisconnected()));
 
     m_propertySyncer->setRequestInitialSync(true);
+    setSessionRecordingFileName(QString::fromLocal8Bit(qgetenv("GAMMARAY_RecordSession")));
 
     ObjectBroker::registerModelInternal(QStringLiteral(
                                             "com.kdab.GammaRay.MessageStatisticsModel"),
@@ -200,8 +201,11 @@ void Client::messageReceived(const Message &msg)
             {
                 const quint8 version = qMin(dataVersion, Message::highestSupportedDataVersion());
                 Message msg(endpointAddress(), Protocol::ClientDataVersionNegotiated);
-                msg << version;
+                msg << version << true << true; // request streaming compression and compact model indexes
                 send(msg);
+                // the server expects this for everything we send from now on
+                Message::setNegotiatedDataVersion(version);
+                Message::setCompactModelIndexesEnabled(true);
             }
 
             m_initState |= ServerInfoReceived;
@@ -210,8 +214,11 @@ void Client::messageReceived(const Message &msg)
         case Protocol::ServerDataVersionNegotiated:
         {
             quint8 version;
-            msg >> version;
-            Message::setNegotiatedDataVersion(version);
+            bool streamCompression;
+            bool compactModelIndexes;
+            msg >> version >> streamCompression >> compactModelIndexes;
+            // the channel already applied the version and the index encoding to what the server sends after this
+            setStreamCompressionEnabled(streamCompression);
 
             m_initState |= ServerDataVersionNegotiated;
             break;
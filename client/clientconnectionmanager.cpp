@@ -35,11 +35,13 @@
 #include "selectionmodelclient.h"
 #include "propertycontrollerclient.h"
 #include "probecontrollerclient.h"
+#include "objectsearchclient.h"
 #include "paintanalyzerclient.h"
 #include "remoteviewclient.h"
 #include <toolmanagerclient.h>
 
 #include <common/objectbroker.h>
+#include <common/objectmodel.h>
 #include <common/processtracker.h>
 #include <common/streamoperators.h>
 
@@ -55,7 +57,17 @@ using namespace GammaRay;
 
 static QAbstractItemModel *modelFactory(const QString &name)
 {
-    return new RemoteModel(name, qApp);
+    auto model = new RemoteModel(name, qApp);
+    if (name == QLatin1String("com.kdab.GammaRay.ObjectTree")
+        || name == QLatin1String("com.kdab.GammaRay.ObjectList")) {
+        // only what the object views need per row, the expensive tooltips are fetched for the visible rows only
+        model->setEagerRoles(-1, QVector<int>() << Qt::DisplayRole << ObjectModel::ObjectIdRole
+                                                << ObjectModel::DecorationIdRole
+                                                << ObjectModel::CreationLocationRole
+                                                << ObjectModel::DeclarationLocationRole);
+        model->setLazyRoles(-1, QVector<int>() << Qt::ToolTipRole);
+    }
+    return model;
 }
 
 static QItemSelectionModel *selectionModelFactory(QAbstractItemModel *model)
@@ -82,6 +94,13 @@ static QObject *createToolManager(const QString &name, QObject *parent)
     return o;
 }
 
+static QObject *createObjectSearch(const QString &name, QObject *parent)
+{
+    QObject *o = new ObjectSearchClient(parent);
+    ObjectBroker::registerObject(name, o);
+    return o;
+}
+
 static QObject *createPaintAnalyzerClient(const QString &name, QObject *parent)
 {
     return new PaintAnalyzerClient(name, parent);
@@ -111,6 +130,7 @@ void ClientConnectionManager::init()
     ObjectBroker::registerClientObjectFactoryCallback<ProbeControllerInterface *>(
         createProbeController);
     ObjectBroker::registerClientObjectFactoryCallback<ToolManagerInterface *>(createToolManager);
+    ObjectBroker::registerClientObjectFactoryCallback<ObjectSearchInterface *>(createObjectSearch);
     ObjectBroker::registerClientObjectFactoryCallback<PaintAnalyzerInterface *>(
         createPaintAnalyzerClient);
     ObjectBroker::registerClientObjectFactoryCallback<RemoteViewInterface *>(createRemoteViewClient);
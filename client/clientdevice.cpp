@@ -29,6 +29,7 @@
 #include "clientdevice.h"
 #include "tcpclientdevice.h"
 #include "localclientdevice.h"
+#include "sharedmemoryclientdevice.h"
 
 #include <QDebug>
 
@@ -51,6 +52,8 @@ ClientDevice *ClientDevice::create(const QUrl &url, QObject *parent)
         device = new TcpClientDevice(parent);
     else if (url.scheme() == QLatin1String("local"))
         device = new LocalClientDevice(parent);
+    else if (url.scheme() == QLatin1String("shm"))
+        device = new SharedMemoryClientDevice(parent);
 
     if (!device) {
         qWarning() << "Unsupported transport protocol:" << url.toString();
@@ -31,6 +31,7 @@
 
 #include "client.h"
 #include "clientconnectionmanager.h"
+#include "sessionreplayserver.h"
 
 #include <common/objectbroker.h>
 #include <common/paths.h>
@@ -39,6 +40,8 @@
 #include <QApplication>
 #include <QStringList>
 
+#include <iostream>
+
 using namespace GammaRay;
 
 int main(int argc, char **argv)
@@ -61,7 +64,20 @@ int main(int argc, char **argv)
     ClientConnectionManager::init();
 
     QUrl serverUrl;
-    if (app.arguments().size() == 2) {
+    // --replay <recording> [--max-speed]: connect to a fake probe replaying a recorded session
+    SessionReplayServer replayServer;
+    const QStringList args = app.arguments();
+    const int replayIndex = args.indexOf(QStringLiteral("--replay"));
+    if (replayIndex > 0 && replayIndex + 1 < args.size()) {
+        replayServer.setSpeed(args.contains(QStringLiteral("--max-speed"))
+                              ? SessionReplayServer::MaximumSpeed : SessionReplayServer::OriginalSpeed);
+        if (!replayServer.open(args.at(replayIndex + 1)) || !replayServer.listen()) {
+            std::cerr << "Cannot replay " << qPrintable(args.at(replayIndex + 1)) << ": "
+                      << qPrintable(replayServer.errorString()) << std::endl;
+            return 1;
+        }
+        serverUrl = replayServer.serverAddress();
+    } else if (app.arguments().size() == 2) {
         serverUrl = QUrl::fromUserInput(app.arguments().at(1));
     } else {
         serverUrl.setScheme(QStringLiteral("tcp"));
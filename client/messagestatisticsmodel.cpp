@@ -54,8 +54,15 @@ static const MetaEnum::Value<Protocol::MessageType> message_type_table[] = {
     M(ModelSortRequest),
     M(ModelSyncBarrier),
     M(SelectionModelStateRequest),
+    M(ModelViewportRequest),
+    M(ModelRoleSelectionRequest),
+    M(ModelLazyDataRequest),
+    M(ModelContentHashRequest),
     M(ModelRowColumnCountReply),
     M(ModelContentReply),
+    M(ModelContentPush),
+    M(ModelLazyDataReply),
+    M(ModelContentHashReply),
     M(ModelContentChanged),
     M(ModelHeaderReply),
     M(ModelHeaderChanged),
@@ -70,6 +77,7 @@ static const MetaEnum::Value<Protocol::MessageType> message_type_table[] = {
     M(SelectionModelSelect),
     M(SelectionModelCurrent),
     M(MethodCall),
+    M(MethodDefinition),
     M(PropertySyncRequest),
     M(PropertyValuesChanged),
     M(ServerInfo),
@@ -30,6 +30,7 @@
 #include "client.h"
 
 #include <common/message.h>
+#include <common/modelindexcodec.h>
 
 #include <QApplication>
 #include <QDataStream>
@@ -42,20 +43,43 @@
 
 using namespace GammaRay;
 
+// rows requested this close to each other are asked for as one viewport
+static const int MaximumViewportGap = 4;
+
 void(*RemoteModel::s_registerClientCallback)() = nullptr;
 
 RemoteModel::Node::~Node()
 {
     qDeleteAll(children);
+    unlinkLru();
+}
+
+const QVariant *RemoteModel::Cell::value(int role) const
+{
+    for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+        if ((*it).first == role)
+            return &(*it).second;
+        if ((*it).first > role)
+            break;
+    }
+    return nullptr;
+}
+
+void RemoteModel::Cell::setValue(int role, const QVariant &value)
+{
+    auto it = data.begin();
+    for (; it != data.end() && (*it).first < role; ++it) {}
+    if (it != data.end() && (*it).first == role)
+        (*it).second = value;
+    else
+        data.insert(it, qMakePair(role, value));
 }
 
 void RemoteModel::Node::clearChildrenData()
 {
     foreach (auto child, children) {
         child->clearChildrenStructure();
-        child->data.clear();
-        child->flags.clear();
-        child->state.clear();
+        child->columns.clear();
     }
 }
 
@@ -71,22 +95,38 @@ void RemoteModel::Node::allocateColumns()
 {
     if (hasColumnData() || !parent || parent->columnCount < 0)
         return;
-    data.resize(parent->columnCount);
-    flags.resize(parent->columnCount);
-    flags.fill(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
-    state.resize(parent->columnCount);
-    state.fill(RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated);
+    columns.resize(parent->columnCount);
+}
+
+void RemoteModel::Node::touch(Node *lru, quint32 generation)
+{
+    lastAccess = generation;
+    if (lruNext == lru)
+        return; // most recently used already
+    unlinkLru();
+    lruPrevious = lru->lruPrevious;
+    lruNext = lru;
+    lruPrevious->lruNext = this;
+    lru->lruPrevious = this;
+}
+
+void RemoteModel::Node::unlinkLru()
+{
+    if (!lruNext)
+        return;
+    lruPrevious->lruNext = lruNext;
+    lruNext->lruPrevious = lruPrevious;
+    lruPrevious = nullptr;
+    lruNext = nullptr;
 }
 
 bool RemoteModel::Node::hasColumnData() const
 {
     if (!parent)
         return false;
-    Q_ASSERT(data.size() == flags.size());
-    Q_ASSERT(data.size() == state.size());
-    Q_ASSERT(data.isEmpty() || data.size() == parent->columnCount || parent->columnCount < 0);
+    Q_ASSERT(columns.isEmpty() || columns.size() == parent->columnCount || parent->columnCount < 0);
 
-    return data.size() == parent->columnCount && parent->columnCount > 0;
+    return columns.size() == parent->columnCount && parent->columnCount > 0;
 }
 
 QVariant RemoteModel::s_emptyDisplayValue;
@@ -95,6 +135,12 @@ QVariant RemoteModel::s_emptySizeHintValue;
 RemoteModel::RemoteModel(const QString &serverObject, QObject *parent)
     : QAbstractItemModel(parent)
     , m_pendingRequestsTimer(new QTimer(this))
+    , m_retiredContentTimer(new QTimer(this))
+    , m_lru(new Node)
+    , m_accessGenerationTimer(new QTimer(this))
+    , m_accessGeneration(0)
+    , m_cachedCellCount(0)
+    , m_maximumCachedCells(200000)
     , m_serverObject(serverObject)
     , m_myAddress(Protocol::InvalidObjectAddress)
     , m_currentSyncBarrier(0)
@@ -118,11 +164,28 @@ RemoteModel::RemoteModel(const QString &serverObject, QObject *parent)
     }
 
     m_root = new Node;
+    m_lru->lruPrevious = m_lru;
+    m_lru->lruNext = m_lru;
 
     m_pendingRequestsTimer->setInterval(0);
     m_pendingRequestsTimer->setSingleShot(true);
     connect(m_pendingRequestsTimer, SIGNAL(timeout()), SLOT(doRequests()));
 
+    // views ask for what they show right after a reset or layout change, so that's when it pays off
+    m_retiredContentTimer->setInterval(2000);
+    m_retiredContentTimer->setSingleShot(true);
+    connect(m_retiredContentTimer, SIGNAL(timeout()), SLOT(clearRetiredContent()));
+
+    // all content arriving in one event loop iteration shares the access generation
+    m_accessGenerationTimer->setInterval(0);
+    m_accessGenerationTimer->setSingleShot(true);
+    connect(m_accessGenerationTimer, SIGNAL(timeout()), SLOT(advanceAccessGeneration()));
+
+    bool ok;
+    const int cacheSize = qgetenv("GAMMARAY_ModelCacheSize").toInt(&ok);
+    if (ok)
+        m_maximumCachedCells = cacheSize;
+
     registerClient(serverObject);
     connectToServer();
 }
@@ -130,6 +193,7 @@ RemoteModel::RemoteModel(const QString &serverObject, QObject *parent)
 RemoteModel::~RemoteModel()
 {
     delete m_root;
+    delete m_lru;
 }
 
 bool RemoteModel::isConnected() const
@@ -199,6 +263,7 @@ QVariant RemoteModel::data(const QModelIndex &index, int role) const
 
     Node *node = nodeForIndex(index);
     Q_ASSERT(node);
+    node->touch(m_lru, m_accessGeneration);
 
     const auto state = stateForColumn(node, index.column());
     if (role == RemoteModelRole::LoadingState)
@@ -219,9 +284,16 @@ QVariant RemoteModel::data(const QModelIndex &index, int role) const
         return QVariant();
     }
 
-    // note .value returns good defaults otherwise
-    Q_ASSERT(node->data.size() > index.column());
-    return node->data.at(index.column()).value(role);
+    Q_ASSERT(node->columns.size() > index.column());
+    // views ask for the display role of what they show, fetch the lazy roles of those right away,
+    // otherwise e.g. a tooltip would only show up when hovering a second time
+    if (role == Qt::DisplayRole)
+        prefetchLazyData(node, index);
+    if (const QVariant *value = node->columns.at(index.column()).value(role))
+        return *value;
+    if (isLazyRole(index.column(), role))
+        requestLazyData(index, role);
+    return QVariant();
 }
 
 bool RemoteModel::setData(const QModelIndex &index, const QVariant &value, int role)
@@ -244,8 +316,8 @@ Qt::ItemFlags RemoteModel::flags(const QModelIndex &index) const
     Q_ASSERT(node);
     if (!node->hasColumnData())
         return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
-    Q_ASSERT(node->flags.size() > index.column());
-    return node->flags.at(index.column());
+    Q_ASSERT(node->columns.size() > index.column());
+    return node->columns.at(index.column()).flags;
 }
 
 QVariant RemoteModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -276,6 +348,29 @@ void RemoteModel::sort(int column, Qt::SortOrder order)
     sendMessage(msg);
 }
 
+void RemoteModel::setEagerRoles(int column, const QVector<int> &roles)
+{
+    if (roles.isEmpty())
+        m_eagerRoles.remove(column);
+    else
+        m_eagerRoles.insert(column, roles);
+    sendRoleSelection();
+}
+
+void RemoteModel::setLazyRoles(int column, const QVector<int> &roles)
+{
+    if (roles.isEmpty())
+        m_lazyRoles.remove(column);
+    else
+        m_lazyRoles.insert(column, roles);
+    sendRoleSelection();
+}
+
+void RemoteModel::setMaximumCachedCells(int cells)
+{
+    m_maximumCachedCells = cells;
+}
+
 void RemoteModel::newMessage(const GammaRay::Message &msg)
 {
     if (!checkSyncBarrier(msg))
@@ -288,10 +383,10 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
         msg >> size;
         Q_ASSERT(size > 0);
 
+        ModelIndexReader reader(msg);
         for (quint32 i = 0; i < size; ++i) {
             // We now need to read the complete entries because of the break -> continue change
-            Protocol::ModelIndex index;
-            msg >> index;
+            const Protocol::ModelIndex index = reader.read();
             qint32 rowCount, columnCount;
             msg >> rowCount >> columnCount;
 
@@ -349,59 +444,45 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
     }
 
     case Protocol::ModelContentReply:
+        readContent(msg, false);
+        break;
+
+    case Protocol::ModelContentPush:
+        readContent(msg, true);
+        break;
+
+    case Protocol::ModelContentHashReply:
+        readContentHashes(msg);
+        break;
+
+    case Protocol::ModelLazyDataReply:
     {
+        qint32 role;
         quint32 size;
-        msg >> size;
+        msg >> role >> size;
         Q_ASSERT(size > 0);
 
-        QHash<QModelIndex, QVector<QModelIndex> > dataChangedIndexes;
+        ModelIndexReader reader(msg);
         for (quint32 i = 0; i < size; ++i) {
-            Protocol::ModelIndex index;
-            msg >> index;
+            const Protocol::ModelIndex index = reader.read();
+            QVariant value;
+            msg >> value;
+
             Node *node = nodeForIndex(index);
             const auto column = index.last().column;
-            const auto state = node ? stateForColumn(node, column) : RemoteModelNodeState::NoState;
-            typedef QHash<int, QVariant> ItemData;
-            ItemData itemData;
-            qint32 flags;
-            msg >> itemData >> flags;
-            if ((state & RemoteModelNodeState::Loading) == 0)
-                continue; // we didn't ask for this, probably outdated response for a moved cell
-
-            if (node) {
-                node->allocateColumns();
-                Q_ASSERT(node->data.size() > column);
-                node->data[column] = itemData;
-                node->flags[column] = static_cast<Qt::ItemFlags>(flags);
-                node->state[column] = state & ~(RemoteModelNodeState::Loading | RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated);
+            if (!node || !node->hasColumnData() || node->columns.size() <= column)
+                continue;
+            auto &cell = node->columns[column];
+            if (!cell.value(role))
+                continue; // content got refreshed meanwhile, we'll ask again when needed
+            cell.setValue(role, value);
 
-#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
-                if ((flags & Qt::ItemNeverHasChildren) && column == 0) {
-                    node->rowCount = 0;
-                    node->columnCount = node->data.size();
-                }
+            const auto qmi = modelIndexForNode(node, column);
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+            emit dataChanged(qmi, qmi);
+#else
+            emit dataChanged(qmi, qmi, QVector<int>() << role);
 #endif
-
-                // group by parent, and emit dataChange for the bounding rect per hierarchy level
-                // as an approximiation of perfect range batching
-                const QModelIndex qmi = modelIndexForNode(node, column);
-                dataChangedIndexes[qmi.parent()].push_back(qmi);
-            }
-        }
-
-        for (auto it = dataChangedIndexes.constBegin(); it != dataChangedIndexes.constEnd(); ++it) {
-            const auto &indexes = it.value();
-            Q_ASSERT(!indexes.isEmpty());
-            int r1 = std::numeric_limits<int>::max(), r2 = 0, c1 = std::numeric_limits<int>::max(),
-                c2 = 0;
-            foreach (const auto &index, indexes) {
-                r1 = std::min(r1, index.row());
-                r2 = std::max(r2, index.row());
-                c1 = std::min(c1, index.column());
-                c2 = std::max(c2, index.column());
-            }
-            const auto qmi = indexes.at(0);
-            emit dataChanged(qmi.sibling(r1, c1), qmi.sibling(r2, c2));
         }
         break;
     }
@@ -445,8 +526,8 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
             for (int col = beginIndex.last().column; col <= endIndex.last().column; ++col) {
                 const auto state = stateForColumn(currentRow, col);
                 if ((state & RemoteModelNodeState::Outdated) == 0) {
-                    Q_ASSERT(currentRow->state.size() > col);
-                    currentRow->state[col] = state | RemoteModelNodeState::Outdated;
+                    Q_ASSERT(currentRow->columns.size() > col);
+                    currentRow->columns[col].state = state | RemoteModelNodeState::Outdated;
                 }
             }
         }
@@ -587,29 +668,22 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
         QVector<Protocol::ModelIndex> parents;
         quint32 hint;
         msg >> parents >> hint;
-
-        if (parents.isEmpty()) { // everything changed (or Qt4)
-            emit layoutAboutToBeChanged();
-            foreach (const auto &persistentIndex, persistentIndexList())
-                changePersistentIndex(persistentIndex, QModelIndex());
-            if (hint == 0)
-                m_root->clearChildrenStructure();
-            else
-                m_root->clearChildrenData();
-            emit layoutChanged();
-            break;
-        }
+        const auto permutations = readRowPermutations(msg);
 
         QVector<Node *> parentNodes;
-        parentNodes.reserve(parents.size());
-        foreach (const auto &p, parents) {
-            auto node = nodeForIndex(p);
-            if (!node)
-                continue;
-            parentNodes.push_back(node);
+        if (parents.isEmpty()) { // everything changed (or Qt4)
+            parentNodes.push_back(m_root);
+        } else {
+            parentNodes.reserve(parents.size());
+            foreach (const auto &p, parents) {
+                auto node = nodeForIndex(p);
+                if (!node)
+                    continue;
+                parentNodes.push_back(node);
+            }
+            if (parentNodes.isEmpty())
+                break; // no currently loaded node changed, nothing to do
         }
-        if (parentNodes.isEmpty())
-            break; // no currently loaded node changed, nothing to do
 
         emit layoutAboutToBeChanged(); // TODO Qt5 support with exact sub-trees
         foreach (const auto &persistentIndex, persistentIndexList()) {
@@ -618,11 +692,25 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
             foreach (auto node, parentNodes) {
                 if (!isAncestor(node, persistentNode))
                     continue;
-                changePersistentIndex(persistentIndex, QModelIndex());
+                // only the reordered rows themselves survive, their children are dropped below
+                const auto it = permutations.constFind(node);
+                if (it != permutations.constEnd() && persistentNode->parent == node
+                    && it.value().at(persistentIndex.row()) >= 0)
+                    changePersistentIndex(persistentIndex,
+                                          createIndex(it.value().at(persistentIndex.row()), persistentIndex.column(), persistentNode));
+                else
+                    changePersistentIndex(persistentIndex, QModelIndex());
                 break;
             }
         }
         foreach (auto node, parentNodes) {
+            const auto it = permutations.constFind(node);
+            if (it != permutations.constEnd()) {
+                permuteChildren(node, it.value(), hint);
+                continue;
+            }
+            retireContent(node);
+            uncacheChildren(node);
             if (hint == 0)
                 node->clearChildrenStructure();
             else
@@ -633,11 +721,89 @@ void RemoteModel::newMessage(const GammaRay::Message &msg)
     }
 
     case Protocol::ModelReset:
+        retireContent(m_root);
         clear();
         break;
     }
 }
 
+QHash<RemoteModel::Node *, QVector<int> > RemoteModel::readRowPermutations(const Message &msg) const
+{
+    QHash<Node *, QVector<int> > permutations;
+    ModelIndexReader reader(msg);
+    quint32 size;
+    msg >> size;
+    for (quint32 i = 0; i < size; ++i) {
+        Protocol::ModelIndex parent;
+        qint32 rowCount;
+        msg >> parent >> rowCount;
+        const QVector<qint32> runs = reader.readRowRuns();
+
+        Node *node = nodeForIndex(parent);
+        if (!node || node->rowCount != rowCount || node->children.size() != rowCount)
+            continue; // we don't know the rows, or not in the state the server refers to
+
+        // the server only tracks the rows it pushed to us, the others are unknown (-1)
+        QVector<int> newRows(rowCount, -1);
+        for (int run = 0; run < runs.size(); run += 3) {
+            const int length = runs.at(run + 2);
+            if (runs.at(run) < 0 || runs.at(run + 1) < 0
+                || runs.at(run) + length > rowCount || runs.at(run + 1) + length > rowCount)
+                continue;
+            for (int j = 0; j < length; ++j)
+                newRows[runs.at(run) + j] = runs.at(run + 1) + j;
+        }
+        permutations.insert(node, newRows);
+    }
+    return permutations;
+}
+
+void RemoteModel::permuteChildren(Node *node, const QVector<int> &newRows, quint32 hint)
+{
+    Q_ASSERT(node->children.size() == newRows.size());
+    QVector<Node *> children(node->children.size());
+    QVector<Node *> unknownRows;
+    for (int row = 0; row < newRows.size(); ++row) {
+        if (newRows.at(row) < 0) {
+            unknownRows.push_back(node->children.at(row));
+            continue;
+        }
+        Q_ASSERT(!children.at(newRows.at(row)));
+        children[newRows.at(row)] = node->children.at(row);
+    }
+    // rows we don't know the new position of fill the gaps, without their content
+    auto unknownIt = unknownRows.constBegin();
+    for (auto it = children.begin(); it != children.end(); ++it) {
+        if (*it)
+            continue;
+        Q_ASSERT(unknownIt != unknownRows.constEnd());
+        *it = *unknownIt++;
+        retireCells(*it);
+        m_cachedCellCount -= cachedCells(*it);
+        (*it)->columns.clear();
+    }
+    node->children = children;
+    m_retiredContentTimer->start();
+
+    foreach (auto child, node->children) {
+        retireContent(child);
+        uncacheChildren(child);
+        if (hint == 0)
+            child->clearChildrenStructure();
+        else
+            child->clearChildrenData();
+        // replies to pending lazy data requests would refer to the old rows
+        for (auto columnIt = child->columns.begin(); !m_lazyRoles.isEmpty() && columnIt != child->columns.end(); ++columnIt) {
+            auto &data = (*columnIt).data;
+            data.erase(std::remove_if(data.begin(), data.end(), [](const RoleData &roleData) {
+                return !roleData.second.isValid();
+            }), data.end());
+        }
+    }
+    // same for pending content requests
+    resetLoadingState(node, 0);
+}
+
 void RemoteModel::serverRegistered(const QString &objectName, Protocol::ObjectAddress objectAddress)
 {
     if (m_serverObject == objectName) {
@@ -653,6 +819,7 @@ void RemoteModel::serverUnregistered(const QString &objectName,
     if (m_myAddress == objectAddress) {
         m_myAddress = Protocol::InvalidObjectAddress;
         clear();
+        clearRetiredContent();
     }
 }
 
@@ -696,13 +863,139 @@ bool RemoteModel::isAncestor(RemoteModel::Node *ancestor, RemoteModel::Node *chi
     return isAncestor(ancestor, child->parent);
 }
 
+// reads the QMap<int, QVariant> sent by the server directly into our compact representation
+static QVector<QPair<int, QVariant> > readRoleData(const Message &msg)
+{
+    quint32 size;
+    msg >> size;
+    QVector<QPair<int, QVariant> > data(size);
+    for (auto it = data.begin(); it != data.end(); ++it)
+        msg >> (*it).first >> (*it).second;
+    // maps are streamed in descending key order, don't rely on that though
+    std::sort(data.begin(), data.end(), [](const QPair<int, QVariant> &lhs, const QPair<int, QVariant> &rhs) {
+        return lhs.first < rhs.first;
+    });
+    return data;
+}
+
+void RemoteModel::readContent(const Message &msg, bool pushed)
+{
+    quint32 size;
+    msg >> size;
+    Q_ASSERT(size > 0);
+
+    QHash<QModelIndex, QVector<QModelIndex> > dataChangedIndexes;
+    ModelIndexReader reader(msg);
+    for (quint32 i = 0; i < size; ++i) {
+        const Protocol::ModelIndex index = reader.read();
+        Node *node = nodeForIndex(index);
+        const auto column = index.last().column;
+        const auto state = node ? stateForColumn(node, column) : RemoteModelNodeState::NoState;
+        // the server computes the same hash over the content it would send when asked for it
+        const int contentBegin = msg.readPosition();
+        const auto itemData = readRoleData(msg);
+        qint32 flags;
+        msg >> flags;
+        const quint64 hash = msg.payloadHash(contentBegin, msg.readPosition());
+        // pushed content refers to the structure as we know it at this point, so it always applies
+        if ((state & RemoteModelNodeState::Loading) == 0 && !pushed)
+            continue; // we didn't ask for this, probably outdated response for a moved cell
+
+        if (node) {
+            node->allocateColumns();
+            if (pushed && node->columns.size() <= column)
+                continue; // columns not known yet
+            storeContent(node, column, itemData, flags, hash, dataChangedIndexes);
+        }
+    }
+
+    emitDataChanged(dataChangedIndexes);
+    evictContent();
+}
+
+void RemoteModel::readContentHashes(const Message &msg)
+{
+    quint32 size;
+    msg >> size;
+    Q_ASSERT(size > 0);
+
+    QHash<QModelIndex, QVector<QModelIndex> > dataChangedIndexes;
+    ModelIndexReader reader(msg);
+    for (quint32 i = 0; i < size; ++i) {
+        const Protocol::ModelIndex index = reader.read();
+        quint64 hash;
+        msg >> hash;
+
+        Node *node = nodeForIndex(index);
+        const auto column = index.last().column;
+        if (!node || (stateForColumn(node, column) & RemoteModelNodeState::Loading) == 0)
+            continue; // outdated response, as in readContent
+
+        const auto it = m_retiredContent.constFind(hash);
+        if (it != m_retiredContent.constEnd()) {
+            storeContent(node, column, it.value().data, qint32(it.value().flags), hash, dataChangedIndexes);
+        } else {
+            // the cell is still marked as loading, so this bypasses requestDataAndFlags
+            m_pendingRequests[ViewportDataAndFlags].push_back(index);
+            m_pendingRequestsTimer->start();
+        }
+    }
+
+    emitDataChanged(dataChangedIndexes);
+    evictContent();
+}
+
+void RemoteModel::storeContent(Node *node, int column, const QVector<RoleData> &data, qint32 flags,
+                               quint64 hash, QHash<QModelIndex, QVector<QModelIndex> > &changedIndexes)
+{
+    Q_ASSERT(node->columns.size() > column);
+    auto &cell = node->columns[column];
+    if (cell.state & RemoteModelNodeState::Empty)
+        ++m_cachedCellCount;
+    cell.data = data;
+    cell.flags = static_cast<Qt::ItemFlags>(flags);
+    cell.state = cell.state & ~(RemoteModelNodeState::Loading | RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated);
+    cell.hash = hash;
+    node->touch(m_lru, m_accessGeneration);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    if ((flags & Qt::ItemNeverHasChildren) && column == 0) {
+        node->rowCount = 0;
+        node->columnCount = node->columns.size();
+    }
+#endif
+
+    // group by parent, and emit dataChange for the bounding rect per hierarchy level
+    // as an approximiation of perfect range batching
+    const QModelIndex qmi = modelIndexForNode(node, column);
+    changedIndexes[qmi.parent()].push_back(qmi);
+}
+
+void RemoteModel::emitDataChanged(const QHash<QModelIndex, QVector<QModelIndex> > &changedIndexes)
+{
+    for (auto it = changedIndexes.constBegin(); it != changedIndexes.constEnd(); ++it) {
+        const auto &indexes = it.value();
+        Q_ASSERT(!indexes.isEmpty());
+        int r1 = std::numeric_limits<int>::max(), r2 = 0, c1 = std::numeric_limits<int>::max(),
+            c2 = 0;
+        foreach (const auto &index, indexes) {
+            r1 = std::min(r1, index.row());
+            r2 = std::max(r2, index.row());
+            c1 = std::min(c1, index.column());
+            c2 = std::max(c2, index.column());
+        }
+        const auto qmi = indexes.at(0);
+        emit dataChanged(qmi.sibling(r1, c1), qmi.sibling(r2, c2));
+    }
+}
+
 RemoteModelNodeState::NodeStates RemoteModel::stateForColumn(RemoteModel::Node *node, int columnIndex) const
 {
     Q_ASSERT(node);
     if (!node->hasColumnData())
         return RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated;
-    Q_ASSERT(node->state.size() > columnIndex);
-    return node->state.at(columnIndex);
+    Q_ASSERT(node->columns.size() > columnIndex);
+    return node->columns.at(columnIndex).state;
 }
 
 void RemoteModel::requestRowColumnCount(const QModelIndex &index) const
@@ -734,10 +1027,13 @@ void RemoteModel::requestDataAndFlags(const QModelIndex &index) const
     Q_ASSERT((state & RemoteModelNodeState::Loading) == 0);
 
     node->allocateColumns();
-    Q_ASSERT(node->state.size() > index.column());
-    node->state[index.column()] = state | RemoteModelNodeState::Loading; // mark pending request
+    Q_ASSERT(node->columns.size() > index.column());
+    node->columns[index.column()].state = state | RemoteModelNodeState::Loading; // mark pending request
 
-    auto &indexes = m_pendingRequests[DataAndFlags];
+    RequestType type = DataAndFlags;
+    if (state & RemoteModelNodeState::Empty)
+        type = m_retiredContent.isEmpty() ? ViewportDataAndFlags : ValidateDataAndFlags;
+    auto &indexes = m_pendingRequests[type];
     indexes.push_back(Protocol::fromQModelIndex(index));
     if (indexes.size() > 100) {
         m_pendingRequestsTimer->stop();
@@ -760,25 +1056,202 @@ void RemoteModel::doRequests() const
         switch (it.key()) {
         case RowColumnCount: {
             Message msg(m_myAddress, Protocol::ModelRowColumnCountRequest);
-            msg << quint32(indexes.size());
-            foreach (const auto &index, indexes)
-                msg << index;
+            ModelIndexWriter(msg).writeList(indexes);
             sendMessage(msg);
             break;
         }
 
         case DataAndFlags: {
             Message msg(m_myAddress, Protocol::ModelContentRequest);
-            msg << quint32(indexes.size());
-            foreach (const auto &index, indexes)
-                msg << index;
+            ModelIndexWriter(msg).writeList(indexes);
             sendMessage(msg);
             break;
         }
+
+        case ValidateDataAndFlags: {
+            Message msg(m_myAddress, Protocol::ModelContentHashRequest);
+            ModelIndexWriter(msg).writeList(indexes);
+            sendMessage(msg);
+            break;
+        }
+
+        case ViewportDataAndFlags: {
+            // views only ask for what they show, so the rows of the cells we have nothing for
+            // are the visible part of the viewport, the server pushes them and the rows around them
+            QHash<Protocol::ModelIndex, QVector<qint32> > rowsPerParent;
+            foreach (const auto &index, indexes) {
+                auto parent = index;
+                parent.resize(parent.size() - 1);
+                rowsPerParent[parent].push_back(index.last().row);
+            }
+            // scattered rows (several views, the current index, refetches after eviction) are asked
+            // for one run at a time, the server would push everything in between otherwise
+            for (auto parentIt = rowsPerParent.begin(); parentIt != rowsPerParent.end(); ++parentIt) {
+                auto &rows = parentIt.value();
+                std::sort(rows.begin(), rows.end());
+                for (int first = 0; first < rows.size();) {
+                    int last = first;
+                    while (last + 1 < rows.size() && rows.at(last + 1) - rows.at(last) <= MaximumViewportGap)
+                        ++last;
+                    Message msg(m_myAddress, Protocol::ModelViewportRequest);
+                    msg << parentIt.key() << rows.at(first) << rows.at(last);
+                    sendMessage(msg);
+                    first = last + 1;
+                }
+            }
+            break;
+        }
         }
 
         it.remove();
     }
+
+    for (auto lazyIt = m_pendingLazyRequests.constBegin(); lazyIt != m_pendingLazyRequests.constEnd(); ++lazyIt) {
+        Message msg(m_myAddress, Protocol::ModelLazyDataRequest);
+        msg << qint32(lazyIt.key());
+        ModelIndexWriter(msg).writeList(lazyIt.value());
+        sendMessage(msg);
+    }
+    m_pendingLazyRequests.clear();
+}
+
+void RemoteModel::requestLazyData(const QModelIndex &index, int role) const
+{
+    Node *node = nodeForIndex(index);
+    Q_ASSERT(node && node->columns.size() > index.column());
+    node->columns[index.column()].setValue(role, QVariant()); // mark pending request
+
+    auto &indexes = m_pendingLazyRequests[role];
+    indexes.push_back(Protocol::fromQModelIndex(index));
+    if (indexes.size() > 100) {
+        m_pendingRequestsTimer->stop();
+        doRequests();
+    } else {
+        m_pendingRequestsTimer->start();
+    }
+}
+
+void RemoteModel::prefetchLazyData(Node *node, const QModelIndex &index) const
+{
+    if (m_lazyRoles.isEmpty())
+        return;
+    auto it = m_lazyRoles.constFind(index.column());
+    if (it == m_lazyRoles.constEnd())
+        it = m_lazyRoles.constFind(-1);
+    if (it == m_lazyRoles.constEnd())
+        return;
+    foreach (int role, it.value()) {
+        if (!node->columns.at(index.column()).value(role))
+            requestLazyData(index, role);
+    }
+}
+
+bool RemoteModel::isLazyRole(int column, int role) const
+{
+    auto it = m_lazyRoles.constFind(column);
+    if (it == m_lazyRoles.constEnd())
+        it = m_lazyRoles.constFind(-1);
+    return it != m_lazyRoles.constEnd() && it.value().contains(role);
+}
+
+void RemoteModel::retireContent(Node *node)
+{
+    foreach (auto child, node->children) {
+        retireCells(child);
+        retireContent(child);
+    }
+    m_retiredContentTimer->start();
+}
+
+void RemoteModel::retireCells(Node *node)
+{
+    for (int column = 0; column < node->columns.size(); ++column) {
+        Cell content = node->columns.at(column);
+        if (content.state & (RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated))
+            continue;
+        // lazily fetched roles are not covered by the hash
+        if (!m_lazyRoles.isEmpty()) {
+            content.data.erase(std::remove_if(content.data.begin(), content.data.end(), [this, column](const RoleData &roleData) {
+                return isLazyRole(column, roleData.first);
+            }), content.data.end());
+        }
+        m_retiredContent.insert(content.hash, content);
+    }
+}
+
+void RemoteModel::evictContent()
+{
+    // rows used since the last content arrived are likely visible, those are never dropped
+    if (!m_accessGenerationTimer->isActive())
+        m_accessGenerationTimer->start();
+    if (m_maximumCachedCells <= 0 || m_cachedCellCount <= m_maximumCachedCells)
+        return;
+
+    // leave some room, so we don't need to do this again for the next bit of content
+    const int targetCellCount = m_maximumCachedCells * 3 / 4;
+    for (Node *node = m_lru->lruNext; node != m_lru && m_cachedCellCount > targetCellCount;) {
+        Node *next = node->lruNext;
+        if (!node->hasColumnData()) { // content dropped by other means meanwhile
+            m_cachedCellCount -= cachedCells(node);
+            node->columns.clear();
+            node->unlinkLru();
+            node = next;
+            continue;
+        }
+        if (node->lastAccess == m_accessGeneration)
+            break;
+        const bool loading = std::any_of(node->columns.constBegin(), node->columns.constEnd(), [](const Cell &cell) {
+            return cell.state & RemoteModelNodeState::Loading;
+        });
+        if (!loading) {
+            m_cachedCellCount -= cachedCells(node);
+            node->columns.clear();
+            node->unlinkLru();
+        }
+        node = next;
+    }
+}
+
+int RemoteModel::cachedCells(const Node *node)
+{
+    int count = 0;
+    foreach (const auto &cell, node->columns) {
+        if ((cell.state & RemoteModelNodeState::Empty) == 0)
+            ++count;
+    }
+    return count;
+}
+
+void RemoteModel::uncacheSubtree(const Node *node)
+{
+    m_cachedCellCount -= cachedCells(node);
+    uncacheChildren(node);
+}
+
+void RemoteModel::uncacheChildren(const Node *node)
+{
+    foreach (auto child, node->children)
+        uncacheSubtree(child);
+}
+
+void RemoteModel::advanceAccessGeneration()
+{
+    ++m_accessGeneration;
+}
+
+void RemoteModel::clearRetiredContent()
+{
+    m_retiredContentTimer->stop();
+    m_retiredContent.clear();
+}
+
+void RemoteModel::sendRoleSelection() const
+{
+    if (!isConnected())
+        return;
+    Message msg(m_myAddress, Protocol::ModelRoleSelectionRequest);
+    msg << m_eagerRoles << m_lazyRoles;
+    sendMessage(msg);
 }
 
 void RemoteModel::requestHeaderData(Qt::Orientation orientation, int section) const
@@ -806,6 +1279,7 @@ void RemoteModel::clear()
 
     delete m_root;
     m_root = new Node;
+    m_cachedCellCount = 0;
     m_horizontalHeaders.clear();
     m_verticalHeaders.clear();
     endResetModel();
@@ -819,6 +1293,8 @@ void RemoteModel::connectToServer()
     beginResetModel();
     Client::instance()->registerObject(m_serverObject, this);
     Client::instance()->registerMessageHandler(m_myAddress, this, "newMessage");
+    if (!m_eagerRoles.isEmpty() || !m_lazyRoles.isEmpty())
+        sendRoleSelection();
     endResetModel();
 }
 
@@ -840,9 +1316,9 @@ void RemoteModel::resetLoadingState(RemoteModel::Node *node, int startRow) const
     Q_ASSERT(node->children.size() == node->rowCount);
     for (int row = startRow; row < node->rowCount; ++row) {
         Node *child = node->children.at(row);
-        for (auto it = child->state.begin(); it != child->state.end(); ++it) {
-            if ((*it) & RemoteModelNodeState::Loading)
-                (*it) = (*it) & ~RemoteModelNodeState::Loading;
+        for (auto it = child->columns.begin(); it != child->columns.end(); ++it) {
+            if ((*it).state & RemoteModelNodeState::Loading)
+                (*it).state = (*it).state & ~RemoteModelNodeState::Loading;
         }
         resetLoadingState(child, 0);
     }
@@ -889,8 +1365,10 @@ void RemoteModel::doRemoveRows(RemoteModel::Node *parentNode, int first, int las
         m_verticalHeaders.remove(first, last - first + 1);
 
     // delete nodes
-    for (int i = first; i <= last; ++i)
+    for (int i = first; i <= last; ++i) {
+        uncacheSubtree(parentNode->children.at(i));
         delete parentNode->children.at(i);
+    }
     parentNode->children.remove(first, last - first + 1);
 
     // adjust row count
@@ -961,9 +1439,7 @@ void RemoteModel::doInsertColumns(RemoteModel::Node *parentNode, int first, int
             continue;
 
         // allocate new columns
-        node->data.insert(first, newColCount, QHash<int, QVariant>());
-        node->flags.insert(first, newColCount, Qt::ItemIsSelectable | Qt::ItemIsEnabled);
-        node->state.insert(first, newColCount, RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated);
+        node->columns.insert(first, newColCount, Cell());
     }
 
     // adjust column count
@@ -986,9 +1462,11 @@ void RemoteModel::doRemoveColumns(RemoteModel::Node *parentNode, int first, int
     foreach (auto node, parentNode->children) {
         if (!node->hasColumnData())
             continue;
-        node->data.remove(first, delColCount);
-        node->flags.remove(first, delColCount);
-        node->state.remove(first, delColCount);
+        for (int column = first; column <= last; ++column) {
+            if ((node->columns.at(column).state & RemoteModelNodeState::Empty) == 0)
+                --m_cachedCellCount;
+        }
+        node->columns.remove(first, delColCount);
     }
 
     // adjust column count
@@ -75,6 +75,21 @@ public:
                         int role = Qt::DisplayRole) const override;
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
 
+    /** Only transfer @p roles of the cells in @p column along with their content, rather than
+     *  all roles the source model provides. Use -1 as @p column for all columns without own setting.
+     */
+    void setEagerRoles(int column, const QVector<int> &roles);
+    /** Transfer @p roles of the cells in @p column only once they are accessed.
+     *  Use -1 as @p column for all columns without own setting.
+     */
+    void setLazyRoles(int column, const QVector<int> &roles);
+
+    /** Keep the content of at most @p cells cells, dropping the least recently used rows
+     *  beyond that. 0 means no limit. The default is 200000, this can also be changed with the
+     *  GAMMARAY_ModelCacheSize environment variable.
+     */
+    void setMaximumCachedCells(int cells);
+
 public slots:
     void newMessage(const GammaRay::Message &msg);
     void serverRegistered(const QString &objectName, Protocol::ObjectAddress objectAddress);
@@ -87,11 +102,33 @@ signals:
     void proxyFilterRegExpChanged();
 
 private:
+    typedef QPair<int, QVariant> RoleData;
+
+    struct Cell { // represents one column of a row
+        Cell()
+            : flags(Qt::ItemIsSelectable | Qt::ItemIsEnabled)
+            , state(RemoteModelNodeState::Empty | RemoteModelNodeState::Outdated)
+            , hash(0) {}
+
+        // returns the value for @p role, or nullptr if we don't have one
+        const QVariant *value(int role) const;
+        // insert or replace the value for @p role
+        void setValue(int role, const QVariant &value);
+
+        QVector<RoleData> data; // sorted by role, much smaller than a hash for the few roles per cell
+        Qt::ItemFlags flags;
+        RemoteModelNodeState::NodeStates state; // cache outdated, waiting for data, etc
+        quint64 hash; // hash of the serialized content, as computed by the server on request
+    };
+
     struct Node { // represents one row
         Node()
             : parent(nullptr)
             , rowCount(-1)
-            , columnCount(-1) {}
+            , columnCount(-1)
+            , lastAccess(0)
+            , lruPrevious(nullptr)
+            , lruNext(nullptr) {}
         ~Node();
         Q_DISABLE_COPY(Node)
         // delete all cached children data, but assume row/column count on this level is still accurate
@@ -103,14 +140,19 @@ private:
         void allocateColumns();
         // returns whether columns are allocated
         bool hasColumnData() const;
+        // mark as used in @p generation, moving it to the end of the least recently used list @p lru
+        void touch(Node *lru, quint32 generation);
+        // remove from the least recently used list, if in there
+        void unlinkLru();
 
         Node *parent;
         QVector<Node *> children;
         qint32 rowCount;
         qint32 columnCount;
-        QVector<QHash<int, QVariant> > data; // column -> role -> data
-        QVector<Qt::ItemFlags> flags;      // column -> flags
-        QVector<RemoteModelNodeState::NodeStates> state;         // column -> state (cache outdated, waiting for data, etc)
+        QVector<Cell> columns;
+        quint32 lastAccess; // access generation, for evicting the least recently used rows
+        Node *lruPrevious; // neighbors in the least recently used list, null if not in there
+        Node *lruNext;
     };
 
     void clear();
@@ -129,7 +171,37 @@ private:
 
     void requestRowColumnCount(const QModelIndex &index) const;
     void requestDataAndFlags(const QModelIndex &index) const;
+    /// Read a content reply or push, only accepting content we asked for unless @p pushed.
+    void readContent(const Message &msg, bool pushed);
+    /// Read a content hash reply, filling in cells from m_retiredContent and asking for the rest.
+    void readContentHashes(const Message &msg);
+    /// Set the content of @p column of @p node, and remember it for emitting dataChanged in @p changedIndexes.
+    void storeContent(Node *node, int column, const QVector<RoleData> &data, qint32 flags, quint64 hash,
+                      QHash<QModelIndex, QVector<QModelIndex> > &changedIndexes);
+    /// Emit dataChanged for @p changedIndexes, grouped by parent.
+    void emitDataChanged(const QHash<QModelIndex, QVector<QModelIndex> > &changedIndexes);
+    /// Keep the loaded content below @p node, before it gets dropped due to a reset or layout change.
+    void retireContent(Node *node);
+    /// Keep the loaded content of @p node itself, before it gets dropped. Callers start m_retiredContentTimer.
+    void retireCells(Node *node);
+    /// Read the row permutations of a layout change, as new row for each old row per parent node.
+    QHash<Node *, QVector<int> > readRowPermutations(const Message &msg) const;
+    /// Move the children of @p node to their new rows, dropping what's below them.
+    void permuteChildren(Node *node, const QVector<int> &newRows, quint32 hint);
+    /// Drop the content of the least recently used rows if we exceed m_maximumCachedCells.
+    void evictContent();
+    /// Number of cells of @p node with content.
+    static int cachedCells(const Node *node);
+    /// Stop accounting for the content of @p node and everything below it, before it gets dropped.
+    void uncacheSubtree(const Node *node);
+    /// Same for everything below @p node.
+    void uncacheChildren(const Node *node);
     void requestHeaderData(Qt::Orientation orientation, int section) const;
+    void requestLazyData(const QModelIndex &index, int role) const;
+    /// Request the lazily fetched roles of the cell at @p index we didn't ask for yet.
+    void prefetchLazyData(Node *node, const QModelIndex &index) const;
+    bool isLazyRole(int column, int role) const;
+    void sendRoleSelection() const;
     /// Reset the loading state for all rows at @p startRow or later.
     /// This is needed when rows have been added or removed before @p startRow, since
     /// pending replies might have a wrong index.
@@ -160,6 +232,8 @@ private:
 
 private slots:
     void doRequests() const;
+    void clearRetiredContent();
+    void advanceAccessGeneration();
 
 private:
     Node *m_root;
@@ -169,15 +243,34 @@ private:
 
     enum RequestType {
         RowColumnCount,
-        DataAndFlags
+        DataAndFlags,
+        // cells we have no data for at all, these are requested as the viewport the server pushes
+        ViewportDataAndFlags,
+        // same, but shortly after a reset or layout change, these are first looked up by content hash
+        ValidateDataAndFlags
     };
 
     mutable QMap<RequestType, QVector<Protocol::ModelIndex>> m_pendingRequests;
+    mutable QHash<int, QVector<Protocol::ModelIndex> > m_pendingLazyRequests; // role -> indexes
     QTimer *m_pendingRequestsTimer;
 
+    QHash<quint64, Cell> m_retiredContent; // content hash -> content
+    QTimer *m_retiredContentTimer;
+
+    // sentinel of the circular list of rows used, least recently used first
+    Node *m_lru;
+    QTimer *m_accessGenerationTimer;
+    quint32 m_accessGeneration;
+    int m_cachedCellCount; // cells with content
+    int m_maximumCachedCells;
+
     QString m_serverObject;
     Protocol::ObjectAddress m_myAddress;
 
+    // column -> roles, -1 for all columns without own entry
+    QMap<int, QVector<int> > m_eagerRoles;
+    QMap<int, QVector<int> > m_lazyRoles;
+
     qint32 m_currentSyncBarrier, m_targetSyncBarrier;
 
     // default data() values for empty cells
@@ -0,0 +1,184 @@
+/*
+  sessionreplayserver.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sessionreplayserver.h"
+
+#include <common/protocol.h>
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+#include <iostream>
+
+using namespace GammaRay;
+
+// how much data we hand to the socket before waiting for the client to catch up
+static const qint64 sendHighWaterMark = 1024 * 1024;
+
+SessionReplayServer::SessionReplayServer(QObject *parent)
+    : QObject(parent)
+    , m_replayedDirection(SessionRecording::Outgoing)
+    , m_hasEntry(false)
+    , m_firstTimestamp(-1)
+    , m_server(new QLocalServer(this))
+    , m_sendTimer(new QTimer(this))
+    , m_speed(OriginalSpeed)
+    , m_messageCount(0)
+    , m_bytes(0)
+{
+    m_sendTimer->setSingleShot(true);
+    connect(m_sendTimer, SIGNAL(timeout()), this, SLOT(sendMessages()));
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+SessionReplayServer::~SessionReplayServer()
+{
+}
+
+void SessionReplayServer::setSpeed(Speed speed)
+{
+    m_speed = speed;
+}
+
+bool SessionReplayServer::open(const QString &fileName)
+{
+    if (!m_reader.open(fileName)) {
+        m_errorString = m_reader.errorString();
+        return false;
+    }
+    if (m_reader.protocolVersion() != Protocol::version()) {
+        m_errorString = tr("Recording uses protocol version %1, expected %2.")
+                        .arg(m_reader.protocolVersion()).arg(Protocol::version());
+        return false;
+    }
+
+    // we play the probe side, whichever side the recording was made on
+    m_replayedDirection = m_reader.isClientRecording() ? SessionRecording::Incoming : SessionRecording::Outgoing;
+    return true;
+}
+
+bool SessionReplayServer::listen()
+{
+    const QString name = QStringLiteral("gammaray-replay-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        m_errorString = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+QString SessionReplayServer::errorString() const
+{
+    return m_errorString;
+}
+
+QUrl SessionReplayServer::serverAddress() const
+{
+    QUrl url;
+    url.setScheme(QStringLiteral("local"));
+    url.setPath(m_server->fullServerName());
+    return url;
+}
+
+void SessionReplayServer::newConnection()
+{
+    auto socket = m_server->nextPendingConnection();
+    if (m_socket) { // one session at a time
+        socket->close();
+        socket->deleteLater();
+        return;
+    }
+
+    m_socket = socket;
+    connect(socket, SIGNAL(readyRead()), this, SLOT(discardIncoming()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(sendMessages()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+
+    m_reader.rewind();
+    m_hasEntry = false;
+    m_firstTimestamp = -1;
+    m_messageCount = 0;
+    m_bytes = 0;
+    m_replayTimer.start();
+    sendMessages();
+}
+
+bool SessionReplayServer::readNextEntry()
+{
+    while (m_reader.readNext(m_entry)) {
+        if (m_entry.direction != m_replayedDirection)
+            continue;
+        if (m_firstTimestamp < 0)
+            m_firstTimestamp = m_entry.timestamp;
+        return true;
+    }
+    return false;
+}
+
+void SessionReplayServer::sendMessages()
+{
+    m_sendTimer->stop();
+    if (!m_socket || !m_replayTimer.isValid())
+        return;
+
+    while (m_socket->bytesToWrite() < sendHighWaterMark) {
+        if (!m_hasEntry) {
+            m_hasEntry = readNextEntry();
+            if (!m_hasEntry) {
+                const qint64 elapsed = m_replayTimer.elapsed();
+                m_replayTimer.invalidate();
+                std::cout << "Replayed " << m_messageCount << " messages (" << m_bytes
+                          << " bytes) in " << elapsed << " ms." << std::endl;
+                emit finished(m_messageCount, m_bytes, elapsed);
+                return;
+            }
+        }
+
+        if (m_speed == OriginalSpeed) {
+            const qint64 due = m_entry.timestamp - m_firstTimestamp - m_replayTimer.nsecsElapsed();
+            if (due > 0) {
+                m_sendTimer->start(int(qMax<qint64>(due / 1000000, 1)));
+                return;
+            }
+        }
+
+        m_socket->write(m_entry.data, m_entry.size);
+        ++m_messageCount;
+        m_bytes += m_entry.size;
+        m_hasEntry = false;
+    }
+}
+
+void SessionReplayServer::discardIncoming()
+{
+    if (m_socket)
+        m_socket->readAll();
+}
@@ -0,0 +1,104 @@
+/*
+  sessionreplayserver.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_SESSIONREPLAYSERVER_H
+#define GAMMARAY_SESSIONREPLAYSERVER_H
+
+#include "gammaray_client_export.h"
+
+#include <common/sessionrecording.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QUrl>
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+/**
+ * Fake probe replaying the probe side of a session recording to a connecting client.
+ *
+ * Messages from the client are ignored, so this makes for a repeatable end-to-end
+ * benchmark of the client side.
+ */
+class GAMMARAY_CLIENT_EXPORT SessionReplayServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionReplayServer(QObject *parent = nullptr);
+    ~SessionReplayServer();
+
+    enum Speed {
+        OriginalSpeed, ///< keep the recorded timing
+        MaximumSpeed ///< as fast as the client reads
+    };
+    void setSpeed(Speed speed);
+
+    bool open(const QString &fileName);
+    bool listen();
+    QString errorString() const;
+
+    /** Address for the client to connect to. */
+    QUrl serverAddress() const;
+
+signals:
+    /** Emitted once all recorded messages have been sent. */
+    void finished(int messageCount, qint64 bytes, qint64 elapsedMSecs);
+
+private slots:
+    void newConnection();
+    void sendMessages();
+    void discardIncoming();
+
+private:
+    bool readNextEntry();
+
+    SessionRecordingReader m_reader;
+    SessionRecordingReader::Entry m_entry;
+    SessionRecording::Direction m_replayedDirection;
+    bool m_hasEntry;
+    qint64 m_firstTimestamp;
+
+    QLocalServer *m_server;
+    QPointer<QLocalSocket> m_socket;
+    QTimer *m_sendTimer;
+    QElapsedTimer m_replayTimer;
+    QString m_errorString;
+    Speed m_speed;
+
+    int m_messageCount;
+    qint64 m_bytes;
+};
+}
+
+#endif // GAMMARAY_SESSIONREPLAYSERVER_H
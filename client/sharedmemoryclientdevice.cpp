@@ -0,0 +1,83 @@
+/*
+  sharedmemoryclientdevice.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sharedmemoryclientdevice.h"
+
+#include <common/sharedmemorydevice.h>
+
+#include <QtEndian>
+
+using namespace GammaRay;
+
+SharedMemoryClientDevice::SharedMemoryClientDevice(QObject *parent)
+    : LocalClientDevice(parent)
+    , m_sharedMemoryDevice(nullptr)
+{
+    // we are only connected once the handshake is done
+    disconnect(m_socket, SIGNAL(connected()), this, SIGNAL(connected()));
+    connect(m_socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+}
+
+QIODevice *SharedMemoryClientDevice::device() const
+{
+    if (m_sharedMemoryDevice)
+        return m_sharedMemoryDevice;
+    return m_socket;
+}
+
+void SharedMemoryClientDevice::socketConnected()
+{
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(handshakeReceived()));
+    handshakeReceived();
+}
+
+void SharedMemoryClientDevice::handshakeReceived()
+{
+    // see SharedMemoryServerDevice for the handshake format
+    qint32 keySize;
+    if (m_socket->peek(reinterpret_cast<char *>(&keySize), sizeof(keySize)) < (int)sizeof(keySize))
+        return;
+    keySize = qFromBigEndian(keySize);
+    if (m_socket->bytesAvailable() < (int)sizeof(keySize) + keySize)
+        return;
+    m_socket->read(sizeof(keySize));
+    const QString key = QString::fromUtf8(m_socket->read(keySize));
+    disconnect(m_socket, SIGNAL(readyRead()), this, SLOT(handshakeReceived()));
+
+    if (!key.isEmpty()) {
+        m_sharedMemoryDevice = new SharedMemoryDevice(m_socket, this);
+        if (!m_sharedMemoryDevice->attach(key) || !m_sharedMemoryDevice->open(QIODevice::ReadWrite)) {
+            delete m_sharedMemoryDevice;
+            m_sharedMemoryDevice = nullptr;
+        }
+    }
+
+    m_socket->putChar(m_sharedMemoryDevice ? 'S' : 'P');
+    m_socket->flush();
+    emit connected();
+}
@@ -0,0 +1,118 @@
+/*
+  compressionstream.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compressionstream.h"
+
+#include <cstring>
+
+using namespace GammaRay;
+
+// larger messages (such as remote view frames) don't benefit from the dictionary, and are compressed on their own
+static const int maximumBlockSize = 16 * 1024;
+// LZ4 looks back at most 64kB
+static const int ringBufferSize = 64 * 1024 + maximumBlockSize;
+
+CompressionStream::CompressionStream()
+    : m_offset(0)
+{
+    m_ringBuffer.resize(ringBufferSize);
+    reset();
+}
+
+CompressionStream::~CompressionStream()
+{
+}
+
+void CompressionStream::reset()
+{
+    LZ4_resetStream(&m_stream);
+    m_offset = 0;
+}
+
+bool CompressionStream::compress(const QByteArray &src, QByteArray &dst)
+{
+    const qint32 srcSz = src.size();
+    if (srcSz <= 0 || srcSz > maximumBlockSize)
+        return false;
+
+    // the decompressor applies the exact same rule, so block positions match on both ends
+    if (m_offset + srcSz > ringBufferSize)
+        m_offset = 0;
+    char *block = m_ringBuffer.data() + m_offset;
+    memcpy(block, src.constData(), srcSz);
+
+    dst.resize(LZ4_compressBound(srcSz) + sizeof(srcSz));
+    *(qint32 *)dst.data() = -srcSz; // negative size marks a streamed block
+
+    const int sz = LZ4_compress_fast_continue(&m_stream, block, dst.data() + sizeof(srcSz), srcSz,
+                                              dst.size() - sizeof(srcSz), 1);
+    Q_ASSERT(sz > 0);
+    dst.resize(sz + sizeof(srcSz));
+    m_offset += srcSz;
+    return true;
+}
+
+DecompressionStream::DecompressionStream()
+    : m_offset(0)
+{
+    m_ringBuffer.resize(ringBufferSize);
+    reset();
+}
+
+DecompressionStream::~DecompressionStream()
+{
+}
+
+void DecompressionStream::reset()
+{
+    LZ4_setStreamDecode(&m_stream, nullptr, 0);
+    m_offset = 0;
+}
+
+bool DecompressionStream::decompress(const QByteArray &src, QByteArray &dst)
+{
+    if (src.size() < (int)sizeof(qint32))
+        return false;
+    const qint32 dstSz = -*(const qint32 *)src.constData();
+    if (dstSz <= 0 || dstSz > maximumBlockSize)
+        return false;
+
+    if (m_offset + dstSz > ringBufferSize)
+        m_offset = 0;
+    char *block = m_ringBuffer.data() + m_offset;
+
+    const int sz = LZ4_decompress_safe_continue(&m_stream, src.constData() + sizeof(dstSz), block,
+                                                src.size() - sizeof(dstSz), dstSz);
+    if (sz != dstSz)
+        return false;
+
+    dst.resize(sz);
+    memcpy(dst.data(), block, sz);
+    m_offset += sz;
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+  compressionstream.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_COMPRESSIONSTREAM_H
+#define GAMMARAY_COMPRESSIONSTREAM_H
+
+#include "lz4/lz4.h" // 3rdparty
+
+#include <QByteArray>
+
+namespace GammaRay {
+/**
+ * LZ4 streaming compression state for the outgoing direction of a connection.
+ *
+ * Messages compressed through this use all previously compressed messages on the
+ * same connection as dictionary, which gives much better ratios for the many small
+ * and very similar messages we usually send. Both ends keep a ring buffer of the
+ * same size with the same update rule, so blocks have to be decompressed in the exact
+ * order they were compressed in, by a DecompressionStream on the other end.
+ *
+ * Compressed block format: qint32 negative uncompressed size, followed by the LZ4 data.
+ */
+class CompressionStream
+{
+public:
+    CompressionStream();
+    ~CompressionStream();
+
+    void reset();
+
+    /** Compress @p src into @p dst.
+     *  Returns @c false if @p src is too large for streaming, it has to be compressed
+     *  independently then.
+     */
+    bool compress(const QByteArray &src, QByteArray &dst);
+
+private:
+    Q_DISABLE_COPY(CompressionStream)
+    LZ4_stream_t m_stream;
+    QByteArray m_ringBuffer;
+    int m_offset;
+};
+
+/** Counterpart to CompressionStream for the incoming direction of a connection. */
+class DecompressionStream
+{
+public:
+    DecompressionStream();
+    ~DecompressionStream();
+
+    void reset();
+
+    /** Decompress the block in @p src (including the size prefix) into @p dst.
+     *  Returns @c false on corrupt input.
+     */
+    bool decompress(const QByteArray &src, QByteArray &dst);
+
+private:
+    Q_DISABLE_COPY(DecompressionStream)
+    LZ4_streamDecode_t m_stream;
+    QByteArray m_ringBuffer;
+    int m_offset;
+};
+}
+
+#endif // GAMMARAY_COMPRESSIONSTREAM_H
@@ -28,8 +28,14 @@
 
 #include "endpoint.h"
 #include "message.h"
+#include "messagechannel.h"
 #include "methodargument.h"
 #include "propertysyncer.h"
+#include "remoteviewframe.h"
+#include "sessionrecording.h"
+#include "variantwrapper.h"
+
+#include <QMetaType>
 
 #include <iostream>
 
@@ -46,13 +52,91 @@ using namespace std;
 
 Endpoint *Endpoint::s_instance = nullptr;
 
+namespace GammaRay {
+/** A single method argument, serialized with the type agreed on in the method definition. */
+struct TypedArgument
+{
+    TypedArgument(int type_ = 0, void *data_ = nullptr)
+        : type(type_)
+        , data(data_)
+        , valid(true) {}
+
+    int type;
+    void *data;
+    bool valid;
+};
+
+static QDataStream &operator<<(QDataStream &out, const TypedArgument &arg)
+{
+    if (!QMetaType::save(out, arg.type, arg.data))
+        cerr << "cannot serialize method argument of type " << QMetaType::typeName(arg.type) << endl;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, TypedArgument &arg)
+{
+    arg.valid = QMetaType::load(in, arg.type, arg.data);
+    return in;
+}
+}
+
+// the type a variant argument is sent as, VariantWrapper is used for calling methods taking a QVariant
+static int argumentType(const QVariant &arg)
+{
+    if (arg.userType() == qMetaTypeId<VariantWrapper>())
+        return QMetaType::QVariant;
+    return arg.userType();
+}
+
+template<typename Container>
+static QVector<int> argumentTypes(const Container &args)
+{
+    QVector<int> types;
+    types.reserve(args.size());
+    for (const auto &arg : args) {
+        if (arg.isValid())
+            types.push_back(argumentType(arg));
+    }
+    return types;
+}
+
+// arguments that are expensive to serialize, and safe to serialize off the main thread
+template<typename Container>
+static bool canSerializeOnIoThread(const Container &args)
+{
+    bool hasFrame = false;
+    for (const auto &arg : args) {
+        if (!arg.isValid())
+            continue;
+        if (arg.userType() != qMetaTypeId<RemoteViewFrame>())
+            return false;
+        hasFrame = true;
+    }
+    return hasFrame;
+}
+
+template<typename Container>
+static void writeMethodCall(Message &msg, quint16 methodId, const Container &args)
+{
+    msg << methodId;
+    for (const auto &arg : args) {
+        if (!arg.isValid())
+            continue;
+        if (arg.userType() == qMetaTypeId<VariantWrapper>()) {
+            QVariant v = arg.template value<VariantWrapper>().variant();
+            msg << TypedArgument(QMetaType::QVariant, &v);
+        } else {
+            msg << TypedArgument(arg.userType(), const_cast<void *>(arg.constData()));
+        }
+    }
+}
+
 Endpoint::Endpoint(QObject *parent)
     : QObject(parent)
     , m_propertySyncer(new PropertySyncer(this))
     , m_socket(nullptr)
     , m_myAddress(Protocol::InvalidObjectAddress +1)
-    , m_bytesRead(0)
-    , m_bytesWritten(0)
+    , m_channel(new MessageChannel(m_myAddress))
     , m_pid(-1)
 {
     if (s_instance) {
@@ -73,12 +157,20 @@ Endpoint::Endpoint(QObject *parent)
     connect(m_bandwidthMeasurementTimer, SIGNAL(timeout()), this, SLOT(logTransmissionRate()));
     m_bandwidthMeasurementTimer->start(1000);
 
+    // with an I/O thread, these are delivered from there
+    connect(m_channel.get(), SIGNAL(messageReceived(GammaRay::Message)), this, SLOT(receiveMessage(GammaRay::Message)),
+            Qt::DirectConnection);
+    connect(m_channel.get(), SIGNAL(messagesReceived()), this, SLOT(dispatchReceivedMessages()));
+    connect(m_channel.get(), SIGNAL(disconnected()), this, SLOT(connectionClosed()));
+
     connect(m_propertySyncer, SIGNAL(message(GammaRay::Message)), this,
             SLOT(sendMessage(GammaRay::Message)));
 }
 
 Endpoint::~Endpoint()
 {
+    flushSendQueue();
+
     for (auto it = m_addressMap.constBegin(); it != m_addressMap.constEnd(); ++it) {
         delete it.value();
     }
@@ -108,13 +200,41 @@ void Endpoint::sendMessage(const Message &msg)
 void Endpoint::doSendMessage(const GammaRay::Message &msg)
 {
     Q_ASSERT(msg.address() != Protocol::InvalidObjectAddress);
-    msg.write(m_socket);
-    m_bytesWritten += msg.size();
+    MessageChannel::EndpointThreadTimer timer(m_channel.get());
+    if (m_sessionRecorder)
+        m_sessionRecorder->record(SessionRecording::Outgoing, msg);
+    m_channel->send(msg);
+}
+
+void Endpoint::flushSendQueue()
+{
+    m_channel->flush();
+}
+
+qint64 Endpoint::sendHighWaterMark() const
+{
+    return m_channel->sendHighWaterMark();
+}
+
+void Endpoint::setSendHighWaterMark(qint64 size)
+{
+    m_channel->setSendHighWaterMark(size);
 }
 
 void Endpoint::waitForMessagesWritten()
 {
-    m_socket->waitForBytesWritten(-1);
+    m_channel->waitForMessagesWritten();
+}
+
+void Endpoint::setSessionRecordingFileName(const QString &fileName)
+{
+    m_sessionRecordingFileName = fileName;
+}
+
+void Endpoint::enableIoThread()
+{
+    Q_ASSERT(!m_socket);
+    m_channel->enableIoThread();
 }
 
 bool Endpoint::isConnected()
@@ -134,21 +254,27 @@ quint16 Endpoint::broadcastPort()
 
 void Endpoint::logTransmissionRate()
 {
-    emit logTransmissionRate(m_bytesRead, m_bytesWritten);
+    const quint64 bytesRead = m_channel->takeBytesRead();
+    const quint64 bytesWritten = m_channel->takeBytesWritten();
+    const quint64 endpointThreadTime = m_channel->takeEndpointThreadTime();
+    emit logTransmissionRate(bytesRead, bytesWritten);
 
     if(!isRemoteClient()) {
-        if(m_bytesRead != 0 || m_bytesWritten != 0) {
-            const float transmissionRateRX = (m_bytesRead * 8 / 1024.0 / 1024.0); // in Mpbs
-            const float transmissionRateTX = (m_bytesWritten * 8 / 1024.0 / 1024.0); // in Mpbs
+        if(bytesRead != 0 || bytesWritten != 0) {
+            const float transmissionRateRX = (bytesRead * 8 / 1024.0 / 1024.0); // in Mpbs
+            const float transmissionRateTX = (bytesWritten * 8 / 1024.0 / 1024.0); // in Mpbs
+            // time the main thread spent on sending/receiving messages, in ms per second
+            const float mainThreadTime = endpointThreadTime / 1000000.0;
+            const char *mode = m_channel->isIoThreadEnabled() ? "I/O thread" : "direct";
     #if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
-            qCWarning(networkstatistics, "RX %7.3f Mbps | TX %7.3f Mbps", transmissionRateRX, transmissionRateTX);
+            qCWarning(networkstatistics, "RX %7.3f Mbps | TX %7.3f Mbps | main thread %7.3f ms/s (%s)",
+                      transmissionRateRX, transmissionRateTX, mainThreadTime, mode);
     #else
-            qDebug("RX %7.3f Mbps | TX %7.3f Mbps", transmissionRateRX, transmissionRateTX);
+            qDebug("RX %7.3f Mbps | TX %7.3f Mbps | main thread %7.3f ms/s (%s)",
+                   transmissionRateRX, transmissionRateTX, mainThreadTime, mode);
     #endif
         }
     }
-    m_bytesRead = 0;
-    m_bytesWritten = 0;
 }
 
 void Endpoint::setDevice(QIODevice *device)
@@ -156,10 +282,18 @@ void Endpoint::setDevice(QIODevice *device)
     Q_ASSERT(!m_socket);
     Q_ASSERT(device);
     m_socket = device;
-    connect(m_socket.data(), SIGNAL(readyRead()), SLOT(readyRead()));
-    connect(m_socket.data(), SIGNAL(disconnected()), SLOT(connectionClosed()));
-    if (m_socket->bytesAvailable())
-        readyRead();
+    resetMethodTables();
+
+    if (!m_sessionRecordingFileName.isEmpty()) {
+        m_sessionRecorder.reset(new SessionRecordingWriter(isRemoteClient()));
+        if (!m_sessionRecorder->open(m_sessionRecordingFileName)) {
+            cerr << "cannot record session to " << qPrintable(m_sessionRecordingFileName) << ": "
+                 << qPrintable(m_sessionRecorder->errorString()) << endl;
+            m_sessionRecorder.reset();
+        }
+    }
+
+    m_channel->setDevice(device);
 }
 
 Protocol::ObjectAddress Endpoint::endpointAddress() const
@@ -167,19 +301,27 @@ Protocol::ObjectAddress Endpoint::endpointAddress() const
     return m_myAddress;
 }
 
-void Endpoint::readyRead()
+void Endpoint::setStreamCompressionEnabled(bool enabled)
 {
-    while (Message::canReadMessage(m_socket.data())) {
-        const auto msg = Message::readMessage(m_socket.data());
-        m_bytesRead += msg.size();
-        messageReceived(msg);
-    }
+    m_channel->setStreamCompressionEnabled(enabled);
+}
+
+void Endpoint::dispatchReceivedMessages()
+{
+    m_channel->dispatchReceivedMessages();
+}
+
+void Endpoint::receiveMessage(const Message &msg)
+{
+    if (m_sessionRecorder)
+        m_sessionRecorder->record(SessionRecording::Incoming, msg);
+    messageReceived(msg);
 }
 
 void Endpoint::connectionClosed()
 {
-    disconnect(m_socket.data(), SIGNAL(readyRead()), this, SLOT(readyRead()));
-    disconnect(m_socket.data(), SIGNAL(disconnected()), this, SLOT(connectionClosed()));
+    m_sessionRecorder.reset();
+    resetMethodTables();
     m_socket = nullptr;
     emit disconnected();
 }
@@ -230,13 +372,206 @@ void Endpoint::invokeObject(const QString &objectName, const char *method,
         return;
 #endif
 
+    Q_ASSERT(method && *method);
+    Q_ASSERT(args.size() <= 10);
+    const quint16 methodId = outgoingMethodId(obj, method, argumentTypes(args));
+    if (methodId != InvalidMethodId)
+        sendMethodCall(obj, methodId, args);
+}
+
+void Endpoint::forwardSignalToRemote(QObject *object, int signalIndex,
+                                     const QVector<QVariant> &args) const
+{
+    if (!isConnected())
+        return;
+
+    ObjectInfo *obj = m_objectMap.value(object, nullptr);
+    if (!obj || obj->address == Protocol::InvalidObjectAddress)
+        return;
+
+    auto it = obj->forwardedSignals.constFind(signalIndex);
+    if (it == obj->forwardedSignals.constEnd()) {
+        const QMetaMethod signal = object->metaObject()->method(signalIndex);
+        Q_ASSERT(signal.methodType() == QMetaMethod::Signal);
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+        QByteArray name = signal.signature();
+        name = name.left(name.indexOf('('));
+#else
+        const QByteArray name = signal.name();
+#endif
+        ObjectInfo::ForwardedSignal forwarded;
+        forwarded.hasVariantArguments = false;
+        foreach (const QByteArray &typeName, signal.parameterTypes()) {
+            const int type = QMetaType::type(typeName);
+            if (type == QMetaType::Void || !type)
+                continue; // not forwarded by the signal mapper either
+            forwarded.argumentTypes.push_back(type);
+            forwarded.hasVariantArguments |= type == QMetaType::QVariant;
+        }
+        forwarded.methodId = outgoingMethodId(obj, name.constData(), forwarded.argumentTypes);
+        it = obj->forwardedSignals.insert(signalIndex, forwarded);
+    }
+
+    const auto &forwarded = it.value();
+    if (forwarded.methodId == InvalidMethodId)
+        return;
+    if (forwarded.argumentTypes.size() != args.size()) {
+        cerr << "cannot forward signal with unexpected arguments on object " << qPrintable(obj->name) << endl;
+        return;
+    }
+    if (!forwarded.hasVariantArguments) {
+        sendMethodCall(obj, forwarded.methodId, args);
+        return;
+    }
+
+    // the signal mapper unwraps QVariant arguments, send them as QVariant whatever they currently hold
+    QVector<QVariant> wrappedArgs(args);
+    for (int i = 0; i < wrappedArgs.size(); ++i) {
+        if (forwarded.argumentTypes.at(i) == QMetaType::QVariant)
+            wrappedArgs[i] = QVariant::fromValue(VariantWrapper(args.at(i)));
+    }
+    sendMethodCall(obj, forwarded.methodId, wrappedArgs);
+}
+
+quint16 Endpoint::outgoingMethodId(ObjectInfo *obj, const char *method,
+                                   const QVector<int> &argumentTypes) const
+{
+    foreach (const auto &m, obj->outgoingMethods) {
+        if (m.argumentTypes == argumentTypes && qstrcmp(m.name.constData(), method) == 0)
+            return m.id;
+    }
+
+    Q_ASSERT(obj->outgoingMethods.size() < InvalidMethodId);
+    if (obj->outgoingMethods.size() >= InvalidMethodId) {
+        cerr << "too many different methods called on object " << qPrintable(obj->name) << endl;
+        return InvalidMethodId;
+    }
+
+    ObjectInfo::OutgoingMethod m;
+    m.name = method;
+    m.argumentTypes = argumentTypes;
+    m.id = obj->outgoingMethods.size();
+    obj->outgoingMethods.push_back(m);
+
+    QVector<QByteArray> typeNames;
+    typeNames.reserve(argumentTypes.size());
+    foreach (int type, argumentTypes)
+        typeNames.push_back(QMetaType::typeName(type));
+
+    Message msg(obj->address, Protocol::MethodDefinition);
+    msg << m.id << m.name << typeNames;
+    send(msg);
+    return m.id;
+}
+
+template<typename Container>
+void Endpoint::sendMethodCall(ObjectInfo *obj, quint16 methodId, const Container &args) const
+{
+    MessageChannel::EndpointThreadTimer timer(m_channel.get());
+    // recording needs the serialized message here
+    if (m_channel->isIoThreadEnabled() && !m_sessionRecorder && canSerializeOnIoThread(args)) {
+        // the arguments are implicitly shared, so this doesn't copy e.g. image data
+        m_channel->sendDeferred(obj->address, Protocol::MethodCall, [methodId, args](Message &msg) {
+            writeMethodCall(msg, methodId, args);
+        });
+        return;
+    }
+
     Message msg(obj->address, Protocol::MethodCall);
-    const QByteArray name(method);
-    Q_ASSERT(!name.isEmpty());
-    msg << name << args;
+    writeMethodCall(msg, methodId, args);
     send(msg);
 }
 
+void Endpoint::defineIncomingMethod(ObjectInfo *obj, const Message &msg)
+{
+    quint16 methodId;
+    QByteArray name;
+    QVector<QByteArray> typeNames;
+    msg >> methodId >> name >> typeNames;
+
+    if (obj->incomingMethods.size() <= methodId)
+        obj->incomingMethods.resize(methodId + 1);
+    auto &m = obj->incomingMethods[methodId];
+    m = ObjectInfo::IncomingMethod();
+    QByteArray signature = name + '(';
+    foreach (const auto &typeName, typeNames) {
+        if (!m.argumentTypeNames.isEmpty())
+            signature += ',';
+        signature += typeName;
+        m.argumentTypeNames.push_back(typeName);
+    }
+    signature += ')';
+    m.argumentTypes.fill(0, typeNames.size());
+    m.signature = QMetaObject::normalizedSignature(signature);
+}
+
+void Endpoint::invokeIncomingMethod(ObjectInfo *obj, const Message &msg)
+{
+    quint16 methodId;
+    msg >> methodId;
+    if (methodId >= obj->incomingMethods.size() || obj->incomingMethods.at(methodId).signature.isEmpty()) {
+        cerr << "call of undefined method " << methodId << " on object " << qPrintable(obj->name) << endl;
+        return;
+    }
+
+    auto &m = obj->incomingMethods[methodId];
+    if (!obj->object) {
+        cerr << "cannot call method " << m.signature.constData() << " on unknown object of name "
+             << qPrintable(obj->name) << " with address " << quint64(obj->address)
+             << " - did you forget to register it?" << endl;
+        return;
+    }
+
+    const QMetaObject *mo = obj->object->metaObject();
+    if (m.metaObject != mo) {
+        m.metaObject = mo;
+        m.method = mo->method(mo->indexOfMethod(m.signature.constData()));
+    }
+    if (m.method.methodIndex() < 0) {
+        cerr << "cannot call unknown method " << m.signature.constData() << " on object "
+             << qPrintable(obj->name) << endl;
+        return;
+    }
+
+    QVector<QGenericArgument> a(10);
+    QVector<TypedArgument> args;
+    args.reserve(m.argumentTypes.size());
+    bool valid = true;
+    for (int i = 0; i < m.argumentTypes.size(); ++i) {
+        int &type = m.argumentTypes[i];
+        if (!type)
+            type = QMetaType::type(m.argumentTypeNames.at(i));
+        if (!type) {
+            valid = false;
+            break;
+        }
+        args.push_back(TypedArgument(type, QMetaType::construct(type)));
+        msg >> args.last();
+        if (!args.last().valid) {
+            valid = false;
+            break;
+        }
+        a[args.size() - 1] = QGenericArgument(QMetaType::typeName(type), args.last().data);
+    }
+
+    if (valid)
+        m.method.invoke(obj->object, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+    else
+        cerr << "cannot deserialize arguments for method " << m.signature.constData() << endl;
+
+    foreach (const auto &arg, args)
+        QMetaType::destroy(arg.type, arg.data);
+}
+
+void Endpoint::resetMethodTables()
+{
+    foreach (ObjectInfo *obj, m_addressMap) {
+        obj->outgoingMethods.clear();
+        obj->forwardedSignals.clear();
+        obj->incomingMethods.clear();
+    }
+}
+
 void Endpoint::invokeObjectLocal(QObject *object, const char *method,
                                  const QVariantList &args) const
 {
@@ -348,21 +683,12 @@ void Endpoint::dispatchMessage(const Message &msg)
     }
 
     ObjectInfo *obj = it.value();
-    if (msg.type() == Protocol::MethodCall) {
-        QByteArray method;
-        msg >> method;
-        if (obj->object) {
-            Q_ASSERT(!method.isEmpty());
-            QVariantList args;
-            msg >> args;
-
-            invokeObjectLocal(obj->object, method.constData(), args);
-        } else {
-            cerr << "cannot call method " << method.constData() << " on unknown object of name "
-                 << qPrintable(obj->name) << " with address " << quint64(obj->address)
-                 << " - did you forget to register it?" << endl;
-        }
+    if (msg.type() == Protocol::MethodDefinition) {
+        defineIncomingMethod(obj, msg);
+        return;
     }
+    if (msg.type() == Protocol::MethodCall)
+        invokeIncomingMethod(obj, msg);
 
     if (obj->receiver)
         obj->messageHandler.invoke(obj->receiver, Q_ARG(GammaRay::Message, msg));
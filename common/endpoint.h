@@ -37,6 +37,8 @@
 #include <QPointer>
 #include <QTimer>
 
+#include <memory>
+
 #if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
 #include <QLoggingCategory>
 Q_DECLARE_LOGGING_CATEGORY(networkstatistics)
@@ -51,7 +53,9 @@ QT_END_NAMESPACE
 
 namespace GammaRay {
 class Message;
+class MessageChannel;
 class PropertySyncer;
+class SessionRecordingWriter;
 
 /** @brief Network protocol endpoint.
  *
@@ -104,6 +108,22 @@ public:
      */
     void waitForMessagesWritten();
 
+    /**
+     * Returns the maximum amount of data handed to the device that has not been written yet.
+     * Outgoing messages beyond that are kept queued, where they can be prioritized
+     * or dropped when superseded by newer ones.
+     */
+    qint64 sendHighWaterMark() const;
+    void setSendHighWaterMark(qint64 size);
+
+    /**
+     * Record all messages sent and received on the following connections to @p fileName,
+     * for later analysis or replay. Each new connection overwrites the previous recording.
+     * An empty file name disables recording.
+     * @see SessionRecordingWriter
+     */
+    void setSessionRecordingFileName(const QString &fileName);
+
     /**
      * Returns a human-readable string describing the host program.
      */
@@ -158,6 +178,16 @@ public slots:
     /** Convenience overload of send(), to directly send message delivered via signals. */
     void sendMessage(const GammaRay::Message &msg);
 
+    /**
+     * Write messages queued during the current event loop iteration to the device,
+     * up to the send high-water mark.
+     *
+     * Outgoing messages are coalesced and written once per event loop iteration,
+     * or whenever the device is ready for more data, so there is usually no need
+     * to call this explicitly.
+     */
+    void flushSendQueue();
+
 signals:
     /** Emitted when a connection to another endpoint was successfully established and passed the protocol version handshake step. */
     void connectionEstablished();
@@ -178,6 +208,17 @@ protected:
     /** The object address of the other endpoint. */
     Protocol::ObjectAddress endpointAddress() const;
 
+    /**
+     * Move socket handling, (de)compression and the serialization of large method call
+     * arguments to a dedicated I/O thread. Must be called before setDevice().
+     */
+    void enableIoThread();
+
+    /** Enable streaming compression for outgoing messages on the current connection.
+     *  This must only be enabled once the other endpoint confirmed to support this.
+     */
+    void setStreamCompressionEnabled(bool enabled);
+
     /** Called for every incoming message.
      *  @see dispatchMessage().
      */
@@ -200,7 +241,9 @@ protected:
     /** Calls the message handler registered for the receiver of @p msg. */
     void dispatchMessage(const GammaRay::Message &msg);
 
-    /** Sends a given message. */
+    /** Sends a given message.
+     *  The default implementation schedules @p msg for sending, see flushSendQueue().
+     */
     virtual void doSendMessage(const Message &msg);
 
     /** All current object name/address pairs. */
@@ -216,10 +259,18 @@ protected:
      */
     void invokeObjectLocal(QObject *object, const char *method, const QVariantList &args) const;
 
+    /**
+     * Forward the emission of the signal @p signalIndex of the locally registered @p object
+     * to the remote object of the same name.
+     */
+    void forwardSignalToRemote(QObject *object, int signalIndex, const QVector<QVariant> &args) const;
+
     PropertySyncer *m_propertySyncer;
 
 private slots:
-    void readyRead();
+    void dispatchReceivedMessages();
+    /** Entry point for messages received by the channel. */
+    void receiveMessage(const GammaRay::Message &msg);
     void logTransmissionRate();
     void connectionClosed();
     void handlerDestroyed(QObject *obj);
@@ -243,6 +294,38 @@ private:
         // custom message handling support
         QObject *receiver;
         QMetaMethod messageHandler;
+
+        // remote method calls, method IDs are assigned by the calling side per connection
+        struct OutgoingMethod
+        {
+            QByteArray name;
+            QVector<int> argumentTypes;
+            quint16 id;
+        };
+        QVector<OutgoingMethod> outgoingMethods;
+        struct ForwardedSignal
+        {
+            quint16 methodId;
+            // declared rather than runtime argument types, QVariant arguments can hold anything
+            QVector<int> argumentTypes;
+            bool hasVariantArguments;
+        };
+        QHash<int, ForwardedSignal> forwardedSignals; // local signal index -> outgoing method
+
+        struct IncomingMethod
+        {
+            IncomingMethod()
+                : metaObject(nullptr) {}
+
+            QByteArray signature;
+            QVector<QByteArray> argumentTypeNames;
+            // resolved on first use, and retried while unknown, as plugins can register types later
+            QVector<int> argumentTypes;
+            // method resolved on the local object, redone if its type changes
+            const QMetaObject *metaObject;
+            QMetaMethod method;
+        };
+        QVector<IncomingMethod> incomingMethods;
     };
 
     /** Inserts @p oi into all maps. */
@@ -250,6 +333,21 @@ private:
     /** Removes @p oi from all maps and destroys it. */
     void removeObjectInfo(ObjectInfo *oi);
 
+    /** Method IDs are 16 bit, this one is never assigned. */
+    static const quint16 InvalidMethodId = 0xffff;
+    /** Returns the method ID for calling @p method with arguments of @p argumentTypes on @p obj.
+     *  New methods are announced to the remote side first.
+     *  Returns InvalidMethodId if @p obj ran out of method IDs.
+     */
+    quint16 outgoingMethodId(ObjectInfo *obj, const char *method, const QVector<int> &argumentTypes) const;
+    /** Sends a method call for the method ID @p methodId and its arguments @p args. */
+    template<typename Container>
+    void sendMethodCall(ObjectInfo *obj, quint16 methodId, const Container &args) const;
+    void defineIncomingMethod(ObjectInfo *obj, const Message &msg);
+    void invokeIncomingMethod(ObjectInfo *obj, const Message &msg);
+    /** Forget all method IDs, they are only valid for one connection. */
+    void resetMethodTables();
+
     QHash<QString, ObjectInfo *> m_nameMap;
     QHash<Protocol::ObjectAddress, ObjectInfo *> m_addressMap;
     QHash<QObject *, ObjectInfo *> m_objectMap;
@@ -257,10 +355,13 @@ private:
 
     QPointer<QIODevice> m_socket;
     Protocol::ObjectAddress m_myAddress;
-    quint64 m_bytesRead;
-    quint64 m_bytesWritten;
     QTimer *m_bandwidthMeasurementTimer;
 
+    std::unique_ptr<MessageChannel> m_channel;
+
+    QString m_sessionRecordingFileName;
+    std::unique_ptr<SessionRecordingWriter> m_sessionRecorder;
+
     QString m_label;
     QString m_key;
     qint64 m_pid;
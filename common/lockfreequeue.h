@@ -0,0 +1,131 @@
+/*
+  lockfreequeue.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_LOCKFREEQUEUE_H
+#define GAMMARAY_LOCKFREEQUEUE_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <utility>
+
+namespace GammaRay {
+/**
+ * Unbounded single-producer/single-consumer queue for handing data between two threads
+ * without locking. push() must only ever be called from one thread, and pop() only ever
+ * from one other thread.
+ *
+ * Nodes the consumer is done with are recycled by the producer, so in the steady state
+ * this does not allocate.
+ */
+template<typename T>
+class LockFreeQueue
+{
+public:
+    LockFreeQueue()
+    {
+        Node *n = new Node;
+        m_consumerNode.store(n);
+        m_producerNode = n;
+        m_firstFree = n;
+        m_consumerNodeCopy = n;
+    }
+
+    ~LockFreeQueue()
+    {
+        Node *n = m_firstFree;
+        while (n) {
+            Node *next = n->next.load(std::memory_order_relaxed);
+            delete n;
+            n = next;
+        }
+    }
+
+    /** Producer side. */
+    void push(T &&value)
+    {
+        Node *n = allocateNode();
+        n->value = std::move(value);
+        n->next.store(nullptr, std::memory_order_relaxed);
+        m_producerNode->next.store(n, std::memory_order_release);
+        m_producerNode = n;
+    }
+
+    /** Consumer side, returns @c false if the queue is empty. */
+    bool pop(T &value)
+    {
+        Node *current = m_consumerNode.load(std::memory_order_relaxed);
+        Node *next = current->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        next->value = T();
+        m_consumerNode.store(next, std::memory_order_release);
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(LockFreeQueue)
+
+    struct Node
+    {
+        Node()
+            : next(nullptr) {}
+        std::atomic<Node *> next;
+        T value;
+    };
+
+    Node *allocateNode()
+    {
+        // nodes before the one the consumer is at are free for reuse
+        if (m_firstFree != m_consumerNodeCopy)
+            return takeFirstFree();
+        m_consumerNodeCopy = m_consumerNode.load(std::memory_order_acquire);
+        if (m_firstFree != m_consumerNodeCopy)
+            return takeFirstFree();
+        return new Node;
+    }
+
+    Node *takeFirstFree()
+    {
+        Node *n = m_firstFree;
+        m_firstFree = n->next.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    // consumer side
+    std::atomic<Node *> m_consumerNode; // the last consumed node, its successor is next in line
+
+    // producer side
+    Node *m_producerNode; // the last pushed node
+    Node *m_firstFree; // oldest node, nodes up to m_consumerNodeCopy can be reused
+    Node *m_consumerNodeCopy;
+};
+}
+
+#endif // GAMMARAY_LOCKFREEQUEUE_H
@@ -28,6 +28,7 @@
 
 #include "message.h"
 
+#include "compressionstream.h"
 #include "sharedpool.h"
 #include "lz4/lz4.h" // 3rdparty
 
@@ -35,6 +36,9 @@
 #include <QDebug>
 #include <qendian.h>
 
+#include <atomic>
+#include <cstring>
+
 inline void compress(const QByteArray &src, QByteArray &dst)
 {
     const qint32 srcSz = src.size();
@@ -47,9 +51,15 @@ inline void compress(const QByteArray &src, QByteArray &dst)
     dst.resize(sz + sizeof(srcSz));
 }
 
-inline void uncompress(const QByteArray &src, QByteArray &dst)
+inline void uncompress(const QByteArray &src, QByteArray &dst, GammaRay::DecompressionStream *stream)
 {
     const qint32 dstSz = *(const qint32 *)src.constData(); // get the dest size
+    if (dstSz < 0) { // block compressed with a CompressionStream
+        if (!stream || !stream->decompress(src, dst))
+            dst.resize(0);
+        return;
+    }
+
     dst.resize(dstSz);
     const int sz = LZ4_decompress_safe(src.constData() + sizeof(dstSz), dst.data(),
                                        src.size()- sizeof(dstSz), dstSz);
@@ -59,8 +69,14 @@ inline void uncompress(const QByteArray &src, QByteArray &dst)
         dst.resize(sz);
 }
 
-static quint8 s_streamVersion = GammaRay::Message::lowestSupportedDataVersion();
+// what we negotiated for the messages we create, the other side's messages are stamped by MessageParser
+static std::atomic<quint8> s_streamVersion(GammaRay::Message::lowestSupportedDataVersion());
+static std::atomic<bool> s_compactModelIndexes(false);
+static bool s_compressionEnabled = qgetenv("GAMMARAY_DISABLE_LZ4") != "1";
 static const int minimumUncompressedSize = 32;
+static const int headerSize = sizeof(GammaRay::Protocol::PayloadSize)
+                              + sizeof(GammaRay::Protocol::ObjectAddress)
+                              + sizeof(GammaRay::Protocol::MessageType);
 
 template<typename T> static T readNumber(QIODevice *device)
 {
@@ -71,12 +87,18 @@ template<typename T> static T readNumber(QIODevice *device)
     return qFromBigEndian(buffer);
 }
 
-template<typename T> static void writeNumber(QIODevice *device, T value)
+template<typename T> static T readNumber(const char *src)
+{
+    T buffer;
+    memcpy(&buffer, src, sizeof(T));
+    return qFromBigEndian(buffer);
+}
+
+template<typename T> static char *writeNumber(char *dst, T value)
 {
     value = qToBigEndian(value);
-    const int writeSize = device->write((char *)&value, sizeof(T));
-    Q_UNUSED(writeSize);
-    Q_ASSERT(writeSize == sizeof(T));
+    memcpy(dst, &value, sizeof(T));
+    return dst + sizeof(T);
 }
 
 using namespace GammaRay;
@@ -98,10 +120,21 @@ public:
 
     void clear()
     {
+        releaseBacking();
         data.buffer().resize(0);
         resetStatus();
     }
 
+    /** Drops the reference to the receive buffer of a MessageParser. */
+    void releaseBacking()
+    {
+        if (!backing)
+            return;
+        data.buffer() = QByteArray();
+        data.buffer().reserve(32);
+        backing.reset();
+    }
+
     void resetStatus()
     {
         data.seek(0);
@@ -112,6 +145,8 @@ public:
     QBuffer data;
     QByteArray scratchSpace;
     QDataStream stream;
+    // set if data references a part of this, rather than owning the payload
+    std::shared_ptr<QByteArray> backing;
 };
 
 Q_GLOBAL_STATIC_WITH_ARGS(SharedPool<MessageBuffer>, s_sharedMessageBufferPool, (5))
@@ -119,6 +154,7 @@ Q_GLOBAL_STATIC_WITH_ARGS(SharedPool<MessageBuffer>, s_sharedMessageBufferPool,
 Message::Message()
     : m_objectAddress(Protocol::InvalidObjectAddress)
     , m_messageType(Protocol::InvalidMessageType)
+    , m_compactModelIndexes(s_compactModelIndexes)
     , m_buffer(s_sharedMessageBufferPool()->acquire())
 {
     m_buffer->clear();
@@ -128,21 +164,39 @@ Message::Message()
 Message::Message(Protocol::ObjectAddress objectAddress, Protocol::MessageType type)
     : m_objectAddress(objectAddress)
     , m_messageType(type)
+    , m_compactModelIndexes(s_compactModelIndexes)
     , m_buffer(s_sharedMessageBufferPool()->acquire())
 {
     m_buffer->clear();
     m_buffer->stream.setVersion(s_streamVersion);
 }
 
+Message::Message(Protocol::ObjectAddress objectAddress, Protocol::MessageType type,
+                 const QByteArray &payload)
+    : m_objectAddress(objectAddress)
+    , m_messageType(type)
+    , m_compactModelIndexes(s_compactModelIndexes)
+    , m_buffer(s_sharedMessageBufferPool()->acquire())
+{
+    m_buffer->clear();
+    m_buffer->data.buffer() = payload;
+    m_buffer->stream.setVersion(s_streamVersion);
+}
+
 Message::Message(Message &&other)
     : m_objectAddress(other.m_objectAddress)
     , m_messageType(other.m_messageType)
+    , m_compactModelIndexes(other.m_compactModelIndexes)
+    , m_supersedeKey(std::move(other.m_supersedeKey))
     , m_buffer(std::move(other.m_buffer))
 {
 }
 
 Message::~Message()
 {
+    // don't keep the receive buffer alive while this sits in the pool
+    if (m_buffer)
+        m_buffer->releaseBacking();
 }
 
 Protocol::ObjectAddress Message::address() const
@@ -155,6 +209,11 @@ Protocol::MessageType Message::type() const
     return m_messageType;
 }
 
+bool Message::hasCompactModelIndexes() const
+{
+    return m_compactModelIndexes;
+}
+
 QDataStream &Message::payload() const
 {
     return m_buffer->stream;
@@ -165,9 +224,7 @@ bool Message::canReadMessage(QIODevice *device)
     if (!device)
         return false;
 
-    static const int minimumSize = sizeof(Protocol::PayloadSize) + sizeof(Protocol::ObjectAddress)
-                                   + sizeof(Protocol::MessageType);
-    if (device->bytesAvailable() < minimumSize)
+    if (device->bytesAvailable() < headerSize)
         return false;
 
     Protocol::PayloadSize payloadSize;
@@ -179,10 +236,10 @@ bool Message::canReadMessage(QIODevice *device)
         return false;
 
     payloadSize = abs(qFromBigEndian(payloadSize));
-    return device->bytesAvailable() >= payloadSize + minimumSize;
+    return device->bytesAvailable() >= payloadSize + headerSize;
 }
 
-Message Message::readMessage(QIODevice *device)
+Message Message::readMessage(QIODevice *device, DecompressionStream *stream)
 {
     Message msg;
 
@@ -197,7 +254,7 @@ Message Message::readMessage(QIODevice *device)
         auto& uncompressedData = msg.m_buffer->scratchSpace;
         uncompressedData.resize(payloadSize);
         device->read(uncompressedData.data(), payloadSize);
-        uncompress(uncompressedData, msg.m_buffer->data.buffer());
+        uncompress(uncompressedData, msg.m_buffer->data.buffer(), stream);
         Q_ASSERT(payloadSize == uncompressedData.size());
     } else {
         if (payloadSize > 0) {
@@ -244,41 +301,244 @@ void Message::setNegotiatedDataVersion(quint8 version)
 void Message::resetNegotiatedDataVersion()
 {
     s_streamVersion = lowestSupportedDataVersion();
+    s_compactModelIndexes = false;
 }
 
-void Message::write(QIODevice *device) const
+bool Message::compressionEnabled()
+{
+    return s_compressionEnabled;
+}
+
+void Message::setCompressionEnabled(bool enabled)
+{
+    s_compressionEnabled = enabled;
+}
+
+bool Message::compactModelIndexesEnabled()
+{
+    return s_compactModelIndexes;
+}
+
+void Message::setCompactModelIndexesEnabled(bool enabled)
+{
+    s_compactModelIndexes = enabled;
+}
+
+const QByteArray &Message::encode(char *header, CompressionStream *stream) const
 {
     Q_ASSERT(m_objectAddress != Protocol::InvalidObjectAddress);
     Q_ASSERT(m_messageType != Protocol::InvalidMessageType);
-    static const bool compressionEnabled = qgetenv("GAMMARAY_DISABLE_LZ4") != "1";
     const int buffSize = m_buffer->data.size();
     auto& compressedData = m_buffer->scratchSpace;
-    if (buffSize > minimumUncompressedSize && compressionEnabled)
-        compress(m_buffer->data.buffer(), compressedData);
+    bool isCompressed = false;
+    if (stream && s_compressionEnabled && stream->compress(m_buffer->data.buffer(), compressedData)) {
+        // streamed blocks are part of the dictionary on both ends, so they are always sent compressed
+        isCompressed = true;
+    } else {
+        if (buffSize > minimumUncompressedSize && s_compressionEnabled)
+            compress(m_buffer->data.buffer(), compressedData);
+        isCompressed = compressedData.size() && compressedData.size() < buffSize;
+    }
 
-    const bool isCompressed = compressedData.size() && compressedData.size() < buffSize;
     if (isCompressed)
-        writeNumber<Protocol::PayloadSize>(device, -compressedData.size()); // send compressed Buffer
+        header = writeNumber<Protocol::PayloadSize>(header, -compressedData.size()); // send compressed Buffer
     else
-        writeNumber<Protocol::PayloadSize>(device, buffSize);   // send uncompressed Buffer
-
-    writeNumber(device, m_objectAddress);
-    writeNumber(device, m_messageType);
-
-    if (buffSize) {
-        if (isCompressed) {
-            const int s = device->write(compressedData);
-            Q_ASSERT(s == compressedData.size());
-            Q_UNUSED(s);
-        } else {
-            const int s = device->write(m_buffer->data.buffer());
-            Q_ASSERT(s == m_buffer->data.size());
-            Q_UNUSED(s);
-        }
+        header = writeNumber<Protocol::PayloadSize>(header, buffSize);   // send uncompressed Buffer
+
+    header = writeNumber(header, m_objectAddress);
+    writeNumber(header, m_messageType);
+
+    return isCompressed ? compressedData : m_buffer->data.buffer();
+}
+
+void Message::write(QIODevice *device) const
+{
+    char header[headerSize];
+    const QByteArray &payload = encode(header, nullptr);
+
+    int s = device->write(header, headerSize);
+    Q_ASSERT(s == headerSize);
+    if (!payload.isEmpty()) {
+        s = device->write(payload);
+        Q_ASSERT(s == payload.size());
     }
+    Q_UNUSED(s);
+}
+
+void Message::appendTo(QByteArray &buffer, CompressionStream *stream) const
+{
+    char header[headerSize];
+    const QByteArray &payload = encode(header, stream);
+
+    buffer.append(header, headerSize);
+    buffer.append(payload);
 }
 
 int Message::size() const
 {
     return m_buffer->data.size();
 }
+
+QByteArray Message::rawPayload() const
+{
+    // don't hand out references into the receive buffer, that might outlive it
+    if (m_buffer->backing)
+        return QByteArray(m_buffer->data.buffer().constData(), m_buffer->data.size());
+    return m_buffer->data.buffer();
+}
+
+int Message::readPosition() const
+{
+    return int(m_buffer->data.pos());
+}
+
+quint64 Message::payloadHash(int from, int to) const
+{
+    Q_ASSERT(from >= 0 && from <= to && to <= m_buffer->data.size());
+    return Protocol::contentHash(m_buffer->data.buffer().constData() + from, to - from);
+}
+
+void Message::setSupersedeKey(const QByteArray &key)
+{
+    m_supersedeKey = key;
+}
+
+QByteArray Message::supersedeKey() const
+{
+    return m_supersedeKey;
+}
+
+// start size of the receive buffer, and what we keep of it once it has been drained
+static const int parserBufferSize = 64 * 1024;
+static const int maximumRetainedParserBufferSize = 1024 * 1024;
+
+MessageParser::MessageParser()
+    : m_buffer(std::make_shared<QByteArray>())
+    , m_readPos(0)
+    , m_streamVersion(Message::lowestSupportedDataVersion())
+    , m_compactModelIndexes(false)
+{
+    m_buffer->reserve(parserBufferSize);
+}
+
+MessageParser::~MessageParser()
+{
+}
+
+qint64 MessageParser::readFrom(QIODevice *device)
+{
+    if (!device)
+        return 0;
+    const qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return 0;
+
+    reserve(int(available));
+    const int oldSize = m_buffer->size();
+    m_buffer->resize(oldSize + int(available));
+    const qint64 readSize = device->read(m_buffer->data() + oldSize, available);
+    m_buffer->resize(oldSize + int(qMax<qint64>(readSize, 0)));
+    return qMax<qint64>(readSize, 0);
+}
+
+void MessageParser::reserve(int size)
+{
+    const int unread = m_buffer->size() - m_readPos;
+
+    if (isExclusive()) {
+        // nobody refers to the consumed part anymore, move the unread rest to the front
+        if (unread == 0 && m_buffer->capacity() > maximumRetainedParserBufferSize) {
+            *m_buffer = QByteArray();
+            m_buffer->reserve(parserBufferSize);
+        } else if (m_readPos > 0 && unread > 0) {
+            memmove(m_buffer->data(), m_buffer->constData() + m_readPos, unread);
+        }
+        m_buffer->resize(unread);
+        m_readPos = 0;
+        if (m_buffer->capacity() < unread + size)
+            m_buffer->reserve(qMax(unread + size, 2 * m_buffer->capacity()));
+        return;
+    }
+
+    // appending within the capacity doesn't move the data messages refer to
+    if (m_buffer->capacity() - m_buffer->size() >= size)
+        return;
+
+    auto buffer = std::make_shared<QByteArray>();
+    buffer->reserve(qMax(unread + size, parserBufferSize));
+    buffer->append(m_buffer->constData() + m_readPos, unread);
+    m_buffer = buffer;
+    m_readPos = 0;
+}
+
+bool MessageParser::hasMessage() const
+{
+    const int unread = m_buffer->size() - m_readPos;
+    if (unread < headerSize)
+        return false;
+    const Protocol::PayloadSize payloadSize
+        = readNumber<Protocol::PayloadSize>(m_buffer->constData() + m_readPos);
+    return unread - headerSize >= abs(payloadSize);
+}
+
+Message MessageParser::takeMessage(DecompressionStream *stream)
+{
+    Q_ASSERT(hasMessage());
+    Message msg;
+
+    const char *frame = m_buffer->constData() + m_readPos;
+    Protocol::PayloadSize payloadSize = readNumber<Protocol::PayloadSize>(frame);
+    frame += sizeof(Protocol::PayloadSize);
+    msg.m_objectAddress = readNumber<Protocol::ObjectAddress>(frame);
+    frame += sizeof(Protocol::ObjectAddress);
+    msg.m_messageType = readNumber<Protocol::MessageType>(frame);
+    frame += sizeof(Protocol::MessageType);
+    Q_ASSERT(msg.m_messageType != Protocol::InvalidMessageType);
+    Q_ASSERT(msg.m_objectAddress != Protocol::InvalidObjectAddress);
+
+    if (payloadSize < 0) {
+        payloadSize = abs(payloadSize);
+        uncompress(QByteArray::fromRawData(frame, payloadSize), msg.m_buffer->data.buffer(), stream);
+    } else if (payloadSize > 0) {
+        msg.m_buffer->backing = m_buffer;
+        msg.m_buffer->data.buffer() = QByteArray::fromRawData(frame, payloadSize);
+    }
+    m_readPos += headerSize + payloadSize;
+
+    msg.m_buffer->resetStatus();
+    msg.m_buffer->stream.setVersion(m_streamVersion);
+    msg.m_compactModelIndexes = m_compactModelIndexes;
+    return msg;
+}
+
+void MessageParser::setNegotiatedDataVersion(quint8 version)
+{
+    m_streamVersion = version;
+}
+
+void MessageParser::setCompactModelIndexesEnabled(bool enabled)
+{
+    m_compactModelIndexes = enabled;
+}
+
+bool MessageParser::isExclusive() const
+{
+    if (m_buffer.use_count() != 1)
+        return false;
+    // messages might have been released on another thread, make sure they are done with the data
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+void MessageParser::clear()
+{
+    if (isExclusive()) {
+        m_buffer->resize(0);
+    } else {
+        m_buffer = std::make_shared<QByteArray>();
+        m_buffer->reserve(parserBufferSize);
+    }
+    m_readPos = 0;
+    m_streamVersion = Message::lowestSupportedDataVersion();
+    m_compactModelIndexes = false;
+}
@@ -41,6 +41,9 @@
 class MessageBuffer;
 
 namespace GammaRay {
+class CompressionStream;
+class DecompressionStream;
+
 /**
  * Single message send between client and server.
  * Binary format:
@@ -56,11 +59,21 @@ public:
      * Construct a new message to/from @p objectAddress and message type @p type.
      */
     explicit Message(Protocol::ObjectAddress objectAddress, Protocol::MessageType type);
+    /**
+     * Construct a new message with an already serialized (uncompressed) @p payload.
+     * @see rawPayload()
+     */
+    explicit Message(Protocol::ObjectAddress objectAddress, Protocol::MessageType type,
+                     const QByteArray &payload);
     Message(Message &&other); // krazy:exclude=explicit
     ~Message();
 
     Protocol::ObjectAddress address() const;
     Protocol::MessageType type() const;
+    /** Whether model indexes in this message use the compact encoding.
+     *  @see ModelIndexWriter
+     */
+    bool hasCompactModelIndexes() const;
 
     /** Read value from the payload
      *  This operator proxy over payload() allow to do:
@@ -107,23 +120,65 @@ public:
 
     /** Checks if there is a full message waiting in @p device. */
     static bool canReadMessage(QIODevice *device);
-    /** Read the next message from @p device. */
-    static Message readMessage(QIODevice *device);
+    /** Read the next message from @p device.
+     *  @p stream is needed to decompress messages sent with streaming compression.
+     */
+    static Message readMessage(QIODevice *device, DecompressionStream *stream = nullptr);
 
     static quint8 lowestSupportedDataVersion();
     static quint8 highestSupportedDataVersion();
 
+    /** The data stream version of the messages created from now on.
+     *  Received messages use the version MessageParser was told about, in order with the message stream.
+     */
     static quint8 negotiatedDataVersion();
     static void setNegotiatedDataVersion(quint8 version);
     static void resetNegotiatedDataVersion();
 
+    /** Whether outgoing payloads are LZ4 compressed where this helps.
+     *  This is enabled by default, unless the GAMMARAY_DISABLE_LZ4 environment variable is set.
+     */
+    static bool compressionEnabled();
+    static void setCompressionEnabled(bool enabled);
+
+    /** Whether the compact model index encoding has been negotiated for the messages created from now on.
+     *  @see ModelIndexWriter
+     */
+    static bool compactModelIndexesEnabled();
+    static void setCompactModelIndexesEnabled(bool enabled);
+
     /** Write this message to @p device. */
     void write(QIODevice *device) const;
 
+    /** Append the wire representation of this message to @p buffer.
+     *  This allows to send several messages with a single write to the device.
+     *  If @p stream is set, it is used for compressing the payload if possible.
+     */
+    void appendTo(QByteArray &buffer, CompressionStream *stream = nullptr) const;
+
     /** Size of the uncompressed message payload. */
     int size() const;
 
+    /** The serialized (uncompressed) message payload. This shares the data with the message. */
+    QByteArray rawPayload() const;
+
+    /** Offset of the next value read from the payload. */
+    int readPosition() const;
+    /** Protocol::contentHash() of the payload bytes between offset @p from and @p to.
+     *  This allows to identify a value by its serialized form while reading it.
+     */
+    quint64 payloadHash(int from, int to) const;
+
+    /**
+     * Mark this message as obsolete once a newer message with the same address, type and
+     * @p key has been sent. This allows the send scheduler to drop it if it hasn't been
+     * written yet, use this for e.g. value change notifications.
+     */
+    void setSupersedeKey(const QByteArray &key);
+    QByteArray supersedeKey() const;
+
 private:
+    friend class MessageParser;
     Message();
 
     /** Access to the message payload. This is read-only for received messages
@@ -131,11 +186,62 @@ private:
      */
     QDataStream &payload() const;
 
+    /** Fills the fixed size message @p header and returns the (possibly compressed)
+     *  payload that has to follow it on the wire.
+     */
+    const QByteArray &encode(char *header, CompressionStream *stream) const;
+
     Protocol::ObjectAddress m_objectAddress;
     Protocol::MessageType m_messageType;
+    bool m_compactModelIndexes;
+    QByteArray m_supersedeKey;
 
     std::unique_ptr<MessageBuffer, std::function<void(MessageBuffer *)>> m_buffer;
 };
+
+/**
+ * Incremental parser for the messages arriving on a device.
+ *
+ * All available data is read at once into a reusable buffer, complete messages are then
+ * sliced out of it. Uncompressed payloads reference that buffer rather than being copied,
+ * so the buffer is only reused once all messages referring to it are gone.
+ */
+class GAMMARAY_COMMON_EXPORT MessageParser
+{
+public:
+    MessageParser();
+    ~MessageParser();
+
+    /** Reads all data available on @p device, returns the number of bytes read. */
+    qint64 readFrom(QIODevice *device);
+    /** Checks if there is a complete message to take. */
+    bool hasMessage() const;
+    /** Returns the next complete message.
+     *  @p stream is needed to decompress messages sent with streaming compression.
+     */
+    Message takeMessage(DecompressionStream *stream = nullptr);
+    /** Discards all buffered data and negotiated settings, e.g. when starting a new connection. */
+    void clear();
+
+    /** Data stream version and model index encoding of the messages the other side sends after
+     *  the one that was just taken. This way a negotiation applies exactly to the messages following it,
+     *  including those already buffered.
+     */
+    void setNegotiatedDataVersion(quint8 version);
+    void setCompactModelIndexesEnabled(bool enabled);
+
+private:
+    Q_DISABLE_COPY(MessageParser)
+    /** Makes room for appending @p size bytes, without moving data still referenced by messages. */
+    void reserve(int size);
+    /** Returns @c true if no message refers to the buffer anymore. */
+    bool isExclusive() const;
+
+    std::shared_ptr<QByteArray> m_buffer;
+    int m_readPos;
+    quint8 m_streamVersion;
+    bool m_compactModelIndexes;
+};
 }
 
 #endif
@@ -0,0 +1,401 @@
+/*
+  messagechannel.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "messagechannel.h"
+#include "compressionstream.h"
+#include "message.h"
+#include "messagescheduler.h"
+
+#include <QIODevice>
+#include <QThread>
+#include <QTimer>
+
+using namespace GammaRay;
+
+// flush the send queue right away once it grows beyond this, rather than waiting for the next event loop iteration
+static const int maximumSendQueueSize = 256 * 1024;
+// how much data we hand to the device before waiting for it to be actually written
+static const qint64 defaultSendHighWaterMark = 1024 * 1024;
+
+MessageChannel::EndpointThreadTimer::EndpointThreadTimer(MessageChannel *channel)
+    : m_channel(channel)
+    , m_active(QThread::currentThread() == channel->m_endpointThread)
+{
+    // nested scopes are only accounted once
+    if (m_active && m_channel->m_timingDepth++ == 0)
+        m_timer.start();
+}
+
+MessageChannel::EndpointThreadTimer::~EndpointThreadTimer()
+{
+    if (m_active && --m_channel->m_timingDepth == 0)
+        m_channel->m_endpointThreadTime += m_timer.nsecsElapsed();
+}
+
+MessageChannel::MessageChannel(Protocol::ObjectAddress endpointAddress)
+    : m_endpointThread(QThread::currentThread())
+    , m_ioThread(nullptr)
+    , m_endpointAddress(endpointAddress)
+    , m_timingDepth(0)
+    , m_scheduler(new MessageScheduler(endpointAddress))
+    , m_decompressionStream(new DecompressionStream)
+    , m_postedMessagesPending(false)
+    , m_receivedMessagesPending(false)
+    , m_sendHighWaterMark(defaultSendHighWaterMark)
+    , m_bytesRead(0)
+    , m_bytesWritten(0)
+    , m_endpointThreadTime(0)
+{
+    // explicitly reserve memory so flushing the queue won't shed it
+    m_sendQueue.reserve(4096);
+    m_sendQueueTimer = new QTimer(this);
+    m_sendQueueTimer->setSingleShot(true);
+    m_sendQueueTimer->setInterval(0);
+    connect(m_sendQueueTimer, SIGNAL(timeout()), this, SLOT(flushSendQueue()));
+}
+
+MessageChannel::~MessageChannel()
+{
+    if (m_ioThread) {
+        QMetaObject::invokeMethod(this, "shutdown", Qt::BlockingQueuedConnection);
+        m_ioThread->quit();
+        m_ioThread->wait();
+        delete m_ioThread;
+    }
+}
+
+void MessageChannel::enableIoThread()
+{
+    Q_ASSERT(!m_device);
+    if (m_ioThread)
+        return;
+
+    m_ioThread = new QThread;
+    m_ioThread->setObjectName(QStringLiteral("GammaRay I/O thread"));
+    moveToThread(m_ioThread);
+    m_ioThread->start();
+}
+
+bool MessageChannel::isIoThreadEnabled() const
+{
+    return m_ioThread;
+}
+
+void MessageChannel::setDevice(QIODevice *device)
+{
+    Q_ASSERT(device);
+    if (!m_ioThread) {
+        attachDevice(device);
+        return;
+    }
+
+    // a device can only be moved to another thread from its own, and without a parent,
+    // the device is reparented once it arrived on the I/O thread
+    device->setParent(nullptr);
+    device->moveToThread(m_ioThread);
+    PostedMessage cmd;
+    cmd.command = AttachDevice;
+    cmd.device = device;
+    post(std::move(cmd));
+}
+
+void MessageChannel::attachDevice(QIODevice *device)
+{
+    Q_ASSERT(!m_device);
+    m_device = device;
+    if (m_ioThread)
+        device->setParent(this);
+    m_compressionStream.reset();
+    m_decompressionStream->reset();
+    m_parser.clear();
+    connect(device, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(device, SIGNAL(disconnected()), this, SLOT(deviceDisconnected()));
+    connect(device, SIGNAL(bytesWritten(qint64)), this, SLOT(flushSendQueue()));
+    if (device->bytesAvailable())
+        readyRead();
+}
+
+void MessageChannel::send(const Message &msg)
+{
+    if (!m_ioThread) {
+        enqueue(msg);
+        return;
+    }
+
+    PostedMessage posted;
+    posted.address = msg.address();
+    posted.type = msg.type();
+    posted.payload = msg.rawPayload();
+    posted.supersedeKey = msg.supersedeKey();
+    post(std::move(posted));
+}
+
+void MessageChannel::sendDeferred(Protocol::ObjectAddress address, Protocol::MessageType type,
+                                  const std::function<void(Message &)> &writePayload)
+{
+    if (!m_ioThread) {
+        Message msg(address, type);
+        writePayload(msg);
+        enqueue(msg);
+        return;
+    }
+
+    PostedMessage posted;
+    posted.address = address;
+    posted.type = type;
+    posted.writePayload = writePayload;
+    post(std::move(posted));
+}
+
+void MessageChannel::post(PostedMessage &&msg)
+{
+    m_postedMessages.push(std::move(msg));
+    // only wake up the I/O thread if it isn't going to look at the queue anyway
+    if (!m_postedMessagesPending.exchange(true))
+        QMetaObject::invokeMethod(this, "processPostedMessages", Qt::QueuedConnection);
+}
+
+void MessageChannel::postCommand(Command command)
+{
+    PostedMessage cmd;
+    cmd.command = command;
+    post(std::move(cmd));
+}
+
+void MessageChannel::processPostedMessages()
+{
+    m_postedMessagesPending.exchange(false);
+
+    PostedMessage posted;
+    while (m_postedMessages.pop(posted)) {
+        switch (posted.command) {
+        case SendMessage:
+            if (posted.writePayload) {
+                Message msg(posted.address, posted.type);
+                posted.writePayload(msg);
+                enqueue(msg);
+            } else {
+                Message msg(posted.address, posted.type, posted.payload);
+                msg.setSupersedeKey(posted.supersedeKey);
+                enqueue(msg);
+            }
+            break;
+        case AttachDevice:
+            attachDevice(posted.device);
+            break;
+        case EnableStreamCompression:
+        case DisableStreamCompression:
+            doSetStreamCompressionEnabled(posted.command == EnableStreamCompression);
+            break;
+        case Flush:
+            flushSendQueue();
+            break;
+        }
+    }
+}
+
+void MessageChannel::enqueue(const Message &msg)
+{
+    m_scheduler->enqueue(msg);
+
+    if (m_scheduler->size() >= maximumSendQueueSize)
+        flushSendQueue();
+    else if (!m_sendQueueTimer->isActive())
+        m_sendQueueTimer->start();
+}
+
+void MessageChannel::flush()
+{
+    if (m_ioThread)
+        postCommand(Flush);
+    else
+        flushSendQueue();
+}
+
+void MessageChannel::flushSendQueue()
+{
+    EndpointThreadTimer timer(this);
+    m_sendQueueTimer->stop();
+    if (!m_device) {
+        m_scheduler->clear();
+        return;
+    }
+
+    // anything above the high-water mark stays in the scheduler, where it can still be
+    // overtaken by more important messages, or be dropped when superseded
+    const qint64 highWaterMark = m_sendHighWaterMark;
+    while (!m_scheduler->isEmpty() && m_device->bytesToWrite() < highWaterMark)
+        writeQueuedMessages(highWaterMark - m_device->bytesToWrite());
+}
+
+void MessageChannel::writeQueuedMessages(qint64 maxSize)
+{
+    if (maxSize <= 0 || m_scheduler->isEmpty())
+        return;
+
+    m_bytesWritten += m_scheduler->dequeue(m_sendQueue, int(qMin<qint64>(maxSize, maximumSendQueueSize)),
+                                           m_compressionStream.get());
+    const int s = m_device->write(m_sendQueue);
+    Q_ASSERT(s == m_sendQueue.size());
+    Q_UNUSED(s);
+    m_sendQueue.resize(0); // keep the capacity for the next batch
+}
+
+void MessageChannel::waitForMessagesWritten()
+{
+    if (m_ioThread)
+        QMetaObject::invokeMethod(this, "doWaitForMessagesWritten", Qt::BlockingQueuedConnection);
+    else
+        doWaitForMessagesWritten();
+}
+
+void MessageChannel::doWaitForMessagesWritten()
+{
+    if (m_ioThread)
+        processPostedMessages();
+
+    m_sendQueueTimer->stop();
+    if (!m_device) {
+        m_scheduler->clear();
+        return;
+    }
+    while (!m_scheduler->isEmpty())
+        writeQueuedMessages(maximumSendQueueSize);
+    m_device->waitForBytesWritten(-1);
+}
+
+void MessageChannel::shutdown()
+{
+    processPostedMessages();
+    flushSendQueue();
+    m_sendQueueTimer->stop();
+    // the device lives on the I/O thread, so it has to be destroyed there
+    delete m_device.data();
+}
+
+qint64 MessageChannel::sendHighWaterMark() const
+{
+    return m_sendHighWaterMark;
+}
+
+void MessageChannel::setSendHighWaterMark(qint64 size)
+{
+    m_sendHighWaterMark = size;
+}
+
+void MessageChannel::setStreamCompressionEnabled(bool enabled)
+{
+    if (m_ioThread)
+        postCommand(enabled ? EnableStreamCompression : DisableStreamCompression);
+    else
+        doSetStreamCompressionEnabled(enabled);
+}
+
+void MessageChannel::doSetStreamCompressionEnabled(bool enabled)
+{
+    if (enabled && !m_compressionStream)
+        m_compressionStream.reset(new CompressionStream);
+    else if (!enabled)
+        m_compressionStream.reset();
+}
+
+quint64 MessageChannel::takeBytesRead()
+{
+    return m_bytesRead.exchange(0);
+}
+
+quint64 MessageChannel::takeBytesWritten()
+{
+    return m_bytesWritten.exchange(0);
+}
+
+quint64 MessageChannel::takeEndpointThreadTime()
+{
+    return m_endpointThreadTime.exchange(0);
+}
+
+void MessageChannel::readyRead()
+{
+    EndpointThreadTimer timer(this);
+    m_parser.readFrom(m_device.data());
+
+    bool received = false;
+    while (m_parser.hasMessage()) {
+        auto msg = m_parser.takeMessage(m_decompressionStream.get());
+        m_bytesRead += msg.size();
+        if (msg.address() == m_endpointAddress
+            && (msg.type() == Protocol::ClientDataVersionNegotiated
+                || msg.type() == Protocol::ServerDataVersionNegotiated))
+            applyNegotiation(msg);
+        if (!m_ioThread) {
+            emit messageReceived(msg);
+            continue;
+        }
+
+        // the payload might still refer to the receive buffer, so hand over the message as a whole
+        m_receivedMessages.push(std::unique_ptr<Message>(new Message(std::move(msg))));
+        received = true;
+    }
+
+    if (received && !m_receivedMessagesPending.exchange(true))
+        emit messagesReceived();
+}
+
+void MessageChannel::applyNegotiation(const Message &msg)
+{
+    // what follows might be parsed before the endpoint sees this, so this can't wait for it
+    Message copy(msg.address(), msg.type(), msg.rawPayload());
+    quint8 version;
+    bool streamCompression;
+    bool compactModelIndexes;
+    copy >> version >> streamCompression >> compactModelIndexes;
+    m_parser.setNegotiatedDataVersion(version);
+    m_parser.setCompactModelIndexesEnabled(compactModelIndexes);
+}
+
+void MessageChannel::dispatchReceivedMessages()
+{
+    EndpointThreadTimer timer(this);
+    m_receivedMessagesPending.exchange(false);
+
+    std::unique_ptr<Message> msg;
+    while (m_receivedMessages.pop(msg))
+        emit messageReceived(*msg);
+}
+
+void MessageChannel::deviceDisconnected()
+{
+    m_sendQueueTimer->stop();
+    m_scheduler->clear();
+    m_compressionStream.reset();
+    disconnect(m_device.data(), SIGNAL(readyRead()), this, SLOT(readyRead()));
+    disconnect(m_device.data(), SIGNAL(disconnected()), this, SLOT(deviceDisconnected()));
+    disconnect(m_device.data(), SIGNAL(bytesWritten(qint64)), this, SLOT(flushSendQueue()));
+    m_device = nullptr;
+    emit disconnected();
+}
@@ -0,0 +1,202 @@
+/*
+  messagechannel.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_MESSAGECHANNEL_H
+#define GAMMARAY_MESSAGECHANNEL_H
+
+#include "gammaray_common_export.h"
+#include "lockfreequeue.h"
+#include "message.h"
+#include "protocol.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QThread;
+class QTimer;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+class CompressionStream;
+class DecompressionStream;
+class MessageScheduler;
+
+/**
+ * Device I/O of an Endpoint: scheduling outgoing messages, streaming (de)compression,
+ * framing, and reading from/writing to the device.
+ *
+ * By default this all happens on the thread of the endpoint. With a dedicated I/O thread,
+ * messages are handed over in both directions via lock-free queues, and the device lives
+ * on the I/O thread. The endpoint thread then only pays for building the messages.
+ */
+class GAMMARAY_COMMON_EXPORT MessageChannel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MessageChannel(Protocol::ObjectAddress endpointAddress);
+    ~MessageChannel();
+
+    /** Move all device I/O to a dedicated thread. Must be called before setDevice(), and cannot be undone. */
+    void enableIoThread();
+    bool isIoThreadEnabled() const;
+
+    /** Start communicating via @p device, takes ownership of @p device. */
+    void setDevice(QIODevice *device);
+
+    /** Queue @p msg for sending. */
+    void send(const Message &msg);
+    /**
+     * Queue a message to @p address of type @p type, whose payload is written by @p writePayload.
+     * With an I/O thread, @p writePayload is called on that, so it must only capture data that is
+     * safe to serialize there.
+     */
+    void sendDeferred(Protocol::ObjectAddress address, Protocol::MessageType type,
+                      const std::function<void(Message &)> &writePayload);
+
+    /** Write all queued messages and block until this is done. */
+    void waitForMessagesWritten();
+    /** Write messages queued so far, up to the send high-water mark. */
+    void flush();
+
+    qint64 sendHighWaterMark() const;
+    void setSendHighWaterMark(qint64 size);
+
+    void setStreamCompressionEnabled(bool enabled);
+
+    /** Returns the amount of payload data read/written since the last call. */
+    quint64 takeBytesRead();
+    quint64 takeBytesWritten();
+    /** Returns the time spent on the endpoint thread for sending and receiving since the last call, in nanoseconds. */
+    quint64 takeEndpointThreadTime();
+
+    /** Accounts the lifetime of this object to the time spent on the endpoint thread. */
+    class EndpointThreadTimer
+    {
+    public:
+        explicit EndpointThreadTimer(MessageChannel *channel);
+        ~EndpointThreadTimer();
+
+    private:
+        Q_DISABLE_COPY(EndpointThreadTimer)
+        MessageChannel *m_channel;
+        QElapsedTimer m_timer;
+        bool m_active;
+    };
+
+    /** Dispatch messages received on the I/O thread, call on the endpoint thread. */
+    void dispatchReceivedMessages();
+
+signals:
+    /** Emitted on the endpoint thread for every received message. */
+    void messageReceived(const GammaRay::Message &msg);
+    /** Emitted when the device got disconnected, with an I/O thread this is emitted there. */
+    void disconnected();
+    /** Emitted on the I/O thread when there are received messages to dispatch. */
+    void messagesReceived();
+
+private slots:
+    void readyRead();
+    void deviceDisconnected();
+    void flushSendQueue();
+    void processPostedMessages();
+    void doWaitForMessagesWritten();
+    void shutdown();
+
+private:
+    // commands for the I/O thread, executed in order
+    enum Command {
+        SendMessage,
+        AttachDevice,
+        EnableStreamCompression,
+        DisableStreamCompression,
+        Flush
+    };
+
+    struct PostedMessage
+    {
+        PostedMessage()
+            : device(nullptr)
+            , command(SendMessage)
+            , address(Protocol::InvalidObjectAddress)
+            , type(Protocol::InvalidMessageType) {}
+
+        QByteArray payload;
+        QByteArray supersedeKey;
+        std::function<void(Message &)> writePayload;
+        QIODevice *device;
+        Command command;
+        Protocol::ObjectAddress address;
+        Protocol::MessageType type;
+    };
+
+    void post(PostedMessage &&msg);
+    void postCommand(Command command);
+    void attachDevice(QIODevice *device);
+    void doSetStreamCompressionEnabled(bool enabled);
+    void enqueue(const Message &msg);
+    /** Applies the encoding the other side negotiated with @p msg to the messages it sends after it. */
+    void applyNegotiation(const Message &msg);
+    /** Writes up to @p maxSize bytes of scheduled messages to the device. */
+    void writeQueuedMessages(qint64 maxSize);
+
+    QThread *m_endpointThread;
+    QThread *m_ioThread;
+    Protocol::ObjectAddress m_endpointAddress;
+    int m_timingDepth;
+
+    // only touched on the I/O thread (or the endpoint thread without one)
+    QPointer<QIODevice> m_device;
+    QByteArray m_sendQueue;
+    QTimer *m_sendQueueTimer;
+    std::unique_ptr<MessageScheduler> m_scheduler;
+    std::unique_ptr<CompressionStream> m_compressionStream;
+    std::unique_ptr<DecompressionStream> m_decompressionStream;
+    MessageParser m_parser;
+
+    // hand-over between endpoint and I/O thread
+    LockFreeQueue<PostedMessage> m_postedMessages;
+    LockFreeQueue<std::unique_ptr<Message> > m_receivedMessages;
+    std::atomic<bool> m_postedMessagesPending;
+    std::atomic<bool> m_receivedMessagesPending;
+
+    std::atomic<qint64> m_sendHighWaterMark;
+    std::atomic<quint64> m_bytesRead;
+    std::atomic<quint64> m_bytesWritten;
+    std::atomic<quint64> m_endpointThreadTime;
+};
+}
+
+#endif // GAMMARAY_MESSAGECHANNEL_H
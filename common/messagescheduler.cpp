@@ -0,0 +1,206 @@
+/*
+  messagescheduler.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "messagescheduler.h"
+#include "message.h"
+
+#include <limits>
+
+using namespace GammaRay;
+
+// messages larger than this (e.g. remote view frames) are treated as bulk data
+static const int largeMessageSize = 64 * 1024;
+
+MessageScheduler::Priority MessageScheduler::AddressQueue::effectivePriority() const
+{
+    // a queue inherits the highest priority of its messages, as we can't reorder within a queue
+    return priorityCount[HighPriority] > 0 ? HighPriority : LowPriority;
+}
+
+MessageScheduler::MessageScheduler(Protocol::ObjectAddress endpointAddress)
+    : m_endpointAddress(endpointAddress)
+    , m_nextSequence(0)
+    , m_count(0)
+    , m_size(0)
+{
+}
+
+MessageScheduler::~MessageScheduler()
+{
+}
+
+MessageScheduler::Priority MessageScheduler::priority(const Message &msg)
+{
+    switch (msg.type()) {
+    case Protocol::ModelRowColumnCountReply:
+    case Protocol::ModelContentReply:
+    case Protocol::ModelContentPush:
+    case Protocol::ModelLazyDataReply:
+    case Protocol::ModelContentHashReply:
+    case Protocol::ModelHeaderReply:
+        return HighPriority;
+    case Protocol::ModelContentChanged:
+    case Protocol::ModelHeaderChanged:
+    case Protocol::PropertyValuesChanged:
+        return LowPriority;
+    default:
+        break;
+    }
+
+    return msg.size() > largeMessageSize ? LowPriority : NormalPriority;
+}
+
+void MessageScheduler::enqueue(const Message &msg)
+{
+    PendingMessage pending;
+    pending.payload = msg.rawPayload();
+    pending.sequence = m_nextSequence++;
+    pending.address = msg.address();
+    pending.type = msg.type();
+    pending.priority = msg.address() == m_endpointAddress ? NormalPriority : priority(msg);
+    ++m_count;
+    m_size += pending.payload.size();
+
+    if (pending.priority == NormalPriority) {
+        m_ordered.enqueue(pending);
+        return;
+    }
+
+    auto &queue = m_queues[msg.address()];
+    unschedule(queue);
+    if (!msg.supersedeKey().isEmpty())
+        dropSuperseded(queue, msg);
+    pending.supersedeKey = msg.supersedeKey();
+    ++queue.priorityCount[pending.priority];
+    queue.messages.enqueue(pending);
+    schedule(msg.address(), queue);
+}
+
+void MessageScheduler::dropSuperseded(AddressQueue &queue, const Message &msg)
+{
+    // only look past messages of the same type, anything else might depend on the older message
+    for (int i = queue.messages.size() - 1; i >= 0; --i) {
+        const auto &pending = queue.messages.at(i);
+        if (pending.type != msg.type())
+            return;
+        if (pending.supersedeKey != msg.supersedeKey())
+            continue;
+
+        --queue.priorityCount[pending.priority];
+        --m_count;
+        m_size -= pending.payload.size();
+        queue.messages.removeAt(i);
+        return; // there can't be more than one, we drop on every insertion
+    }
+}
+
+void MessageScheduler::schedule(Protocol::ObjectAddress address, AddressQueue &queue)
+{
+    Q_ASSERT(!queue.scheduled);
+    if (queue.messages.isEmpty())
+        return;
+    queue.readyPriority = queue.effectivePriority();
+    queue.readySequence = queue.messages.head().sequence;
+    queue.scheduled = true;
+    m_ready[queue.readyPriority].insert(queue.readySequence, address);
+}
+
+void MessageScheduler::unschedule(AddressQueue &queue)
+{
+    if (!queue.scheduled)
+        return;
+    m_ready[queue.readyPriority].remove(queue.readySequence);
+    queue.scheduled = false;
+}
+
+int MessageScheduler::dequeue(QByteArray &buffer, int maxSize, CompressionStream *stream)
+{
+    int payloadSize = 0;
+    while (m_count > 0) {
+        // normal priority messages act as barrier
+        quint64 barrier = std::numeric_limits<quint64>::max();
+        if (!m_ordered.isEmpty())
+            barrier = m_ordered.head().sequence;
+
+        // the oldest address queue of the highest priority that isn't held back by the barrier,
+        // the barrier itself otherwise
+        auto next = m_queues.end();
+        for (int i = PriorityCount - 1; i >= 0; --i) {
+            if (m_ready[i].isEmpty() || m_ready[i].constBegin().key() > barrier)
+                continue;
+            next = m_queues.find(m_ready[i].constBegin().value());
+            break;
+        }
+
+        PendingMessage pending;
+        if (next == m_queues.end()) {
+            Q_ASSERT(!m_ordered.isEmpty());
+            pending = m_ordered.dequeue();
+        } else {
+            auto &queue = next.value();
+            Q_ASSERT(!queue.messages.isEmpty());
+            unschedule(queue);
+            pending = queue.messages.dequeue();
+            --queue.priorityCount[pending.priority];
+            if (queue.messages.isEmpty())
+                m_queues.erase(next);
+            else
+                schedule(pending.address, queue);
+        }
+        --m_count;
+        m_size -= pending.payload.size();
+
+        Message msg(pending.address, pending.type, pending.payload);
+        msg.appendTo(buffer, stream);
+        payloadSize += pending.payload.size();
+
+        if (buffer.size() >= maxSize)
+            break;
+    }
+    return payloadSize;
+}
+
+bool MessageScheduler::isEmpty() const
+{
+    return m_count == 0;
+}
+
+int MessageScheduler::size() const
+{
+    return m_size;
+}
+
+void MessageScheduler::clear()
+{
+    m_ordered.clear();
+    m_queues.clear();
+    for (int i = 0; i < PriorityCount; ++i)
+        m_ready[i].clear();
+    m_count = 0;
+    m_size = 0;
+}
@@ -0,0 +1,130 @@
+/*
+  messagescheduler.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_MESSAGESCHEDULER_H
+#define GAMMARAY_MESSAGESCHEDULER_H
+
+#include "gammaray_common_export.h"
+#include "protocol.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QQueue>
+
+namespace GammaRay {
+class CompressionStream;
+class Message;
+
+/**
+ * Queue of outgoing messages, sitting between Endpoint and the device.
+ *
+ * Messages of normal priority (structural changes, state changes, messages to the endpoint itself)
+ * are sent in the order they were queued, across all addresses, and act as a barrier: they are sent
+ * after everything queued before them, and before everything queued after them.
+ * Only the replies and bulk data queued in between are reordered against each other, replies first,
+ * while messages to the same address are never reordered.
+ *
+ * Queued replies and bulk data made obsolete by a newer one (see Message::setSupersedeKey()) are dropped.
+ */
+class GAMMARAY_COMMON_EXPORT MessageScheduler
+{
+public:
+    enum Priority {
+        LowPriority, ///< bulk data and change notifications
+        NormalPriority,
+        HighPriority, ///< replies to interactive requests
+        PriorityCount
+    };
+
+    explicit MessageScheduler(Protocol::ObjectAddress endpointAddress);
+    ~MessageScheduler();
+
+    static Priority priority(const Message &msg);
+
+    void enqueue(const Message &msg);
+    /** Appends queued messages to @p buffer in scheduling order, until it reaches @p maxSize.
+     *  At least one message is appended, if there is any.
+     *  @return the uncompressed payload size of the appended messages.
+     */
+    int dequeue(QByteArray &buffer, int maxSize, CompressionStream *stream);
+
+    bool isEmpty() const;
+    /** Uncompressed payload size of all queued messages. */
+    int size() const;
+    void clear();
+
+private:
+    struct PendingMessage
+    {
+        QByteArray payload;
+        QByteArray supersedeKey;
+        quint64 sequence;
+        Protocol::ObjectAddress address;
+        Protocol::MessageType type;
+        Priority priority;
+    };
+
+    /** Replies and bulk data to one address. */
+    struct AddressQueue
+    {
+        AddressQueue()
+            : readySequence(0)
+            , readyPriority(LowPriority)
+            , scheduled(false)
+        {
+            for (int i = 0; i < PriorityCount; ++i)
+                priorityCount[i] = 0;
+        }
+
+        Priority effectivePriority() const;
+
+        QQueue<PendingMessage> messages;
+        int priorityCount[PriorityCount];
+        // key under which this queue is listed in m_ready, if scheduled
+        quint64 readySequence;
+        Priority readyPriority;
+        bool scheduled;
+    };
+
+    void dropSuperseded(AddressQueue &queue, const Message &msg);
+    void schedule(Protocol::ObjectAddress address, AddressQueue &queue);
+    void unschedule(AddressQueue &queue);
+
+    QQueue<PendingMessage> m_ordered; // normal priority messages
+    QHash<Protocol::ObjectAddress, AddressQueue> m_queues;
+    // non-empty address queues by effective priority and sequence of their head
+    QMap<quint64, Protocol::ObjectAddress> m_ready[PriorityCount];
+    Protocol::ObjectAddress m_endpointAddress;
+    quint64 m_nextSequence;
+    int m_count;
+    int m_size;
+};
+}
+
+#endif // GAMMARAY_MESSAGESCHEDULER_H
@@ -0,0 +1,231 @@
+/*
+  modelindexcodec.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modelindexcodec.h"
+#include "message.h"
+
+using namespace GammaRay;
+
+// Compact format of a single index, relative to the previous one:
+// - varint number of leading levels identical to the previous index
+// - varint number of levels following
+// - per following level: varint row, varint column
+//   the row of the first following level is zigzag encoded relative to the
+//   row of the previous index on that level, if that exists
+// Lists are a varint size, followed by indexes each with a varint count of
+// subsequent columns in the same row.
+// Row runs are a varint count, followed by the varint distance of the old row to the
+// end of the previous run, the zigzag encoded distance of the new row to the old one,
+// and the varint length.
+
+static quint32 zigzagEncode(qint32 value)
+{
+    return (static_cast<quint32>(value) << 1) ^ static_cast<quint32>(value >> 31);
+}
+
+static qint32 zigzagDecode(quint32 value)
+{
+    return static_cast<qint32>(value >> 1) ^ -static_cast<qint32>(value & 1);
+}
+
+static bool isNextColumn(const Protocol::ModelIndex &index, const Protocol::ModelIndex &other)
+{
+    if (index.size() != other.size() || index.isEmpty())
+        return false;
+    const int last = index.size() - 1;
+    for (int i = 0; i < last; ++i) {
+        if (index.at(i).row != other.at(i).row || index.at(i).column != other.at(i).column)
+            return false;
+    }
+    return index.at(last).row == other.at(last).row
+           && index.at(last).column + 1 == other.at(last).column;
+}
+
+ModelIndexWriter::ModelIndexWriter(Message &msg)
+    : m_msg(msg)
+    , m_compact(msg.hasCompactModelIndexes())
+{
+}
+
+void ModelIndexWriter::write(const Protocol::ModelIndex &index)
+{
+    if (!m_compact) {
+        m_msg << index;
+        return;
+    }
+
+    int shared = 0;
+    const int maxShared = qMin(index.size(), m_previous.size());
+    while (shared < maxShared && index.at(shared).row == m_previous.at(shared).row
+           && index.at(shared).column == m_previous.at(shared).column)
+        ++shared;
+
+    writeVarint(shared);
+    writeVarint(index.size() - shared);
+    for (int i = shared; i < index.size(); ++i) {
+        if (i == shared && i < m_previous.size())
+            writeVarint(zigzagEncode(index.at(i).row - m_previous.at(i).row));
+        else
+            writeVarint(index.at(i).row);
+        writeVarint(index.at(i).column);
+    }
+    m_previous = index;
+}
+
+void ModelIndexWriter::writeList(const QVector<Protocol::ModelIndex> &indexes)
+{
+    if (!m_compact) {
+        m_msg << quint32(indexes.size());
+        for (const auto &index : indexes)
+            m_msg << index;
+        return;
+    }
+
+    writeVarint(indexes.size());
+    for (int i = 0; i < indexes.size();) {
+        const auto &index = indexes.at(i);
+        write(index);
+        int columns = 0;
+        while (i + columns + 1 < indexes.size() && isNextColumn(indexes.at(i + columns), indexes.at(i + columns + 1)))
+            ++columns;
+        writeVarint(columns);
+        i += columns + 1;
+    }
+}
+
+void ModelIndexWriter::writeRowRuns(const QVector<qint32> &runs)
+{
+    Q_ASSERT(runs.size() % 3 == 0);
+    writeVarint(runs.size() / 3);
+    qint32 previousEnd = 0;
+    for (int i = 0; i + 2 < runs.size(); i += 3) {
+        Q_ASSERT(runs.at(i) >= previousEnd);
+        writeVarint(runs.at(i) - previousEnd);
+        writeVarint(zigzagEncode(runs.at(i + 1) - runs.at(i)));
+        writeVarint(runs.at(i + 2));
+        previousEnd = runs.at(i) + runs.at(i + 2);
+    }
+}
+
+void ModelIndexWriter::writeVarint(quint32 value)
+{
+    while (value >= 0x80) {
+        m_msg << quint8(value | 0x80);
+        value >>= 7;
+    }
+    m_msg << quint8(value);
+}
+
+ModelIndexReader::ModelIndexReader(const Message &msg)
+    : m_msg(msg)
+    , m_compact(msg.hasCompactModelIndexes())
+{
+}
+
+Protocol::ModelIndex ModelIndexReader::read()
+{
+    Protocol::ModelIndex index;
+    if (!m_compact) {
+        m_msg >> index;
+        return index;
+    }
+
+    const int shared = qMin<int>(readVarint(), m_previous.size());
+    const int levels = readVarint();
+    index.reserve(shared + levels);
+    for (int i = 0; i < shared; ++i)
+        index.push_back(m_previous.at(i));
+    for (int i = shared; i < shared + levels; ++i) {
+        Protocol::ModelIndexData data;
+        if (i == shared && i < m_previous.size())
+            data.row = m_previous.at(i).row + zigzagDecode(readVarint());
+        else
+            data.row = readVarint();
+        data.column = readVarint();
+        index.push_back(data);
+    }
+    m_previous = index;
+    return index;
+}
+
+QVector<Protocol::ModelIndex> ModelIndexReader::readList()
+{
+    QVector<Protocol::ModelIndex> indexes;
+    if (!m_compact) {
+        quint32 size;
+        m_msg >> size;
+        indexes.reserve(size);
+        for (quint32 i = 0; i < size; ++i)
+            indexes.push_back(read());
+        return indexes;
+    }
+
+    const int size = readVarint();
+    indexes.reserve(size);
+    while (indexes.size() < size) {
+        auto index = read();
+        int columns = qMin<int>(readVarint(), size - indexes.size() - 1);
+        if (index.isEmpty())
+            columns = 0;
+        indexes.push_back(index);
+        for (int i = 0; i < columns; ++i) {
+            ++index.last().column;
+            indexes.push_back(index);
+        }
+    }
+    return indexes;
+}
+
+QVector<qint32> ModelIndexReader::readRowRuns()
+{
+    const quint32 count = readVarint();
+    QVector<qint32> runs;
+    runs.reserve(qMin<quint32>(count, 1024) * 3);
+    qint32 previousEnd = 0;
+    for (quint32 i = 0; i < count; ++i) {
+        const qint32 oldRow = previousEnd + readVarint();
+        const qint32 newRow = oldRow + zigzagDecode(readVarint());
+        const qint32 length = readVarint();
+        runs << oldRow << newRow << length;
+        previousEnd = oldRow + length;
+    }
+    return runs;
+}
+
+quint32 ModelIndexReader::readVarint()
+{
+    quint32 value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        quint8 byte = 0;
+        m_msg >> byte;
+        value |= static_cast<quint32>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}
@@ -0,0 +1,88 @@
+/*
+  modelindexcodec.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_MODELINDEXCODEC_H
+#define GAMMARAY_MODELINDEXCODEC_H
+
+#include "gammaray_common_export.h"
+#include "protocol.h"
+
+namespace GammaRay {
+class Message;
+
+/**
+ * Writes a sequence of model indexes into a message.
+ *
+ * If negotiated (see Message::hasCompactModelIndexes()), indexes are encoded as
+ * LEB128 varints relative to the previously written index, so that siblings of a deep
+ * index only cost a few bytes. Lists additionally collapse consecutive columns of the
+ * same row into a range. Otherwise the plain QDataStream representation is used.
+ *
+ * Use one writer per message, and read it with a ModelIndexReader in the same order.
+ */
+class GAMMARAY_COMMON_EXPORT ModelIndexWriter
+{
+public:
+    explicit ModelIndexWriter(Message &msg);
+
+    void write(const Protocol::ModelIndex &index);
+    /** Writes the size of @p indexes followed by its content. */
+    void writeList(const QVector<Protocol::ModelIndex> &indexes);
+    /** Writes (old first row, new first row, length) triples of moved rows, ordered by old row.
+     *  These are always encoded compactly, independent of the negotiated index format.
+     */
+    void writeRowRuns(const QVector<qint32> &runs);
+
+private:
+    void writeVarint(quint32 value);
+
+    Message &m_msg;
+    Protocol::ModelIndex m_previous;
+    bool m_compact;
+};
+
+/** Reads model indexes written by ModelIndexWriter. */
+class GAMMARAY_COMMON_EXPORT ModelIndexReader
+{
+public:
+    explicit ModelIndexReader(const Message &msg);
+
+    Protocol::ModelIndex read();
+    QVector<Protocol::ModelIndex> readList();
+    QVector<qint32> readRowRuns();
+
+private:
+    quint32 readVarint();
+
+    const Message &m_msg;
+    Protocol::ModelIndex m_previous;
+    bool m_compact;
+};
+}
+
+#endif // GAMMARAY_MODELINDEXCODEC_H
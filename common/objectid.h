@@ -43,7 +43,12 @@ namespace GammaRay {
 /** @brief Type-safe and cross-process object identifier vector. */
 typedef QVector<class ObjectId> ObjectIds;
 
-/** @brief Type-safe and cross-process object identifier. */
+/** @brief Type-safe and cross-process object identifier.
+ *
+ *  QObject identifiers can carry the generation the probe tracks the object with, to tell
+ *  apart different objects that got allocated at the same address over time.
+ *  The generation is not taken into account when comparing identifiers.
+ */
 class ObjectId
 {
 public:
@@ -56,20 +61,25 @@ public:
 
     explicit ObjectId(void *obj, const QByteArray &typeName)
         : m_type(VoidStarType)
+        , m_generation(0)
         , m_id(reinterpret_cast<quint64>(obj))
         , m_typeName(typeName)
     {}
-    explicit ObjectId(QObject *obj)
+    explicit ObjectId(QObject *obj, quint32 generation = 0)
         : m_type(QObjectType)
+        , m_generation(generation)
         , m_id(reinterpret_cast<quint64>(obj))
     {}
     explicit ObjectId()
         : m_type(Invalid)
+        , m_generation(0)
         , m_id(0)
     {}
     inline bool isNull() const { return m_id == 0; }
     inline quint64 id() const { return m_id; }
     inline Type type() const { return m_type; }
+    /** Tracking generation of the object, 0 if unknown. */
+    inline quint32 generation() const { return m_generation; }
     inline QByteArray typeName() const { return m_typeName; }
 
     inline QObject *asQObject() const
@@ -97,13 +107,15 @@ private:
     friend QDataStream &operator>>(QDataStream &out, ObjectId &id);
 
     Type m_type;
+    quint32 m_generation;
     quint64 m_id;
     QByteArray m_typeName;
 };
 
 inline QDebug &operator<<(QDebug dbg, const ObjectId &id)
 {
-    dbg.nospace() << "ObjectId(" << id.type() << ", " << id.id() << ", " << id.typeName() << ")";
+    dbg.nospace() << "ObjectId(" << id.type() << ", " << id.id() << ", " << id.generation() << ", "
+                  << id.typeName() << ")";
     return dbg.space();
 }
 
@@ -118,6 +130,7 @@ inline QDataStream &operator<<(QDataStream &out, const ObjectId &id)
 {
     out << static_cast<quint8>(id.m_type);
     out << id.m_id;
+    out << id.m_generation;
     out << id.m_typeName;
     return out;
 }
@@ -128,6 +141,7 @@ inline QDataStream &operator>>(QDataStream &in, ObjectId &id)
     in >> u;
     id.m_type = static_cast<ObjectId::Type>(u);
     in >> id.m_id;
+    in >> id.m_generation;
     in >> id.m_typeName;
     return in;
 }
@@ -0,0 +1,65 @@
+/*
+  objectsearchinterface.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_OBJECTSEARCHINTERFACE_H
+#define GAMMARAY_OBJECTSEARCHINTERFACE_H
+
+#include "objectid.h"
+
+#include <QObject>
+
+namespace GammaRay {
+/** @brief Probe-side search for objects by name, class name or address. */
+class ObjectSearchInterface : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ObjectSearchInterface(QObject *parent = nullptr);
+    virtual ~ObjectSearchInterface();
+
+public slots:
+    /** Searches for objects whose name or class name (including base classes) contains @p text,
+     *  or whose address is @p text. Results are delivered via searchResults().
+     *  @p maxResults limits the number of returned objects, -1 means no limit.
+     */
+    virtual void search(const QString &text, int maxResults) = 0;
+
+Q_SIGNALS:
+    void searchResults(const QString &text, const GammaRay::ObjectIds &objects);
+
+private:
+    Q_DISABLE_COPY(ObjectSearchInterface)
+};
+}
+
+QT_BEGIN_NAMESPACE
+Q_DECLARE_INTERFACE(GammaRay::ObjectSearchInterface, "com.kdab.GammaRay.ObjectSearchInterface")
+QT_END_NAMESPACE
+
+#endif // GAMMARAY_OBJECTSEARCHINTERFACE_H
@@ -211,6 +211,8 @@ void PropertySyncer::propertyChanged()
     msg << (*it).addr << (quint32)changes.size();
     foreach (const auto &change, changes)
         msg << change.first << change.second;
+    // a newer change of the same properties makes a not yet sent one obsolete
+    msg.setSupersedeKey(QByteArray::number((*it).addr) + ':' + QByteArray::number(sigIndex));
     emit message(msg);
 }
 
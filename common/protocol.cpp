@@ -28,6 +28,10 @@
 
 #include "protocol.h"
 
+#include <QtEndian>
+
+#include <cstring>
+
 namespace GammaRay {
 namespace Protocol {
 Protocol::ModelIndex fromQModelIndex(const QModelIndex &index)
@@ -52,9 +56,25 @@ QModelIndex toQModelIndex(const QAbstractItemModel *model, const Protocol::Model
     return qmi;
 }
 
+quint64 contentHash(const char *data, int size)
+{
+    // multiply-xorshift over 8 byte words, the same on either byte order
+    static const quint64 multiplier = Q_UINT64_C(0x9e3779b97f4a7c15);
+    quint64 hash = quint64(size) * multiplier;
+    int pos = 0;
+    for (; pos + 8 <= size; pos += 8) {
+        hash = (hash ^ qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(data + pos))) * multiplier;
+        hash ^= hash >> 32;
+    }
+    uchar tail[8] = { 0 };
+    memcpy(tail, data + pos, size - pos);
+    hash = (hash ^ qFromLittleEndian<quint64>(tail)) * multiplier;
+    return hash ^ (hash >> 29);
+}
+
 qint32 version()
 {
-    return 36;
+    return 46;
 }
 
 qint32 broadcastFormatVersion()
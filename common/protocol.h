@@ -74,10 +74,17 @@ enum BuildInMessageType {
     ModelSortRequest,
     ModelSyncBarrier,
     SelectionModelStateRequest,
+    ModelViewportRequest,
+    ModelRoleSelectionRequest,
+    ModelLazyDataRequest,
+    ModelContentHashRequest,
 
     // server -> client
     ModelRowColumnCountReply,
     ModelContentReply,
+    ModelContentPush,
+    ModelLazyDataReply,
+    ModelContentHashReply,
     ModelContentChanged,
     ModelHeaderReply,
     ModelHeaderChanged,
@@ -95,6 +102,7 @@ enum BuildInMessageType {
     SelectionModelCurrent,
 
     MethodCall,
+    MethodDefinition,
     PropertySyncRequest,
     PropertyValuesChanged,
 
@@ -114,11 +122,25 @@ public:
     explicit ModelIndexData(qint32 row_ = 0, qint32 column_ = 0)
         : row(row_), column(column_) {}
 
+    bool operator==(const ModelIndexData &other) const
+    {
+        return row == other.row && column == other.column;
+    }
+    bool operator!=(const ModelIndexData &other) const { return !(*this == other); }
+
     qint32 row;
     qint32 column;
 };
 typedef QVector<ModelIndexData> ModelIndex;
 
+inline uint qHash(const ModelIndex &index, uint seed = 0)
+{
+    uint hash = seed;
+    for (auto it = index.constBegin(); it != index.constEnd(); ++it)
+        hash = (hash * 31 + uint(it->row)) * 31 + uint(it->column);
+    return hash;
+}
+
 /** @brief Protocol representation of an QItemSelectionRange. */
 struct ItemSelectionRange {
     ModelIndex topLeft;
@@ -133,6 +155,11 @@ GAMMARAY_COMMON_EXPORT ModelIndex fromQModelIndex(const QModelIndex &index);
 GAMMARAY_COMMON_EXPORT QModelIndex toQModelIndex(const QAbstractItemModel *model,
                                                  const ModelIndex &index);
 
+/** Cheap, non-cryptographic 64 bit hash of @p size bytes at @p data.
+ *  Used to identify model cell content by its serialized form on both ends.
+ */
+GAMMARAY_COMMON_EXPORT quint64 contentHash(const char *data, int size);
+
 /** Protocol version, must match exactly between client and server. */
 GAMMARAY_COMMON_EXPORT qint32 version();
 
@@ -0,0 +1,184 @@
+/*
+  sessionrecording.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sessionrecording.h"
+#include "message.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+using namespace GammaRay;
+
+static const char magic[] = { 'G', 'R', 'S', 'R' };
+static const quint32 formatVersion = 1;
+static const int fileHeaderSize = sizeof(magic) + sizeof(quint32) + sizeof(qint32) + sizeof(quint8);
+static const int entryHeaderSize = sizeof(quint64) + sizeof(quint8);
+static const int messageHeaderSize = sizeof(Protocol::PayloadSize) + sizeof(Protocol::ObjectAddress)
+                                     + sizeof(Protocol::MessageType);
+
+template<typename T> static char *writeNumber(char *dst, T value)
+{
+    value = qToBigEndian(value);
+    memcpy(dst, &value, sizeof(T));
+    return dst + sizeof(T);
+}
+
+template<typename T> static T readNumber(const char *src)
+{
+    T value;
+    memcpy(&value, src, sizeof(T));
+    return qFromBigEndian(value);
+}
+
+SessionRecordingWriter::SessionRecordingWriter(bool isClient)
+    : m_isClient(isClient)
+{
+}
+
+SessionRecordingWriter::~SessionRecordingWriter()
+{
+}
+
+bool SessionRecordingWriter::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    char header[fileHeaderSize];
+    memcpy(header, magic, sizeof(magic));
+    char *p = writeNumber(header + sizeof(magic), formatVersion);
+    p = writeNumber(p, Protocol::version());
+    writeNumber<quint8>(p, m_isClient ? 1 : 0);
+    m_file.write(header, fileHeaderSize);
+
+    m_timer.start();
+    return true;
+}
+
+QString SessionRecordingWriter::errorString() const
+{
+    return m_file.errorString();
+}
+
+void SessionRecordingWriter::record(SessionRecording::Direction direction, const Message &msg)
+{
+    if (!m_file.isOpen())
+        return;
+
+    char header[entryHeaderSize];
+    writeNumber<quint8>(writeNumber<quint64>(header, m_timer.nsecsElapsed()), direction);
+    m_file.write(header, entryHeaderSize);
+    msg.write(&m_file);
+}
+
+SessionRecordingReader::SessionRecordingReader()
+    : m_begin(nullptr)
+    , m_end(nullptr)
+    , m_pos(nullptr)
+    , m_protocolVersion(0)
+    , m_isClient(false)
+{
+}
+
+SessionRecordingReader::~SessionRecordingReader()
+{
+}
+
+bool SessionRecordingReader::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    const uchar *mapped = size > 0 ? m_file.map(0, size) : nullptr;
+    if (mapped) {
+        m_begin = reinterpret_cast<const char *>(mapped);
+    } else {
+        m_data = m_file.readAll();
+        m_begin = m_data.constData();
+    }
+    m_end = m_begin + size;
+
+    if (size < fileHeaderSize || memcmp(m_begin, magic, sizeof(magic)) != 0) {
+        m_errorString = QStringLiteral("Not a GammaRay session recording.");
+        return false;
+    }
+    if (readNumber<quint32>(m_begin + sizeof(magic)) != formatVersion) {
+        m_errorString = QStringLiteral("Unsupported session recording format version.");
+        return false;
+    }
+    m_protocolVersion = readNumber<qint32>(m_begin + sizeof(magic) + sizeof(quint32));
+    m_isClient = readNumber<quint8>(m_begin + sizeof(magic) + sizeof(quint32) + sizeof(qint32));
+
+    rewind();
+    return true;
+}
+
+QString SessionRecordingReader::errorString() const
+{
+    return m_errorString;
+}
+
+bool SessionRecordingReader::isClientRecording() const
+{
+    return m_isClient;
+}
+
+qint32 SessionRecordingReader::protocolVersion() const
+{
+    return m_protocolVersion;
+}
+
+bool SessionRecordingReader::readNext(Entry &entry)
+{
+    // a recording that got cut off ends with the last complete entry
+    if (!m_pos || m_end - m_pos < entryHeaderSize + messageHeaderSize)
+        return false;
+
+    const char *msg = m_pos + entryHeaderSize;
+    const qint64 payloadSize = qAbs<qint64>(readNumber<Protocol::PayloadSize>(msg));
+    if (m_end - msg < messageHeaderSize + payloadSize)
+        return false;
+
+    entry.timestamp = readNumber<quint64>(m_pos);
+    entry.direction = static_cast<SessionRecording::Direction>(readNumber<quint8>(m_pos + sizeof(quint64)));
+    entry.data = msg;
+    entry.size = messageHeaderSize + int(payloadSize);
+    m_pos = msg + entry.size;
+    return true;
+}
+
+void SessionRecordingReader::rewind()
+{
+    m_pos = m_begin ? m_begin + fileHeaderSize : nullptr;
+}
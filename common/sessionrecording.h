@@ -0,0 +1,128 @@
+/*
+  sessionrecording.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_SESSIONRECORDING_H
+#define GAMMARAY_SESSIONRECORDING_H
+
+#include "gammaray_common_export.h"
+#include "protocol.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+
+namespace GammaRay {
+class Message;
+
+/**
+ * Recording of the messages exchanged between probe and client, for analysis or replay.
+ *
+ * File format (all numbers big endian):
+ * - header: "GRSR" magic, quint32 format version, qint32 protocol version,
+ *   quint8 recording side (0 probe, 1 client)
+ * - followed by one entry per message: quint64 nanoseconds since the start of the recording,
+ *   quint8 direction (0 incoming, 1 outgoing), and the message in its wire format
+ *   (see Message), without streaming compression.
+ *
+ * Entries are only ever appended, the file can be memory-mapped for reading.
+ */
+namespace SessionRecording {
+enum Direction {
+    Incoming = 0,
+    Outgoing = 1
+};
+}
+
+/** Appends messages to a session recording file. */
+class GAMMARAY_COMMON_EXPORT SessionRecordingWriter
+{
+public:
+    /** @p isClient indicates on which side of the connection the recording is made. */
+    explicit SessionRecordingWriter(bool isClient);
+    ~SessionRecordingWriter();
+
+    bool open(const QString &fileName);
+    QString errorString() const;
+
+    void record(SessionRecording::Direction direction, const Message &msg);
+
+private:
+    Q_DISABLE_COPY(SessionRecordingWriter)
+    QFile m_file;
+    QElapsedTimer m_timer;
+    bool m_isClient;
+};
+
+/** Reads a session recording file. */
+class GAMMARAY_COMMON_EXPORT SessionRecordingReader
+{
+public:
+    struct Entry
+    {
+        Entry()
+            : timestamp(0)
+            , direction(SessionRecording::Incoming)
+            , data(nullptr)
+            , size(0) {}
+
+        /// nanoseconds since the start of the recording
+        qint64 timestamp;
+        SessionRecording::Direction direction;
+        /// the message in wire format, valid as long as the reader is
+        const char *data;
+        int size;
+    };
+
+    SessionRecordingReader();
+    ~SessionRecordingReader();
+
+    bool open(const QString &fileName);
+    QString errorString() const;
+
+    /** Returns @c true if the recording was made on the client side. */
+    bool isClientRecording() const;
+    qint32 protocolVersion() const;
+
+    /** Reads the next entry into @p entry, returns @c false at the end of the recording. */
+    bool readNext(Entry &entry);
+    /** Restart reading from the first entry. */
+    void rewind();
+
+private:
+    Q_DISABLE_COPY(SessionRecordingReader)
+    QFile m_file;
+    QByteArray m_data; // used if the file can't be mapped
+    const char *m_begin;
+    const char *m_end;
+    const char *m_pos;
+    QString m_errorString;
+    qint32 m_protocolVersion;
+    bool m_isClient;
+};
+}
+
+#endif // GAMMARAY_SESSIONRECORDING_H
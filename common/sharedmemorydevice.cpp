@@ -0,0 +1,373 @@
+/*
+  sharedmemorydevice.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sharedmemorydevice.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QSharedMemory>
+
+#include <atomic>
+#include <cstring>
+
+namespace GammaRay {
+static const quint32 RingSize = 4 * 1024 * 1024; // must be a power of two
+
+struct SharedMemoryRingHeader
+{
+    std::atomic<quint32> head; // write position, only modified by the producer
+    std::atomic<quint32> tail; // read position, only modified by the consumer
+    std::atomic<quint32> consumerWaiting; // consumer needs a wake-up once new data is available
+    std::atomic<quint32> producerWaiting; // producer needs a wake-up once space is available
+};
+
+static const int SegmentSize = 2 * (sizeof(SharedMemoryRingHeader) + RingSize);
+
+/** Single-producer/single-consumer byte ring inside the shared memory segment. */
+class SharedMemoryRing
+{
+public:
+    explicit SharedMemoryRing(char *base)
+        : m_header(reinterpret_cast<SharedMemoryRingHeader *>(base))
+        , m_data(base + sizeof(SharedMemoryRingHeader))
+    {
+    }
+
+    void initialize()
+    {
+        m_header->head.store(0);
+        m_header->tail.store(0);
+        m_header->consumerWaiting.store(1);
+        m_header->producerWaiting.store(0);
+    }
+
+    quint32 available() const
+    {
+        return m_header->head.load(std::memory_order_acquire)
+               - m_header->tail.load(std::memory_order_relaxed);
+    }
+
+    // producer side
+    quint32 write(const char *src, quint32 size)
+    {
+        const quint32 head = m_header->head.load(std::memory_order_relaxed);
+        const quint32 tail = m_header->tail.load(std::memory_order_acquire);
+        const quint32 n = qMin(size, RingSize - (head - tail));
+        const quint32 offset = head & (RingSize - 1);
+        const quint32 firstPart = qMin(n, RingSize - offset);
+        memcpy(m_data + offset, src, firstPart);
+        memcpy(m_data, src + firstPart, n - firstPart);
+        m_header->head.store(head + n);
+        return n;
+    }
+
+    // asks for a wake-up once there is space, returns false if there is space already after all
+    bool setProducerWaiting()
+    {
+        m_header->producerWaiting.store(1);
+        return m_header->head.load(std::memory_order_relaxed) - m_header->tail.load() == RingSize;
+    }
+    bool takeConsumerWaiting() { return m_header->consumerWaiting.exchange(0); }
+
+    // consumer side
+    quint32 read(char *dst, quint32 maxSize)
+    {
+        const quint32 tail = m_header->tail.load(std::memory_order_relaxed);
+        const quint32 head = m_header->head.load(std::memory_order_acquire);
+        const quint32 n = qMin(maxSize, head - tail);
+        const quint32 offset = tail & (RingSize - 1);
+        const quint32 firstPart = qMin(n, RingSize - offset);
+        memcpy(dst, m_data + offset, firstPart);
+        memcpy(dst + firstPart, m_data, n - firstPart);
+        m_header->tail.store(tail + n);
+        return n;
+    }
+
+    // asks for a wake-up once there is data, returns false if there is data already after all
+    bool setConsumerWaiting()
+    {
+        m_header->consumerWaiting.store(1);
+        return m_header->head.load() == m_header->tail.load(std::memory_order_relaxed);
+    }
+    bool takeProducerWaiting() { return m_header->producerWaiting.exchange(0); }
+
+private:
+    SharedMemoryRingHeader *m_header;
+    char *m_data;
+};
+}
+
+using namespace GammaRay;
+
+SharedMemoryDevice::SharedMemoryDevice(QLocalSocket *socket, QObject *parent)
+    : QIODevice(parent)
+    , m_socket(socket)
+    , m_sharedMemory(nullptr)
+    , m_readRing(nullptr)
+    , m_writeRing(nullptr)
+    , m_writeBufferPos(0)
+{
+    Q_ASSERT(m_socket);
+}
+
+SharedMemoryDevice::~SharedMemoryDevice()
+{
+    delete m_readRing;
+    delete m_writeRing;
+}
+
+bool SharedMemoryDevice::create()
+{
+#ifndef QT_NO_SHAREDMEMORY
+    static std::atomic<int> s_segmentCount(0);
+    m_sharedMemory = new QSharedMemory(QStringLiteral("gammaray-%1-%2").arg(QCoreApplication::applicationPid()).arg(++s_segmentCount), this);
+    if (!m_sharedMemory->create(SegmentSize)) {
+        qWarning() << "Failed to create shared memory segment:" << m_sharedMemory->errorString();
+        return false;
+    }
+    setupRings(true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SharedMemoryDevice::attach(const QString &key)
+{
+#ifndef QT_NO_SHAREDMEMORY
+    m_sharedMemory = new QSharedMemory(key, this);
+    if (!m_sharedMemory->attach()) {
+        qWarning() << "Failed to attach to shared memory segment:" << m_sharedMemory->errorString();
+        return false;
+    }
+    if (m_sharedMemory->size() < SegmentSize) {
+        qWarning() << "Shared memory segment has unexpected size:" << m_sharedMemory->size();
+        m_sharedMemory->detach();
+        return false;
+    }
+    setupRings(false);
+    return true;
+#else
+    Q_UNUSED(key);
+    return false;
+#endif
+}
+
+QString SharedMemoryDevice::key() const
+{
+#ifndef QT_NO_SHAREDMEMORY
+    if (m_sharedMemory)
+        return m_sharedMemory->key();
+#endif
+    return QString();
+}
+
+void SharedMemoryDevice::setupRings(bool creator)
+{
+#ifndef QT_NO_SHAREDMEMORY
+    char *base = static_cast<char *>(m_sharedMemory->data());
+    SharedMemoryRing *serverToClient = new SharedMemoryRing(base);
+    SharedMemoryRing *clientToServer = new SharedMemoryRing(base + SegmentSize / 2);
+    if (creator) {
+        serverToClient->initialize();
+        clientToServer->initialize();
+        m_writeRing = serverToClient;
+        m_readRing = clientToServer;
+    } else {
+        m_writeRing = clientToServer;
+        m_readRing = serverToClient;
+    }
+#else
+    Q_UNUSED(creator);
+#endif
+}
+
+bool SharedMemoryDevice::open(OpenMode mode)
+{
+    if (!m_readRing || !m_writeRing)
+        return false;
+
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(notified()));
+    connect(m_socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+    if (m_socket->bytesAvailable() > 0 || m_readRing->available() > 0)
+        QMetaObject::invokeMethod(this, "notified", Qt::QueuedConnection);
+
+    return QIODevice::open(mode);
+}
+
+void SharedMemoryDevice::close()
+{
+    QIODevice::close();
+    disconnect(m_socket, SIGNAL(readyRead()), this, SLOT(notified()));
+    m_socket->disconnectFromServer();
+    m_writeBuffer.clear();
+    m_writeBufferPos = 0;
+}
+
+bool SharedMemoryDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 SharedMemoryDevice::bytesAvailable() const
+{
+    if (!m_readRing)
+        return QIODevice::bytesAvailable();
+    return QIODevice::bytesAvailable() + m_readRing->available();
+}
+
+qint64 SharedMemoryDevice::bytesToWrite() const
+{
+    return m_writeBuffer.size() - m_writeBufferPos;
+}
+
+qint64 SharedMemoryDevice::readData(char *data, qint64 maxSize)
+{
+    const quint32 n = m_readRing->read(data, qMin<qint64>(maxSize, RingSize));
+    if (n > 0 && m_readRing->takeProducerWaiting())
+        notifyOtherSide();
+    if (m_readRing->available() == 0)
+        waitForData();
+    if (n == 0 && m_socket->state() != QLocalSocket::ConnectedState)
+        return -1;
+    return n;
+}
+
+qint64 SharedMemoryDevice::writeData(const char *data, qint64 maxSize)
+{
+    if (m_socket->state() != QLocalSocket::ConnectedState)
+        return -1;
+
+    // anything that doesn't fit into the ring right now is kept until the reader made space,
+    // and everything after that has to wait behind it
+    qint64 written = 0;
+    if (m_writeBuffer.isEmpty())
+        written = writeToRing(data, maxSize);
+    if (written < maxSize)
+        m_writeBuffer.append(data + written, int(maxSize - written));
+    return maxSize;
+}
+
+qint64 SharedMemoryDevice::writeToRing(const char *data, qint64 size)
+{
+    qint64 total = 0;
+    while (total < size) {
+        const quint32 n = m_writeRing->write(data + total, qMin<qint64>(size - total, RingSize));
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        // only ask for a wake-up once the ring is full, and check again afterwards,
+        // so space made in between isn't missed
+        if (m_writeRing->setProducerWaiting())
+            break;
+    }
+    if (total > 0 && m_writeRing->takeConsumerWaiting())
+        notifyOtherSide();
+    return total;
+}
+
+qint64 SharedMemoryDevice::flushWriteBuffer()
+{
+    if (m_writeBuffer.isEmpty())
+        return 0;
+    const qint64 n = writeToRing(m_writeBuffer.constData() + m_writeBufferPos,
+                                 m_writeBuffer.size() - m_writeBufferPos);
+    m_writeBufferPos += int(n);
+    if (m_writeBufferPos == m_writeBuffer.size()) {
+        m_writeBuffer.clear();
+        m_writeBufferPos = 0;
+    }
+    return n;
+}
+
+void SharedMemoryDevice::waitForData()
+{
+    // only ask for a wake-up once the ring is empty, and check again afterwards, so data written
+    // in between isn't missed; unless the producer took the request already, we report that ourselves
+    if (m_readRing->setConsumerWaiting() || !m_readRing->takeConsumerWaiting())
+        return;
+    QMetaObject::invokeMethod(this, "notified", Qt::QueuedConnection);
+}
+
+void SharedMemoryDevice::notifyOtherSide()
+{
+    m_socket->putChar(0);
+    m_socket->flush();
+}
+
+void SharedMemoryDevice::notified()
+{
+    m_socket->readAll(); // wake-up bytes carry no information
+
+    const qint64 written = flushWriteBuffer();
+    if (written > 0)
+        emit bytesWritten(written);
+    if (bytesAvailable() > 0)
+        emit readyRead();
+    else
+        waitForData();
+}
+
+bool SharedMemoryDevice::waitForReadyRead(int msecs)
+{
+    if (bytesAvailable() > 0)
+        return true;
+    if (!m_readRing->setConsumerWaiting())
+        return true;
+
+    QElapsedTimer timer;
+    timer.start();
+    while (msecs < 0 || timer.elapsed() < msecs) {
+        const int remaining = msecs < 0 ? -1 : qMax<int>(0, msecs - timer.elapsed());
+        if (!m_socket->waitForReadyRead(remaining))
+            return false;
+        notified();
+        if (bytesAvailable() > 0)
+            return true;
+    }
+    return false;
+}
+
+bool SharedMemoryDevice::waitForBytesWritten(int msecs)
+{
+    if (m_writeBuffer.isEmpty())
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_writeBuffer.isEmpty()) {
+        const int remaining = msecs < 0 ? -1 : qMax<int>(0, msecs - timer.elapsed());
+        if ((msecs >= 0 && remaining == 0) || !m_socket->waitForReadyRead(remaining))
+            return false;
+        notified();
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/*
+  sharedmemorydevice.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_SHAREDMEMORYDEVICE_H
+#define GAMMARAY_SHAREDMEMORYDEVICE_H
+
+#include "gammaray_common_export.h"
+
+#include <QIODevice>
+
+QT_BEGIN_NAMESPACE
+class QLocalSocket;
+class QSharedMemory;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+class SharedMemoryRing;
+
+/**
+ * Byte stream between two processes on the same host, using a single-producer/single-consumer
+ * ring buffer in shared memory for each direction.
+ *
+ * A local socket connection between both ends is used to manage the connection life time,
+ * and for waking up the other side when new data or free space is available. This is a single
+ * byte only when the other side actually waits for it, the data itself never passes through
+ * the kernel.
+ */
+class GAMMARAY_COMMON_EXPORT SharedMemoryDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    /** Create a device on top of the already connected @p socket, the socket is not owned by this. */
+    explicit SharedMemoryDevice(QLocalSocket *socket, QObject *parent = nullptr);
+    ~SharedMemoryDevice();
+
+    /** Create a new shared memory segment, for the server side.
+     *  Returns @c false if shared memory is not available.
+     */
+    bool create();
+    /** Attach to the shared memory segment identified by @p key, for the client side. */
+    bool attach(const QString &key);
+    /** Key of the shared memory segment, to be passed to the other side. */
+    QString key() const;
+
+    bool open(OpenMode mode) override;
+    void close() override;
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    bool waitForReadyRead(int msecs) override;
+    bool waitForBytesWritten(int msecs) override;
+
+signals:
+    void disconnected();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private slots:
+    void notified();
+
+private:
+    void setupRings(bool creator);
+    /** Writes as much of @p data into the ring as fits, waking up the reader if needed. */
+    qint64 writeToRing(const char *data, qint64 size);
+    qint64 flushWriteBuffer();
+    /** Asks the other side for a wake-up once new data is available. */
+    void waitForData();
+    void notifyOtherSide();
+
+    QLocalSocket *m_socket;
+    QSharedMemory *m_sharedMemory;
+    SharedMemoryRing *m_readRing;
+    SharedMemoryRing *m_writeRing;
+    QByteArray m_writeBuffer; // only what didn't fit into the ring
+    int m_writeBufferPos; // part of m_writeBuffer already written to the ring
+};
+}
+
+#endif // GAMMARAY_SHAREDMEMORYDEVICE_H
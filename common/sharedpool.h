@@ -27,81 +27,96 @@
 #ifndef GAMMARAY_SHAREDPOOL_H
 #define GAMMARAY_SHAREDPOOL_H
 
-#include <assert.h>
+#include <QThreadStorage>
+
 #include <iostream>
 #include <functional>
 #include <memory>
-#include <stack>
 #include <vector>
 
 #define IF_DEBUG(x)
 
 namespace GammaRay {
 
+/** Pool of reusable objects, objects can be acquired and released from any thread.
+ *  Every thread has a pool of its own, objects go into the pool of the thread releasing them,
+ *  so this doesn't need any locking.
+ */
 template <class T>
 class SharedPool
 {
 public:
     // no `using a = b;` for MSVC2010 :(
     typedef std::unique_ptr<T, std::function<void(T*)>> PtrType;
-
-    SharedPool(size_t prealloc = 0)
-        : m_capacity(0)
-    {
-        while (prealloc--) {
-            add(std::unique_ptr<T>(new T));
-        }
-    }
-    ~SharedPool()
+    typedef std::vector<std::unique_ptr<T>> Pool;
+
+    /** @p prealloc objects are created for every thread on first use, at most @p maximumSize
+     *  released objects are kept per thread. The latter matters for threads releasing objects
+     *  acquired on another thread, such as received messages.
+     */
+    explicit SharedPool(size_t prealloc = 0, size_t maximumSize = 32)
+        : m_prealloc(prealloc)
+        , m_maximumSize(maximumSize)
     {
-        assert(m_capacity == size() && "Some objects are still acquired");
-        IF_DEBUG(std::cout << "Acquired objects left in pool on destruction: " << (m_capacity - size()) << std::endl);
-    }
-
-    void add(std::unique_ptr<T> t)
-    {
-        m_pool.push(std::move(t));
-        m_capacity++;
-
-        IF_DEBUG(std::cout << "Adding object to pool: " << m_pool.top().get() << " - current capacity:" << m_capacity << std::endl);
     }
 
     PtrType acquire()
     {
+        Pool &pool = localPool();
         // insert more if necessary
-        if (m_pool.empty()) {
+        if (pool.empty()) {
             IF_DEBUG(std::cout << "Growing pool by one" << std::endl);
-            add(std::unique_ptr<T>(new T));
+            pool.push_back(std::unique_ptr<T>(new T));
         }
 
-        auto ptr = m_pool.top().release();
+        auto ptr = pool.back().release();
+        pool.pop_back();
         IF_DEBUG(std::cout << "Acquire: " << ptr << std::endl);
-        PtrType tmp(ptr, [this](T* ptr) {
-            IF_DEBUG(std::cout << "Release: " << ptr << std::endl);
-            m_pool.push(std::unique_ptr<T>(ptr));
+        return PtrType(ptr, [this](T* ptr) {
+            release(ptr);
         });
-        m_pool.pop();
-        return std::move(tmp);
+    }
+
+    /** Number of objects available to the current thread without allocating. */
+    size_t size() const
+    {
+        return localPool().size();
     }
 
     bool empty() const
     {
-        return m_pool.empty();
+        return size() == 0;
     }
 
-    size_t capacity() const
+private:
+    void release(T *ptr)
     {
-        return m_capacity;
+        IF_DEBUG(std::cout << "Release: " << ptr << std::endl);
+        Pool &pool = localPool();
+        if (pool.size() >= m_maximumSize) {
+            delete ptr;
+            return;
+        }
+        pool.push_back(std::unique_ptr<T>(ptr));
     }
 
-    size_t size() const
+    Pool &localPool() const
     {
-        return m_pool.size();
+        Pool *pool = m_pools.localData();
+        if (!pool) {
+            pool = new Pool;
+            for (size_t i = 0; i < m_prealloc; ++i)
+                pool->push_back(std::unique_ptr<T>(new T));
+            IF_DEBUG(std::cout << "Creating pool for thread, current capacity: " << pool->size() << std::endl);
+            m_pools.setLocalData(pool);
+        }
+        return *pool;
     }
 
-private:
-    size_t m_capacity;
-    std::stack<std::unique_ptr<T>, std::vector<std::unique_ptr<T>>> m_pool;
+    size_t m_prealloc;
+    size_t m_maximumSize;
+    // deleted with all pooled objects when the thread ends
+    mutable QThreadStorage<Pool *> m_pools;
 };
 
 }
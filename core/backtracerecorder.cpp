@@ -0,0 +1,239 @@
+/*
+  backtracerecorder.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "backtracerecorder.h"
+#include "probesettings.h"
+
+#include <QObject>
+#include <QStringList>
+
+#include <algorithm>
+
+using namespace GammaRay;
+
+BacktraceRecorder::BacktraceRecorder()
+    : m_policy(Sampled)
+    , m_sampleRate(100)
+    , m_sampleCounter(0)
+    , m_recordedCount(0)
+    , m_pendingCount(0)
+    , m_classNameCount(0)
+{
+}
+
+BacktraceRecorder::~BacktraceRecorder()
+{
+}
+
+void BacktraceRecorder::readSettings()
+{
+    // GAMMARAY_DISABLE_BACKTRACE_LOGGING=1 predates the capture policies
+    if (ProbeSettings::value(QStringLiteral("DISABLE_BACKTRACE_LOGGING"), false).toBool()) {
+        setPolicy(Off);
+        return;
+    }
+
+    const QString policy = ProbeSettings::value(QStringLiteral("BacktracePolicy")).toString().toLower();
+    if (policy == QLatin1String("off"))
+        setPolicy(Off);
+    else if (policy == QLatin1String("all"))
+        setPolicy(All);
+    else if (policy == QLatin1String("classes"))
+        setPolicy(Classes);
+    else
+        setPolicy(Sampled);
+
+    setSampleRate(ProbeSettings::value(QStringLiteral("BacktraceSampleRate"), 100).toInt());
+
+    QVector<QByteArray> classNames;
+    foreach (const QString &className,
+             ProbeSettings::value(QStringLiteral("BacktraceClasses")).toString().split(QLatin1Char(','))) {
+        const QString name = className.trimmed();
+        if (!name.isEmpty())
+            classNames.push_back(name.toLatin1());
+    }
+    setClassNames(classNames);
+}
+
+BacktraceRecorder::Policy BacktraceRecorder::policy() const
+{
+    return static_cast<Policy>(m_policy.load(std::memory_order_relaxed));
+}
+
+void BacktraceRecorder::setPolicy(BacktraceRecorder::Policy policy)
+{
+    m_policy.store(policy, std::memory_order_relaxed);
+}
+
+void BacktraceRecorder::setSampleRate(int rate)
+{
+    m_sampleRate.store(qMax(1, rate), std::memory_order_relaxed);
+}
+
+void BacktraceRecorder::setClassNames(const QVector<QByteArray> &classNames)
+{
+    // every shard gets its own copy, so applying the filter doesn't need a global lock
+    for (int i = 0; i < ShardCount; ++i) {
+        QMutexLocker lock(&m_shards[i].mutex);
+        m_shards[i].classNames = classNames;
+    }
+    m_classNameCount.store(classNames.size(), std::memory_order_relaxed);
+}
+
+BacktraceRecorder::Shard &BacktraceRecorder::shard(QObject *obj) const
+{
+    // the lowest bits are always the same due to the allocation granularity
+    const quintptr addr = reinterpret_cast<quintptr>(obj);
+    return m_shards[((addr >> 4) ^ (addr >> 12)) % ShardCount];
+}
+
+bool BacktraceRecorder::shouldRecord()
+{
+    switch (policy()) {
+    case Off:
+        return false;
+    case Sampled:
+    {
+        const unsigned int rate = m_sampleRate.load(std::memory_order_relaxed);
+        return m_sampleCounter.fetch_add(1, std::memory_order_relaxed) % rate == 0;
+    }
+    case All:
+        return true;
+    case Classes:
+        // the class isn't known yet during construction, only skip what can't match at all
+        return m_classNameCount.load(std::memory_order_relaxed) > 0;
+    }
+    return false;
+}
+
+void BacktraceRecorder::insertTrace(Shard &s, QObject *obj, void *const *frames, int count)
+{
+    const int id = s.trie.insert(frames, count);
+    const auto it = s.traces.find(obj);
+    if (it != s.traces.end()) {
+        // stale entry from an object at the same address we didn't see being destroyed
+        s.trie.release(it.value());
+        it.value() = id;
+    } else {
+        s.traces.insert(obj, id);
+        m_recordedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BacktraceRecorder::record(QObject *obj, void *const *frames, int count)
+{
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    if (policy() != Classes) {
+        insertTrace(s, obj, frames, count);
+        return;
+    }
+
+    // keep the frames aside until the class is known, most objects won't make it into the trie
+    auto it = s.pendingFrames.find(obj);
+    if (it == s.pendingFrames.end()) {
+        it = s.pendingFrames.insert(obj, QVector<void *>());
+        m_pendingCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    QVector<void *> &pending = it.value();
+    pending.resize(count);
+    std::copy(frames, frames + count, pending.begin());
+}
+
+bool BacktraceRecorder::matchesClassFilter(const Shard &s, const QMetaObject *mo)
+{
+    for (; mo; mo = mo->superClass()) {
+        foreach (const QByteArray &className, s.classNames) {
+            if (className == mo->className())
+                return true;
+        }
+    }
+    return false;
+}
+
+void BacktraceRecorder::objectConstructed(QObject *obj)
+{
+    // called for every object, avoid the lock when there is nothing to decide about
+    if (m_pendingCount.load(std::memory_order_relaxed) == 0)
+        return;
+
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    const auto it = s.pendingFrames.find(obj);
+    if (it == s.pendingFrames.end())
+        return;
+
+    if (matchesClassFilter(s, obj->metaObject()))
+        insertTrace(s, obj, it.value().constData(), it.value().size());
+    s.pendingFrames.erase(it);
+    m_pendingCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void BacktraceRecorder::remove(QObject *obj)
+{
+    // called for every destroyed object, avoid the lock when there is nothing to look at
+    if (m_recordedCount.load(std::memory_order_relaxed) == 0
+        && m_pendingCount.load(std::memory_order_relaxed) == 0)
+        return;
+
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    if (s.pendingFrames.remove(obj))
+        m_pendingCount.fetch_sub(1, std::memory_order_relaxed);
+    const auto it = s.traces.find(obj);
+    if (it == s.traces.end())
+        return;
+    s.trie.release(it.value());
+    s.traces.erase(it);
+    m_recordedCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+QVector<void *> BacktraceRecorder::frames(QObject *obj) const
+{
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    const auto it = s.traces.constFind(obj);
+    if (it == s.traces.constEnd())
+        return QVector<void *>();
+    return s.trie.frames(it.value());
+}
+
+int BacktraceRecorder::recordedObjectCount() const
+{
+    return m_recordedCount.load(std::memory_order_relaxed);
+}
+
+int BacktraceRecorder::frameCount() const
+{
+    int count = 0;
+    for (int i = 0; i < ShardCount; ++i) {
+        QMutexLocker lock(&m_shards[i].mutex);
+        count += m_shards[i].trie.nodeCount();
+    }
+    return count;
+}
@@ -0,0 +1,134 @@
+/*
+  backtracerecorder.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_BACKTRACERECORDER_H
+#define GAMMARAY_BACKTRACERECORDER_H
+
+#include "gammaray_core_export.h"
+#include "stacktrie.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+class QObject;
+struct QMetaObject;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+/** @brief Records where objects have been constructed.
+ *
+ *  Which objects get a construction backtrace is decided by the capture policy, traces
+ *  are stored deduplicated in a StackTrie and released again once their object is destroyed.
+ *  The default policy is Sampled.
+ *
+ *  Objects are distributed over a number of shards by address, each with its own lock and trie,
+ *  so threads creating and destroying objects concurrently rarely contend. All methods are
+ *  thread-safe.
+ */
+class GAMMARAY_CORE_EXPORT BacktraceRecorder
+{
+public:
+    enum Policy {
+        Off, ///< record nothing
+        All, ///< record every object
+        Sampled, ///< record every n-th object, see setSampleRate()
+        Classes ///< record instances of the classes set with setClassNames() and their subclasses
+    };
+
+    BacktraceRecorder();
+    ~BacktraceRecorder();
+
+    /** Reads the capture policy from the probe settings. BacktracePolicy is one of
+     *  "off", "all", "sampled" or "classes", BacktraceSampleRate is the n used for "sampled"
+     *  and BacktraceClasses a comma separated list of class names used for "classes".
+     */
+    void readSettings();
+
+    Policy policy() const;
+    void setPolicy(Policy policy);
+    void setSampleRate(int rate);
+    void setClassNames(const QVector<QByteArray> &classNames);
+
+    /** Returns @c true if the backtrace of an object about to be constructed should be recorded.
+     *  Lock-free, so this can be called for every object. With the Classes policy this is only
+     *  @c false without any class names, the class of the object isn't known yet at this point.
+     */
+    bool shouldRecord();
+    /** Stores the backtrace of @p count @p frames, innermost first, as construction location of @p obj.
+     *  With the Classes policy the frames are only kept aside until objectConstructed() decides about them.
+     */
+    void record(QObject *obj, void *const *frames, int count);
+    /** Call once @p obj is fully constructed, to apply the class filter. */
+    void objectConstructed(QObject *obj);
+    /** Call when @p obj is destroyed, to release its backtrace. */
+    void remove(QObject *obj);
+
+    /** Returns the construction backtrace of @p obj, innermost frame first, if recorded. */
+    QVector<void *> frames(QObject *obj) const;
+
+    int recordedObjectCount() const;
+    /** Number of distinct stack frames stored. */
+    int frameCount() const;
+
+private:
+    Q_DISABLE_COPY(BacktraceRecorder)
+
+    struct Shard
+    {
+        mutable QMutex mutex;
+        StackTrie trie;
+        QHash<QObject *, int> traces; // object -> trie id
+        // Classes policy: frames of objects whose class isn't known yet
+        QHash<QObject *, QVector<void *> > pendingFrames;
+        QVector<QByteArray> classNames; // copy of the Classes filter
+        char padding[64]; // keep the mutexes of different shards on different cache lines
+    };
+
+    enum { ShardCount = 16 };
+    Shard &shard(QObject *obj) const;
+
+    void insertTrace(Shard &s, QObject *obj, void *const *frames, int count);
+    static bool matchesClassFilter(const Shard &s, const QMetaObject *mo);
+
+    std::atomic<int> m_policy;
+    std::atomic<int> m_sampleRate;
+    std::atomic<unsigned int> m_sampleCounter;
+    std::atomic<int> m_recordedCount;
+    std::atomic<int> m_pendingCount;
+    std::atomic<int> m_classNameCount;
+
+    mutable Shard m_shards[ShardCount];
+};
+}
+
+#endif // GAMMARAY_BACKTRACERECORDER_H
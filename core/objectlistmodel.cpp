@@ -42,10 +42,10 @@ using namespace std;
 ObjectListModel::ObjectListModel(Probe *probe)
     : ObjectModelBase< QAbstractTableModel >(probe)
 {
-    connect(probe, SIGNAL(objectCreated(QObject*)),
-            this, SLOT(objectAdded(QObject*)));
-    connect(probe, SIGNAL(objectDestroyed(QObject*)),
-            this, SLOT(objectRemoved(QObject*)));
+    connect(probe, SIGNAL(objectsCreated(QVector<QObject*>)),
+            this, SLOT(objectsAdded(QVector<QObject*>)));
+    connect(probe, SIGNAL(objectsDestroyed(QVector<QObject*>)),
+            this, SLOT(objectsRemoved(QVector<QObject*>)));
 }
 
 QPair<int, QVariant> ObjectListModel::defaultSelectedItem() const
@@ -57,7 +57,7 @@ QPair<int, QVariant> ObjectListModel::defaultSelectedItem() const
 QVariant ObjectListModel::data(const QModelIndex &index, int role) const
 {
     QMutexLocker lock(Probe::objectLock());
-    if (index.row() >= 0 && index.row() < m_objects.size()) {
+    if (index.row() >= 0 && index.row() < m_objects.count()) {
         QObject *obj = m_objects.at(index.row());
         if (Probe::instance()->isValidObject(obj))
             return dataForObject(obj, index, role);
@@ -77,43 +77,70 @@ int ObjectListModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return m_objects.size();
+    return m_objects.count();
 }
 
-void ObjectListModel::objectAdded(QObject *obj)
+void ObjectListModel::objectsAdded(const QVector<QObject *> &objects)
 {
-    // see Probe::objectCreated, that promises a valid object in the main thread
+    // see Probe::objectsCreated, that promises valid objects in the main thread
     Q_ASSERT(QThread::currentThread() == thread());
-    Q_ASSERT(obj);
-    Q_ASSERT(Probe::instance()->isValidObject(obj));
-
-    auto it = std::lower_bound(m_objects.begin(), m_objects.end(), obj);
-    Q_ASSERT(it == m_objects.end() || *it != obj);
-
-    const int row = std::distance(m_objects.begin(), it);
-    Q_ASSERT(row >= 0 && row <= m_objects.size());
+    if (objects.isEmpty())
+        return;
 
-    beginInsertRows(QModelIndex(), row, row);
-    m_objects.insert(it, obj);
-    Q_ASSERT(m_objects.at(row) == obj);
+    const int first = m_objects.count();
+    beginInsertRows(QModelIndex(), first, first + objects.size() - 1);
+    foreach (QObject *obj, objects) {
+        Q_ASSERT(obj);
+        Q_ASSERT(Probe::instance()->isValidObject(obj));
+        Q_ASSERT(!m_slots.contains(obj));
+        m_slots.insert(obj, m_objects.append(obj));
+    }
     endInsertRows();
 }
 
-void ObjectListModel::objectRemoved(QObject *obj)
+void ObjectListModel::objectsRemoved(const QVector<QObject *> &objects)
 {
     Q_ASSERT(thread() == QThread::currentThread());
 
-    auto it = std::lower_bound(m_objects.begin(), m_objects.end(), obj);
-    if (it == m_objects.end() || *it != obj) {
-        // not found
+    QVector<int> rows;
+    rows.reserve(objects.size());
+    foreach (QObject *obj, objects) {
+        const QHash<QObject *, int>::const_iterator it = m_slots.constFind(obj);
+        if (it == m_slots.constEnd())
+            continue; // not found
+        rows.push_back(m_objects.row(it.value()));
+    }
+    if (rows.isEmpty())
         return;
+
+    // remove contiguous ranges, from the last one on so the rows before stay valid
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    int last = rows.size() - 1;
+    while (last >= 0) {
+        int first = last;
+        while (first > 0 && rows.at(first - 1) == rows.at(first) - 1)
+            --first;
+
+        beginRemoveRows(QModelIndex(), rows.at(first), rows.at(last));
+        for (int i = last; i >= first; --i) {
+            QObject *obj = m_objects.at(rows.at(i));
+            m_objects.remove(m_slots.take(obj));
+        }
+        endRemoveRows();
+
+        last = first - 1;
     }
 
-    const int row = std::distance(m_objects.begin(), it);
-    Q_ASSERT(row >= 0 && row < m_objects.size());
-    Q_ASSERT(m_objects.at(row) == obj);
+    compact();
+}
+
+void ObjectListModel::compact()
+{
+    if (!m_objects.needsCompaction())
+        return;
 
-    beginRemoveRows(QModelIndex(), row, row);
-    m_objects.erase(it);
-    endRemoveRows();
+    m_objects.compact();
+    for (int slot = 0; slot < m_objects.slotCount(); ++slot)
+        m_slots[m_objects.objectAtSlot(slot)] = slot;
 }
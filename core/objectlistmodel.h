@@ -30,10 +30,11 @@
 #define GAMMARAY_OBJECTLISTMODEL_H
 
 #include "objectmodelbase.h"
+#include "objectrowlist.h"
 
+#include <QHash>
 #include <QMutex>
 #include <QVector>
-#include <QSet>
 
 namespace GammaRay {
 class Probe;
@@ -62,14 +63,15 @@ public slots:
     QPair<int, QVariant> defaultSelectedItem() const;
 
 private slots:
-    void objectAdded(QObject *obj);
-    void objectRemoved(QObject *obj);
+    void objectsAdded(const QVector<QObject *> &objects);
+    void objectsRemoved(const QVector<QObject *> &objects);
 
 private:
-    void removeObject(QObject *obj);
+    void compact();
 
-    // sorted vector for stable iterators/indexes, esp. for the model methods
-    QVector<QObject *> m_objects;
+    // in the order of creation, new objects are appended as one contiguous range per batch
+    ObjectRowList m_objects;
+    QHash<QObject *, int> m_slots;
 };
 }
 
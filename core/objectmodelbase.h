@@ -40,6 +40,7 @@
 
 #include "util.h"
 #include "objectdataprovider.h"
+#include "probe.h"
 
 #include <common/objectid.h>
 #include <common/objectmodel.h>
@@ -96,7 +97,7 @@ public:
         } else if (role == ObjectModel::ObjectRole) {
             return QVariant::fromValue(object);
         } else if (role == ObjectModel::ObjectIdRole) {
-            return QVariant::fromValue(ObjectId(object));
+            return QVariant::fromValue(Probe::objectId(object));
         } else if (role == Qt::ToolTipRole) {
             return Util::tooltipForObject(object);
         } else if (role == ObjectModel::DecorationIdRole && index.column() == 0) {
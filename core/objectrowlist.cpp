@@ -0,0 +1,124 @@
+/*
+  objectrowlist.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "objectrowlist.h"
+
+using namespace GammaRay;
+
+ObjectRowList::ObjectRowList()
+    : m_count(0)
+{
+}
+
+int ObjectRowList::count() const
+{
+    return m_count;
+}
+
+int ObjectRowList::append(QObject *obj)
+{
+    m_objects.push_back(obj);
+    const int i = m_objects.size();
+    // node i covers the slots (i - lowbit(i), i], sum up the nodes covering the ones before i
+    int sum = 1;
+    for (int j = i - 1; j > i - (i & -i); j -= j & -j)
+        sum += m_tree.at(j - 1);
+    m_tree.push_back(sum);
+    ++m_count;
+    return i - 1;
+}
+
+void ObjectRowList::remove(int slot)
+{
+    Q_ASSERT(m_objects.at(slot));
+    m_objects[slot] = nullptr;
+    for (int i = slot + 1; i <= m_tree.size(); i += i & -i)
+        --m_tree[i - 1];
+    --m_count;
+}
+
+int ObjectRowList::row(int slot) const
+{
+    int row = 0;
+    for (int i = slot; i > 0; i -= i & -i)
+        row += m_tree.at(i - 1);
+    return row;
+}
+
+QObject *ObjectRowList::at(int row) const
+{
+    Q_ASSERT(row >= 0 && row < m_count);
+    int step = 1;
+    while (step * 2 <= m_tree.size())
+        step *= 2;
+
+    // find the last slot with less than row + 1 occupied slots up to it, the one after is ours
+    int pos = 0;
+    int remaining = row + 1;
+    for (; step > 0; step /= 2) {
+        if (pos + step <= m_tree.size() && m_tree.at(pos + step - 1) < remaining) {
+            pos += step;
+            remaining -= m_tree.at(pos - 1);
+        }
+    }
+    return m_objects.at(pos);
+}
+
+bool ObjectRowList::needsCompaction() const
+{
+    return m_objects.size() > 32 && m_count * 2 < m_objects.size();
+}
+
+void ObjectRowList::compact()
+{
+    QVector<QObject *> objects;
+    objects.reserve(m_count);
+    foreach (QObject *obj, m_objects) {
+        if (obj)
+            objects.push_back(obj);
+    }
+    m_objects = objects;
+
+    const int size = m_objects.size();
+    m_tree.fill(1, size);
+    for (int i = 1; i <= size; ++i) {
+        const int parent = i + (i & -i);
+        if (parent <= size)
+            m_tree[parent - 1] += m_tree.at(i - 1);
+    }
+}
+
+QObject *ObjectRowList::objectAtSlot(int slot) const
+{
+    return m_objects.at(slot);
+}
+
+int ObjectRowList::slotCount() const
+{
+    return m_objects.size();
+}
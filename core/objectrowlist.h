@@ -0,0 +1,72 @@
+/*
+  objectrowlist.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_OBJECTROWLIST_H
+#define GAMMARAY_OBJECTROWLIST_H
+
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QObject;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+/** @brief Objects in the order they have been added, with logarithmic row lookups.
+ *
+ *  Objects are only ever appended, each one gets a slot that stays the same until the
+ *  next compaction. Removed objects leave a hole, a Fenwick tree over the occupied slots
+ *  maps between slots and rows.
+ */
+class ObjectRowList
+{
+public:
+    ObjectRowList();
+
+    int count() const;
+    /** Appends @p obj as last row, returns its slot. */
+    int append(QObject *obj);
+    void remove(int slot);
+    int row(int slot) const;
+    QObject *at(int row) const;
+
+    /** Returns @c true if it's time to get rid of the holes left by removed objects. */
+    bool needsCompaction() const;
+    /** Removes the holes, this changes the slots but not the rows. */
+    void compact();
+    /** Returns the object in @p slot, nullptr if it has been removed. */
+    QObject *objectAtSlot(int slot) const;
+    int slotCount() const;
+
+private:
+    QVector<QObject *> m_objects; // by slot, nullptr for removed ones
+    QVector<int> m_tree; // 1-based Fenwick tree over the occupancy of m_objects
+    int m_count;
+};
+}
+
+#endif // GAMMARAY_OBJECTROWLIST_H
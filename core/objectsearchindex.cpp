@@ -0,0 +1,288 @@
+/*
+  objectsearchindex.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "objectsearchindex.h"
+#include "probe.h"
+
+#include <QMetaObject>
+
+#include <algorithm>
+
+using namespace GammaRay;
+
+static const int MinimumStalePostings = 4096;
+// class names partially matching the search text easily match everything, like "obj" for QObject
+static const int MaxPartialClassMatches = 100;
+
+ObjectSearchIndex::ObjectSearchIndex(QObject *parent)
+    : ObjectSearchInterface(parent)
+    , m_livePostings(0)
+    , m_stalePostings(0)
+{
+}
+
+ObjectSearchIndex::~ObjectSearchIndex()
+{
+}
+
+int ObjectSearchIndex::size() const
+{
+    return m_slotForObject.size();
+}
+
+QVector<quint64> ObjectSearchIndex::trigrams(const QString &text)
+{
+    QVector<quint64> result;
+    if (text.size() < 3)
+        return result;
+    result.reserve(text.size() - 2);
+    for (int i = 0; i + 2 < text.size(); ++i) {
+        result.push_back((quint64(text.at(i).unicode()) << 32)
+                         | (quint64(text.at(i + 1).unicode()) << 16)
+                         | quint64(text.at(i + 2).unicode()));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void ObjectSearchIndex::objectAdded(QObject *obj)
+{
+    if (m_slotForObject.contains(obj))
+        return;
+
+    int slot;
+    if (m_freeSlots.isEmpty()) {
+        slot = m_entries.size();
+        m_entries.resize(slot + 1);
+    } else {
+        slot = m_freeSlots.last();
+        m_freeSlots.resize(m_freeSlots.size() - 1);
+    }
+    m_slotForObject.insert(obj, slot);
+
+    Entry &entry = m_entries[slot];
+    entry.object = obj;
+    entry.metaObject = obj->metaObject();
+    entry.name = obj->objectName().toLower();
+
+    ClassGroup &group = m_classGroups[entry.metaObject];
+    if (group.objectCount == 0) {
+        group.className = QString::fromUtf8(entry.metaObject->className()).toLower();
+        // separated by line breaks, which are never part of the search text
+        const QChar separator = QLatin1Char('\n');
+        group.classNames = separator;
+        for (const QMetaObject *mo = entry.metaObject; mo; mo = mo->superClass())
+            group.classNames += QString::fromUtf8(mo->className()).toLower() + separator;
+    }
+    ++group.objectCount;
+
+    indexEntry(slot);
+}
+
+void ObjectSearchIndex::indexEntry(int slot)
+{
+    m_classGroups[m_entries.at(slot).metaObject].entries.push_back(slot);
+    ++m_livePostings;
+    indexName(slot);
+}
+
+void ObjectSearchIndex::indexName(int slot)
+{
+    const QVector<quint64> keys = trigrams(m_entries.at(slot).name);
+    for (QVector<quint64>::const_iterator it = keys.constBegin(); it != keys.constEnd(); ++it)
+        m_postings[*it].push_back(slot);
+    m_livePostings += keys.size();
+}
+
+void ObjectSearchIndex::objectRenamed(QObject *obj)
+{
+    const QHash<QObject *, int>::const_iterator slotIt = m_slotForObject.constFind(obj);
+    if (slotIt == m_slotForObject.constEnd())
+        return;
+
+    const QString name = obj->objectName().toLower();
+    Entry &entry = m_entries[slotIt.value()];
+    if (entry.name == name)
+        return;
+
+    // postings of the old name are verified against the entry on lookup, same as for removed objects
+    const int postings = trigrams(entry.name).size();
+    m_livePostings -= postings;
+    m_stalePostings += postings;
+    entry.name = name;
+    indexName(slotIt.value());
+
+    if (m_stalePostings > std::max(m_livePostings, MinimumStalePostings))
+        compact();
+}
+
+void ObjectSearchIndex::objectRemoved(QObject *obj)
+{
+    // obj is already destroyed at this point, it must not be dereferenced
+    const QHash<QObject *, int>::iterator slotIt = m_slotForObject.find(obj);
+    if (slotIt == m_slotForObject.end())
+        return;
+    const int slot = slotIt.value();
+    m_slotForObject.erase(slotIt);
+
+    Entry &entry = m_entries[slot];
+    const int postings = trigrams(entry.name).size() + 1;
+    m_livePostings -= postings;
+    m_stalePostings += postings;
+
+    // the meta object might be gone along with the last instance, so don't keep it around
+    const QHash<const QMetaObject *, ClassGroup>::iterator groupIt = m_classGroups.find(entry.metaObject);
+    Q_ASSERT(groupIt != m_classGroups.end());
+    if (--groupIt.value().objectCount == 0) {
+        m_stalePostings -= groupIt.value().entries.size();
+        m_classGroups.erase(groupIt);
+    }
+
+    entry = Entry();
+    m_freeSlots.push_back(slot);
+
+    if (m_stalePostings > std::max(m_livePostings, MinimumStalePostings))
+        compact();
+}
+
+void ObjectSearchIndex::compact()
+{
+    m_postings.clear();
+    for (QHash<const QMetaObject *, ClassGroup>::iterator it = m_classGroups.begin(); it != m_classGroups.end(); ++it)
+        it.value().entries.clear();
+    m_livePostings = 0;
+    m_stalePostings = 0;
+
+    for (int slot = 0; slot < m_entries.size(); ++slot) {
+        if (m_entries.at(slot).object)
+            indexEntry(slot);
+    }
+}
+
+bool ObjectSearchIndex::SearchResult::add(QObject *object)
+{
+    if (!found.contains(object)) {
+        found.insert(object);
+        objects.push_back(object);
+    }
+    return maxResults < 0 || objects.size() < maxResults;
+}
+
+QVector<QObject *> ObjectSearchIndex::find(const QString &text, int maxResults) const
+{
+    SearchResult result(maxResults);
+    if (text.isEmpty() || maxResults == 0)
+        return result.objects;
+    const QString searchText = text.toLower();
+
+    // address
+    if (searchText.startsWith(QLatin1String("0x"))) {
+        bool ok = false;
+        QObject *obj = reinterpret_cast<QObject *>(searchText.mid(2).toULongLong(&ok, 16));
+        if (ok && m_slotForObject.contains(obj) && !result.add(obj))
+            return result.objects;
+    }
+
+    // object names first, those are what one usually searches for
+    if (!findNames(searchText, result))
+        return result.objects;
+
+    // class names, the number of distinct meta objects is small compared to the number of objects;
+    // all instances of classes named exactly like the search text, including subclasses
+    const QString className = QLatin1Char('\n') + searchText + QLatin1Char('\n');
+    int noLimit = -1;
+    for (QHash<const QMetaObject *, ClassGroup>::const_iterator groupIt = m_classGroups.constBegin();
+         groupIt != m_classGroups.constEnd(); ++groupIt) {
+        if (groupIt.value().classNames.contains(className) && !addClassGroup(groupIt, result, noLimit))
+            return result.objects;
+    }
+
+    // and some instances of classes partially matching it
+    int partialMatches = MaxPartialClassMatches;
+    for (QHash<const QMetaObject *, ClassGroup>::const_iterator groupIt = m_classGroups.constBegin();
+         groupIt != m_classGroups.constEnd() && partialMatches > 0; ++groupIt) {
+        if (groupIt.value().className.contains(searchText) && !addClassGroup(groupIt, result, partialMatches))
+            return result.objects;
+    }
+    return result.objects;
+}
+
+bool ObjectSearchIndex::findNames(const QString &searchText, SearchResult &result) const
+{
+    const QVector<quint64> keys = trigrams(searchText);
+    if (keys.isEmpty()) {
+        // too short for the index, but those are cheap to compare
+        for (QVector<Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+            if (it->object && it->name.contains(searchText) && !result.add(it->object))
+                return false;
+        }
+        return true;
+    }
+
+    const QVector<int> *candidates = nullptr;
+    for (QVector<quint64>::const_iterator it = keys.constBegin(); it != keys.constEnd(); ++it) {
+        const QHash<quint64, QVector<int> >::const_iterator postingIt = m_postings.constFind(*it);
+        if (postingIt == m_postings.constEnd())
+            return true; // no name contains this trigram
+        if (!candidates || postingIt.value().size() < candidates->size())
+            candidates = &postingIt.value();
+    }
+    for (QVector<int>::const_iterator it = candidates->constBegin(); it != candidates->constEnd(); ++it) {
+        const Entry &entry = m_entries.at(*it);
+        if (entry.object && entry.name.contains(searchText) && !result.add(entry.object))
+            return false;
+    }
+    return true;
+}
+
+bool ObjectSearchIndex::addClassGroup(QHash<const QMetaObject *, ClassGroup>::const_iterator groupIt,
+                                      SearchResult &result, int &limit) const
+{
+    const QVector<int> &entries = groupIt.value().entries;
+    for (QVector<int>::const_iterator it = entries.constBegin(); it != entries.constEnd() && limit != 0; ++it) {
+        const Entry &entry = m_entries.at(*it);
+        if (!entry.object || entry.metaObject != groupIt.key() || result.found.contains(entry.object))
+            continue;
+        if (limit > 0)
+            --limit;
+        if (!result.add(entry.object))
+            return false;
+    }
+    return true;
+}
+
+void ObjectSearchIndex::search(const QString &text, int maxResults)
+{
+    const QVector<QObject *> objects = find(text, maxResults);
+    ObjectIds ids;
+    ids.reserve(objects.size());
+    for (QVector<QObject *>::const_iterator it = objects.constBegin(); it != objects.constEnd(); ++it)
+        ids.push_back(Probe::objectId(*it));
+    emit searchResults(text, ids);
+}
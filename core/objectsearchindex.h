@@ -0,0 +1,142 @@
+/*
+  objectsearchindex.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_OBJECTSEARCHINDEX_H
+#define GAMMARAY_OBJECTSEARCHINDEX_H
+
+#include "gammaray_core_export.h"
+
+#include <common/objectsearchinterface.h>
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+namespace GammaRay {
+/** @brief Search index over all objects tracked by the probe.
+ *
+ *  Object names are indexed by their trigrams, so substring searches only need to look at
+ *  the objects sharing the rarest trigram of the search text. Class names are matched once per
+ *  meta object rather than per object, and addresses are looked up directly.
+ *
+ *  The index is updated incrementally from Probe::objectCreated() and Probe::objectDestroyed(),
+ *  and by the probe for renamed objects (Qt 5 only).
+ */
+class GAMMARAY_CORE_EXPORT ObjectSearchIndex : public ObjectSearchInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(GammaRay::ObjectSearchInterface)
+public:
+    explicit ObjectSearchIndex(QObject *parent = nullptr);
+    ~ObjectSearchIndex();
+
+    /** Returns the objects whose address is @p text, followed by those whose name contains @p text,
+     *  followed by the instances of classes named @p text and their subclasses (case-insensitive).
+     *  Instances of classes whose name only contains @p text come last, and only a limited number of them.
+     *  At most @p maxResults objects are returned, -1 means no limit.
+     */
+    QVector<QObject *> find(const QString &text, int maxResults = -1) const;
+
+    /** Number of indexed objects. */
+    int size() const;
+
+    /** Re-indexes the name of @p obj, which has to be valid. Called by the probe with the object lock held. */
+    void objectRenamed(QObject *obj);
+
+public slots:
+    void objectAdded(QObject *obj);
+    void objectRemoved(QObject *obj);
+
+    void search(const QString &text, int maxResults) override;
+
+private:
+    struct Entry
+    {
+        Entry()
+            : object(nullptr)
+            , metaObject(nullptr)
+        {
+        }
+        QObject *object; // null for unused slots
+        const QMetaObject *metaObject;
+        QString name; // lower case
+    };
+
+    struct ClassGroup
+    {
+        ClassGroup()
+            : objectCount(0)
+        {
+        }
+        QString className; // lower case
+        QString classNames; // lower case, including all base classes, each enclosed in line breaks
+        QVector<int> entries; // can contain stale and duplicate slots, see m_stalePostings
+        int objectCount;
+    };
+
+    struct SearchResult
+    {
+        explicit SearchResult(int maxResults)
+            : maxResults(maxResults)
+        {
+        }
+        /** Returns @c false once the result is full. */
+        bool add(QObject *object);
+
+        int maxResults;
+        QVector<QObject *> objects;
+        QSet<QObject *> found;
+    };
+
+    static QVector<quint64> trigrams(const QString &text);
+    /** Adds the objects whose name contains @p searchText, returns @c false once @p result is full. */
+    bool findNames(const QString &searchText, SearchResult &result) const;
+    /** Adds at most @p limit instances of the class of @p groupIt (-1 for all) not found yet,
+     *  reducing @p limit accordingly. Returns @c false once @p result is full.
+     */
+    bool addClassGroup(QHash<const QMetaObject *, ClassGroup>::const_iterator groupIt,
+                       SearchResult &result, int &limit) const;
+    void indexEntry(int slot);
+    void indexName(int slot);
+    void compact();
+
+    QVector<Entry> m_entries;
+    QVector<int> m_freeSlots;
+    QHash<QObject *, int> m_slotForObject;
+    QHash<const QMetaObject *, ClassGroup> m_classGroups;
+
+    // Postings are not removed when an object is destroyed, as that would be linear in the size of
+    // the posting list. Instead matches are verified against the entry, and the postings are rebuilt
+    // once there are more stale than valid ones.
+    QHash<quint64, QVector<int> > m_postings;
+    int m_livePostings;
+    int m_stalePostings;
+};
+}
+
+#endif // GAMMARAY_OBJECTSEARCHINDEX_H
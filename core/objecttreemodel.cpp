@@ -48,10 +48,10 @@ using namespace GammaRay;
 ObjectTreeModel::ObjectTreeModel(Probe *probe)
     : ObjectModelBase< QAbstractItemModel >(probe)
 {
-    connect(probe, SIGNAL(objectCreated(QObject*)),
-            this, SLOT(objectAdded(QObject*)));
-    connect(probe, SIGNAL(objectDestroyed(QObject*)),
-            this, SLOT(objectRemoved(QObject*)));
+    connect(probe, SIGNAL(objectsCreated(QVector<QObject*>)),
+            this, SLOT(objectsAdded(QVector<QObject*>)));
+    connect(probe, SIGNAL(objectsDestroyed(QVector<QObject*>)),
+            this, SLOT(objectsRemoved(QVector<QObject*>)));
     connect(probe, SIGNAL(objectReparented(QObject*)),
             this, SLOT(objectReparented(QObject*)));
 }
@@ -67,90 +67,216 @@ static inline QObject *parentObject(QObject *obj)
     return obj->parent();
 }
 
-void ObjectTreeModel::objectAdded(QObject *obj)
+void ObjectTreeModel::objectsAdded(const QVector<QObject *> &objects)
 {
-    // see Probe::objectCreated, that promises a valid object in the main thread here
+    // see Probe::objectsCreated, that promises valid objects in the main thread here
     Q_ASSERT(thread() == QThread::currentThread());
-    Q_ASSERT(Probe::instance()->isValidObject(obj));
 
-    IF_DEBUG(cout << "tree obj added: " << hex << obj << " p: " << parentObject(obj) << endl;
-             )
-    Q_ASSERT(!obj->parent() || Probe::instance()->isValidObject(parentObject(obj)));
+    QMutexLocker objectLock(Probe::objectLock());
 
-    if (indexForObject(obj).isValid()) {
-        IF_DEBUG(cout << "tree double obj added: " << hex << obj << endl;
+    // group by parent, in the order of the first child of each parent, that way
+    // a new parent is always inserted before its own children are
+    QVector<QObject *> parents;
+    QHash<QObject *, QVector<QObject *> > children;
+    foreach (QObject *obj, objects) {
+        Q_ASSERT(Probe::instance()->isValidObject(obj));
+        IF_DEBUG(cout << "tree obj added: " << hex << obj << " p: " << parentObject(obj) << endl;
                  )
-        return;
+        Q_ASSERT(!obj->parent() || Probe::instance()->isValidObject(parentObject(obj)));
+
+        if (m_positions.contains(obj)) {
+            IF_DEBUG(cout << "tree double obj added: " << hex << obj << endl;
+                     )
+            continue;
+        }
+
+        QObject *parent = parentObject(obj);
+        QHash<QObject *, QVector<QObject *> >::iterator it = children.find(parent);
+        if (it == children.end()) {
+            parents.push_back(parent);
+            children.insert(parent, QVector<QObject *>() << obj);
+        } else {
+            it.value().push_back(obj);
+        }
     }
 
+    foreach (QObject *parent, parents)
+        insertChildren(parent, children.value(parent));
+}
+
+// pre-condition: objectLock is held
+void ObjectTreeModel::insertChildren(QObject *parent, const QVector<QObject *> &objects)
+{
     // this is ugly, but apparently it can happen
     // that an object gets created without parent
     // then later the delayed signal comes in
     // so catch this gracefully by first adding the
     // parent if required
-    if (parentObject(obj)) {
-        const QModelIndex index = indexForObject(parentObject(obj));
-        if (!index.isValid()) {
-            IF_DEBUG(cout << "tree: handle parent first" << endl;
-                     )
-            objectAdded(parentObject(obj));
-        }
+    if (parent && !m_positions.contains(parent)) {
+        IF_DEBUG(cout << "tree: handle parent first" << endl;
+                 )
+        addObject(parent);
+    }
+
+    const QModelIndex parentIndex = indexForObject(parent);
+    if (parent && !parentIndex.isValid())
+        return;
+
+    QVector<QObject *> newObjects;
+    newObjects.reserve(objects.size());
+    foreach (QObject *obj, objects) {
+        // might have been added as the parent of another object already
+        if (!m_positions.contains(obj))
+            newObjects.push_back(obj);
+    }
+    if (newObjects.isEmpty())
+        return;
+
+    ObjectRowList &siblings = m_children[parent];
+    const int first = siblings.count();
+    beginInsertRows(parentIndex, first, first + newObjects.size() - 1);
+    foreach (QObject *obj, newObjects) {
+        Position pos;
+        pos.parent = parent;
+        pos.slot = siblings.append(obj);
+        m_positions.insert(obj, pos);
+    }
+    endInsertRows();
+}
+
+void ObjectTreeModel::addObject(QObject *obj)
+{
+    Q_ASSERT(Probe::instance()->isValidObject(obj));
+    Q_ASSERT(!m_positions.contains(obj));
+
+    QObject *parent = parentObject(obj);
+    if (parent && !m_positions.contains(parent)) {
+        IF_DEBUG(cout << "tree: handle parent first" << endl;
+                 )
+        addObject(parent);
     }
 
-    const QModelIndex index = indexForObject(parentObject(obj));
+    const QModelIndex index = indexForObject(parent);
 
     // either we get a proper parent and hence valid index or there is no parent
-    Q_ASSERT(index.isValid() || !parentObject(obj));
+    Q_ASSERT(index.isValid() || !parent);
 
-    QVector<QObject *> &children = m_parentChildMap[ parentObject(obj) ];
-    auto it = std::lower_bound(children.begin(), children.end(), obj);
-    const int row = std::distance(children.begin(), it);
+    ObjectRowList &children = m_children[parent];
+    const int row = children.count();
 
     beginInsertRows(index, row, row);
 
-    children.insert(it, obj);
-    m_childParentMap.insert(obj, parentObject(obj));
+    Position pos;
+    pos.parent = parent;
+    pos.slot = children.append(obj);
+    m_positions.insert(obj, pos);
 
     endInsertRows();
 }
 
-void ObjectTreeModel::objectRemoved(QObject *obj)
+void ObjectTreeModel::compactChildren(ObjectRowList &children)
+{
+    if (!children.needsCompaction())
+        return;
+
+    children.compact();
+    for (int slot = 0; slot < children.slotCount(); ++slot)
+        m_positions[children.objectAtSlot(slot)].slot = slot;
+}
+
+// forget about all descendants of obj, they are gone from the model along with obj
+void ObjectTreeModel::removeChildren(QObject *obj)
+{
+    const QHash<QObject *, ObjectRowList>::iterator it = m_children.find(obj);
+    if (it == m_children.end())
+        return;
+    const ObjectRowList children = it.value();
+    m_children.erase(it);
+
+    for (int slot = 0; slot < children.slotCount(); ++slot) {
+        QObject *child = children.objectAtSlot(slot);
+        if (!child)
+            continue;
+        m_positions.remove(child);
+        removeChildren(child);
+    }
+}
+
+void ObjectTreeModel::objectsRemoved(const QVector<QObject *> &objects)
 {
     // slot, hence should always land in main thread due to auto connection
     Q_ASSERT(thread() == QThread::currentThread());
 
-    IF_DEBUG(cout
-             << "tree removed: "
-             << hex << obj << " "
-             << hex << obj->parent() << dec << " "
-             << m_parentChildMap.value(obj->parent()).size() << " "
-             << m_parentChildMap.contains(obj) << endl;
-             )
+    // group by parent, in the order of the first removed child of each parent, objects are
+    // destroyed before their children, so parents are usually removed before their children
+    QVector<QObject *> parents;
+    QHash<QObject *, QVector<QObject *> > children;
+    foreach (QObject *obj, objects) {
+        IF_DEBUG(cout << "tree removed: " << hex << obj << dec << " "
+                      << m_children.contains(obj) << endl;
+                 )
 
-    if (!m_childParentMap.contains(obj)) {
-        Q_ASSERT(!m_parentChildMap.contains(obj));
-        return;
+        const QHash<QObject *, Position>::const_iterator it = m_positions.constFind(obj);
+        if (it == m_positions.constEnd()) {
+            Q_ASSERT(!m_children.contains(obj));
+            continue;
+        }
+
+        QObject *parent = it.value().parent;
+        QHash<QObject *, QVector<QObject *> >::iterator childIt = children.find(parent);
+        if (childIt == children.end()) {
+            parents.push_back(parent);
+            children.insert(parent, QVector<QObject *>() << obj);
+        } else {
+            childIt.value().push_back(obj);
+        }
     }
 
-    QObject *parentObj = m_childParentMap[ obj ];
-    const QModelIndex parentIndex = indexForObject(parentObj);
-    if (parentObj && !parentIndex.isValid())
-        return;
+    foreach (QObject *parent, parents)
+        removeChildRows(parent, children.value(parent));
+}
 
-    QVector<QObject *> &siblings = m_parentChildMap[ parentObj ];
+void ObjectTreeModel::removeChildRows(QObject *parent, const QVector<QObject *> &objects)
+{
+    if (parent && !m_positions.contains(parent))
+        return; // removed along with an ancestor already
+    const QModelIndex parentIndex = indexForObject(parent);
+    if (parent && !parentIndex.isValid())
+        return;
 
-    auto it = std::lower_bound(siblings.begin(), siblings.end(), obj);
-    if (it == siblings.end() || *it != obj)
+    ObjectRowList &siblings = m_children[parent];
+    QVector<int> rows;
+    rows.reserve(objects.size());
+    foreach (QObject *obj, objects) {
+        const QHash<QObject *, Position>::const_iterator it = m_positions.constFind(obj);
+        if (it == m_positions.constEnd() || it.value().parent != parent)
+            continue; // removed along with an ancestor already
+        rows.push_back(siblings.row(it.value().slot));
+    }
+    if (rows.isEmpty())
         return;
-    const int row = std::distance(siblings.begin(), it);
 
-    beginRemoveRows(parentIndex, row, row);
+    // remove contiguous ranges, from the last one on so the rows before stay valid
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    int last = rows.size() - 1;
+    while (last >= 0) {
+        int first = last;
+        while (first > 0 && rows.at(first - 1) == rows.at(first) - 1)
+            --first;
+
+        beginRemoveRows(parentIndex, rows.at(first), rows.at(last));
+        for (int i = last; i >= first; --i) {
+            QObject *obj = siblings.at(rows.at(i));
+            siblings.remove(m_positions.take(obj).slot);
+            removeChildren(obj);
+        }
+        endRemoveRows();
 
-    siblings.erase(it);
-    m_childParentMap.remove(obj);
-    m_parentChildMap.remove(obj);
+        last = first - 1;
+    }
 
-    endRemoveRows();
+    compactChildren(siblings);
 }
 
 void ObjectTreeModel::objectReparented(QObject *obj)
@@ -162,45 +288,43 @@ void ObjectTreeModel::objectReparented(QObject *obj)
 
     QMutexLocker objectLock(Probe::objectLock());
     if (!Probe::instance()->isValidObject(obj)) {
-        objectRemoved(obj);
+        objectsRemoved(QVector<QObject *>() << obj);
         return;
     }
 
     // we didn't know obj yet
-    if (!m_childParentMap.contains(obj)) {
-        Q_ASSERT(!m_parentChildMap.contains(obj));
-        objectAdded(obj);
+    if (!m_positions.contains(obj)) {
+        Q_ASSERT(!m_children.contains(obj));
+        addObject(obj);
         return;
     }
 
-    QObject *oldParent = m_childParentMap.value(obj);
+    const Position oldPos = m_positions.value(obj);
+    QObject *oldParent = oldPos.parent;
     const auto sourceParent = indexForObject(oldParent);
     if ((oldParent && !sourceParent.isValid()) || (oldParent == parentObject(obj)))
         return;
 
-    QVector<QObject *> &oldSiblings = m_parentChildMap[oldParent];
-    auto oldIt = std::lower_bound(oldSiblings.begin(),
-                                                          oldSiblings.end(), obj);
-    if (oldIt == oldSiblings.end() || *oldIt != obj)
-        return;
-    const int sourceRow = std::distance(oldSiblings.begin(), oldIt);
-
     IF_DEBUG(cout << "actually reparenting! " << hex << obj << " old parent: " << oldParent << " new parent: " << parentObject(
                  obj) << dec << endl;
              )
     const auto destParent = indexForObject(parentObject(obj));
     Q_ASSERT(destParent.isValid() || !parentObject(obj));
 
-    QVector<QObject *> &newSiblings = m_parentChildMap[parentObject(obj)];
-    auto newIt = std::lower_bound(newSiblings.begin(),
-                                                          newSiblings.end(), obj);
-    const int destRow = std::distance(newSiblings.begin(), newIt);
+    ObjectRowList &newSiblings = m_children[parentObject(obj)];
+    ObjectRowList &oldSiblings = m_children[oldParent];
+    const int sourceRow = oldSiblings.row(oldPos.slot);
+    const int destRow = newSiblings.count();
 
     beginMoveRows(sourceParent, sourceRow, sourceRow, destParent, destRow);
-    oldSiblings.erase(oldIt);
-    newSiblings.insert(newIt, obj);
-    m_childParentMap.insert(obj, parentObject(obj));
+    oldSiblings.remove(oldPos.slot);
+    Position newPos;
+    newPos.parent = parentObject(obj);
+    newPos.slot = newSiblings.append(obj);
+    m_positions.insert(obj, newPos);
     endMoveRows();
+
+    compactChildren(oldSiblings);
 }
 
 QVariant ObjectTreeModel::data(const QModelIndex &index, int role) const
@@ -228,37 +352,42 @@ int ObjectTreeModel::rowCount(const QModelIndex &parent) const
     if (parent.column() == 1)
         return 0;
     QObject *parentObj = reinterpret_cast<QObject *>(parent.internalPointer());
-    return m_parentChildMap.value(parentObj).size();
+    const QHash<QObject *, ObjectRowList>::const_iterator it = m_children.constFind(parentObj);
+    return it == m_children.constEnd() ? 0 : it.value().count();
 }
 
 QModelIndex ObjectTreeModel::parent(const QModelIndex &child) const
 {
     QObject *childObj = reinterpret_cast<QObject *>(child.internalPointer());
-    return indexForObject(m_childParentMap.value(childObj));
+    return indexForObject(m_positions.value(childObj).parent);
 }
 
 QModelIndex ObjectTreeModel::index(int row, int column, const QModelIndex &parent) const
 {
     QObject *parentObj = reinterpret_cast<QObject *>(parent.internalPointer());
-    const QVector<QObject *> children = m_parentChildMap.value(parentObj);
-    if (row < 0 || column < 0 || row >= children.size() || column >= columnCount())
+    const QHash<QObject *, ObjectRowList>::const_iterator it = m_children.constFind(parentObj);
+    if (it == m_children.constEnd())
+        return QModelIndex();
+    if (row < 0 || column < 0 || row >= it.value().count() || column >= columnCount())
         return QModelIndex();
-    return createIndex(row, column, children.at(row));
+    return createIndex(row, column, it.value().at(row));
 }
 
 QModelIndex ObjectTreeModel::indexForObject(QObject *object) const
 {
     if (!object)
         return QModelIndex();
-    QObject *parent = m_childParentMap.value(object);
+    const QHash<QObject *, Position>::const_iterator posIt = m_positions.constFind(object);
+    if (posIt == m_positions.constEnd())
+        return QModelIndex();
+    QObject *parent = posIt.value().parent;
     const QModelIndex parentIndex = indexForObject(parent);
     if (!parentIndex.isValid() && parent)
         return QModelIndex();
-    const QVector<QObject *> &siblings = m_parentChildMap[ parent ];
-    auto it = std::lower_bound(siblings.constBegin(), siblings.constEnd(), object);
-    if (it == siblings.constEnd() || *it != object)
+    const QHash<QObject *, ObjectRowList>::const_iterator it = m_children.constFind(parent);
+    if (it == m_children.constEnd())
         return QModelIndex();
 
-    const int row = std::distance(siblings.constBegin(), it);
-    return index(row, 0, parentIndex);
+    const int row = it.value().row(posIt.value().slot);
+    return createIndex(row, 0, object);
 }
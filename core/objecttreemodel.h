@@ -30,7 +30,9 @@
 #define GAMMARAY_OBJECTTREEMODEL_H
 
 #include "objectmodelbase.h"
+#include "objectrowlist.h"
 
+#include <QHash>
 #include <QVector>
 
 namespace GammaRay {
@@ -52,16 +54,27 @@ public slots:
     QPair<int, QVariant> defaultSelectedItem() const;
 
 private slots:
-    void objectAdded(QObject *obj);
-    void objectRemoved(QObject *obj);
+    void objectsAdded(const QVector<QObject *> &objects);
+    void objectsRemoved(const QVector<QObject *> &objects);
     void objectReparented(QObject *obj);
 
 private:
+    struct Position
+    {
+        QObject *parent;
+        int slot;
+    };
+
+    void addObject(QObject *obj);
+    void insertChildren(QObject *parent, const QVector<QObject *> &objects);
+    void removeChildRows(QObject *parent, const QVector<QObject *> &objects);
+    void compactChildren(ObjectRowList &children);
+    void removeChildren(QObject *obj);
     QModelIndex indexForObject(QObject *object) const;
 
 private:
-    QHash<QObject *, QObject *> m_childParentMap;
-    QHash<QObject *, QVector<QObject *> > m_parentChildMap;
+    QHash<QObject *, Position> m_positions;
+    QHash<QObject *, ObjectRowList> m_children;
 };
 }
 
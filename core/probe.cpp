@@ -43,6 +43,9 @@
 #include "util.h"
 #include "varianthandler.h"
 #include "metaobjectregistry.h"
+#include "objectsearchindex.h"
+#include "trackedobjectset.h"
+#include "backtracerecorder.h"
 
 #include "remote/server.h"
 #include "remote/remotemodelserver.h"
@@ -54,6 +57,7 @@
 #include <common/objectbroker.h>
 #include <common/streamoperators.h>
 #include <common/paths.h>
+#include <common/lockfreequeue.h>
 
 #if USE_BACKWARD_CPP
 #include <backward.hpp>
@@ -70,6 +74,7 @@
 #include <QMouseEvent>
 #include <QUrl>
 #include <QThread>
+#include <QThreadStorage>
 #include <QTimer>
 
 #ifdef HAVE_PRIVATE_QT_HEADERS
@@ -89,6 +94,7 @@ extern QSignalSpyCallbackSet Q_CORE_EXPORT qt_signal_spy_callback_set;
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <cstdio>
 
@@ -106,9 +112,29 @@ using namespace std;
 QAtomicPointer<Probe> Probe::s_instance = QAtomicPointer<Probe>(nullptr);
 
 namespace GammaRay {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+// QObject's own signals come first, so their signal index is the same for every class,
+// and matches their method index in QObject
+static int objectNameChangedIndex()
+{
+    static const int index = QObject::staticMetaObject.indexOfSignal("objectNameChanged(QString)");
+    return index;
+}
+#endif
+// set if any registered callback set has a signal begin callback
+static std::atomic<bool> s_forwardSignalBegin(false);
+
 static void signal_begin_callback(QObject *caller, int method_index, void **argv)
 {
-    if (method_index == 0 || Probe::instance()->filterObject(caller))
+    if (method_index == 0)
+        return;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    // installed even without other callbacks, this is how we learn about renamed objects
+    if (method_index == objectNameChangedIndex())
+        Probe::objectRenamed(caller);
+#endif
+    if (!s_forwardSignalBegin.load(std::memory_order_relaxed) || Probe::instance()->filterObject(caller))
         return;
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -125,10 +151,9 @@ static void signal_end_callback(QObject *caller, int method_index)
     if (method_index == 0)
         return;
 
-    QMutexLocker locker(Probe::objectLock());
+    // lock-free, the slot would have deleted caller in this thread
     if (!Probe::instance()->isValidObject(caller)) // implies filterObject()
         return; // deleted in the slot
-    locker.unlock();
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
     method_index = Util::signalIndexToMethodIndex(caller->metaObject(), method_index);
@@ -155,10 +180,9 @@ static void slot_end_callback(QObject *caller, int method_index)
     if (method_index == 0)
         return;
 
-    QMutexLocker locker(Probe::objectLock());
+    // lock-free, the slot would have deleted caller in this thread
     if (!Probe::instance()->isValidObject(caller)) // implies filterObject()
         return; // deleted in the slot
-    locker.unlock();
 
     Probe::executeSignalCallback([=](const SignalSpyCallbackSet &callbacks) {
             if (callbacks.slotEndCallback)
@@ -193,23 +217,109 @@ void dumpObject(QObject *obj)
     cout.flags(oldFlags);
 }
 
+struct PendingObject
+{
+    QObject *obj;
+    quint32 generation;
+};
+
+// single producer (the owning thread), single consumer (the probe thread)
+struct PendingObjectQueue
+{
+    PendingObjectQueue()
+        : orphaned(false)
+    {
+    }
+
+    LockFreeQueue<PendingObject> queue;
+    // set once the owning thread is gone, the probe thread deletes the queue after draining it
+    std::atomic<bool> orphaned;
+};
+
+struct PendingObjectQueueHandle
+{
+    explicit PendingObjectQueueHandle(PendingObjectQueue *q)
+        : queue(q)
+    {
+    }
+
+    ~PendingObjectQueueHandle()
+    {
+        queue->orphaned.store(true, std::memory_order_release);
+    }
+
+    PendingObjectQueue *queue;
+};
+
 struct Listener
 {
     Listener()
         : trackDestroyed(true)
     {
+#if USE_BACKWARD_CPP
+        constructionBacktraces.readSettings();
+#endif
     }
 
     bool trackDestroyed;
     QVector<QObject *> addedBeforeProbeInstance;
 
+    QMutex pendingObjectQueuesLock;
+    QVector<PendingObjectQueue *> pendingObjectQueues;
+
 #if USE_BACKWARD_CPP
-    QHash<QObject *, backward::StackTrace> constructionBacktracesForObjects;
+    BacktraceRecorder constructionBacktraces;
 #endif
 };
 
 Q_GLOBAL_STATIC(Listener, s_listener)
 
+static QThreadStorage<PendingObjectQueueHandle *> s_pendingObjectQueue;
+
+// returns the creation queue of the current thread, registering it on first use
+static PendingObjectQueue *localPendingObjectQueue()
+{
+    if (!s_pendingObjectQueue.hasLocalData()) {
+        PendingObjectQueue *queue = new PendingObjectQueue;
+        {
+            QMutexLocker lock(&s_listener()->pendingObjectQueuesLock);
+            s_listener()->pendingObjectQueues.push_back(queue);
+        }
+        s_pendingObjectQueue.setLocalData(new PendingObjectQueueHandle(queue));
+    }
+    return s_pendingObjectQueue.localData()->queue;
+}
+
+#if USE_BACKWARD_CPP
+// what backward::TraceResolver needs from a stack trace, for the frames stored in BacktraceRecorder
+struct RecordedStackTrace
+{
+    explicit RecordedStackTrace(const QVector<void *> &f)
+        : frames(f)
+    {
+    }
+
+    size_t size() const
+    {
+        return frames.size();
+    }
+
+    backward::Trace operator[](size_t idx) const
+    {
+        if (idx >= size())
+            return backward::Trace();
+        return backward::Trace(frames.at(idx), idx);
+    }
+
+    void **begin()
+    {
+        return frames.isEmpty() ? nullptr : frames.data();
+    }
+
+    QVector<void *> frames;
+};
+#endif
+
 // ensures proper information is returned by isValidObject by
 // locking it in objectAdded/Removed
 Q_GLOBAL_STATIC_WITH_ARGS(QMutex, s_lock, (QMutex::Recursive))
@@ -219,7 +329,10 @@ Probe::Probe(QObject *parent)
     , m_objectListModel(new ObjectListModel(this))
     , m_objectTreeModel(new ObjectTreeModel(this))
     , m_window(nullptr)
+    , m_trackedObjects(new TrackedObjectSet)
     , m_metaObjectRegistry(new MetaObjectRegistry(this))
+    , m_objectSearchIndex(new ObjectSearchIndex(this))
+    , m_batchingCreatedObjects(false)
     , m_queueTimer(new QTimer(this))
     , m_server(nullptr)
 #if USE_BACKWARD_CPP
@@ -231,6 +344,10 @@ Probe::Probe(QObject *parent)
 
     StreamOperators::registerOperators();
     ProbeSettings::receiveSettings();
+#if USE_BACKWARD_CPP
+    // the launcher might provide a different capture policy than the environment
+    s_listener()->constructionBacktraces.readSettings();
+#endif
 
     m_server = new Server(this);
 
@@ -238,6 +355,7 @@ Probe::Probe(QObject *parent)
     ObjectBroker::registerObject<ProbeControllerInterface *>(new ProbeController(this));
     m_toolManager = new ToolManager(this);
     ObjectBroker::registerObject<ToolManagerInterface *>(m_toolManager);
+    ObjectBroker::registerObject<ObjectSearchInterface *>(m_objectSearchIndex);
 
     EnumRepositoryServer::create(this);
     ClassesIconsRepositoryServer::create(this);
@@ -264,9 +382,12 @@ Probe::Probe(QObject *parent)
         = qt_signal_spy_callback_set.slot_begin_callback;
     m_previousSignalSpyCallbackSet.slotEndCallback = qt_signal_spy_callback_set.slot_end_callback;
     registerSignalSpyCallbackSet(m_previousSignalSpyCallbackSet); // daisy-chain existing callbacks
+    setupSignalSpyCallbacks(); // needed for objectRenamed() even without any other callbacks
 
     connect(this, SIGNAL(objectCreated(QObject*)), m_metaObjectRegistry, SLOT(objectAdded(QObject*)));
     connect(this, SIGNAL(objectDestroyed(QObject*)), m_metaObjectRegistry, SLOT(objectRemoved(QObject*)));
+    connect(this, SIGNAL(objectCreated(QObject*)), m_objectSearchIndex, SLOT(objectAdded(QObject*)));
+    connect(this, SIGNAL(objectDestroyed(QObject*)), m_objectSearchIndex, SLOT(objectRemoved(QObject*)));
 }
 
 Probe::~Probe()
@@ -305,6 +426,11 @@ MetaObjectRegistry *Probe::metaObjectRegistry() const
     return m_metaObjectRegistry;
 }
 
+ObjectSearchIndex *Probe::objectSearchIndex() const
+{
+    return m_objectSearchIndex;
+}
+
 Probe *GammaRay::Probe::instance()
 {
 #if (QT_VERSION < QT_VERSION_CHECK(5, 0, 0))
@@ -367,6 +493,7 @@ void Probe::createProbe(bool findExisting)
         s_instance = QAtomicPointer<Probe>(probe);
 
         // add objects to the probe that were tracked before its creation
+        probe->beginCreatedObjectBatch();
         foreach (QObject *obj, s_listener()->addedBeforeProbeInstance) {
             objectAdded(obj);
         }
@@ -375,6 +502,7 @@ void Probe::createProbe(bool findExisting)
         // try to find existing objects by other means
         if (findExisting)
             probe->findExistingObjects();
+        probe->endCreatedObjectBatch();
     }
 
     // eventually initialize the rest
@@ -537,7 +665,23 @@ bool Probe::isValidObject(QObject *obj) const
 {
     ///TODO: can we somehow assert(s_lock().isLocked()) ?!
     ///  -> Not with a recursive mutex. Make it non-recursive, and you can do Q_ASSERT(!s_lock().tryLock());
-    return m_validObjects.contains(obj);
+    return m_trackedObjects->state(obj) == TrackedObjectSet::Announced;
+}
+
+bool Probe::isValidObject(const ObjectId &id) const
+{
+    if (id.type() != ObjectId::QObjectType)
+        return false;
+    if (id.generation() == 0)
+        return isValidObject(id.asQObject());
+    return m_trackedObjects->isAnnounced(id.asQObject(), id.generation());
+}
+
+ObjectId Probe::objectId(QObject *obj)
+{
+    if (!obj || !isInitialized())
+        return ObjectId(obj);
+    return ObjectId(obj, instance()->m_trackedObjects->generation(obj));
 }
 
 QMutex *Probe::objectLock()
@@ -559,12 +703,12 @@ QMutex *Probe::objectLock()
  * - post information to our thread
  * - emit objectCreated there right away if object still valid
  *
+ * Posting to our thread doesn't need the object lock, see queueCreatedObject().
+ *
  * Pre-conditions: lock may or may not be held already, arbitrary thread
  */
 void Probe::objectAdded(QObject *obj, bool fromCtor)
 {
-    QMutexLocker lock(s_lock());
-
     // attempt to ignore objects created by GammaRay itself, especially short-lived ones
     if (fromCtor && ProbeGuard::insideProbe() && obj->thread() == QThread::currentThread())
         return;
@@ -577,22 +721,25 @@ void Probe::objectAdded(QObject *obj, bool fromCtor)
 #endif
 
 #if USE_BACKWARD_CPP
-    static const bool disableBacktraceLogging = qgetenv("GAMMARAY_DISABLE_BACKTRACE_LOGGING") == "1";
-    if (!disableBacktraceLogging) {
-        if (fromCtor) {
-            s_listener()->constructionBacktracesForObjects[obj].load_here(32);
-        }
+    if (fromCtor && s_listener()->constructionBacktraces.shouldRecord()) {
+        backward::StackTrace st;
+        st.load_here(32);
+        s_listener()->constructionBacktraces.record(obj, st.begin(), st.size());
     }
 #endif
 
     if (!isInitialized()) {
-        IF_DEBUG(cout
-                 << "objectAdded Before: "
-                 << hex << obj
-                 << (fromCtor ? " (from ctor)" : "") << endl;
-                 )
-        s_listener()->addedBeforeProbeInstance << obj;
-        return;
+        QMutexLocker lock(s_lock());
+        // createProbe() sets the instance while holding the lock
+        if (!isInitialized()) {
+            IF_DEBUG(cout
+                     << "objectAdded Before: "
+                     << hex << obj
+                     << (fromCtor ? " (from ctor)" : "") << endl;
+                     )
+            s_listener()->addedBeforeProbeInstance << obj;
+            return;
+        }
     }
 
     if (instance()->filterObject(obj)) {
@@ -604,7 +751,13 @@ void Probe::objectAdded(QObject *obj, bool fromCtor)
         return;
     }
 
-    if (instance()->m_validObjects.contains(obj)) {
+    if (fromCtor || instance()->thread() != QThread::currentThread()) {
+        queueCreatedObject(obj);
+        return;
+    }
+
+    QMutexLocker lock(s_lock());
+    if (instance()->m_trackedObjects->state(obj) != TrackedObjectSet::Untracked) {
         // this happens when we get a child event before the objectAdded call from the ctor
         // or when we add an item from addedBeforeProbeInstance who got added already
         // due to the add-parent-before-child logic
@@ -617,36 +770,26 @@ void Probe::objectAdded(QObject *obj, bool fromCtor)
     }
 
     // make sure we already know the parent
-    if (obj->parent() && !instance()->m_validObjects.contains(obj->parent()))
-        objectAdded(obj->parent(), fromCtor);
-    Q_ASSERT(!obj->parent() || instance()->m_validObjects.contains(obj->parent()));
-
-    instance()->m_validObjects << obj;
-    if (!instance()->hasReliableObjectTracking()) {
-        // when we did not use a preload variant that
-        // overwrites qt_removeObject we must track object
-        // deletion manually
-        connect(obj, SIGNAL(destroyed(QObject*)),
-                instance(), SLOT(handleObjectDestroyed(QObject*)),
-                Qt::DirectConnection);
-    }
+    if (obj->parent()
+        && instance()->m_trackedObjects->state(obj->parent()) == TrackedObjectSet::Untracked)
+        objectAdded(obj->parent());
 
-    if (!fromCtor && obj->parent() && instance()->isObjectCreationQueued(obj->parent())) {
+    if (obj->parent() && instance()->isObjectCreationQueued(obj->parent())) {
         // when a child event triggers a call to objectAdded while inside the ctor
         // the parent is already tracked but it's call to objectFullyConstructed
         // was delayed. hence we must do the same for the child for integrity
-        fromCtor = true;
+        queueCreatedObject(obj);
+        return;
     }
 
-    IF_DEBUG(cout << "objectAdded: " << hex << obj
-                  << (fromCtor ? " (from ctor)" : "")
-                  << ", p: " << obj->parent() << endl;
+    IF_DEBUG(cout << "objectAdded: " << hex << obj << ", p: " << obj->parent() << endl;
              )
 
-    if (fromCtor)
-        instance()->queueCreatedObject(obj);
-    else
-        instance()->objectFullyConstructed(obj);
+    const quint32 generation = TrackedObjectSet::nextGeneration();
+    if (!instance()->m_trackedObjects->insertPending(obj, generation))
+        return;
+    instance()->trackDestruction(obj);
+    instance()->objectFullyConstructed(obj, generation);
 }
 
 // pre-conditions: lock may or may not be held already, our thread
@@ -654,46 +797,77 @@ void Probe::processQueuedObjectChanges()
 {
     QMutexLocker lock(s_lock());
 
-    IF_DEBUG(cout << Q_FUNC_INFO << " " << m_queuedObjectChanges.size() << endl;
+    IF_DEBUG(cout << Q_FUNC_INFO << " " << m_queuedDestroyedObjects.size() << endl;
              )
 
     // must be called from the main thread via timeout
     Q_ASSERT(QThread::currentThread() == thread());
 
-    foreach (const auto &change, m_queuedObjectChanges) {
-        switch (change.type) {
-        case ObjectChange::Create:
-            objectFullyConstructed(change.obj);
-            break;
-        case ObjectChange::Destroy:
-            emit objectDestroyed(change.obj);
-            break;
+    // destroyed objects have been announced in an earlier run already, while created
+    // objects might reuse their addresses, so destructions have to go first
+    if (!m_queuedDestroyedObjects.isEmpty()) {
+        QVector<QObject *> destroyedObjects;
+        destroyedObjects.swap(m_queuedDestroyedObjects);
+        foreach (QObject *obj, destroyedObjects)
+            emit objectDestroyed(obj);
+        m_destroyedObjectBatch += destroyedObjects;
+    }
+    flushDestroyedObjectBatch();
+
+    // reset before draining, so we don't miss anything queued while we are at it
+    m_pendingObjectsScheduled.fetchAndStoreOrdered(0);
+    QVector<PendingObjectQueue *> queues;
+    {
+        QMutexLocker queuesLock(&s_listener()->pendingObjectQueuesLock);
+        queues = s_listener()->pendingObjectQueues;
+    }
+    beginCreatedObjectBatch();
+    foreach (PendingObjectQueue *queue, queues) {
+        // check before draining, nothing is added after the thread is gone
+        const bool orphaned = queue->orphaned.load(std::memory_order_acquire);
+        PendingObject pending;
+        while (queue->queue.pop(pending))
+            objectFullyConstructed(pending.obj, pending.generation);
+        if (orphaned) {
+            QMutexLocker queuesLock(&s_listener()->pendingObjectQueuesLock);
+            QVector<PendingObjectQueue *> &registeredQueues = s_listener()->pendingObjectQueues;
+            registeredQueues.remove(registeredQueues.indexOf(queue));
+            delete queue;
         }
     }
+    endCreatedObjectBatch();
 
     IF_DEBUG(cout << Q_FUNC_INFO << " done" << endl;
              )
 
-    m_queuedObjectChanges.clear();
+    // after creations, renamed objects might have been announced only just now
+    foreach (QObject *obj, m_renamedObjects) {
+        if (isValidObject(obj))
+            m_objectSearchIndex->objectRenamed(obj);
+    }
+    m_renamedObjects.clear();
 
     foreach (QObject *obj, m_pendingReparents) {
         if (!isValidObject(obj))
             continue;
-        if (filterObject(obj)) // the move might have put it under a hidden parent
+        if (filterObject(obj)) { // the move might have put it under a hidden parent
             objectRemoved(obj);
-        else
+        } else {
+            flushDestroyedObjectBatch();
             emit objectReparented(obj);
+        }
     }
     m_pendingReparents.clear();
 }
 
 // pre-condition: lock is held already, our thread
-void Probe::objectFullyConstructed(QObject *obj)
+void Probe::objectFullyConstructed(QObject *obj, quint32 generation)
 {
     Q_ASSERT(thread() == QThread::currentThread());
 
-    if (!m_validObjects.contains(obj)) {
-        // deleted already
+    // once announced, destroying obj from another thread needs the lock, so we must not touch obj before
+    if (!m_trackedObjects->announce(obj, generation)) {
+        // deleted already, or announced as the ancestor of another object
         IF_DEBUG(cout << "stale fully constructed: " << hex << obj << endl;
                  )
         return;
@@ -703,78 +877,154 @@ void Probe::objectFullyConstructed(QObject *obj)
         // when the call was delayed from the ctor construction,
         // the parent might not have been set properly yet. hence
         // apply the filter again
-        m_validObjects.remove(obj);
+        m_trackedObjects->remove(obj);
         IF_DEBUG(cout << "now filtered fully constructed: " << hex << obj << endl;
                  )
         return;
     }
 
+#if USE_BACKWARD_CPP
+    s_listener()->constructionBacktraces.objectConstructed(obj);
+#endif
+
     IF_DEBUG(cout << "fully constructed: " << hex << obj << endl;
              )
 
-    // ensure we know all our ancestors already
-    for (QObject *parent = obj->parent(); parent; parent = parent->parent()) {
-        if (!m_validObjects.contains(parent)) {
-            objectAdded(parent); // will also handle any further ancestors
+    // ensure we announced all our ancestors already
+    if (QObject *parent = obj->parent()) {
+        switch (m_trackedObjects->state(parent)) {
+        case TrackedObjectSet::Untracked:
+        {
+            const quint32 parentGeneration = TrackedObjectSet::nextGeneration();
+            m_trackedObjects->insertPending(parent, parentGeneration);
+            trackDestruction(parent);
+            objectFullyConstructed(parent, parentGeneration); // will also handle any further ancestors
+            break;
+        }
+        case TrackedObjectSet::Pending:
+            objectFullyConstructed(parent, 0); // will also handle any further ancestors
+            break;
+        case TrackedObjectSet::Announced:
             break;
         }
     }
-    Q_ASSERT(!obj->parent() || m_validObjects.contains(obj->parent()));
+    Q_ASSERT(!obj->parent() || isValidObject(obj->parent()));
 
     m_toolManager->objectAdded(obj);
     emit objectCreated(obj);
+
+    m_createdObjectBatchIndex.insert(obj, m_createdObjectBatch.size());
+    m_createdObjectBatch.push_back(obj);
+    if (!m_batchingCreatedObjects)
+        endCreatedObjectBatch();
+}
+
+// pre-condition: lock is held already, our thread
+void Probe::beginCreatedObjectBatch()
+{
+    Q_ASSERT(!m_batchingCreatedObjects);
+    m_batchingCreatedObjects = true;
+}
+
+// pre-condition: lock is held already, our thread
+void Probe::endCreatedObjectBatch()
+{
+    m_batchingCreatedObjects = false;
+    if (m_createdObjectBatch.isEmpty())
+        return;
+
+    // new objects might reuse the address of destroyed ones not reported yet
+    flushDestroyedObjectBatch();
+
+    QVector<QObject *> createdObjects;
+    createdObjects.swap(m_createdObjectBatch);
+    if (createdObjects.size() != m_createdObjectBatchIndex.size())
+        createdObjects.erase(std::remove(createdObjects.begin(), createdObjects.end(), nullptr), createdObjects.end());
+    m_createdObjectBatchIndex.clear();
+    if (!createdObjects.isEmpty())
+        emit objectsCreated(createdObjects);
+}
+
+// pre-condition: lock is held already, our thread
+void Probe::flushDestroyedObjectBatch()
+{
+    if (m_destroyedObjectBatch.isEmpty())
+        return;
+
+    QVector<QObject *> destroyedObjects;
+    destroyedObjects.swap(m_destroyedObjectBatch);
+    emit objectsDestroyed(destroyedObjects);
 }
 
 /*
  * We have two cases to consider here:
  * (1) our thread:
- * - emit objectDestroyed() right away
+ * - emit objectDestroyed() right away, objectsDestroyed() along with the next queued changes
  * (2) other thread:
  * - post information to our thread, emit objectDestroyed() there
  *
+ * Objects that haven't been announced yet are just dropped, without needing the lock.
+ *
  * pre-conditions: arbitrary thread, lock may or may not be held already
  */
 void Probe::objectRemoved(QObject *obj)
 {
-    QMutexLocker lock(s_lock());
+#if USE_BACKWARD_CPP
+    if (s_listener())
+        s_listener()->constructionBacktraces.remove(obj);
+#endif
 
     if (!isInitialized()) {
-        IF_DEBUG(cout
-                 << "objectRemoved Before: "
-                 << hex << obj
-                 << " have statics: " << s_listener() << endl;
-                 )
-
-        if (!s_listener())
+        QMutexLocker lock(s_lock());
+        if (!isInitialized()) {
+            IF_DEBUG(cout
+                     << "objectRemoved Before: "
+                     << hex << obj
+                     << " have statics: " << s_listener() << endl;
+                     )
+
+            if (!s_listener())
+                return;
+
+            QVector<QObject *> &addedBefore = s_listener()->addedBeforeProbeInstance;
+            for (auto it = addedBefore.begin(); it != addedBefore.end();) {
+                if (*it == obj)
+                    it = addedBefore.erase(it);
+                else
+                    ++it;
+            }
             return;
-
-        QVector<QObject *> &addedBefore = s_listener()->addedBeforeProbeInstance;
-        for (auto it = addedBefore.begin(); it != addedBefore.end();) {
-            if (*it == obj)
-                it = addedBefore.erase(it);
-            else
-                ++it;
         }
-        return;
     }
 
-    IF_DEBUG(cout << "object removed:" << hex << obj << " " << obj->parent() << endl;
-             )
+    // nobody can be using objects that haven't been announced yet, so those don't need the lock,
+    // their queued creation is skipped as they are not pending anymore
+    Probe *probe = instance();
+    if (probe->m_trackedObjects->removePending(obj) != TrackedObjectSet::Announced)
+        return; // not tracked by the probe (probably a gammaray object), or dropped now
 
-    bool success = instance()->m_validObjects.remove(obj);
-    if (!success) {
-        // object was not tracked by the probe, probably a gammaray object
-        EXPENSIVE_ASSERT(!instance()->isObjectCreationQueued(obj));
-        return;
-    }
+    QMutexLocker lock(s_lock());
+    if (probe->m_trackedObjects->remove(obj) == TrackedObjectSet::Untracked)
+        return; // filtered out meanwhile
 
-    instance()->purgeChangesForObject(obj);
-    EXPENSIVE_ASSERT(!instance()->isObjectCreationQueued(obj));
+    IF_DEBUG(cout << "object removed:" << hex << obj << endl;
+             )
 
-    if (instance()->thread() == QThread::currentThread())
-        emit instance()->objectDestroyed(obj);
-    else
-        instance()->queueDestroyedObject(obj);
+    if (probe->thread() == QThread::currentThread()) {
+        emit probe->objectDestroyed(obj);
+        // no need to report it if objectsCreated() hasn't been emitted for it yet either
+        // the slot is nulled out rather than removed, that keeps the indexes of the others valid
+        const auto batchIt = probe->m_createdObjectBatchIndex.find(obj);
+        if (batchIt != probe->m_createdObjectBatchIndex.end()) {
+            probe->m_createdObjectBatch[batchIt.value()] = nullptr;
+            probe->m_createdObjectBatchIndex.erase(batchIt);
+        } else {
+            probe->m_destroyedObjectBatch.push_back(obj);
+            probe->notifyQueuedObjectChanges();
+        }
+    } else {
+        probe->queueDestroyedObject(obj);
+    }
 }
 
 void Probe::handleObjectDestroyed(QObject *obj)
@@ -782,46 +1032,67 @@ void Probe::handleObjectDestroyed(QObject *obj)
     objectRemoved(obj);
 }
 
-// pre-condition: we have the lock, arbitrary thread
+// pre-condition: obj is not filtered, arbitrary thread, lock may or may not be held already
 void Probe::queueCreatedObject(QObject *obj)
 {
-    EXPENSIVE_ASSERT(!isObjectCreationQueued(obj));
+    Probe *probe = instance();
+    if (probe->m_trackedObjects->state(obj) != TrackedObjectSet::Untracked)
+        return; // see objectAdded()
 
-    ObjectChange c;
-    c.obj = obj;
-    c.type = ObjectChange::Create;
-    m_queuedObjectChanges.push_back(c);
-    notifyQueuedObjectChanges();
+    // make sure we already know the parent
+    QObject *parent = obj->parent();
+    if (parent && probe->m_trackedObjects->state(parent) == TrackedObjectSet::Untracked)
+        objectAdded(parent, true);
+
+    PendingObject pending;
+    pending.obj = obj;
+    pending.generation = TrackedObjectSet::nextGeneration();
+    if (!probe->m_trackedObjects->insertPending(obj, pending.generation))
+        return; // added by another thread meanwhile
+    probe->trackDestruction(obj);
+
+    localPendingObjectQueue()->queue.push(std::move(pending));
+    probe->schedulePendingObjects();
 }
 
 // pre-condition: we have the lock, arbitrary thread
 void Probe::queueDestroyedObject(QObject *obj)
 {
-    ObjectChange c;
-    c.obj = obj;
-    c.type = ObjectChange::Destroy;
-    m_queuedObjectChanges.push_back(c);
+    m_queuedDestroyedObjects.push_back(obj);
     notifyQueuedObjectChanges();
 }
 
-// pre-condition: we have the lock, arbitrary thread
+// pre-condition: arbitrary thread, lock may or may not be held already
+void Probe::objectRenamed(QObject *obj)
+{
+    if (!isInitialized())
+        return;
+    Probe *probe = instance();
+    // objects not announced yet are indexed with their name at that point
+    if (probe->m_trackedObjects->state(obj) != TrackedObjectSet::Announced)
+        return;
+
+    QMutexLocker lock(s_lock());
+    probe->m_renamedObjects.insert(obj);
+    probe->notifyQueuedObjectChanges();
+}
+
+// pre-condition: arbitrary thread
 bool Probe::isObjectCreationQueued(QObject *obj) const
 {
-    return std::find_if(m_queuedObjectChanges.begin(), m_queuedObjectChanges.end(),
-                        [obj](const ObjectChange &c) {
-        return c.obj == obj && c.type == Probe::ObjectChange::Create;
-    }) != m_queuedObjectChanges.end();
+    return m_trackedObjects->state(obj) == TrackedObjectSet::Pending;
 }
 
-// pre-condition: we have the lock, arbitrary thread
-void Probe::purgeChangesForObject(QObject *obj)
+// pre-condition: arbitrary thread
+void Probe::trackDestruction(QObject *obj)
 {
-    for (int i = 0; i < m_queuedObjectChanges.size(); ++i) {
-        if (m_queuedObjectChanges.at(i).obj == obj
-            && m_queuedObjectChanges.at(i).type == ObjectChange::Create) {
-            m_queuedObjectChanges.remove(i);
-            return;
-        }
+    if (!hasReliableObjectTracking()) {
+        // when we did not use a preload variant that
+        // overwrites qt_removeObject we must track object
+        // deletion manually
+        connect(obj, SIGNAL(destroyed(QObject*)),
+                this, SLOT(handleObjectDestroyed(QObject*)),
+                Qt::DirectConnection);
     }
 }
 
@@ -845,6 +1116,13 @@ void Probe::notifyQueuedObjectChanges()
     }
 }
 
+// pre-condition: arbitrary thread, lock may or may not be held already
+void Probe::schedulePendingObjects()
+{
+    if (m_pendingObjectsScheduled.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "processQueuedObjectChanges", Qt::QueuedConnection);
+}
+
 bool Probe::eventFilter(QObject *receiver, QEvent *event)
 {
     if (ProbeGuard::insideProbe() && receiver->thread() == QThread::currentThread())
@@ -854,34 +1132,41 @@ bool Probe::eventFilter(QObject *receiver, QEvent *event)
         QChildEvent *childEvent = static_cast<QChildEvent *>(event);
         QObject *obj = childEvent->child();
 
-        QMutexLocker lock(s_lock());
-        const bool tracked = m_validObjects.contains(obj);
+        const TrackedObjectSet::State state = m_trackedObjects->state(obj);
         const bool filtered = filterObject(obj);
 
         IF_DEBUG(cout << "child event: " << hex << obj << ", p: " << obj->parent() << dec
-                      << ", tracked: " << tracked
+                      << ", state: " << state
                       << ", filtered: " << filtered
                       << ", type: " << (childEvent->added() ? "added" : "removed") << endl;
                  )
 
         if (!filtered && childEvent->added()) {
-            if (!tracked) {
+            if (state == TrackedObjectSet::Untracked) {
                 // was not tracked before, add to all models
                 // child added events are sent before qt_addObject is called,
                 // so we assumes this comes from the ctor
                 objectAdded(obj, true);
-            } else if (!isObjectCreationQueued(obj) && !isObjectCreationQueued(obj->parent())) {
+            } else if (state == TrackedObjectSet::Announced) {
                 // object is known already, just update the position in the tree
                 // BUT: only when we did not queue this item before
-                IF_DEBUG(cout << "update pos: " << hex << obj << endl;
-                         )
-                m_pendingReparents.removeAll(obj);
-                emit objectReparented(obj);
+                QMutexLocker lock(s_lock());
+                if (isValidObject(obj) && !isObjectCreationQueued(obj->parent())) {
+                    IF_DEBUG(cout << "update pos: " << hex << obj << endl;
+                             )
+                    m_pendingReparents.removeAll(obj);
+                    flushDestroyedObjectBatch();
+                    emit objectReparented(obj);
+                }
             }
-        } else if (tracked) {
+        } else if (state != TrackedObjectSet::Untracked) {
             if (hasReliableObjectTracking()) { // defer processing this until we know its final location
-                m_pendingReparents.push_back(obj);
-                notifyQueuedObjectChanges();
+                // objects still queued for creation will pick up their final location anyway
+                if (state == TrackedObjectSet::Announced) {
+                    QMutexLocker lock(s_lock());
+                    m_pendingReparents.push_back(obj);
+                    notifyQueuedObjectChanges();
+                }
             } else {
                 objectRemoved(obj);
             }
@@ -889,13 +1174,13 @@ bool Probe::eventFilter(QObject *receiver, QEvent *event)
     }
 
     // widget only unfortunately, but more precise than ChildAdded/Removed...
-    if (event->type() == QEvent::ParentChange) {
+    if (event->type() == QEvent::ParentChange
+        && m_trackedObjects->state(receiver) == TrackedObjectSet::Announced) {
         QMutexLocker lock(s_lock());
-        const bool tracked = m_validObjects.contains(receiver);
         const bool filtered = filterObject(receiver);
-        if (!filtered && tracked && !isObjectCreationQueued(receiver)
-            && !isObjectCreationQueued(receiver->parent())) {
+        if (!filtered && isValidObject(receiver) && !isObjectCreationQueued(receiver->parent())) {
             m_pendingReparents.removeAll(receiver);
+            flushDestroyedObjectBatch();
             emit objectReparented(receiver);
         }
     }
@@ -907,9 +1192,7 @@ bool Probe::eventFilter(QObject *receiver, QEvent *event)
         && event->type() != QEvent::Destroy
         && event->type() != QEvent::WinIdChange // unsafe since emitted from dtors
         && !filterObject(receiver)) {
-        QMutexLocker lock(s_lock());
-        const bool tracked = m_validObjects.contains(receiver);
-        if (!tracked)
+        if (m_trackedObjects->state(receiver) == TrackedObjectSet::Untracked)
             discoverObject(receiver);
     }
 
@@ -942,7 +1225,7 @@ void Probe::discoverObject(QObject *object)
         return;
 
     QMutexLocker lock(s_lock());
-    if (m_validObjects.contains(object))
+    if (m_trackedObjects->state(object) != TrackedObjectSet::Untracked)
         return;
 
     objectAdded(object);
@@ -1014,12 +1297,20 @@ void Probe::registerSignalSpyCallbackSet(const SignalSpyCallbackSet &callbacks)
 void Probe::setupSignalSpyCallbacks()
 {
     QSignalSpyCallbackSet cbs = { nullptr, nullptr, nullptr, nullptr };
+    bool forwardSignalBegin = false;
     foreach (const auto &it, m_signalSpyCallbacks) {
-        if (it.signalBeginCallback) cbs.signal_begin_callback = signal_begin_callback;
+        if (it.signalBeginCallback) forwardSignalBegin = true;
         if (it.signalEndCallback) cbs.signal_end_callback = signal_end_callback;
         if (it.slotBeginCallback) cbs.slot_begin_callback = slot_begin_callback;
         if (it.slotEndCallback) cbs.slot_end_callback = slot_end_callback;
     }
+    s_forwardSignalBegin.store(forwardSignalBegin, std::memory_order_relaxed);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    cbs.signal_begin_callback = signal_begin_callback; // see objectRenamed()
+#else
+    if (forwardSignalBegin)
+        cbs.signal_begin_callback = signal_begin_callback;
+#endif
     qt_register_signal_spy_callbacks(cbs);
 }
 
@@ -1034,12 +1325,12 @@ void Probe::executeSignalCallback(const Func &func)
 SourceLocation Probe::objectCreationSourceLocation(QObject *object)
 {
 #if USE_BACKWARD_CPP
-  if (!s_listener()->constructionBacktracesForObjects.contains(object)) {
+  RecordedStackTrace st(s_listener()->constructionBacktraces.frames(object));
+  if (st.size() == 0) {
     IF_DEBUG(std::cout << "No backtrace for object available" << object << "." << std::endl;)
     return SourceLocation();
   }
 
-  backward::StackTrace &st = s_listener()->constructionBacktracesForObjects[object];
   int distanceToQObject = 0;
   m_traceResolver->load_stacktrace(st);
 
@@ -33,9 +33,11 @@
 #include "probeinterface.h"
 #include "signalspycallbackset.h"
 
+#include <common/objectid.h>
 #include <common/sourcelocation.h>
 
 #include <QObject>
+#include <QHash>
 #include <QList>
 #include <QSet>
 #include <QVector>
@@ -73,6 +75,8 @@ class BenchSuite;
 class Server;
 class ToolManager;
 class MetaObjectRegistry;
+class ObjectSearchIndex;
+class TrackedObjectSet;
 
 /**
  * @brief Central entity of GammaRay: The probe is tracking the Qt application under test
@@ -123,6 +127,7 @@ public:
     QObject *probe() const override;
 
     MetaObjectRegistry *metaObjectRegistry() const;
+    ObjectSearchIndex *objectSearchIndex() const;
 
     /**
      * Lock this to check the validity of a QObject
@@ -133,14 +138,36 @@ public:
     /**
      * check whether @p obj is still valid
      *
-     * NOTE: the objectLock must be locked when this is called!
+     * Newly created objects only become valid once objectCreated() has been emitted for them.
+     *
+     * NOTE: the objectLock must be locked when this is called, unless @p obj is only
+     * accessed from the thread it lives in!
      */
     bool isValidObject(QObject *obj) const;
+    /**
+     * check whether the object identified by @p id is still valid
+     *
+     * Unlike isValidObject(QObject*) this also detects if the object has been destroyed
+     * and another one has been created at the same address meanwhile, if @p id
+     * has been obtained from objectId(). The check itself doesn't need the objectLock,
+     * accessing the object afterwards does though, see above.
+     * @since 2.9
+     */
+    bool isValidObject(const ObjectId &id) const;
+
+    /**
+     * Returns an ObjectId for @p obj carrying the generation the probe tracks it with,
+     * for use with isValidObject(const ObjectId&).
+     * @since 2.9
+     */
+    static ObjectId objectId(QObject *obj);
 
     bool filterObject(QObject *obj) const override;
 
     /// internal
     static void startupHookReceived();
+    /// internal, called for every emission of QObject::objectNameChanged()
+    static void objectRenamed(QObject *obj);
     template<typename Func> static void executeSignalCallback(const Func &func);
 
 signals:
@@ -184,6 +211,28 @@ signals:
     void objectDestroyed(QObject *obj);
     void objectReparented(QObject *obj);
 
+    /**
+     * Emitted for batches of newly created QObjects, in addition to objectCreated().
+     *
+     * Objects announced together, e.g. all objects created in other threads or from ctors
+     * since the last event loop re-entry, are reported at once, parents always precede their
+     * children. Prefer this over objectCreated() when you need to handle many objects.
+     * The same notes as for objectCreated() apply.
+     * @since 2.9
+     */
+    void objectsCreated(const QVector<QObject *> &objects);
+    /**
+     * Emitted for batches of destroyed objects, in addition to objectDestroyed().
+     *
+     * Each object reported by objectsCreated() is reported here exactly once, before
+     * objectsCreated() or objectReparented() are emitted for any object created later.
+     * Unlike objectDestroyed(), objects destroyed in the probe thread are collected as well and
+     * reported once the queued object changes are processed. The same notes as for
+     * objectDestroyed() apply.
+     * @since 2.9
+     */
+    void objectsDestroyed(const QVector<QObject *> &objects);
+
 protected:
     bool eventFilter(QObject *receiver, QEvent *event) override;
 
@@ -204,13 +253,17 @@ private:
      */
     bool hasReliableObjectTracking() const;
 
-    void objectFullyConstructed(QObject *obj);
+    void objectFullyConstructed(QObject *obj, quint32 generation);
 
-    void queueCreatedObject(QObject *obj);
+    static void queueCreatedObject(QObject *obj);
     void queueDestroyedObject(QObject *obj);
     bool isObjectCreationQueued(QObject *obj) const;
-    void purgeChangesForObject(QObject *obj);
+    void trackDestruction(QObject *obj);
     void notifyQueuedObjectChanges();
+    void schedulePendingObjects();
+    void beginCreatedObjectBatch();
+    void endCreatedObjectBatch();
+    void flushDestroyedObjectBatch();
 
     void findExistingObjects();
 
@@ -231,20 +284,24 @@ private:
     ObjectTreeModel *m_objectTreeModel;
     ToolManager *m_toolManager;
     QObject *m_window;
-    QSet<QObject *> m_validObjects;
+    std::unique_ptr<TrackedObjectSet> m_trackedObjects;
     MetaObjectRegistry *m_metaObjectRegistry;
-
-    // all delayed object changes need to go through a single queue, as the order is crucial
-    struct ObjectChange {
-        QObject *obj;
-        enum Type {
-            Create,
-            Destroy
-        } type;
-    };
-    QVector<ObjectChange> m_queuedObjectChanges;
+    ObjectSearchIndex *m_objectSearchIndex;
+
+    // created objects are queued lock-free per thread, destroyed ones need the object lock
+    // as they have been announced already, see processQueuedObjectChanges() for the order
+    QVector<QObject *> m_queuedDestroyedObjects;
+    QAtomicInt m_pendingObjectsScheduled;
+    // objects announced but not yet reported by objectsCreated(), destroyed ones are nulled out
+    QVector<QObject *> m_createdObjectBatch;
+    QHash<QObject *, int> m_createdObjectBatchIndex;
+    bool m_batchingCreatedObjects;
+    // objects destroyed but not yet reported by objectsDestroyed(), in the order of destruction
+    QVector<QObject *> m_destroyedObjectBatch;
 
     QList<QObject *> m_pendingReparents;
+    // announced objects whose name changed, to be re-indexed by processQueuedObjectChanges()
+    QSet<QObject *> m_renamedObjects;
     QTimer *m_queueTimer;
     QVector<QObject *> m_globalEventFilters;
     QVector<SignalSpyCallbackSet> m_signalSpyCallbacks;
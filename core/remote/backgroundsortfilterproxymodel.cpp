@@ -0,0 +1,889 @@
+/*
+  backgroundsortfilterproxymodel.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "backgroundsortfilterproxymodel.h"
+
+#include <core/probeguard.h>
+
+#include <QDateTime>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <algorithm>
+
+using namespace GammaRay;
+
+static int loadGeneration(const QAtomicInt &generation)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    return generation.load();
+#else
+    return generation;
+#endif
+}
+
+// same semantics as QSortFilterProxyModel::filterAcceptsRow(), based on the key snapshot
+static bool acceptsRow(const QVector<QString> &keys, int columnCount, int row,
+                       const QRegExp &regExp, int keyColumn)
+{
+    if (regExp.isEmpty())
+        return true;
+    if (keyColumn < 0) {
+        for (int column = 0; column < columnCount; ++column) {
+            if (keys.at(row * columnCount + column).contains(regExp))
+                return true;
+        }
+        return false;
+    }
+    if (keyColumn >= columnCount)
+        return false;
+    return keys.at(row * columnCount + keyColumn).contains(regExp);
+}
+
+// a subset of the QSortFilterProxyModel::lessThan() type handling, this must not touch any model
+static bool variantLessThan(const QVariant &lhs, const QVariant &rhs, Qt::CaseSensitivity caseSensitivity)
+{
+    if (lhs.userType() == QVariant::Invalid)
+        return false;
+    if (rhs.userType() == QVariant::Invalid)
+        return true;
+
+    switch (lhs.userType()) {
+    case QVariant::Int:
+    case QVariant::LongLong:
+    case QVariant::Bool:
+        return lhs.toLongLong() < rhs.toLongLong();
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        return lhs.toULongLong() < rhs.toULongLong();
+    case QVariant::Double:
+        return lhs.toDouble() < rhs.toDouble();
+    case QVariant::Char:
+        return lhs.toChar() < rhs.toChar();
+    case QVariant::Date:
+        return lhs.toDate() < rhs.toDate();
+    case QVariant::Time:
+        return lhs.toTime() < rhs.toTime();
+    case QVariant::DateTime:
+        return lhs.toDateTime() < rhs.toDateTime();
+    default:
+        return lhs.toString().compare(rhs.toString(), caseSensitivity) < 0;
+    }
+}
+
+namespace {
+struct SortKeyLessThan
+{
+    SortKeyLessThan(const QVector<QVariant> &keys, Qt::SortOrder order, Qt::CaseSensitivity caseSensitivity)
+        : keys(keys)
+        , order(order)
+        , caseSensitivity(caseSensitivity)
+    {
+    }
+
+    bool operator()(int lhs, int rhs) const
+    {
+        if (order == Qt::AscendingOrder)
+            return variantLessThan(keys.at(lhs), keys.at(rhs), caseSensitivity);
+        return variantLessThan(keys.at(rhs), keys.at(lhs), caseSensitivity);
+    }
+
+    const QVector<QVariant> &keys;
+    Qt::SortOrder order;
+    Qt::CaseSensitivity caseSensitivity;
+};
+
+/** Computes a new mapping from a key snapshot, without accessing the source model. */
+class SortFilterJob : public QRunnable
+{
+public:
+    SortFilterJob(QObject *receiver, const QAtomicInt *currentGeneration)
+        : receiver(receiver)
+        , currentGeneration(currentGeneration)
+        , columnCount(0)
+        , rowCount(0)
+        , filterKeyColumn(0)
+        , sorted(false)
+        , sortOrder(Qt::AscendingOrder)
+        , sortCaseSensitivity(Qt::CaseSensitive)
+    {
+    }
+
+    void run() override
+    {
+        QVector<int> &rows = mapping.proxyToSource;
+        rows.reserve(rowCount);
+        for (int row = 0; row < rowCount; ++row) {
+            if ((row & 0x3ff) == 0 && isCancelled())
+                return;
+            if (acceptsRow(filterKeys, columnCount, row, filterRegExp, filterKeyColumn))
+                rows.push_back(row);
+        }
+
+        if (sorted) {
+            if (isCancelled())
+                return;
+            std::stable_sort(rows.begin(), rows.end(), SortKeyLessThan(sortKeys, sortOrder, sortCaseSensitivity));
+        }
+
+        if (isCancelled())
+            return;
+        QMetaObject::invokeMethod(receiver, "applyMapping", Qt::QueuedConnection,
+                                  Q_ARG(GammaRay::BackgroundSortFilterProxyModel::Mapping, mapping));
+    }
+
+    bool isCancelled() const
+    {
+        return loadGeneration(*currentGeneration) != mapping.generation;
+    }
+
+    // the receiver outlives us, its destructor waits for all jobs to finish
+    QObject *receiver;
+    const QAtomicInt *currentGeneration;
+
+    BackgroundSortFilterProxyModel::Mapping mapping;
+    QVector<QString> filterKeys;
+    QVector<QVariant> sortKeys;
+    int columnCount;
+    int rowCount;
+    QRegExp filterRegExp;
+    int filterKeyColumn;
+    bool sorted;
+    Qt::SortOrder sortOrder;
+    Qt::CaseSensitivity sortCaseSensitivity;
+};
+}
+
+BackgroundSortFilterProxyModel::BackgroundSortFilterProxyModel(QObject *parent)
+    : QAbstractProxyModel(parent)
+    , m_filterKeyColumn(0)
+    , m_filterRole(Qt::DisplayRole)
+    , m_sortColumn(-1)
+    , m_sortOrder(Qt::AscendingOrder)
+    , m_sortRole(Qt::DisplayRole)
+    , m_sortCaseSensitivity(Qt::CaseSensitive)
+    , m_dynamicSortFilter(true)
+    , m_sourceColumnCount(0)
+    , m_sourceRevision(0)
+    , m_updatePending(false)
+    , m_tracksSnapshot(false)
+    , m_updateTimer(new QTimer(this))
+    , m_threadPool(new QThreadPool(this))
+    , m_generation(0)
+{
+    qRegisterMetaType<GammaRay::BackgroundSortFilterProxyModel::Mapping>();
+
+    // a single worker is enough, anything but the latest computation is cancelled anyway
+    m_threadPool->setMaxThreadCount(1);
+
+    // coalesce changes to several filter/sort settings in a row
+    m_updateTimer->setSingleShot(true);
+    m_updateTimer->setInterval(0);
+    connect(m_updateTimer, SIGNAL(timeout()), this, SLOT(startUpdate()));
+}
+
+BackgroundSortFilterProxyModel::~BackgroundSortFilterProxyModel()
+{
+    m_generation.fetchAndAddOrdered(1);
+    m_threadPool->waitForDone();
+}
+
+QRegExp BackgroundSortFilterProxyModel::filterRegExp() const
+{
+    return m_filterRegExp;
+}
+
+void BackgroundSortFilterProxyModel::setFilterRegExp(const QRegExp &regExp)
+{
+    if (m_filterRegExp == regExp)
+        return;
+    m_filterRegExp = regExp;
+    invalidate();
+}
+
+int BackgroundSortFilterProxyModel::filterKeyColumn() const
+{
+    return m_filterKeyColumn;
+}
+
+void BackgroundSortFilterProxyModel::setFilterKeyColumn(int column)
+{
+    if (m_filterKeyColumn == column)
+        return;
+    m_filterKeyColumn = column;
+    if (!m_filterRegExp.isEmpty())
+        invalidate();
+}
+
+Qt::CaseSensitivity BackgroundSortFilterProxyModel::filterCaseSensitivity() const
+{
+    return m_filterRegExp.caseSensitivity();
+}
+
+void BackgroundSortFilterProxyModel::setFilterCaseSensitivity(Qt::CaseSensitivity caseSensitivity)
+{
+    if (m_filterRegExp.caseSensitivity() == caseSensitivity)
+        return;
+    m_filterRegExp.setCaseSensitivity(caseSensitivity);
+    if (!m_filterRegExp.isEmpty())
+        invalidate();
+}
+
+int BackgroundSortFilterProxyModel::filterRole() const
+{
+    return m_filterRole;
+}
+
+void BackgroundSortFilterProxyModel::setFilterRole(int role)
+{
+    if (m_filterRole == role)
+        return;
+    m_filterRole = role;
+    resetFilterKeys();
+    if (!m_filterRegExp.isEmpty())
+        invalidate();
+}
+
+bool BackgroundSortFilterProxyModel::dynamicSortFilter() const
+{
+    return m_dynamicSortFilter;
+}
+
+void BackgroundSortFilterProxyModel::setDynamicSortFilter(bool enable)
+{
+    m_dynamicSortFilter = enable;
+}
+
+int BackgroundSortFilterProxyModel::sortColumn() const
+{
+    return m_sortColumn;
+}
+
+Qt::SortOrder BackgroundSortFilterProxyModel::sortOrder() const
+{
+    return m_sortOrder;
+}
+
+int BackgroundSortFilterProxyModel::sortRole() const
+{
+    return m_sortRole;
+}
+
+void BackgroundSortFilterProxyModel::setSortRole(int role)
+{
+    if (m_sortRole == role)
+        return;
+    m_sortRole = role;
+    resetSortKeys();
+    if (m_sortColumn >= 0)
+        invalidate();
+}
+
+Qt::CaseSensitivity BackgroundSortFilterProxyModel::sortCaseSensitivity() const
+{
+    return m_sortCaseSensitivity;
+}
+
+void BackgroundSortFilterProxyModel::setSortCaseSensitivity(Qt::CaseSensitivity caseSensitivity)
+{
+    if (m_sortCaseSensitivity == caseSensitivity)
+        return;
+    m_sortCaseSensitivity = caseSensitivity;
+    if (m_sortColumn >= 0)
+        invalidate();
+}
+
+bool BackgroundSortFilterProxyModel::isUpdating() const
+{
+    return m_updatePending;
+}
+
+void BackgroundSortFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (sourceModel == this->sourceModel())
+        return;
+
+    beginResetModel();
+    if (this->sourceModel())
+        disconnect(this->sourceModel(), nullptr, this, nullptr);
+
+    QAbstractProxyModel::setSourceModel(sourceModel);
+
+    if (sourceModel) {
+        connect(sourceModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+                this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(sourceModel, SIGNAL(headerDataChanged(Qt::Orientation,int,int)),
+                this, SLOT(sourceHeaderDataChanged(Qt::Orientation,int,int)));
+        connect(sourceModel, SIGNAL(rowsInserted(QModelIndex,int,int)),
+                this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        connect(sourceModel, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+                this, SLOT(sourceRowsAboutToBeRemoved(QModelIndex,int,int)));
+        connect(sourceModel, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+                this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        // column changes, moved rows/columns and layout changes are rare in the flat models
+        // this is used for, so a reset is good enough for those
+        connect(sourceModel, SIGNAL(columnsAboutToBeInserted(QModelIndex,int,int)),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(columnsInserted(QModelIndex,int,int)),
+                this, SLOT(sourceModelReset()));
+        connect(sourceModel, SIGNAL(columnsAboutToBeRemoved(QModelIndex,int,int)),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(columnsRemoved(QModelIndex,int,int)),
+                this, SLOT(sourceModelReset()));
+        connect(sourceModel, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceModelReset()));
+        connect(sourceModel, SIGNAL(columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)),
+                this, SLOT(sourceModelReset()));
+        connect(sourceModel, SIGNAL(layoutAboutToBeChanged()),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(layoutChanged()),
+                this, SLOT(sourceModelReset()));
+        connect(sourceModel, SIGNAL(modelAboutToBeReset()),
+                this, SLOT(sourceModelAboutToBeReset()));
+        connect(sourceModel, SIGNAL(modelReset()),
+                this, SLOT(sourceModelReset()));
+    }
+
+    resetMapping();
+    endResetModel();
+}
+
+QModelIndex BackgroundSortFilterProxyModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel())
+        return QModelIndex();
+    Q_ASSERT(proxyIndex.model() == this);
+    return sourceModel()->index(m_proxyToSource.at(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex BackgroundSortFilterProxyModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid() || sourceIndex.parent().isValid())
+        return QModelIndex();
+    Q_ASSERT(sourceIndex.model() == sourceModel());
+    const int row = m_sourceToProxy.value(sourceIndex.row(), -1);
+    if (row < 0)
+        return QModelIndex();
+    return index(row, sourceIndex.column());
+}
+
+QModelIndex BackgroundSortFilterProxyModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || column < 0 || row >= m_proxyToSource.size()
+        || column >= m_sourceColumnCount)
+        return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex BackgroundSortFilterProxyModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child);
+    return QModelIndex();
+}
+
+int BackgroundSortFilterProxyModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_proxyToSource.size();
+}
+
+int BackgroundSortFilterProxyModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_sourceColumnCount;
+}
+
+bool BackgroundSortFilterProxyModel::hasChildren(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !m_proxyToSource.isEmpty();
+}
+
+void BackgroundSortFilterProxyModel::sort(int column, Qt::SortOrder order)
+{
+    if (m_sortColumn == column && m_sortOrder == order)
+        return;
+    const bool keysChanged = m_sortColumn != column;
+    m_sortColumn = column;
+    m_sortOrder = order;
+    if (keysChanged)
+        resetSortKeys();
+    invalidate();
+}
+
+void BackgroundSortFilterProxyModel::startUpdate()
+{
+    if (!sourceModel())
+        return;
+
+    const int generation = m_generation.fetchAndAddOrdered(1) + 1;
+
+    if (m_filterRegExp.isEmpty() && !hasSortKeys()) {
+        // nothing to compute, restoring the source order is cheap enough to do right away
+        Mapping mapping;
+        mapping.generation = generation;
+        mapping.sourceRevision = m_sourceRevision;
+        const int rows = sourceModel()->rowCount();
+        mapping.proxyToSource.reserve(rows);
+        for (int row = 0; row < rows; ++row)
+            mapping.proxyToSource.push_back(row);
+        applyMapping(mapping);
+        return;
+    }
+
+    auto job = new SortFilterJob(this, &m_generation);
+    job->mapping.generation = generation;
+    job->mapping.sourceRevision = m_sourceRevision;
+    job->mapping.sourceRowCount = sourceModel()->rowCount();
+    job->filterKeys = m_filterKeys; // implicitly shared, we detach on the next source change
+    job->sortKeys = m_sortKeys;
+    job->columnCount = m_sourceColumnCount;
+    job->rowCount = sourceModel()->rowCount();
+    job->filterRegExp = m_filterRegExp;
+    job->filterKeyColumn = m_filterKeyColumn;
+    job->sorted = hasSortKeys();
+    job->sortOrder = m_sortOrder;
+    job->sortCaseSensitivity = m_sortCaseSensitivity;
+
+    // source changes while the job runs are applied on top of its result, rather than restarting it
+    m_snapshotRows.resize(job->rowCount);
+    for (int row = 0; row < job->rowCount; ++row)
+        m_snapshotRows[row] = row;
+    m_tracksSnapshot = true;
+
+    m_updatePending = true;
+    ProbeGuard guard; // don't report our worker thread as part of the target application
+    m_threadPool->start(job);
+}
+
+void BackgroundSortFilterProxyModel::applyMapping(const Mapping &mapping)
+{
+    if (mapping.generation != loadGeneration(m_generation))
+        return; // superseded by a newer computation
+    m_updatePending = false;
+
+    QVector<int> proxyToSource = mapping.proxyToSource;
+    if (mapping.sourceRevision != m_sourceRevision)
+        rebaseMapping(proxyToSource, mapping.sourceRowCount);
+    m_tracksSnapshot = false;
+    m_snapshotRows.clear();
+
+    emit layoutAboutToBeChanged();
+
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QVector<int> sourceRows;
+    sourceRows.reserve(oldIndexes.size());
+    foreach (const auto &persistentIndex, oldIndexes)
+        sourceRows.push_back(m_proxyToSource.at(persistentIndex.row()));
+
+    m_proxyToSource = proxyToSource;
+    rebuildSourceToProxy();
+
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for (int i = 0; i < oldIndexes.size(); ++i)
+        newIndexes.push_back(index(m_sourceToProxy.at(sourceRows.at(i)), oldIndexes.at(i).column()));
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged();
+    emit updated();
+}
+
+void BackgroundSortFilterProxyModel::sourceDataChanged(const QModelIndex &topLeft,
+                                                       const QModelIndex &bottomRight)
+{
+    if (topLeft.parent().isValid())
+        return;
+
+    updateKeys(topLeft.row(), bottomRight.row());
+
+    int first = m_proxyToSource.size();
+    int last = -1;
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        const int proxyRow = m_sourceToProxy.at(row);
+        if (proxyRow < 0)
+            continue;
+        first = std::min(first, proxyRow);
+        last = std::max(last, proxyRow);
+    }
+    if (last >= 0)
+        emit dataChanged(index(first, topLeft.column()), index(last, bottomRight.column()));
+
+    if (!m_dynamicSortFilter)
+        return;
+    const bool filterChanged = !m_filterRegExp.isEmpty()
+                               && (m_filterKeyColumn < 0
+                                   || (m_filterKeyColumn >= topLeft.column()
+                                       && m_filterKeyColumn <= bottomRight.column()));
+    const bool sortChanged = hasSortKeys() && m_sortColumn >= topLeft.column()
+                             && m_sortColumn <= bottomRight.column();
+    if (!filterChanged && !sortChanged)
+        return;
+
+    // a pending result was computed from the old keys, so treat the changed rows like added ones there
+    if (m_tracksSnapshot) {
+        ++m_sourceRevision;
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row)
+            m_snapshotRows[row] = -1;
+    }
+
+    // only rows that change their filter state or end up out of order are moved,
+    // the others keep their proxy rows, and so their persistent indexes
+    QVector<int> insertedRows;
+    QVector<int> removedProxyRows;
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        const int proxyRow = m_sourceToProxy.at(row);
+        const bool accepted = filterChanged ? filterAcceptsRow(row) : proxyRow >= 0;
+        if (accepted && proxyRow < 0)
+            insertedRows.push_back(row);
+        else if (!accepted && proxyRow >= 0)
+            removedProxyRows.push_back(proxyRow);
+    }
+    removeProxyRows(removedProxyRows);
+
+    // while an update is pending, the mapping isn't sorted by the current keys anyway
+    while (sortChanged && !m_updatePending) {
+        removedProxyRows.clear();
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            const int proxyRow = m_sourceToProxy.at(row);
+            if (proxyRow >= 0 && !isSortedAt(proxyRow)) {
+                removedProxyRows.push_back(proxyRow);
+                insertedRows.push_back(row);
+            }
+        }
+        // removing a row can put two changed rows next to each other, so check again
+        if (removedProxyRows.isEmpty())
+            break;
+        removeProxyRows(removedProxyRows);
+    }
+
+    insertSourceRows(insertedRows);
+}
+
+void BackgroundSortFilterProxyModel::sourceHeaderDataChanged(Qt::Orientation orientation, int first,
+                                                             int last)
+{
+    if (orientation == Qt::Horizontal)
+        emit headerDataChanged(orientation, first, last);
+}
+
+void BackgroundSortFilterProxyModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    // we insert the accepted rows once we know their content
+    if (parent.isValid())
+        return;
+
+    ++m_sourceRevision;
+    const int count = last - first + 1;
+    for (auto it = m_proxyToSource.begin(); it != m_proxyToSource.end(); ++it) {
+        if (*it >= first)
+            *it += count;
+    }
+    m_sourceToProxy.insert(first, count, -1);
+    if (m_tracksSnapshot)
+        m_snapshotRows.insert(first, count, -1);
+    m_filterKeys.insert(first * m_sourceColumnCount, count * m_sourceColumnCount, QString());
+    if (hasSortKeys())
+        m_sortKeys.insert(first, count, QVariant());
+    updateKeys(first, last);
+
+    QVector<int> acceptedRows;
+    for (int row = first; row <= last; ++row) {
+        if (filterAcceptsRow(row))
+            acceptedRows.push_back(row);
+    }
+    insertSourceRows(acceptedRows);
+}
+
+void BackgroundSortFilterProxyModel::sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first,
+                                                                int last)
+{
+    if (parent.isValid())
+        return;
+
+    ++m_sourceRevision;
+    QVector<int> proxyRows;
+    for (int row = first; row <= last; ++row) {
+        const int proxyRow = m_sourceToProxy.at(row);
+        if (proxyRow >= 0)
+            proxyRows.push_back(proxyRow);
+    }
+    removeProxyRows(proxyRows);
+}
+
+void BackgroundSortFilterProxyModel::sourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid())
+        return;
+
+    const int count = last - first + 1;
+    for (auto it = m_proxyToSource.begin(); it != m_proxyToSource.end(); ++it) {
+        if (*it > last)
+            *it -= count;
+    }
+    // the removed rows are not mapped anymore at this point, the proxy rows of the others stay the same
+    m_sourceToProxy.remove(first, count);
+    if (m_tracksSnapshot)
+        m_snapshotRows.remove(first, count);
+    m_filterKeys.remove(first * m_sourceColumnCount, count * m_sourceColumnCount);
+    if (hasSortKeys())
+        m_sortKeys.remove(first, count);
+}
+
+void BackgroundSortFilterProxyModel::sourceModelAboutToBeReset()
+{
+    beginResetModel();
+}
+
+void BackgroundSortFilterProxyModel::sourceModelReset()
+{
+    resetMapping();
+    endResetModel();
+}
+
+void BackgroundSortFilterProxyModel::resetMapping()
+{
+    ++m_sourceRevision;
+    m_generation.fetchAndAddOrdered(1);
+    m_updatePending = false;
+    m_tracksSnapshot = false;
+    m_snapshotRows.clear();
+    m_proxyToSource.clear();
+    m_sourceColumnCount = sourceModel() ? sourceModel()->columnCount() : 0;
+    resetFilterKeys();
+    resetSortKeys();
+
+    if (!sourceModel())
+        return;
+
+    // until the background computation is done, show all rows if there is no filter,
+    // and none otherwise, rather than briefly showing rows that don't match the filter
+    const int rows = sourceModel()->rowCount();
+    if (m_filterRegExp.isEmpty()) {
+        m_proxyToSource.reserve(rows);
+        for (int row = 0; row < rows; ++row)
+            m_proxyToSource.push_back(row);
+    }
+    rebuildSourceToProxy();
+
+    if (!m_filterRegExp.isEmpty() || m_sortColumn >= 0)
+        invalidate();
+}
+
+void BackgroundSortFilterProxyModel::resetFilterKeys()
+{
+    m_filterKeys.clear();
+    if (!sourceModel())
+        return;
+    m_filterKeys.resize(sourceModel()->rowCount() * m_sourceColumnCount);
+    updateKeys(0, sourceModel()->rowCount() - 1);
+}
+
+void BackgroundSortFilterProxyModel::resetSortKeys()
+{
+    m_sortKeys.clear();
+    if (!sourceModel() || !hasSortKeys())
+        return;
+    const int rows = sourceModel()->rowCount();
+    m_sortKeys.reserve(rows);
+    for (int row = 0; row < rows; ++row)
+        m_sortKeys.push_back(sourceModel()->index(row, m_sortColumn).data(m_sortRole));
+}
+
+void BackgroundSortFilterProxyModel::updateKeys(int firstRow, int lastRow)
+{
+    const bool sorted = hasSortKeys();
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = 0; column < m_sourceColumnCount; ++column) {
+            const QModelIndex index = sourceModel()->index(row, column);
+            m_filterKeys[row * m_sourceColumnCount + column] = index.data(m_filterRole).toString();
+            if (sorted && column == m_sortColumn)
+                m_sortKeys[row] = index.data(m_sortRole);
+        }
+    }
+}
+
+void BackgroundSortFilterProxyModel::invalidate()
+{
+    // cancel what's running right away, the new computation starts once all settings are applied
+    m_generation.fetchAndAddOrdered(1);
+    m_tracksSnapshot = false;
+    m_snapshotRows.clear();
+    m_updatePending = true;
+    m_updateTimer->start();
+}
+
+void BackgroundSortFilterProxyModel::rebuildSourceToProxy()
+{
+    m_sourceToProxy.fill(-1, sourceModel() ? sourceModel()->rowCount() : 0);
+    for (int i = 0; i < m_proxyToSource.size(); ++i)
+        m_sourceToProxy[m_proxyToSource.at(i)] = i;
+}
+
+void BackgroundSortFilterProxyModel::updateSourceToProxy(int firstProxyRow)
+{
+    for (int i = firstProxyRow; i < m_proxyToSource.size(); ++i)
+        m_sourceToProxy[m_proxyToSource.at(i)] = i;
+}
+
+void BackgroundSortFilterProxyModel::insertProxyRows(int proxyRow, QVector<int>::const_iterator begin,
+                                                     QVector<int>::const_iterator end)
+{
+    const int count = end - begin;
+    beginInsertRows(QModelIndex(), proxyRow, proxyRow + count - 1);
+    m_proxyToSource.insert(proxyRow, count, -1);
+    std::copy(begin, end, m_proxyToSource.begin() + proxyRow);
+    updateSourceToProxy(proxyRow);
+    endInsertRows();
+}
+
+void BackgroundSortFilterProxyModel::insertSourceRows(QVector<int> sourceRows)
+{
+    if (sourceRows.isEmpty())
+        return;
+
+    // all insert positions refer to the mapping before the insertion, so insert the rows
+    // landing at the same position together, starting at the back
+    if (hasSortKeys())
+        std::stable_sort(sourceRows.begin(), sourceRows.end(),
+                         SortKeyLessThan(m_sortKeys, m_sortOrder, m_sortCaseSensitivity));
+    else
+        std::sort(sourceRows.begin(), sourceRows.end());
+    QVector<int> positions;
+    positions.reserve(sourceRows.size());
+    foreach (int row, sourceRows)
+        positions.push_back(insertPosition(row));
+
+    int end = sourceRows.size();
+    while (end > 0) {
+        int begin = end - 1;
+        while (begin > 0 && positions.at(begin - 1) == positions.at(end - 1))
+            --begin;
+        insertProxyRows(positions.at(end - 1), sourceRows.constBegin() + begin,
+                        sourceRows.constBegin() + end);
+        end = begin;
+    }
+}
+
+void BackgroundSortFilterProxyModel::removeProxyRows(QVector<int> proxyRows)
+{
+    std::sort(proxyRows.begin(), proxyRows.end());
+
+    // remove consecutive proxy rows in one go, starting from the end
+    while (!proxyRows.isEmpty()) {
+        const int lastProxyRow = proxyRows.last();
+        int firstProxyRow = lastProxyRow;
+        int i = proxyRows.size() - 1;
+        while (i > 0 && proxyRows.at(i - 1) == firstProxyRow - 1) {
+            --firstProxyRow;
+            --i;
+        }
+        proxyRows.resize(i);
+        beginRemoveRows(QModelIndex(), firstProxyRow, lastProxyRow);
+        for (int proxyRow = firstProxyRow; proxyRow <= lastProxyRow; ++proxyRow)
+            m_sourceToProxy[m_proxyToSource.at(proxyRow)] = -1;
+        m_proxyToSource.remove(firstProxyRow, lastProxyRow - firstProxyRow + 1);
+        updateSourceToProxy(firstProxyRow);
+        endRemoveRows();
+    }
+}
+
+void BackgroundSortFilterProxyModel::rebaseMapping(QVector<int> &proxyToSource, int snapshotRowCount) const
+{
+    QVector<int> snapshotToSource(snapshotRowCount, -1); // -1 for rows removed in the mean time
+    QVector<int> addedRows;
+    for (int row = 0; row < m_snapshotRows.size(); ++row) {
+        const int snapshotRow = m_snapshotRows.at(row);
+        if (snapshotRow >= 0)
+            snapshotToSource[snapshotRow] = row;
+        else if (filterAcceptsRow(row))
+            addedRows.push_back(row);
+    }
+
+    QVector<int> rows;
+    rows.reserve(proxyToSource.size() + addedRows.size());
+    foreach (int snapshotRow, proxyToSource) {
+        const int row = snapshotToSource.at(snapshotRow);
+        if (row >= 0)
+            rows.push_back(row);
+    }
+
+    // merge in the added rows where insertPosition() would put them
+    proxyToSource.resize(rows.size() + addedRows.size());
+    if (hasSortKeys()) {
+        const SortKeyLessThan lessThan(m_sortKeys, m_sortOrder, m_sortCaseSensitivity);
+        std::stable_sort(addedRows.begin(), addedRows.end(), lessThan);
+        std::merge(rows.constBegin(), rows.constEnd(), addedRows.constBegin(), addedRows.constEnd(),
+                   proxyToSource.begin(), lessThan);
+    } else {
+        std::merge(rows.constBegin(), rows.constEnd(), addedRows.constBegin(), addedRows.constEnd(),
+                   proxyToSource.begin());
+    }
+}
+
+bool BackgroundSortFilterProxyModel::hasSortKeys() const
+{
+    return m_sortColumn >= 0 && m_sortColumn < m_sourceColumnCount;
+}
+
+bool BackgroundSortFilterProxyModel::filterAcceptsRow(int sourceRow) const
+{
+    return acceptsRow(m_filterKeys, m_sourceColumnCount, sourceRow, m_filterRegExp, m_filterKeyColumn);
+}
+
+bool BackgroundSortFilterProxyModel::isSortedAt(int proxyRow) const
+{
+    const SortKeyLessThan lessThan(m_sortKeys, m_sortOrder, m_sortCaseSensitivity);
+    const int row = m_proxyToSource.at(proxyRow);
+    if (proxyRow > 0 && lessThan(row, m_proxyToSource.at(proxyRow - 1)))
+        return false;
+    return proxyRow + 1 >= m_proxyToSource.size() || !lessThan(m_proxyToSource.at(proxyRow + 1), row);
+}
+
+int BackgroundSortFilterProxyModel::insertPosition(int sourceRow) const
+{
+    // the mapping is about to be replaced, it isn't necessarily in source order or sorted by the
+    // current keys until then, so don't search it; the result puts the row where it belongs
+    if (m_updatePending)
+        return m_proxyToSource.size();
+
+    if (!hasSortKeys()) {
+        // unsorted, keep the source order
+        return std::lower_bound(m_proxyToSource.constBegin(), m_proxyToSource.constEnd(), sourceRow)
+               - m_proxyToSource.constBegin();
+    }
+    return std::upper_bound(m_proxyToSource.constBegin(), m_proxyToSource.constEnd(), sourceRow,
+                            SortKeyLessThan(m_sortKeys, m_sortOrder, m_sortCaseSensitivity))
+           - m_proxyToSource.constBegin();
+}
@@ -0,0 +1,194 @@
+/*
+  backgroundsortfilterproxymodel.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_BACKGROUNDSORTFILTERPROXYMODEL_H
+#define GAMMARAY_BACKGROUNDSORTFILTERPROXYMODEL_H
+
+#include "gammaray_core_export.h"
+
+#include <QAbstractProxyModel>
+#include <QAtomicInt>
+#include <QRegExp>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QThreadPool;
+class QTimer;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+/** Sort/filter proxy model for large flat source models, that sorts and filters in a background thread.
+ *
+ *  Filter and sort keys of all source rows are kept in a snapshot, which is updated incrementally
+ *  as the source model changes. Changing the filter or the sort order hands that snapshot to a
+ *  worker thread, which computes the new row mapping. The result is then applied in one go as a
+ *  layout change in the GUI thread. Until then, the previous mapping remains in place. Computations
+ *  that became stale due to another filter or sort change in the mean time are cancelled.
+ *
+ *  Structural changes of the source model are applied synchronously, the same way QSortFilterProxyModel
+ *  handles them, and so are content changes of rows, which move only the rows that change their filter
+ *  state or their place in the sort order. Those that happen while a computation is running are applied
+ *  on top of its result, so a steady stream of new or changing rows doesn't hold it back.
+ *
+ *  Only the first level of the source model is considered. For trees such as the object tree,
+ *  KRecursiveFilterProxyModel evaluates filter changes in the background in a similar way.
+ *
+ *  The properties match those of QSortFilterProxyModel, so RemoteModelServer and the client-side
+ *  search line work the same way with either.
+ */
+class GAMMARAY_CORE_EXPORT BackgroundSortFilterProxyModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QRegExp filterRegExp READ filterRegExp WRITE setFilterRegExp)
+    Q_PROPERTY(int filterKeyColumn READ filterKeyColumn WRITE setFilterKeyColumn)
+    Q_PROPERTY(
+        Qt::CaseSensitivity filterCaseSensitivity READ filterCaseSensitivity WRITE setFilterCaseSensitivity)
+    Q_PROPERTY(bool dynamicSortFilter READ dynamicSortFilter WRITE setDynamicSortFilter)
+    Q_PROPERTY(int filterRole READ filterRole WRITE setFilterRole)
+    Q_PROPERTY(int sortRole READ sortRole WRITE setSortRole)
+    Q_PROPERTY(Qt::CaseSensitivity sortCaseSensitivity READ sortCaseSensitivity WRITE setSortCaseSensitivity)
+
+public:
+    explicit BackgroundSortFilterProxyModel(QObject *parent = nullptr);
+    ~BackgroundSortFilterProxyModel();
+
+    QRegExp filterRegExp() const;
+    void setFilterRegExp(const QRegExp &regExp);
+    int filterKeyColumn() const;
+    void setFilterKeyColumn(int column);
+    Qt::CaseSensitivity filterCaseSensitivity() const;
+    void setFilterCaseSensitivity(Qt::CaseSensitivity caseSensitivity);
+    int filterRole() const;
+    void setFilterRole(int role);
+
+    bool dynamicSortFilter() const;
+    void setDynamicSortFilter(bool enable);
+    int sortColumn() const;
+    Qt::SortOrder sortOrder() const;
+    int sortRole() const;
+    void setSortRole(int role);
+    Qt::CaseSensitivity sortCaseSensitivity() const;
+    void setSortCaseSensitivity(Qt::CaseSensitivity caseSensitivity);
+
+    /** Returns @c true while a background computation is pending. */
+    bool isUpdating() const;
+
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    /** Result of a background computation, only public for the worker thread to deliver it. */
+    struct Mapping
+    {
+        Mapping()
+            : generation(0)
+            , sourceRevision(0)
+            , sourceRowCount(0)
+        {
+        }
+        int generation;
+        int sourceRevision;
+        int sourceRowCount;
+        QVector<int> proxyToSource;
+    };
+
+signals:
+    /** Emitted once the result of a background computation has been applied. */
+    void updated();
+
+private slots:
+    void startUpdate();
+    void applyMapping(const GammaRay::BackgroundSortFilterProxyModel::Mapping &mapping);
+
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sourceHeaderDataChanged(Qt::Orientation orientation, int first, int last);
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void sourceRowsRemoved(const QModelIndex &parent, int first, int last);
+    void sourceModelAboutToBeReset();
+    void sourceModelReset();
+
+private:
+    void resetMapping();
+    void resetFilterKeys();
+    void resetSortKeys();
+    void updateKeys(int firstRow, int lastRow);
+    void invalidate();
+    void rebuildSourceToProxy();
+    /** Updates m_sourceToProxy for the proxy rows from @p firstProxyRow on. */
+    void updateSourceToProxy(int firstProxyRow);
+    /** Inserts the source rows [@p begin, @p end) as consecutive proxy rows at @p proxyRow. */
+    void insertProxyRows(int proxyRow, QVector<int>::const_iterator begin, QVector<int>::const_iterator end);
+    /** Inserts the accepted, not yet mapped @p sourceRows at their insert positions. */
+    void insertSourceRows(QVector<int> sourceRows);
+    void removeProxyRows(QVector<int> proxyRows);
+    /** Applies the source changes since the snapshot of a background computation to its result. */
+    void rebaseMapping(QVector<int> &proxyToSource, int snapshotRowCount) const;
+    bool hasSortKeys() const;
+    bool filterAcceptsRow(int sourceRow) const;
+    /** Whether the row at @p proxyRow is in order with its neighbors. */
+    bool isSortedAt(int proxyRow) const;
+    int insertPosition(int sourceRow) const;
+
+    // only touched in the GUI thread
+    QVector<int> m_proxyToSource;
+    QVector<int> m_sourceToProxy; // -1 for filtered rows
+    QVector<QString> m_filterKeys; // source row * column count + column
+    QVector<QVariant> m_sortKeys; // per source row, for the current sort column
+    QRegExp m_filterRegExp;
+    int m_filterKeyColumn;
+    int m_filterRole;
+    int m_sortColumn;
+    Qt::SortOrder m_sortOrder;
+    int m_sortRole;
+    Qt::CaseSensitivity m_sortCaseSensitivity;
+    bool m_dynamicSortFilter;
+    int m_sourceColumnCount;
+    int m_sourceRevision; // bumped on structural source changes, pending results need rebasing
+    bool m_updatePending;
+    // source row -> row in the snapshot of the running computation, -1 for rows added since
+    QVector<int> m_snapshotRows;
+    bool m_tracksSnapshot;
+    QTimer *m_updateTimer;
+
+    // shared with the worker thread
+    QThreadPool *m_threadPool;
+    QAtomicInt m_generation;
+};
+}
+
+Q_DECLARE_METATYPE(GammaRay::BackgroundSortFilterProxyModel::Mapping)
+
+#endif // GAMMARAY_BACKGROUNDSORTFILTERPROXYMODEL_H
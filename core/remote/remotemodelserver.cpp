@@ -28,20 +28,28 @@
 
 #include "remotemodelserver.h"
 #include "server.h"
+#include "backgroundsortfilterproxymodel.h"
 #include <core/probeguard.h>
+#include <core/probesettings.h>
 #include <common/protocol.h>
 #include <common/message.h>
+#include <common/modelindexcodec.h>
 #include <common/modelevent.h>
 #include <common/sourcelocation.h>
 
+#include <3rdparty/kde/krecursivefilterproxymodel.h>
+
 #include <QAbstractItemModel>
 #include <QSortFilterProxyModel>
 #include <QDataStream>
 #include <QDebug>
 #include <QBuffer>
 #include <QIcon>
+#include <QTimer>
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 
 using namespace GammaRay;
 using namespace std;
@@ -52,10 +60,17 @@ RemoteModelServer::RemoteModelServer(const QString &objectName, QObject *parent)
     : QObject(parent)
     , m_model(nullptr)
     , m_dummyBuffer(new QBuffer(&m_dummyData, this))
+    , m_dataChangeTimer(new QTimer(this))
+    , m_prefetchRowCount(ProbeSettings::value(QStringLiteral("ModelPrefetchRows"), 50).toInt())
     , m_monitored(false)
 {
     setObjectName(objectName);
     m_dummyBuffer->open(QIODevice::WriteOnly);
+
+    m_dataChangeTimer->setSingleShot(true);
+    m_dataChangeTimer->setInterval(ProbeSettings::value(QStringLiteral("ModelChangeInterval"), 0).toInt());
+    connect(m_dataChangeTimer, SIGNAL(timeout()), this, SLOT(flushDataChanges()));
+
     registerServer();
 }
 
@@ -75,8 +90,14 @@ void RemoteModelServer::setModel(QAbstractItemModel *model)
 
     if (m_model)
         disconnectModel();
+    clearPendingDataChanges();
+    m_viewports.clear();
+    m_layoutRows.clear();
 
     m_model = model;
+    // filtering large trees from the client's search line must not block the target application
+    if (auto proxy = qobject_cast<KRecursiveFilterProxyModel *>(m_model))
+        proxy->setBackgroundFilteringEnabled(true);
     if (m_model && m_monitored)
         connectModel();
 
@@ -84,6 +105,16 @@ void RemoteModelServer::setModel(QAbstractItemModel *model)
         modelReset();
 }
 
+void RemoteModelServer::setDataChangeInterval(int msecs)
+{
+    m_dataChangeTimer->setInterval(msecs);
+}
+
+void RemoteModelServer::setPrefetchRowCount(int rows)
+{
+    m_prefetchRowCount = qMax(0, rows);
+}
+
 void RemoteModelServer::connectModel()
 {
     Q_ASSERT(m_model);
@@ -108,10 +139,15 @@ void RemoteModelServer::connectModel()
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
     connect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
             SLOT(dataChanged(QModelIndex,QModelIndex)));
+    connect(m_model, SIGNAL(layoutAboutToBeChanged()), SLOT(layoutAboutToBeChanged()));
     connect(m_model, SIGNAL(layoutChanged()), SLOT(layoutChanged()));
 #else
     connect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
             SLOT(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    connect(m_model,
+            SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+            this,
+            SLOT(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
     connect(m_model,
             SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
             this,
@@ -145,11 +181,17 @@ void RemoteModelServer::disconnectModel()
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
     disconnect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
                this, SLOT(dataChanged(QModelIndex,QModelIndex)));
+    disconnect(m_model, SIGNAL(layoutAboutToBeChanged()),
+               this, SLOT(layoutAboutToBeChanged()));
     disconnect(m_model, SIGNAL(layoutChanged()),
                this, SLOT(layoutChanged()));
 #else
     disconnect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
                this, SLOT(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    disconnect(m_model,
+               SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+               this,
+               SLOT(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
     disconnect(m_model,
                SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
                this,
@@ -161,6 +203,11 @@ void RemoteModelServer::disconnectModel()
 
 void RemoteModelServer::newRequest(const GammaRay::Message &msg)
 {
+    if (msg.type() == Protocol::ModelRoleSelectionRequest) {
+        msg >> m_eagerRoles >> m_lazyRoles;
+        return;
+    }
+
     if (!m_model && msg.type() != Protocol::ModelSyncBarrier)
         return;
 
@@ -168,15 +215,13 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
     switch (msg.type()) {
     case Protocol::ModelRowColumnCountRequest:
     {
-        quint32 size;
-        msg >> size;
-        Q_ASSERT(size > 0);
+        const auto requestedIndexes = ModelIndexReader(msg).readList();
+        Q_ASSERT(!requestedIndexes.isEmpty());
 
         Message reply(m_myAddress, Protocol::ModelRowColumnCountReply);
-        reply << size;
-        for (quint32 i = 0; i < size; ++i) {
-            Protocol::ModelIndex index;
-            msg >> index;
+        ModelIndexWriter writer(reply);
+        reply << quint32(requestedIndexes.size());
+        for (const auto &index : requestedIndexes) {
             const QModelIndex qmIndex = Protocol::toQModelIndex(m_model, index);
 
             qint32 rowCount = -1, columnCount = -1;
@@ -185,7 +230,8 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
                 columnCount = m_model->columnCount(qmIndex);
             }
 
-            reply << index << rowCount << columnCount;
+            writer.write(index);
+            reply << rowCount << columnCount;
         }
         sendMessage(reply);
         break;
@@ -193,15 +239,12 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
 
     case Protocol::ModelContentRequest:
     {
-        quint32 size;
-        msg >> size;
-        Q_ASSERT(size > 0);
+        const auto requestedIndexes = ModelIndexReader(msg).readList();
+        Q_ASSERT(!requestedIndexes.isEmpty());
 
         QVector<QModelIndex> indexes;
-        indexes.reserve(size);
-        for (quint32 i = 0; i < size; ++i) {
-            Protocol::ModelIndex index;
-            msg >> index;
+        indexes.reserve(requestedIndexes.size());
+        for (const auto &index : requestedIndexes) {
             const QModelIndex qmIndex = Protocol::toQModelIndex(m_model, index);
             if (!qmIndex.isValid())
                 continue;
@@ -210,14 +253,77 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
         if (indexes.isEmpty())
             break;
 
-        Message msg(m_myAddress, Protocol::ModelContentReply);
-        msg << quint32(indexes.size());
-        foreach (const auto &qmIndex, indexes)
-            msg << Protocol::fromQModelIndex(qmIndex)
-                          << filterItemData(m_model->itemData(qmIndex))
-                          << qint32(m_model->flags(qmIndex));
+        sendContent(Protocol::ModelContentReply, indexes);
+        break;
+    }
 
-        sendMessage(msg);
+    case Protocol::ModelContentHashRequest:
+    {
+        const auto requestedIndexes = ModelIndexReader(msg).readList();
+        Q_ASSERT(!requestedIndexes.isEmpty());
+
+        QVector<QModelIndex> indexes;
+        indexes.reserve(requestedIndexes.size());
+        for (const auto &index : requestedIndexes) {
+            const QModelIndex qmIndex = Protocol::toQModelIndex(m_model, index);
+            if (qmIndex.isValid())
+                indexes.push_back(qmIndex);
+        }
+        if (indexes.isEmpty())
+            break;
+
+        Message reply(m_myAddress, Protocol::ModelContentHashReply);
+        ModelIndexWriter writer(reply);
+        reply << quint32(indexes.size());
+        foreach (const auto &qmIndex, indexes) {
+            writer.write(Protocol::fromQModelIndex(qmIndex));
+            reply << contentHash(itemData(qmIndex), qint32(m_model->flags(qmIndex)));
+        }
+        sendMessage(reply);
+        break;
+    }
+
+    case Protocol::ModelViewportRequest:
+    {
+        Protocol::ModelIndex parentIndex;
+        qint32 first, last;
+        msg >> parentIndex >> first >> last;
+        Q_ASSERT(first <= last);
+
+        const QModelIndex parent = Protocol::toQModelIndex(m_model, parentIndex);
+        if (!parentIndex.isEmpty() && !parent.isValid())
+            break; // outdated request, the client will ask again once it caught up
+        pushViewport(parent, first, last);
+        break;
+    }
+
+    case Protocol::ModelLazyDataRequest:
+    {
+        qint32 role;
+        msg >> role;
+        const auto requestedIndexes = ModelIndexReader(msg).readList();
+        Q_ASSERT(!requestedIndexes.isEmpty());
+
+        QVector<QModelIndex> indexes;
+        indexes.reserve(requestedIndexes.size());
+        for (const auto &index : requestedIndexes) {
+            const QModelIndex qmIndex = Protocol::toQModelIndex(m_model, index);
+            if (qmIndex.isValid())
+                indexes.push_back(qmIndex);
+        }
+        if (indexes.isEmpty())
+            break;
+
+        Message reply(m_myAddress, Protocol::ModelLazyDataReply);
+        ModelIndexWriter writer(reply);
+        reply << role << quint32(indexes.size());
+        foreach (const auto &qmIndex, indexes) {
+            QMap<int, QVariant> itemData;
+            itemData.insert(role, m_model->data(qmIndex, role));
+            writer.write(Protocol::fromQModelIndex(qmIndex));
+            reply << filterItemData(std::move(itemData)).value(role);
+        }
+        sendMessage(reply);
         break;
     }
 
@@ -265,6 +371,10 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
 
     case Protocol::ModelSyncBarrier:
     {
+        // everything that happened before the barrier has to arrive before it,
+        // and the client forgot everything we sent before
+        flushDataChanges();
+        m_viewports.clear();
         qint32 barrierId;
         msg >> barrierId;
         Message reply(m_myAddress, Protocol::ModelSyncBarrier);
@@ -275,6 +385,121 @@ void RemoteModelServer::newRequest(const GammaRay::Message &msg)
     }
 }
 
+static QVector<int> rolesForColumn(const QMap<int, QVector<int> > &roles, int column)
+{
+    auto it = roles.constFind(column);
+    if (it == roles.constEnd())
+        it = roles.constFind(-1);
+    return it == roles.constEnd() ? QVector<int>() : it.value();
+}
+
+QMap<int, QVariant> RemoteModelServer::itemData(const QModelIndex &index) const
+{
+    QMap<int, QVariant> itemData;
+    const auto eagerRoles = rolesForColumn(m_eagerRoles, index.column());
+    if (eagerRoles.isEmpty()) {
+        itemData = m_model->itemData(index);
+    } else {
+        // much cheaper than itemData(), which asks for every role below Qt::UserRole
+        foreach (int role, eagerRoles)
+            itemData.insert(role, m_model->data(index, role));
+    }
+    foreach (int role, rolesForColumn(m_lazyRoles, index.column()))
+        itemData.remove(role);
+    return filterItemData(std::move(itemData));
+}
+
+quint64 RemoteModelServer::contentHash(const QMap<int, QVariant> &itemData, qint32 flags) const
+{
+    // the client hashes the bytes it received in a content reply, so this has to match sendContent()
+    m_hashData.clear();
+    QDataStream stream(&m_hashData, QIODevice::WriteOnly);
+    stream.setVersion(Message::negotiatedDataVersion());
+    stream << itemData << flags;
+    return Protocol::contentHash(m_hashData.constData(), m_hashData.size());
+}
+
+void RemoteModelServer::sendContent(Protocol::MessageType type, const QVector<QModelIndex> &indexes)
+{
+    if (indexes.isEmpty())
+        return;
+
+    Message msg(m_myAddress, type);
+    ModelIndexWriter writer(msg);
+    msg << quint32(indexes.size());
+    foreach (const auto &qmIndex, indexes) {
+        writer.write(Protocol::fromQModelIndex(qmIndex));
+        msg << itemData(qmIndex) << qint32(m_model->flags(qmIndex));
+    }
+    sendMessage(msg);
+}
+
+void RemoteModelServer::pushViewport(const QModelIndex &parent, int first, int last)
+{
+    const int rowCount = m_model->rowCount(parent);
+    const int columnCount = m_model->columnCount(parent);
+    if (rowCount <= 0 || columnCount <= 0 || first >= rowCount)
+        return;
+    first = qMax(0, first);
+    last = qMin(last, rowCount - 1);
+
+    Viewport *viewport = nullptr;
+    for (auto it = m_viewports.begin(); it != m_viewports.end();) {
+        if (!(*it).isRoot && !(*it).parent.isValid()) { // parent got removed
+            it = m_viewports.erase(it);
+            continue;
+        }
+        if ((*it).parent == parent) {
+            viewport = &(*it);
+            break;
+        }
+        ++it;
+    }
+    if (!viewport) {
+        Viewport v;
+        v.parent = parent;
+        v.isRoot = !parent.isValid();
+        v.firstRow = 0;
+        v.lastRow = -1;
+        m_viewports.push_back(v);
+        viewport = &m_viewports.last();
+    }
+
+    // the visible rows are sent in any case, as they are asked for,
+    // the ones around them only if they haven't been sent before
+    QVector<QModelIndex> indexes;
+    indexes.reserve((last - first + 1) * columnCount);
+    for (int row = first; row <= last; ++row) {
+        for (int column = 0; column < columnCount; ++column)
+            indexes.push_back(m_model->index(row, column, parent));
+    }
+    sendContent(Protocol::ModelContentPush, indexes);
+
+    const int prefetchFirst = qMax(0, first - m_prefetchRowCount);
+    const int prefetchLast = qMin(rowCount - 1, last + m_prefetchRowCount);
+    indexes.clear();
+    for (int row = prefetchFirst; row <= prefetchLast; ++row) {
+        if ((row >= first && row <= last) || (row >= viewport->firstRow && row <= viewport->lastRow))
+            continue;
+        for (int column = 0; column < columnCount; ++column)
+            indexes.push_back(m_model->index(row, column, parent));
+    }
+    sendContent(Protocol::ModelContentPush, indexes);
+
+    viewport->firstRow = prefetchFirst;
+    viewport->lastRow = prefetchLast;
+}
+
+void RemoteModelServer::resetViewport(const QModelIndex &parent)
+{
+    for (auto it = m_viewports.begin(); it != m_viewports.end(); ++it) {
+        if ((*it).parent == parent && ((*it).isRoot || parent.isValid())) {
+            m_viewports.erase(it);
+            return;
+        }
+    }
+}
+
 QMap<int, QVariant> RemoteModelServer::filterItemData(QMap<int, QVariant> &&itemData) const
 {
     for (auto it = itemData.begin(); it != itemData.end();) {
@@ -297,42 +522,120 @@ QMap<int, QVariant> RemoteModelServer::filterItemData(QMap<int, QVariant> &&item
     return itemData;
 }
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
+// whether canSerialize() depends on the content of @p type, rather than on the type alone
+static bool hasVariantElements(int type)
+{
+    switch (type) {
+    case QMetaType::QVariantList:
+    case QMetaType::QVariantMap:
+    case QMetaType::QVariantHash:
+        return true;
+    default:
+        break;
+    }
+    // not registered by Qt itself, so look it up rather than registering it
+    return type == QMetaType::type("QVector<QVariant>");
+}
+#endif
+
 bool RemoteModelServer::canSerialize(const QVariant &value) const
 {
-    if (qstrcmp(value.typeName(), "QJSValue") == 0) {
-        // QJSValue tries to serialize nested elements and asserts if that fails
-        // too bad it can contain QObject* as nested element, which obviously can't be serialized...
-        return false;
+    const int type = value.userType();
+    auto infoIt = m_serializationInfo.constFind(type);
+    if (infoIt == m_serializationInfo.constEnd()) {
+        const SerializationInfo info = serializationInfo(value);
+        // stream operators can be registered at any time, e.g. by plugins loaded later on,
+        // so only positive results are kept
+        if (!info.canSave)
+            return false;
+        infoIt = m_serializationInfo.insert(type, info);
     }
+    // copy, recursing into the elements can insert into m_serializationInfo
+    const SerializationInfo info = infoIt.value();
+
+    // note: being able to write the container does not mean we can write every single element,
+    // or vice versa, so both need to be checked
+    if (info.containerKind == SerializationInfo::NoContainer)
+        return true;
+    if (info.canSaveElements >= 0)
+        return info.canSaveElements;
 
-    // recurse into containers
 #if QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
-    if (value.canConvert<QVariantList>()) {
-        QSequentialIterable it = value.value<QSequentialIterable>();
-        foreach (const QVariant &v, it) {
-            if (!canSerialize(v))
-                return false;
+    QVector<QVariant> elements;
+    if (info.containerKind == SerializationInfo::SequentialContainer) {
+        auto iterable = value.value<QSequentialIterable>();
+        for (auto it = iterable.begin(); it != iterable.end(); ++it) {
+            elements.push_back(*it);
+            if (!info.hasVariantElements)
+                break;
         }
-        // note: do not return true here, the fact we can write every single element
-        // does not mean we can write the entire thing, or vice vesa...
-    } else if (value.canConvert<QVariantMap>()) {
+    } else {
         auto iterable = value.value<QAssociativeIterable>();
         for (auto it = iterable.begin(); it != iterable.end(); ++it) {
-            if (!canSerialize(it.value()) || !canSerialize(it.key()))
-                return false;
+            elements.push_back(it.key());
+            elements.push_back(it.value());
+            if (!info.hasVariantElements)
+                break;
+        }
+    }
+    if (elements.isEmpty())
+        return true;
+
+    bool result = true;
+    bool contentIndependent = !info.hasVariantElements;
+    foreach (const auto &element, elements) {
+        contentIndependent = contentIndependent && !hasVariantElements(element.userType());
+        if (!canSerialize(element)) {
+            result = false;
+            break;
         }
-        // see above
     }
+    // all elements are of the same type, so the first one tells us about all of them,
+    // a negative result might change though, as for the type itself
+    if (contentIndependent && result)
+        m_serializationInfo[type].canSaveElements = result;
+    return result;
+#else
+    return true;
+#endif
+}
+
+RemoteModelServer::SerializationInfo RemoteModelServer::serializationInfo(const QVariant &value) const
+{
+    SerializationInfo info;
+    info.containerKind = SerializationInfo::NoContainer;
+    info.hasVariantElements = false;
+    info.canSaveElements = -1;
+
+    if (qstrcmp(value.typeName(), "QJSValue") == 0) {
+        // QJSValue tries to serialize nested elements and asserts if that fails
+        // too bad it can contain QObject* as nested element, which obviously can't be serialized...
+        info.canSave = false;
+        return info;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
+    if (value.canConvert<QVariantList>())
+        info.containerKind = SerializationInfo::SequentialContainer;
+    else if (value.canConvert<QVariantMap>())
+        info.containerKind = SerializationInfo::AssociativeContainer;
+    info.hasVariantElements = info.containerKind != SerializationInfo::NoContainer
+                              && hasVariantElements(value.userType());
 #endif
 
     // whitelist a few expensive to encode types we know we can serialize
-    if (value.userType() == qMetaTypeId<QUrl>() || value.userType() == qMetaTypeId<GammaRay::SourceLocation>())
-        return true;
+    if (value.userType() == qMetaTypeId<QUrl>() || value.userType() == qMetaTypeId<GammaRay::SourceLocation>()) {
+        info.canSave = true;
+        return info;
+    }
 
     // ugly, but there doesn't seem to be a better way atm to find out without trying
+    // this only depends on the type though, as long as it's a valid one
     m_dummyBuffer->seek(0);
     QDataStream stream(m_dummyBuffer);
-    return QMetaType::save(stream, value.userType(), value.constData());
+    info.canSave = QMetaType::save(stream, value.userType(), value.constData());
+    return info;
 }
 
 void RemoteModelServer::modelMonitored(bool monitored)
@@ -346,6 +649,14 @@ void RemoteModelServer::modelMonitored(bool monitored)
         else
             disconnectModel();
     }
+    if (!m_monitored) {
+        clearPendingDataChanges();
+        m_viewports.clear();
+    }
+    if (!isConnected()) { // the next client tells us its own role selection
+        m_eagerRoles.clear();
+        m_lazyRoles.clear();
+    }
 }
 
 void RemoteModelServer::dataChanged(const QModelIndex &begin, const QModelIndex &end,
@@ -353,9 +664,103 @@ void RemoteModelServer::dataChanged(const QModelIndex &begin, const QModelIndex
 {
     if (!isConnected())
         return;
-    Message msg(m_myAddress, Protocol::ModelContentChanged);
-    msg << Protocol::fromQModelIndex(begin) << Protocol::fromQModelIndex(end) << roles;
-    sendMessage(msg);
+
+    PendingDataChange change;
+    change.firstRow = begin.row();
+    change.lastRow = end.row();
+    change.firstColumn = begin.column();
+    change.lastColumn = end.column();
+    change.roles = roles;
+    std::sort(change.roles.begin(), change.roles.end());
+    change.roles.erase(std::unique(change.roles.begin(), change.roles.end()), change.roles.end());
+    addPendingDataChange(Protocol::fromQModelIndex(begin.parent()), change);
+
+    if (!m_dataChangeTimer->isActive())
+        m_dataChangeTimer->start();
+}
+
+void RemoteModelServer::addPendingDataChange(const Protocol::ModelIndex &parent, PendingDataChange &change)
+{
+    auto parentIt = m_pendingDataChangeParents.constFind(parent);
+    if (parentIt == m_pendingDataChangeParents.constEnd()) {
+        parentIt = m_pendingDataChangeParents.insert(parent, m_pendingDataChanges.size());
+        m_pendingDataChanges.resize(m_pendingDataChanges.size() + 1);
+        m_pendingDataChanges.last().parent = parent;
+    }
+    auto &changes = m_pendingDataChanges[parentIt.value()].changes;
+
+    // as the pending row ranges are disjoint, only the one before the first one starting
+    // at or after change can reach into it
+    auto it = changes.lowerBound(change.firstRow);
+    if (it != changes.begin()) {
+        auto previous = it;
+        --previous;
+        if (previous.value().lastRow + 1 >= change.firstRow)
+            it = previous;
+    }
+
+    // columns are merged into the bounding range, that keeps rows disjoint at the cost of
+    // sometimes reporting a few unchanged cells in the same rows
+    while (it != changes.end() && it.key() <= change.lastRow + 1) {
+        const auto &pending = it.value();
+        change.firstRow = qMin(change.firstRow, pending.firstRow);
+        change.lastRow = qMax(change.lastRow, pending.lastRow);
+        change.firstColumn = qMin(change.firstColumn, pending.firstColumn);
+        change.lastColumn = qMax(change.lastColumn, pending.lastColumn);
+        if (change.roles.isEmpty() || pending.roles.isEmpty()) {
+            change.roles.clear();
+        } else {
+            QVector<int> roles;
+            roles.reserve(change.roles.size() + pending.roles.size());
+            std::set_union(change.roles.constBegin(), change.roles.constEnd(),
+                           pending.roles.constBegin(), pending.roles.constEnd(),
+                           std::back_inserter(roles));
+            change.roles = roles;
+        }
+        it = changes.erase(it);
+    }
+    changes.insert(change.firstRow, change);
+}
+
+void RemoteModelServer::clearPendingDataChanges()
+{
+    m_pendingDataChanges.clear();
+    m_pendingDataChangeParents.clear();
+    m_dataChangeTimer->stop();
+}
+
+void RemoteModelServer::flushDataChanges()
+{
+    m_dataChangeTimer->stop();
+    if (m_pendingDataChanges.isEmpty())
+        return;
+    if (!isConnected()) {
+        clearPendingDataChanges();
+        return;
+    }
+
+    foreach (const auto &pending, m_pendingDataChanges) {
+        foreach (const auto &change, pending.changes) {
+            auto beginIndex = pending.parent;
+            beginIndex.push_back(Protocol::ModelIndexData(change.firstRow, change.firstColumn));
+            auto endIndex = pending.parent;
+            endIndex.push_back(Protocol::ModelIndexData(change.lastRow, change.lastColumn));
+
+            Message msg(m_myAddress, Protocol::ModelContentChanged);
+            msg << beginIndex << endIndex << change.roles;
+
+            // a pending notification for the very same range is redundant
+            QByteArray key;
+            {
+                QDataStream stream(&key, QIODevice::WriteOnly);
+                stream << beginIndex << endIndex << change.roles;
+            }
+            msg.setSupersedeKey(key);
+            sendMessage(msg);
+        }
+    }
+    m_pendingDataChanges.clear();
+    m_pendingDataChangeParents.clear();
 }
 
 void RemoteModelServer::headerDataChanged(Qt::Orientation orientation, int first, int last)
@@ -386,8 +791,8 @@ void RemoteModelServer::rowsAboutToBeMoved(const QModelIndex &sourceParent, int
 void RemoteModelServer::rowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
                                   const QModelIndex &destinationParent, int destinationRow)
 {
-    Q_UNUSED(sourceParent);
-    Q_UNUSED(destinationParent);
+    resetViewport(sourceParent);
+    resetViewport(destinationParent);
     Q_ASSERT(m_preOpIndexes.size() >= 2);
     const auto destParentIdx = m_preOpIndexes.takeLast();
     const auto sourceParentIdx = m_preOpIndexes.takeLast();
@@ -409,6 +814,8 @@ void RemoteModelServer::columnsMoved(const QModelIndex &sourceParent, int source
                                      int sourceEnd, const QModelIndex &destinationParent,
                                      int destinationColumn)
 {
+    resetViewport(sourceParent);
+    resetViewport(destinationParent);
     sendMoveMessage(Protocol::ModelColumnsMoved,
                     Protocol::fromQModelIndex(sourceParent), sourceStart, sourceEnd,
                     Protocol::fromQModelIndex(destinationParent), destinationColumn);
@@ -420,6 +827,11 @@ void RemoteModelServer::columnsRemoved(const QModelIndex &parent, int start, int
 }
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+void RemoteModelServer::layoutAboutToBeChanged()
+{
+    recordLayoutRows(QList<QPersistentModelIndex>());
+}
+
 void RemoteModelServer::layoutChanged()
 {
     sendLayoutChanged();
@@ -427,6 +839,13 @@ void RemoteModelServer::layoutChanged()
 
 #else
 
+void RemoteModelServer::layoutAboutToBeChanged(const QList<QPersistentModelIndex> &parents,
+                                               QAbstractItemModel::LayoutChangeHint hint)
+{
+    Q_UNUSED(hint);
+    recordLayoutRows(parents);
+}
+
 void RemoteModelServer::layoutChanged(const QList<QPersistentModelIndex> &parents,
                                       QAbstractItemModel::LayoutChangeHint hint)
 {
@@ -439,18 +858,98 @@ void RemoteModelServer::layoutChanged(const QList<QPersistentModelIndex> &parent
 
 #endif
 
+void RemoteModelServer::recordLayoutRows(const QList<QPersistentModelIndex> &parents)
+{
+    m_layoutRows.clear();
+    if (!isConnected())
+        return;
+
+    // only the rows pushed to the client for its viewports are tracked, the client drops the content
+    // of all other rows below the changed parents (and can recover it by content hash)
+    m_layoutRows.reserve(m_viewports.size());
+    foreach (const auto &viewport, m_viewports) {
+        if (!viewport.isRoot && !viewport.parent.isValid())
+            continue;
+        if (!parents.isEmpty() && !parents.contains(viewport.parent))
+            continue;
+        const int rowCount = m_model->rowCount(viewport.parent);
+        const int lastRow = qMin(viewport.lastRow, rowCount - 1);
+        if (viewport.firstRow > lastRow || m_model->columnCount(viewport.parent) <= 0)
+            continue;
+
+        LayoutRows layoutRows;
+        layoutRows.parent = viewport.parent;
+        layoutRows.isRoot = viewport.isRoot;
+        layoutRows.rowCount = rowCount;
+        layoutRows.firstRow = viewport.firstRow;
+        layoutRows.rows.reserve(lastRow - viewport.firstRow + 1);
+        for (int row = viewport.firstRow; row <= lastRow; ++row)
+            layoutRows.rows.push_back(m_model->index(row, 0, viewport.parent));
+        m_layoutRows.push_back(layoutRows);
+    }
+}
+
 void RemoteModelServer::sendLayoutChanged(const QVector< Protocol::ModelIndex > &parents,
                                           quint32 hint)
 {
-    if (!isConnected())
+    m_viewports.clear();
+    if (!isConnected()) {
+        m_layoutRows.clear();
         return;
+    }
+    flushDataChanges();
     Message msg(m_myAddress, Protocol::ModelLayoutChanged);
     msg << parents << hint;
+
+    // for each tracked viewport whose parent kept its row count, the runs of rows that stayed below
+    // that parent as (old first row, new first row, length) triples, rows not covered are unknown
+    QVector<QPair<Protocol::ModelIndex, QVector<qint32> > > permutations;
+    QVector<qint32> rowCounts;
+    foreach (const auto &layoutRows, m_layoutRows) {
+        if (!layoutRows.isRoot && !layoutRows.parent.isValid())
+            continue;
+        const int rowCount = m_model->rowCount(layoutRows.parent);
+        if (rowCount != layoutRows.rowCount)
+            continue;
+
+        QVector<qint32> runs;
+        for (int i = 0; i < layoutRows.rows.size();) {
+            const auto &index = layoutRows.rows.at(i);
+            if (!index.isValid() || index.parent() != layoutRows.parent) {
+                ++i;
+                continue;
+            }
+            const int newRow = index.row();
+            int length = 1;
+            while (i + length < layoutRows.rows.size()) {
+                const auto &next = layoutRows.rows.at(i + length);
+                if (next.row() != newRow + length || next.parent() != layoutRows.parent)
+                    break;
+                ++length;
+            }
+            runs << layoutRows.firstRow + i << newRow << length;
+            i += length;
+        }
+        permutations.push_back(qMakePair(Protocol::fromQModelIndex(layoutRows.parent), runs));
+        rowCounts.push_back(rowCount);
+    }
+    m_layoutRows.clear();
+
+    ModelIndexWriter writer(msg);
+    msg << quint32(permutations.size());
+    for (int i = 0; i < permutations.size(); ++i) {
+        msg << permutations.at(i).first << rowCounts.at(i);
+        writer.writeRowRuns(permutations.at(i).second);
+    }
     sendMessage(msg);
 }
 
 void RemoteModelServer::modelReset()
 {
+    // the reset invalidates all pending changes anyway
+    clearPendingDataChanges();
+    m_viewports.clear();
+    m_layoutRows.clear();
     if (!isConnected())
         return;
     sendMessage(Message(m_myAddress, Protocol::ModelReset));
@@ -459,8 +958,10 @@ void RemoteModelServer::modelReset()
 void RemoteModelServer::sendAddRemoveMessage(Protocol::MessageType type, const QModelIndex &parent,
                                              int start, int end)
 {
+    resetViewport(parent);
     if (!isConnected())
         return;
+    flushDataChanges();
     Message msg(m_myAddress, type);
     msg << Protocol::fromQModelIndex(parent) << start << end;
     sendMessage(msg);
@@ -474,6 +975,7 @@ void RemoteModelServer::sendMoveMessage(Protocol::MessageType type,
 {
     if (!isConnected())
         return;
+    flushDataChanges();
     Message msg(m_myAddress, type);
     msg << sourceParent << qint32(sourceStart) << qint32(sourceEnd)
                   << destinationParent << qint32(destinationIndex);
@@ -513,6 +1015,8 @@ bool RemoteModelServer::proxyDynamicSortFilter() const
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         return proxy->dynamicSortFilter();
+    if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        return proxy->dynamicSortFilter();
     return false;
 }
 
@@ -520,25 +1024,37 @@ void RemoteModelServer::setProxyDynamicSortFilter(bool dynamicSortFilter)
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         proxy->setDynamicSortFilter(dynamicSortFilter);
+    else if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        proxy->setDynamicSortFilter(dynamicSortFilter);
 }
 
 Qt::CaseSensitivity RemoteModelServer::proxyFilterCaseSensitivity() const
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         return proxy->filterCaseSensitivity();
+    if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        return proxy->filterCaseSensitivity();
     return Qt::CaseSensitive;
 }
 
 void RemoteModelServer::setProxyFilterCaseSensitivity(Qt::CaseSensitivity caseSensitivity)
 {
-    if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
+    if (auto proxy = qobject_cast<KRecursiveFilterProxyModel *>(m_model)) {
+        ProbeGuard guard; // this might start the background filter thread
+        proxy->setFilterCaseSensitivity(caseSensitivity);
+    } else if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model)) {
+        proxy->setFilterCaseSensitivity(caseSensitivity);
+    } else if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model)) {
         proxy->setFilterCaseSensitivity(caseSensitivity);
+    }
 }
 
 int RemoteModelServer::proxyFilterKeyColumn() const
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         return proxy->filterKeyColumn();
+    if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        return proxy->filterKeyColumn();
     return 0;
 }
 
@@ -546,17 +1062,27 @@ void RemoteModelServer::setProxyFilterKeyColumn(int column)
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         proxy->setFilterKeyColumn(column);
+    else if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        proxy->setFilterKeyColumn(column);
 }
 
 QRegExp RemoteModelServer::proxyFilterRegExp() const
 {
     if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
         return proxy->filterRegExp();
+    if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model))
+        return proxy->filterRegExp();
     return QRegExp();
 }
 
 void RemoteModelServer::setProxyFilterRegExp(const QRegExp &regExp)
 {
-    if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model))
+    if (auto proxy = qobject_cast<KRecursiveFilterProxyModel *>(m_model)) {
+        ProbeGuard guard; // this might start the background filter thread
+        proxy->setFilterRegExp(regExp);
+    } else if (auto proxy = qobject_cast<QSortFilterProxyModel *>(m_model)) {
         proxy->setFilterRegExp(regExp);
+    } else if (auto proxy = qobject_cast<BackgroundSortFilterProxyModel *>(m_model)) {
+        proxy->setFilterRegExp(regExp);
+    }
 }
@@ -31,21 +31,26 @@
 
 #include <common/protocol.h>
 
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QPersistentModelIndex>
 #include <QPointer>
 #include <QRegExp>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE
 class QBuffer;
 class QAbstractItemModel;
+class QTimer;
 QT_END_NAMESPACE
 
 namespace GammaRay {
 class Message;
 
 /** Provides the server-side interface for a QAbstractItemModel to be used from a separate process.
- *  If the source model is a QSortFilterProxyModel, this also forwards properties for configuring
- *  the proxy behavior, enabling server-side searching and sorting.
+ *  If the source model is a QSortFilterProxyModel or a BackgroundSortFilterProxyModel, this also
+ *  forwards properties for configuring the proxy behavior, enabling server-side searching and sorting.
  */
 class RemoteModelServer : public QObject
 {
@@ -66,6 +71,17 @@ public:
     /** Set the source model for this model server instance. */
     void setModel(QAbstractItemModel *model);
 
+    /** Data changes of the source model are collected for @p msecs milliseconds before being sent.
+     *  The default is 0, sending them once per event loop iteration. This can also be changed by the
+     *  ModelChangeInterval probe setting.
+     */
+    void setDataChangeInterval(int msecs);
+
+    /** Number of rows before and after the rows visible on the client side that are sent along with them.
+     *  The default is 50, this can also be changed by the ModelPrefetchRows probe setting.
+     */
+    void setPrefetchRowCount(int rows);
+
 public slots:
     void newRequest(const GammaRay::Message &msg);
     /** Notifications about an object on the client side (un)monitoring this object.
@@ -81,12 +97,81 @@ private:
     void sendMoveMessage(Protocol::MessageType type, const Protocol::ModelIndex &sourceParent,
                          int sourceStart, int sourceEnd,
                          const Protocol::ModelIndex &destinationParent, int destinationIndex);
+    /** The roles of @p index to send along with its content, as selected by the client. */
+    QMap<int, QVariant> itemData(const QModelIndex &index) const;
+    /** Hash of the content of a cell as sent to the client, so the client can validate its cache.
+     *  Only computed on request, the client derives it from the content it received.
+     */
+    quint64 contentHash(const QMap<int, QVariant> &itemData, qint32 flags) const;
+    /** Send data and flags of @p indexes as a message of @p type. */
+    void sendContent(Protocol::MessageType type, const QVector<QModelIndex> &indexes);
+    /** Push the rows @p first to @p last below @p parent, and the ones around them not sent yet. */
+    void pushViewport(const QModelIndex &parent, int first, int last);
+    /** Forget which rows below @p parent have been sent as part of the viewport. */
+    void resetViewport(const QModelIndex &parent);
     QMap< int, QVariant > filterItemData(QMap<int, QVariant> &&itemData) const;
+    /** Remember the viewport rows below @p parents (all if empty), so we can tell the client how
+     *  a layout change moved them. */
+    void recordLayoutRows(const QList<QPersistentModelIndex> &parents);
     void sendLayoutChanged(
         const QVector<Protocol::ModelIndex> &parents = QVector<Protocol::ModelIndex>(),
         quint32 hint = 0);
     bool canSerialize(const QVariant &value) const;
 
+    /** What canSerialize needs to know about a metatype. */
+    struct SerializationInfo
+    {
+        enum ContainerKind {
+            NoContainer,
+            SequentialContainer,
+            AssociativeContainer
+        };
+        bool canSave; // QMetaType::save works for the type itself
+        ContainerKind containerKind;
+        bool hasVariantElements; // elements need to be checked one by one, as they can be of any type
+        qint8 canSaveElements; // for containers with a fixed element type, -1 if not known yet
+    };
+    SerializationInfo serializationInfo(const QVariant &value) const;
+
+    /** A not yet sent change of the cells in the given rows and columns below a parent. */
+    struct PendingDataChange
+    {
+        int firstRow;
+        int lastRow;
+        int firstColumn;
+        int lastColumn;
+        QVector<int> roles; // sorted, empty means all roles
+    };
+    /** The pending changes below one parent, by first row. The row ranges are disjoint and not adjacent. */
+    struct PendingDataChanges
+    {
+        Protocol::ModelIndex parent;
+        QMap<int, PendingDataChange> changes;
+    };
+    /** Queue @p change below @p parent for sending, merging it with pending changes of overlapping
+     *  or adjacent rows. */
+    void addPendingDataChange(const Protocol::ModelIndex &parent, PendingDataChange &change);
+    void clearPendingDataChanges();
+
+    /** The rows below a parent last pushed to the client for its viewport. */
+    struct Viewport
+    {
+        QPersistentModelIndex parent;
+        bool isRoot;
+        int firstRow;
+        int lastRow;
+    };
+
+    /** The rows of a viewport before a layout change, starting at @p firstRow. */
+    struct LayoutRows
+    {
+        QPersistentModelIndex parent;
+        bool isRoot;
+        int rowCount;
+        int firstRow;
+        QVector<QPersistentModelIndex> rows;
+    };
+
     // proxy model settings
     bool proxyDynamicSortFilter() const;
     void setProxyDynamicSortFilter(bool dynamicSortFilter);
@@ -119,8 +204,11 @@ private slots:
                       const QModelIndex &destinationParent, int destinationColumn);
     void columnsRemoved(const QModelIndex &parent, int start, int end);
 #ifdef QT4_MOC_WORKAROUND // Qt4 moc doesn't understand QT_VERSION preprocessor conditionals
+    void layoutAboutToBeChanged();
     void layoutChanged();
 #else
+    void layoutAboutToBeChanged(const QList<QPersistentModelIndex> &parents,
+                                QAbstractItemModel::LayoutChangeHint hint);
     void layoutChanged(const QList<QPersistentModelIndex> &parents,
                        QAbstractItemModel::LayoutChangeHint hint);
 #endif
@@ -129,16 +217,32 @@ private slots:
 
     void modelDeleted();
 
+    /** Sends all pending data changes, this needs to happen before any structural change is sent. */
+    void flushDataChanges();
+
 private:
     QPointer<QAbstractItemModel> m_model;
     // those two are used for canSerialize, since recreating the QBuffer is somewhat expensive,
     // especially since being a QObject triggers all kind of GammaRay internals
     QByteArray m_dummyData;
     QBuffer *m_dummyBuffer;
+    // metatype id -> serialization info, only for types we know we can save
+    mutable QHash<int, SerializationInfo> m_serializationInfo;
+    // reused for contentHash
+    mutable QByteArray m_hashData;
     // converted model indexes from aboutToBeX signals, needed in cases where the operation changes
     // the serialized index (move to sub-tree of source parent for example)
     // as operations can occur nested, we need to have a stack for this
     QList<Protocol::ModelIndex> m_preOpIndexes;
+    QVector<PendingDataChanges> m_pendingDataChanges; // in order of the first change per parent
+    QHash<Protocol::ModelIndex, int> m_pendingDataChangeParents; // parent -> m_pendingDataChanges index
+    QTimer *m_dataChangeTimer;
+    QVector<Viewport> m_viewports;
+    QVector<LayoutRows> m_layoutRows;
+    int m_prefetchRowCount;
+    // column -> roles, -1 for all columns without own entry
+    QMap<int, QVector<int> > m_eagerRoles;
+    QMap<int, QVector<int> > m_lazyRoles;
     Protocol::ObjectAddress m_myAddress;
     bool m_monitored;
 };
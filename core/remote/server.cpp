@@ -62,6 +62,13 @@ Server::Server(QObject *parent)
     if (!ProbeSettings::value(QStringLiteral("RemoteAccessEnabled"), true).toBool())
         return;
 
+    setSendHighWaterMark(ProbeSettings::value(QStringLiteral("SendHighWaterMark"),
+                                              int(sendHighWaterMark())).toInt());
+    // keep socket I/O and frame serialization off the main thread of the target
+    if (ProbeSettings::value(QStringLiteral("IoThread"), true).toBool())
+        enableIoThread();
+    setSessionRecordingFileName(ProbeSettings::value(QStringLiteral("RecordSession")).toString());
+
     m_serverDevice = ServerDevice::create(serverAddress(), this);
     if (!m_serverDevice)
         return;
@@ -180,15 +187,20 @@ void Server::messageReceived(const Message &msg)
         case Protocol::ClientDataVersionNegotiated:
         {
             quint8 version;
-            msg >> version;
+            bool streamCompression;
+            bool compactModelIndexes;
+            msg >> version >> streamCompression >> compactModelIndexes;
 
             {
                 Message msg(endpointAddress(), Protocol::ServerDataVersionNegotiated);
-                msg << version;
+                msg << version << streamCompression << compactModelIndexes;
                 send(msg);
             }
 
             Message::setNegotiatedDataVersion(version);
+            Message::setCompactModelIndexesEnabled(compactModelIndexes);
+            // everything we send after the confirmation can use streaming compression
+            setStreamCompressionEnabled(streamCompression);
             break;
         }
         case Protocol::ObjectMonitored:
@@ -279,22 +291,7 @@ void Server::forwardSignal(QObject *sender, int signalIndex, const QVector< QVar
 
     Q_ASSERT(sender);
     Q_ASSERT(signalIndex >= 0);
-    const QMetaMethod signal = sender->metaObject()->method(signalIndex);
-    Q_ASSERT(signal.methodType() == QMetaMethod::Signal);
-
-#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-    QByteArray name = signal.signature();
-#else
-    QByteArray name = signal.methodSignature();
-#endif
-    // get the name of the function to invoke, excluding the parens and function arguments.
-    name = name.mid(0, name.indexOf('('));
-
-    QVariantList v;
-    v.reserve(args.size());
-    foreach (const QVariant &arg, args)
-        v.push_back(arg);
-    Endpoint::invokeObject(sender->objectName(), name, v);
+    forwardSignalToRemote(sender, signalIndex, args);
 }
 
 void Server::registerMonitorNotifier(Protocol::ObjectAddress address, QObject *receiver,
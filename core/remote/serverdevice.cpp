@@ -30,6 +30,7 @@
 
 #include "tcpserverdevice.h"
 #include "localserverdevice.h"
+#include "sharedmemoryserverdevice.h"
 
 #include <QDebug>
 #include <QUrl>
@@ -62,6 +63,8 @@ ServerDevice *ServerDevice::create(const QUrl &serverAddress, QObject *parent)
         device = new TcpServerDevice(parent);
     else if (serverAddress.scheme() == QLatin1String("local"))
         device = new LocalServerDevice(parent);
+    else if (serverAddress.scheme() == QLatin1String("shm"))
+        device = new SharedMemoryServerDevice(parent);
 
     if (!device) {
         qWarning() << "Unsupported transport protocol:" << serverAddress.toString();
@@ -0,0 +1,99 @@
+/*
+  sharedmemoryserverdevice.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2013-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sharedmemoryserverdevice.h"
+
+#include <common/sharedmemorydevice.h>
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+
+using namespace GammaRay;
+
+SharedMemoryServerDevice::SharedMemoryServerDevice(QObject *parent)
+    : LocalServerDevice(parent)
+{
+    disconnect(m_server, SIGNAL(newConnection()), this, SIGNAL(newConnection()));
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(localConnection()));
+}
+
+QIODevice *SharedMemoryServerDevice::nextPendingConnection()
+{
+    Q_ASSERT(!m_pendingConnections.isEmpty());
+    return m_pendingConnections.dequeue();
+}
+
+void SharedMemoryServerDevice::localConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *socket = m_server->nextPendingConnection();
+        auto device = new SharedMemoryDevice(socket, this);
+
+        // handshake: segment key (empty if we can't provide one), answered by 'S' or 'P' for
+        // shared memory or plain socket transfer respectively
+        const QByteArray key = device->create() ? device->key().toUtf8() : QByteArray();
+        const qint32 keySize = qToBigEndian<qint32>(key.size());
+        socket->write(reinterpret_cast<const char *>(&keySize), sizeof(keySize));
+        socket->write(key);
+
+        m_handshakes.insert(socket, device);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(handshakeReplyReceived()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(handshakeAborted()));
+    }
+}
+
+void SharedMemoryServerDevice::handshakeReplyReceived()
+{
+    auto socket = qobject_cast<QLocalSocket *>(sender());
+    Q_ASSERT(socket);
+    char mode;
+    if (!socket->getChar(&mode))
+        return;
+
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(handshakeReplyReceived()));
+    disconnect(socket, SIGNAL(disconnected()), this, SLOT(handshakeAborted()));
+    SharedMemoryDevice *device = m_handshakes.take(socket);
+
+    if (mode == 'S' && device->open(QIODevice::ReadWrite)) {
+        socket->setParent(device);
+        m_pendingConnections.enqueue(device);
+    } else {
+        delete device;
+        m_pendingConnections.enqueue(socket);
+    }
+    emit newConnection();
+}
+
+void SharedMemoryServerDevice::handshakeAborted()
+{
+    auto socket = qobject_cast<QLocalSocket *>(sender());
+    Q_ASSERT(socket);
+    delete m_handshakes.take(socket);
+    socket->deleteLater();
+}
@@ -0,0 +1,98 @@
+/*
+  stacktrie.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stacktrie.h"
+
+using namespace GammaRay;
+
+StackTrie::StackTrie()
+{
+}
+
+int StackTrie::insert(void *const *frames, int count)
+{
+    int node = -1;
+    for (int i = count - 1; i >= 0; --i) {
+        const QPair<int, quintptr> key(node, reinterpret_cast<quintptr>(frames[i]));
+        const auto it = m_children.constFind(key);
+        if (it == m_children.constEnd()) {
+            const int child = addNode(node, frames[i]);
+            m_children.insert(key, child);
+            node = child;
+        } else {
+            node = it.value();
+        }
+        ++m_nodes[node].refCount;
+    }
+    return node;
+}
+
+void StackTrie::release(int id)
+{
+    while (id >= 0) {
+        Node &node = m_nodes[id];
+        Q_ASSERT(node.refCount > 0);
+        const int parent = node.parent;
+        if (--node.refCount == 0) {
+            m_children.remove(qMakePair(parent, reinterpret_cast<quintptr>(node.address)));
+            m_freeNodes.push_back(id);
+        }
+        id = parent;
+    }
+}
+
+QVector<void *> StackTrie::frames(int id) const
+{
+    QVector<void *> result;
+    for (; id >= 0; id = m_nodes.at(id).parent)
+        result.push_back(m_nodes.at(id).address);
+    return result;
+}
+
+int StackTrie::nodeCount() const
+{
+    return m_nodes.size() - m_freeNodes.size();
+}
+
+int StackTrie::addNode(int parent, void *address)
+{
+    Node node;
+    node.address = address;
+    node.parent = parent;
+    node.refCount = 0;
+
+    if (m_freeNodes.isEmpty()) {
+        m_nodes.push_back(node);
+        return m_nodes.size() - 1;
+    }
+
+    const int id = m_freeNodes.last();
+    m_freeNodes.resize(m_freeNodes.size() - 1);
+    m_nodes[id] = node;
+    return id;
+}
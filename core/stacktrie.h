@@ -0,0 +1,79 @@
+/*
+  stacktrie.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_STACKTRIE_H
+#define GAMMARAY_STACKTRIE_H
+
+#include "gammaray_core_export.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+namespace GammaRay {
+/** @brief Prefix tree of stack traces.
+ *
+ *  Traces are stored from the outermost frame inwards, so traces sharing the same call path
+ *  share their nodes, and each distinct trace is stored only once. A trace is identified by its
+ *  innermost node, which is reference counted, unused nodes are recycled.
+ */
+class GAMMARAY_CORE_EXPORT StackTrie
+{
+public:
+    StackTrie();
+
+    /** Adds a reference to the trace of @p count @p frames, innermost frame first.
+     *  Returns the id of the trace, or -1 if @p count is 0.
+     */
+    int insert(void *const *frames, int count);
+    /** Drops a reference to trace @p id, as returned by insert(). */
+    void release(int id);
+
+    /** Returns the frames of trace @p id, innermost frame first. */
+    QVector<void *> frames(int id) const;
+
+    /** Number of nodes currently in use. */
+    int nodeCount() const;
+
+private:
+    struct Node
+    {
+        void *address;
+        int parent;
+        int refCount;
+    };
+
+    int addNode(int parent, void *address);
+
+    QVector<Node> m_nodes;
+    QVector<int> m_freeNodes;
+    QHash<QPair<int, quintptr>, int> m_children;
+};
+}
+
+#endif // GAMMARAY_STACKTRIE_H
@@ -78,7 +78,7 @@ void ToolManager::selectObject(const ObjectId &id, const QString &toolId)
     case ObjectId::QObjectType:
     {
         QMutexLocker lock(Probe::objectLock());
-        if (!Probe::instance()->isValidObject(id.asQObject()))
+        if (!Probe::instance()->isValidObject(id))
             return;
 
         Probe::instance()->selectObject(id.asQObject(), toolId);
@@ -104,7 +104,7 @@ void ToolManager::requestToolsForObject(const ObjectId &id)
     case ObjectId::QObjectType:
     {
         QMutexLocker lock(Probe::objectLock());
-        if (!Probe::instance()->isValidObject(id.asQObject()))
+        if (!Probe::instance()->isValidObject(id))
             return;
 
         toolInfos = toolsForObject(id.asQObject());
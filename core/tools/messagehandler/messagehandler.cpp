@@ -35,6 +35,7 @@
 #include "backtrace.h"
 
 #include <core/probeguard.h>
+#include <core/remote/backgroundsortfilterproxymodel.h>
 #include <core/remote/serverproxymodel.h>
 
 #include "common/objectbroker.h"
@@ -43,7 +44,6 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QMutex>
-#include <QSortFilterProxyModel>
 #include <QThread>
 
 #include <iostream>
@@ -163,7 +163,8 @@ MessageHandler::MessageHandler(ProbeInterface *probe, QObject *parent)
     Q_ASSERT(s_model == nullptr);
     s_model = m_messageModel;
 
-    auto proxy = new ServerProxyModel<QSortFilterProxyModel>(this);
+    // the message log can grow large, don't block the application while searching it
+    auto proxy = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     proxy->addRole(MessageModelRole::Type);
     proxy->addRole(MessageModelRole::Line);
     proxy->addRole(MessageModelRole::Backtrace);
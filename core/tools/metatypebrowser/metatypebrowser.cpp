@@ -29,20 +29,19 @@
 #include "metatypebrowser.h"
 #include "metatypesmodel.h"
 
+#include <core/remote/backgroundsortfilterproxymodel.h>
 #include <core/remote/serverproxymodel.h>
 
 #include <common/objectbroker.h>
 #include <common/tools/metatypebrowser/metatyperoles.h>
 
-#include <QSortFilterProxyModel>
-
 using namespace GammaRay;
 
 MetaTypeBrowser::MetaTypeBrowser(ProbeInterface *probe, QObject *parent)
     : MetaTypeBrowserInterface(parent)
     , m_mtm(new MetaTypesModel(this))
 {
-    auto proxy = new ServerProxyModel<QSortFilterProxyModel>(this);
+    auto proxy = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     proxy->setSourceModel(m_mtm);
     proxy->addRole(MetaTypeRoles::MetaObjectIdRole);
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.MetaTypeModel"), proxy);
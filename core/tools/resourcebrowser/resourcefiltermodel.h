@@ -37,7 +37,9 @@ class ResourceFilterModel : public KRecursiveFilterProxyModel
     Q_OBJECT
 public:
     explicit ResourceFilterModel(QObject *parent = nullptr);
-    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+
+protected:
+    bool acceptRow(int source_row, const QModelIndex &source_parent) const override;
 };
 }
 
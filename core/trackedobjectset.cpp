@@ -0,0 +1,302 @@
+/*
+  trackedobjectset.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trackedobjectset.h"
+
+using namespace GammaRay;
+
+static const quint32 AnnouncedBit = 1;
+// lock-free lookup attempts before falling back to the shard lock
+static const int MaxOptimisticReads = 8;
+static std::atomic<quint32> s_generation(0);
+
+static int slotHash(QObject *obj)
+{
+    // the lowest bits are always the same due to the allocation granularity, and the shard
+    // index is taken from the next ones, so mix in the upper bits as well
+    const quint64 addr = reinterpret_cast<quintptr>(obj) >> 4;
+    return static_cast<int>((addr * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 33);
+}
+
+TrackedObjectSet::Table::Table(int capacity)
+    : mask(capacity - 1)
+    , entries(new Slot[capacity])
+{
+    Q_ASSERT((capacity & mask) == 0);
+    for (int i = 0; i < capacity; ++i) {
+        entries[i].object.store(nullptr, std::memory_order_relaxed);
+        entries[i].stamp.store(0, std::memory_order_relaxed);
+    }
+}
+
+TrackedObjectSet::Table::~Table()
+{
+    delete[] entries;
+}
+
+TrackedObjectSet::Shard::Shard()
+    : sequence(0)
+    , table(new Table(16))
+    , count(0)
+{
+}
+
+TrackedObjectSet::Shard::~Shard()
+{
+    delete table.load(std::memory_order_relaxed);
+    qDeleteAll(retiredTables);
+}
+
+TrackedObjectSet::TrackedObjectSet()
+{
+}
+
+TrackedObjectSet::~TrackedObjectSet()
+{
+}
+
+TrackedObjectSet::Shard &TrackedObjectSet::shard(QObject *obj) const
+{
+    // the lowest bits are always the same due to the allocation granularity
+    const quintptr addr = reinterpret_cast<quintptr>(obj);
+    return m_shards[((addr >> 4) ^ (addr >> 12)) % ShardCount];
+}
+
+// lock-free read, retried if a modification of the shard interfered
+quint32 TrackedObjectSet::stamp(QObject *obj) const
+{
+    const Shard &s = shard(obj);
+    for (int attempt = 0; attempt < MaxOptimisticReads; ++attempt) {
+        const quint32 sequence = s.sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+            continue;
+
+        const Table *table = s.table.load(std::memory_order_acquire);
+        quint32 result = 0;
+        for (int i = slotHash(obj) & table->mask;; i = (i + 1) & table->mask) {
+            QObject *o = table->entries[i].object.load(std::memory_order_relaxed);
+            if (!o)
+                break;
+            if (o == obj) {
+                result = table->entries[i].stamp.load(std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) == sequence)
+            return result;
+    }
+
+    // a writer keeps getting in the way (or got preempted while modifying the shard),
+    // rather than spinning wait for it on the shard lock
+    QMutexLocker lock(&s.mutex);
+    const Table *table = s.table.load(std::memory_order_relaxed);
+    const int index = find(table, obj);
+    return index < 0 ? 0 : table->entries[index].stamp.load(std::memory_order_relaxed);
+}
+
+// pre-condition: shard is locked
+int TrackedObjectSet::find(const Table *table, QObject *obj)
+{
+    for (int i = slotHash(obj) & table->mask;; i = (i + 1) & table->mask) {
+        QObject *o = table->entries[i].object.load(std::memory_order_relaxed);
+        if (!o)
+            return -1;
+        if (o == obj)
+            return i;
+    }
+}
+
+// pre-condition: shard is locked and being written, obj is not in there yet
+void TrackedObjectSet::insert(Shard &s, QObject *obj, quint32 stamp)
+{
+    Table *table = s.table.load(std::memory_order_relaxed);
+    if ((s.count + 1) * 4 > (table->mask + 1) * 3) {
+        // readers might still be looking at the old table, so we can't delete it yet,
+        // as we only ever grow that costs at most as much as the current table
+        Table *newTable = new Table((table->mask + 1) * 2);
+        for (int i = 0; i <= table->mask; ++i) {
+            QObject *o = table->entries[i].object.load(std::memory_order_relaxed);
+            if (!o)
+                continue;
+            int j = slotHash(o) & newTable->mask;
+            while (newTable->entries[j].object.load(std::memory_order_relaxed))
+                j = (j + 1) & newTable->mask;
+            newTable->entries[j].object.store(o, std::memory_order_relaxed);
+            newTable->entries[j].stamp.store(table->entries[i].stamp.load(std::memory_order_relaxed),
+                                           std::memory_order_relaxed);
+        }
+        s.retiredTables.push_back(table);
+        s.table.store(newTable, std::memory_order_release);
+        table = newTable;
+    }
+
+    int i = slotHash(obj) & table->mask;
+    while (table->entries[i].object.load(std::memory_order_relaxed))
+        i = (i + 1) & table->mask;
+    table->entries[i].stamp.store(stamp, std::memory_order_relaxed);
+    table->entries[i].object.store(obj, std::memory_order_relaxed);
+    ++s.count;
+}
+
+// pre-condition: shard is locked and being written
+void TrackedObjectSet::erase(Table *table, int index)
+{
+    // backward shift deletion, so we don't need tombstones
+    for (int j = index;;) {
+        j = (j + 1) & table->mask;
+        QObject *o = table->entries[j].object.load(std::memory_order_relaxed);
+        if (!o)
+            break;
+        const int home = slotHash(o) & table->mask;
+        // the entry at j can be moved to index unless its home slot lies cyclically in (index, j]
+        const bool stays = index <= j ? (index < home && home <= j) : (index < home || home <= j);
+        if (stays)
+            continue;
+        table->entries[index].object.store(o, std::memory_order_relaxed);
+        table->entries[index].stamp.store(table->entries[j].stamp.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+        index = j;
+    }
+    table->entries[index].object.store(nullptr, std::memory_order_relaxed);
+    table->entries[index].stamp.store(0, std::memory_order_relaxed);
+}
+
+void TrackedObjectSet::beginWrite(Shard &s)
+{
+    s.sequence.store(s.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TrackedObjectSet::endWrite(Shard &s)
+{
+    s.sequence.store(s.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+TrackedObjectSet::State TrackedObjectSet::state(QObject *obj) const
+{
+    const quint32 s = stamp(obj);
+    if (s == 0)
+        return Untracked;
+    return (s & AnnouncedBit) ? Announced : Pending;
+}
+
+quint32 TrackedObjectSet::generation(QObject *obj) const
+{
+    return stamp(obj) >> 1;
+}
+
+bool TrackedObjectSet::isAnnounced(QObject *obj, quint32 generation) const
+{
+    return stamp(obj) == ((generation << 1) | AnnouncedBit);
+}
+
+bool TrackedObjectSet::insertPending(QObject *obj, quint32 generation)
+{
+    Q_ASSERT(generation != 0);
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    if (find(s.table.load(std::memory_order_relaxed), obj) >= 0)
+        return false;
+    beginWrite(s);
+    insert(s, obj, generation << 1);
+    endWrite(s);
+    return true;
+}
+
+bool TrackedObjectSet::announce(QObject *obj, quint32 generation)
+{
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    Table *table = s.table.load(std::memory_order_relaxed);
+    const int i = find(table, obj);
+    if (i < 0)
+        return false;
+    const quint32 stamp = table->entries[i].stamp.load(std::memory_order_relaxed);
+    if (stamp & AnnouncedBit)
+        return false;
+    if (generation != 0 && (stamp >> 1) != generation)
+        return false;
+    // a single store, readers see either the old or the new stamp
+    table->entries[i].stamp.store(stamp | AnnouncedBit, std::memory_order_release);
+    return true;
+}
+
+TrackedObjectSet::State TrackedObjectSet::remove(QObject *obj)
+{
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    Table *table = s.table.load(std::memory_order_relaxed);
+    const int i = find(table, obj);
+    if (i < 0)
+        return Untracked;
+    const State state
+        = (table->entries[i].stamp.load(std::memory_order_relaxed) & AnnouncedBit) ? Announced : Pending;
+    beginWrite(s);
+    erase(table, i);
+    --s.count;
+    endWrite(s);
+    return state;
+}
+
+TrackedObjectSet::State TrackedObjectSet::removePending(QObject *obj)
+{
+    Shard &s = shard(obj);
+    QMutexLocker lock(&s.mutex);
+    Table *table = s.table.load(std::memory_order_relaxed);
+    const int i = find(table, obj);
+    if (i < 0)
+        return Untracked;
+    if (table->entries[i].stamp.load(std::memory_order_relaxed) & AnnouncedBit)
+        return Announced;
+    beginWrite(s);
+    erase(table, i);
+    --s.count;
+    endWrite(s);
+    return Pending;
+}
+
+int TrackedObjectSet::size() const
+{
+    int count = 0;
+    for (int i = 0; i < ShardCount; ++i) {
+        QMutexLocker lock(&m_shards[i].mutex);
+        count += m_shards[i].count;
+    }
+    return count;
+}
+
+quint32 TrackedObjectSet::nextGeneration()
+{
+    // the upper bit is lost when shifting in the announced bit
+    quint32 generation = (s_generation.fetch_add(1, std::memory_order_relaxed) + 1) & 0x7fffffff;
+    if (generation == 0) // wrapped around
+        generation = (s_generation.fetch_add(1, std::memory_order_relaxed) + 1) & 0x7fffffff;
+    return generation;
+}
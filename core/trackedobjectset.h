@@ -0,0 +1,138 @@
+/*
+  trackedobjectset.h
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAMMARAY_TRACKEDOBJECTSET_H
+#define GAMMARAY_TRACKEDOBJECTSET_H
+
+#include "gammaray_core_export.h"
+
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+class QObject;
+QT_END_NAMESPACE
+
+namespace GammaRay {
+/** @brief Thread-safe set of the objects tracked by the probe.
+ *
+ *  Objects are first added as pending, stamped with a generation number to tell apart
+ *  different objects created at the same address. Once the probe thread announced them
+ *  they are marked as such.
+ *
+ *  Objects are distributed over a number of shards by address, each an open-addressing hash
+ *  table. Modifications only lock the shard an object belongs to, so threads creating and
+ *  destroying objects concurrently rarely contend. Lookups usually don't lock, they retry if the
+ *  shard has been modified meanwhile, and only take the shard lock if that keeps happening.
+ */
+class GAMMARAY_CORE_EXPORT TrackedObjectSet
+{
+public:
+    enum State {
+        Untracked,
+        Pending,
+        Announced
+    };
+
+    TrackedObjectSet();
+    ~TrackedObjectSet();
+
+    /** Lock-free, see above. */
+    State state(QObject *obj) const;
+    /** Returns the generation @p obj has been added with, 0 if it isn't tracked. Lock-free, see above. */
+    quint32 generation(QObject *obj) const;
+    /** Returns @c true if @p obj is announced and has been added with @p generation. Lock-free, see above. */
+    bool isAnnounced(QObject *obj, quint32 generation) const;
+
+    /** Adds @p obj as pending, returns @c false if it is already tracked. */
+    bool insertPending(QObject *obj, quint32 generation);
+    /** Marks a pending object as announced. @p generation has to match the one @p obj has been
+     *  added with, unless it is 0. Returns @c false if @p obj isn't pending (anymore).
+     */
+    bool announce(QObject *obj, quint32 generation);
+
+    /** Removes @p obj, returns the state it had before. */
+    State remove(QObject *obj);
+    /** Removes @p obj only if it is pending, returns the state it had before. */
+    State removePending(QObject *obj);
+
+    /** Number of tracked objects, pending or announced. */
+    int size() const;
+
+    /** Returns a new generation number for insertPending(), never 0. */
+    static quint32 nextGeneration();
+
+private:
+    Q_DISABLE_COPY(TrackedObjectSet)
+
+    struct Slot
+    {
+        std::atomic<QObject *> object; // nullptr for empty entries
+        std::atomic<quint32> stamp; // generation << 1, lowest bit set once announced
+    };
+
+    struct Table
+    {
+        explicit Table(int capacity);
+        ~Table();
+
+        int mask;
+        Slot *entries;
+    };
+
+    struct Shard
+    {
+        Shard();
+        ~Shard();
+
+        mutable QMutex mutex; // serializes modifications
+        std::atomic<quint32> sequence; // odd while the table is being modified
+        std::atomic<Table *> table;
+        int count;
+        // replaced tables, lock-free readers might still look at those
+        QVector<Table *> retiredTables;
+        char padding[64]; // keep the mutexes of different shards on different cache lines
+    };
+
+    enum { ShardCount = 64 };
+    Shard &shard(QObject *obj) const;
+
+    quint32 stamp(QObject *obj) const;
+    static int find(const Table *table, QObject *obj);
+    static void insert(Shard &s, QObject *obj, quint32 stamp);
+    static void erase(Table *table, int index);
+    static void beginWrite(Shard &s);
+    static void endWrite(Shard &s);
+
+    mutable Shard m_shards[ShardCount];
+};
+}
+
+#endif // GAMMARAY_TRACKEDOBJECTSET_H
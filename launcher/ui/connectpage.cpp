@@ -73,6 +73,7 @@ ConnectPage::ConnectPage(QWidget *parent)
 }
 
 const QString ConnectPage::localPrefix = QStringLiteral("local://");
+const QString ConnectPage::sharedMemoryPrefix = QStringLiteral("shm://");
 const QString ConnectPage::tcpPrefix = QStringLiteral("tcp://");
 
 void ConnectPage::validateHostAddress(const QString &address)
@@ -107,8 +108,13 @@ void ConnectPage::validateHostAddress(const QString &address)
 void ConnectPage::handleLocalAddress(QString &stillToParse, bool &correctSoFar)
 {
 #ifdef Q_OS_UNIX
-    if (stillToParse.startsWith(localPrefix))
+    QString scheme = QStringLiteral("local");
+    if (stillToParse.startsWith(localPrefix)) {
         stillToParse.remove(localPrefix); //don't remove second slash
+    } else if (stillToParse.startsWith(sharedMemoryPrefix)) {
+        stillToParse.remove(sharedMemoryPrefix);
+        scheme = QStringLiteral("shm");
+    }
 
     // Its also okay, if only a path to an existing file is given
     QFileInfo localSocketFile(stillToParse);
@@ -120,7 +126,7 @@ void ConnectPage::handleLocalAddress(QString &stillToParse, bool &correctSoFar)
         } else {
             stillToParse = "";
             correctSoFar = true;
-            m_currentUrl.setScheme("local");
+            m_currentUrl.setScheme(scheme);
             m_currentUrl.setPath(localSocketFile.filePath());
         }
     }
@@ -83,6 +83,7 @@ private:
     void clearWarnings();
 
     static const QString localPrefix;
+    static const QString sharedMemoryPrefix;
     static const QString tcpPrefix;
 
     QScopedPointer<Ui::ConnectPage> ui;
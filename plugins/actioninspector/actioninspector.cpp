@@ -30,6 +30,7 @@
 #include <core/probeinterface.h>
 #include <core/metaobject.h>
 #include <core/metaobjectrepository.h>
+#include <core/remote/backgroundsortfilterproxymodel.h>
 #include <core/remote/serverproxymodel.h>
 
 #include <common/objectmodel.h>
@@ -66,7 +67,7 @@ ActionInspector::ActionInspector(ProbeInterface *probe, QObject *parent)
     connect(probe->probe(), SIGNAL(objectSelected(QObject*,QPoint)),
             SLOT(objectSelected(QObject*)));
 
-    auto proxy = new ServerProxyModel<QSortFilterProxyModel>(this);
+    auto proxy = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     proxy->setSourceModel(actionModel);
     proxy->addRole(ActionModel::ObjectIdRole);
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.ActionModel"), proxy);
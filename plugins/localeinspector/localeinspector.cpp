@@ -35,12 +35,12 @@
 #include "timezoneoffsetdatamodel.h"
 #endif
 
+#include <core/remote/backgroundsortfilterproxymodel.h>
 #include <core/remote/serverproxymodel.h>
 #include <common/objectbroker.h>
 
 #include <QDebug>
 #include <QItemSelectionModel>
-#include <QSortFilterProxyModel>
 
 using namespace GammaRay;
 
@@ -50,7 +50,7 @@ LocaleInspector::LocaleInspector(ProbeInterface *probe, QObject *parent)
     auto *registry = new LocaleDataAccessorRegistry(this);
 
     auto *model = new LocaleModel(registry, this);
-    auto proxy = new ServerProxyModel<QSortFilterProxyModel>(this);
+    auto proxy = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     proxy->setSourceModel(model);
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.LocaleModel"), proxy);
 
@@ -59,7 +59,7 @@ LocaleInspector::LocaleInspector(ProbeInterface *probe, QObject *parent)
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
     auto tzModel = new TimezoneModel(this);
-    proxy = new ServerProxyModel<QSortFilterProxyModel>(this);
+    proxy = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     proxy->setSourceModel(tzModel);
     proxy->addRole(TimezoneModelRoles::LocalZoneRole);
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.TimezoneModel"), proxy);
@@ -34,6 +34,7 @@
 #include <core/metaobjectrepository.h>
 #include <core/probeinterface.h>
 #include <core/objecttypefilterproxymodel.h>
+#include <core/remote/backgroundsortfilterproxymodel.h>
 #include <core/remote/serverproxymodel.h>
 
 #include <common/objectbroker.h>
@@ -56,7 +57,7 @@ TranslatorInspector::TranslatorInspector(ProbeInterface *probe, QObject *parent)
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.TranslatorsModel"),
                          m_translatorsModel);
 
-    m_translationsModel = new ServerProxyModel<QSortFilterProxyModel>(this);
+    m_translationsModel = new ServerProxyModel<BackgroundSortFilterProxyModel>(this);
     probe->registerModel(QStringLiteral("com.kdab.GammaRay.TranslationsModel"),
                          m_translationsModel);
 
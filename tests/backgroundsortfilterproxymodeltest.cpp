@@ -0,0 +1,350 @@
+/*
+  backgroundsortfilterproxymodeltest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/remote/backgroundsortfilterproxymodel.h>
+
+#include <3rdparty/qt/modeltest.h>
+
+#include <QSignalSpy>
+#include <QSortFilterProxyModel>
+#include <QStandardItemModel>
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+class BackgroundSortFilterProxyModelTest : public QObject
+{
+    Q_OBJECT
+private:
+    static void fillModel(QStandardItemModel *model, int rows)
+    {
+        for (int row = 0; row < rows; ++row) {
+            QList<QStandardItem *> items;
+            items.push_back(new QStandardItem(QStringLiteral("Object%1").arg(row)));
+            items.push_back(new QStandardItem(row % 3 ? QStringLiteral("QObject") : QStringLiteral("QTimer")));
+            items.back()->setData(rows - row, Qt::UserRole);
+            model->appendRow(items);
+        }
+    }
+
+    static bool waitForUpdate(BackgroundSortFilterProxyModel *proxy)
+    {
+        for (int i = 0; i < 500 && proxy->isUpdating(); ++i)
+            QTest::qWait(10);
+        return !proxy->isUpdating();
+    }
+
+    // compares against QSortFilterProxyModel with the same configuration
+    static bool sameRows(QAbstractItemModel *proxy, QAbstractItemModel *reference)
+    {
+        if (proxy->rowCount() != reference->rowCount())
+            return false;
+        for (int row = 0; row < proxy->rowCount(); ++row) {
+            if (proxy->index(row, 0).data() != reference->index(row, 0).data())
+                return false;
+        }
+        return true;
+    }
+
+private slots:
+    void testFilter()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 100);
+
+        BackgroundSortFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QCOMPARE(proxy.rowCount(), 100);
+        QCOMPARE(proxy.columnCount(), 2);
+
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+
+        QSignalSpy updateSpy(&proxy, SIGNAL(updated()));
+        QVERIFY(updateSpy.isValid());
+
+        proxy.setFilterKeyColumn(-1);
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("timer"), Qt::CaseInsensitive, QRegExp::FixedString));
+        reference.setFilterKeyColumn(-1);
+        reference.setFilterRegExp(QRegExp(QStringLiteral("timer"), Qt::CaseInsensitive, QRegExp::FixedString));
+        QCOMPARE(proxy.rowCount(), 100); // nothing changes before the background computation is done
+        QVERIFY(waitForUpdate(&proxy));
+        QCOMPARE(updateSpy.size(), 1);
+        QCOMPARE(proxy.rowCount(), 34);
+        QVERIFY(sameRows(&proxy, &reference));
+
+        const QModelIndex sourceIndex = source.index(3, 1);
+        const QModelIndex proxyIndex = proxy.mapFromSource(sourceIndex);
+        QCOMPARE(proxyIndex.row(), 1);
+        QCOMPARE(proxy.mapToSource(proxyIndex), sourceIndex);
+        QVERIFY(!proxy.mapFromSource(source.index(4, 0)).isValid());
+
+        proxy.setFilterRegExp(QRegExp());
+        QVERIFY(waitForUpdate(&proxy));
+        QCOMPARE(proxy.rowCount(), 100);
+    }
+
+    void testSort()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 50);
+
+        BackgroundSortFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+
+        proxy.setSortRole(Qt::UserRole);
+        proxy.sort(1, Qt::AscendingOrder);
+        reference.setSortRole(Qt::UserRole);
+        reference.sort(1, Qt::AscendingOrder);
+        QVERIFY(waitForUpdate(&proxy));
+        QVERIFY(sameRows(&proxy, &reference));
+        QCOMPARE(proxy.index(0, 0).data().toString(), QStringLiteral("Object49"));
+
+        proxy.sort(0, Qt::DescendingOrder);
+        proxy.setSortRole(Qt::DisplayRole);
+        reference.setSortRole(Qt::DisplayRole);
+        reference.sort(0, Qt::DescendingOrder);
+        QVERIFY(waitForUpdate(&proxy));
+        QVERIFY(sameRows(&proxy, &reference));
+    }
+
+    void testPersistentIndexes()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 30);
+
+        BackgroundSortFilterProxyModel proxy;
+        proxy.setSourceModel(&source);
+
+        const QPersistentModelIndex kept(proxy.index(6, 1));
+        const QPersistentModelIndex filtered(proxy.index(7, 0));
+        proxy.setFilterKeyColumn(1);
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("QTimer")));
+        QVERIFY(waitForUpdate(&proxy));
+
+        QVERIFY(kept.isValid());
+        QCOMPARE(kept.row(), 2);
+        QCOMPARE(kept.column(), 1);
+        QCOMPARE(proxy.mapToSource(kept), source.index(6, 1));
+        QVERIFY(!filtered.isValid());
+    }
+
+    void testSourceChanges()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 20);
+
+        BackgroundSortFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        reference.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        proxy.sort(0);
+        reference.sort(0);
+        QVERIFY(waitForUpdate(&proxy));
+        QVERIFY(sameRows(&proxy, &reference));
+
+        // structural changes are applied synchronously
+        source.insertRow(5, new QStandardItem(QStringLiteral("Object100")));
+        source.insertRow(0, new QStandardItem(QStringLiteral("Object2")));
+        QVERIFY(!proxy.isUpdating());
+        QVERIFY(sameRows(&proxy, &reference));
+
+        source.removeRows(3, 10);
+        QVERIFY(sameRows(&proxy, &reference));
+
+        // so are content changes
+        source.item(0, 0)->setText(QStringLiteral("Object1"));
+        QVERIFY(!proxy.isUpdating());
+        QVERIFY(sameRows(&proxy, &reference));
+
+        source.clear();
+        QCOMPARE(proxy.rowCount(), 0);
+        QCOMPARE(proxy.columnCount(), 0);
+    }
+
+    void testContentChanges()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 30);
+
+        BackgroundSortFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        reference.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        proxy.sort(0);
+        reference.sort(0);
+        QVERIFY(waitForUpdate(&proxy));
+        QVERIFY(sameRows(&proxy, &reference));
+
+        const QPersistentModelIndex unchanged = proxy.mapFromSource(source.index(10, 0));
+        QVERIFY(unchanged.isValid());
+        const int unchangedRow = unchanged.row();
+        const QPersistentModelIndex renamed = proxy.mapFromSource(source.index(17, 0));
+        QVERIFY(renamed.isValid());
+
+        // starts matching, stops matching, moves within the sort order, and stays in place
+        source.item(2, 0)->setText(QStringLiteral("Object1002"));
+        source.item(21, 0)->setText(QStringLiteral("Object99"));
+        source.item(14, 0)->setText(QStringLiteral("Object0001"));
+        source.item(17, 0)->setText(QStringLiteral("Object17a"));
+        source.item(12, 1)->setText(QStringLiteral("QTimer"));
+        QVERIFY(!proxy.isUpdating());
+        QVERIFY(sameRows(&proxy, &reference));
+
+        QVERIFY(unchanged.isValid());
+        QCOMPARE(unchanged.data().toString(), QStringLiteral("Object10"));
+        QCOMPARE(proxy.mapToSource(unchanged), source.index(10, 0));
+        QCOMPARE(unchanged.row(), unchangedRow + 1); // "Object0001" sorts before it now
+        QVERIFY(renamed.isValid()); // still in order, so not moved
+        QCOMPARE(renamed.data().toString(), QStringLiteral("Object17a"));
+    }
+
+    void testContentChangesWhileUpdating()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 20000);
+
+        BackgroundSortFilterProxyModel proxy;
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+        reference.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        reference.sort(0);
+
+        QSignalSpy updateSpy(&proxy, SIGNAL(updated()));
+        QVERIFY(updateSpy.isValid());
+
+        // changing filter and sort keys must not restart the computation either
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        proxy.sort(0);
+        QTest::qWait(0);
+        for (int i = 0; i < 200 && proxy.isUpdating(); ++i) {
+            source.item(i * 13, 0)->setText(QStringLiteral("Changed%1").arg(i));
+            source.item(i * 17 + 5, 0)->setText(QStringLiteral("Renamed%1").arg(i * 2));
+            QTest::qWait(1);
+        }
+        QVERIFY(waitForUpdate(&proxy));
+        QCOMPARE(updateSpy.size(), 1);
+        QVERIFY(sameRows(&proxy, &reference));
+    }
+
+    void testInsertWhileResorting()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 2000);
+
+        BackgroundSortFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+
+        proxy.sort(0, Qt::AscendingOrder);
+        QVERIFY(waitForUpdate(&proxy));
+
+        // the mapping still has the old order, new rows must not be placed by the new one
+        proxy.sort(0, Qt::DescendingOrder);
+        reference.sort(0, Qt::DescendingOrder);
+        source.insertRow(7, new QStandardItem(QStringLiteral("Object5000")));
+        source.appendRow(new QStandardItem(QStringLiteral("Object0")));
+        QCOMPARE(proxy.rowCount(), 2002);
+        QVERIFY(waitForUpdate(&proxy));
+        QVERIFY(sameRows(&proxy, &reference));
+    }
+
+    void testSourceChangesWhileUpdating()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 20000);
+
+        BackgroundSortFilterProxyModel proxy;
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+        reference.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        reference.sort(0);
+
+        QSignalSpy updateSpy(&proxy, SIGNAL(updated()));
+        QVERIFY(updateSpy.isValid());
+
+        // rows keep arriving and going while the computation runs, that must not hold it back
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("1")));
+        proxy.sort(0);
+        QTest::qWait(0);
+        for (int i = 0; i < 200 && proxy.isUpdating(); ++i) {
+            source.appendRow(new QStandardItem(QStringLiteral("Added%1").arg(i)));
+            source.insertRow(i * 10, new QStandardItem(QStringLiteral("Inserted%1").arg(i)));
+            source.removeRow(i * 7 + 1);
+            QTest::qWait(1);
+        }
+        QVERIFY(waitForUpdate(&proxy));
+        QCOMPARE(updateSpy.size(), 1);
+        QVERIFY(sameRows(&proxy, &reference));
+    }
+
+    void testCancellation()
+    {
+        QStandardItemModel source;
+        fillModel(&source, 20000);
+
+        BackgroundSortFilterProxyModel proxy;
+        proxy.setSourceModel(&source);
+        QSortFilterProxyModel reference;
+        reference.setSourceModel(&source);
+        reference.setFilterRegExp(QRegExp(QStringLiteral("Object19")));
+
+        QSignalSpy updateSpy(&proxy, SIGNAL(updated()));
+        QVERIFY(updateSpy.isValid());
+
+        // the first computation is most likely still running when the filter changes again,
+        // either way the last filter has to win
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("Object1")));
+        QTest::qWait(0);
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("Object19")));
+        QVERIFY(waitForUpdate(&proxy));
+        QTest::qWait(10);
+        QVERIFY(updateSpy.size() >= 1);
+        QVERIFY(sameRows(&proxy, &reference));
+    }
+};
+
+QTEST_MAIN(BackgroundSortFilterProxyModelTest)
+
+#include "backgroundsortfilterproxymodeltest.moc"
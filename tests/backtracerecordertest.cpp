@@ -0,0 +1,156 @@
+/*
+  backtracerecordertest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/backtracerecorder.h>
+#include <core/stacktrie.h>
+
+#include <QTimer>
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+static void *frame(quintptr addr)
+{
+    return reinterpret_cast<void *>(addr);
+}
+
+class BacktraceRecorderTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testStackTrie()
+    {
+        StackTrie trie;
+        void *const a[] = { frame(3), frame(2), frame(1) };
+        void *const b[] = { frame(4), frame(2), frame(1) };
+
+        const int idA = trie.insert(a, 3);
+        QCOMPARE(trie.nodeCount(), 3);
+        QCOMPARE(trie.insert(a, 3), idA);
+        QCOMPARE(trie.nodeCount(), 3);
+
+        // shares the outer two frames
+        const int idB = trie.insert(b, 3);
+        QVERIFY(idB != idA);
+        QCOMPARE(trie.nodeCount(), 4);
+        QCOMPARE(trie.frames(idA), QVector<void *>() << frame(3) << frame(2) << frame(1));
+        QCOMPARE(trie.frames(idB), QVector<void *>() << frame(4) << frame(2) << frame(1));
+
+        trie.release(idA);
+        QCOMPARE(trie.nodeCount(), 4);
+        trie.release(idA);
+        QCOMPARE(trie.nodeCount(), 3);
+        QCOMPARE(trie.frames(idB), QVector<void *>() << frame(4) << frame(2) << frame(1));
+
+        // recycles the free node
+        const int idC = trie.insert(a, 3);
+        QCOMPARE(trie.nodeCount(), 4);
+        QCOMPARE(trie.frames(idC), QVector<void *>() << frame(3) << frame(2) << frame(1));
+
+        trie.release(idB);
+        trie.release(idC);
+        QCOMPARE(trie.nodeCount(), 0);
+        QCOMPARE(trie.insert(a, 0), -1);
+    }
+
+    void testRecordAndRemove()
+    {
+        BacktraceRecorder recorder;
+        recorder.setPolicy(BacktraceRecorder::All);
+        void *const trace[] = { frame(2), frame(1) };
+
+        QObject a, b;
+        QVERIFY(recorder.shouldRecord());
+        recorder.record(&a, trace, 2);
+        QCOMPARE(recorder.frameCount(), 2);
+        recorder.record(&b, trace, 2);
+        QCOMPARE(recorder.recordedObjectCount(), 2);
+        QCOMPARE(recorder.frames(&a), QVector<void *>() << frame(2) << frame(1));
+
+        recorder.remove(&a);
+        QCOMPARE(recorder.recordedObjectCount(), 1);
+        QVERIFY(recorder.frames(&a).isEmpty());
+        QCOMPARE(recorder.frames(&b).size(), 2);
+        recorder.remove(&b);
+        QCOMPARE(recorder.recordedObjectCount(), 0);
+        QCOMPARE(recorder.frameCount(), 0);
+
+        recorder.setPolicy(BacktraceRecorder::Off);
+        QVERIFY(!recorder.shouldRecord());
+    }
+
+    void testSampling()
+    {
+        BacktraceRecorder recorder;
+        QCOMPARE(recorder.policy(), BacktraceRecorder::Sampled);
+        recorder.setSampleRate(10);
+
+        int count = 0;
+        for (int i = 0; i < 1000; ++i) {
+            if (recorder.shouldRecord())
+                ++count;
+        }
+        QCOMPARE(count, 100);
+    }
+
+    void testClassFilter()
+    {
+        BacktraceRecorder recorder;
+        recorder.setPolicy(BacktraceRecorder::Classes);
+        QVERIFY(!recorder.shouldRecord());
+        recorder.setClassNames(QVector<QByteArray>() << QByteArray("QTimer"));
+        void *const trace[] = { frame(1) };
+
+        QObject obj;
+        QTimer timer;
+        QVERIFY(recorder.shouldRecord());
+        recorder.record(&obj, trace, 1);
+        recorder.record(&timer, trace, 1);
+        // nothing is stored before the class is known
+        QCOMPARE(recorder.recordedObjectCount(), 0);
+        QCOMPARE(recorder.frameCount(), 0);
+
+        recorder.objectConstructed(&obj);
+        recorder.objectConstructed(&timer);
+        QCOMPARE(recorder.recordedObjectCount(), 1);
+        QVERIFY(recorder.frames(&obj).isEmpty());
+        QCOMPARE(recorder.frames(&timer).size(), 1);
+
+        // destroyed before being fully constructed
+        QObject other;
+        recorder.record(&other, trace, 1);
+        recorder.remove(&other);
+        recorder.objectConstructed(&other);
+        QVERIFY(recorder.frames(&other).isEmpty());
+        QCOMPARE(recorder.recordedObjectCount(), 1);
+    }
+};
+
+QTEST_MAIN(BacktraceRecorderTest)
+
+#include "backtracerecordertest.moc"
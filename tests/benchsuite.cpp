@@ -28,17 +28,375 @@
 
 #include "benchsuite.h"
 #include "core/probe.h"
+#include "core/objectsearchindex.h"
 #include "core/util.h"
+#include "core/remote/remotemodelserver.h"
+
+#include <common/message.h>
+#include <common/messagechannel.h>
+#include <common/modelindexcodec.h>
+#include <common/remoteviewframe.h>
 
 #include <QtTestGui>
 
+#include <QElapsedTimer>
 #include <QLabel>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStandardItemModel>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
 #include <QTreeView>
+#include <QUrl>
+
+#include <memory>
 
 QTEST_MAIN(GammaRay::BenchSuite)
 
 using namespace GammaRay;
 
+namespace GammaRay {
+// RemoteModelServer without a connection, counting what it would send
+class FakeRemoteModelServer : public RemoteModelServer
+{
+public:
+    FakeRemoteModelServer()
+        : RemoteModelServer(QStringLiteral("com.kdab.GammaRay.BenchSuite.Model"), nullptr)
+        , byteCount(0)
+    {
+        m_myAddress = 42;
+    }
+
+    static void setup()
+    {
+        s_registerServerCallback = &registerServer;
+    }
+
+    mutable qint64 byteCount;
+
+private:
+    static void registerServer() {}
+    bool isConnected() const override { return true; }
+    void sendMessage(const Message &msg) const override { byteCount += msg.size(); }
+};
+}
+
+namespace {
+// same socket types as used by TcpServerDevice/LocalServerDevice and their client counterparts
+struct SocketPair
+{
+    SocketPair()
+        : serverSide(nullptr)
+        , clientSide(nullptr)
+    {
+    }
+
+    bool connect(const QString &transport)
+    {
+        if (transport == QLatin1String("tcp")) {
+            tcpServer.reset(new QTcpServer);
+            if (!tcpServer->listen(QHostAddress::LocalHost))
+                return false;
+            auto socket = new QTcpSocket;
+            clientSide = socket;
+            socket->connectToHost(QHostAddress::LocalHost, tcpServer->serverPort());
+            if (!socket->waitForConnected(5000) || !tcpServer->waitForNewConnection(5000))
+                return false;
+            serverSide = tcpServer->nextPendingConnection();
+        } else {
+            localServer.reset(new QLocalServer);
+            const QString name = QStringLiteral("gammaray-benchsuite-")
+                                 + QString::number(QCoreApplication::applicationPid());
+            QLocalServer::removeServer(name);
+            if (!localServer->listen(name))
+                return false;
+            auto socket = new QLocalSocket;
+            clientSide = socket;
+            socket->connectToServer(name);
+            if (!socket->waitForConnected(5000) || !localServer->waitForNewConnection(5000))
+                return false;
+            serverSide = localServer->nextPendingConnection();
+        }
+        return serverSide;
+    }
+
+    std::unique_ptr<QTcpServer> tcpServer;
+    std::unique_ptr<QLocalServer> localServer;
+    QIODevice *serverSide;
+    QIODevice *clientSide;
+};
+
+// probe and client side of a connection, each using the same channel setup as the Endpoint
+struct ChannelPair
+{
+    bool connect(const QString &transport, bool ioThread)
+    {
+        if (!sockets.connect(transport))
+            return false;
+        probe.reset(new MessageChannel(Protocol::InvalidObjectAddress));
+        client.reset(new MessageChannel(Protocol::InvalidObjectAddress));
+        attach(probe.get(), sockets.serverSide, ioThread);
+        attach(client.get(), sockets.clientSide, ioThread);
+        return true;
+    }
+
+    static void attach(MessageChannel *channel, QIODevice *device, bool ioThread)
+    {
+        if (ioThread)
+            channel->enableIoThread();
+        channel->setDevice(device);
+        if (!ioThread) // with an I/O thread the channel takes care of this itself
+            device->setParent(channel);
+    }
+
+    // the channels own the sockets, which in turn need to go before their server
+    SocketPair sockets;
+    std::unique_ptr<MessageChannel> probe;
+    std::unique_ptr<MessageChannel> client;
+};
+
+static const Protocol::ObjectAddress benchAddress = 23;
+
+// Payload and message type of a message with @p content, as sent by the probe.
+QByteArray transportPayload(const QString &content, Protocol::MessageType *type)
+{
+    Message msg(benchAddress, Protocol::ModelContentReply);
+    if (content == QLatin1String("model content")) {
+        *type = Protocol::ModelContentReply;
+        // reply to a content request for a screen full of a typical object tree
+        static const int rows = 64;
+        static const int columns = 2;
+        msg << quint32(rows * columns);
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                Protocol::ModelIndex index;
+                index.push_back(Protocol::ModelIndexData(0, 0));
+                index.push_back(Protocol::ModelIndexData(row, column));
+                QMap<int, QVariant> itemData;
+                itemData.insert(Qt::DisplayRole, column == 0
+                                ? QString(QStringLiteral("object") + QString::number(row))
+                                : QString(QStringLiteral("QQuickItem")));
+                itemData.insert(Qt::ToolTipRole, QString(QStringLiteral("Object #%1 at 0x%2")
+                                                         .arg(row).arg(0x1f3a20 + row * 0x40, 0, 16)));
+                msg << index << itemData << qint32(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+            }
+        }
+    } else if (content == QLatin1String("property sync")) {
+        // a handful of property changes of a single object
+        *type = Protocol::PropertyValuesChanged;
+        msg << Protocol::ObjectAddress(42) << quint32(4);
+        msg << QByteArray("enabled") << QVariant(true);
+        msg << QByteArray("currentIndex") << QVariant(7);
+        msg << QByteArray("filterText") << QVariant(QStringLiteral("QQuick"));
+        msg << QByteArray("zoom") << QVariant(1.5);
+    } else {
+        // a frame of a window of a typical size, with some structure for the compression to find
+        *type = Protocol::MethodCall;
+        QImage image(800, 600, QImage::Format_ARGB32_Premultiplied);
+        for (int y = 0; y < image.height(); ++y) {
+            auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < image.width(); ++x)
+                line[x] = qRgb(x & 0xff, y & 0xff, (x / 16 + y / 16) % 2 ? 0x80 : 0xe0);
+        }
+        RemoteViewFrame frame;
+        frame.setViewRect(QRectF(QPointF(0, 0), image.size()));
+        frame.setSceneRect(frame.viewRect());
+        frame.setImage(image);
+        msg << frame;
+    }
+    return msg.rawPayload();
+}
+
+// Enables or disables LZ4 compression for the lifetime of this object.
+struct CompressionSwitch
+{
+    explicit CompressionSwitch(bool enabled)
+        : wasEnabled(Message::compressionEnabled())
+    {
+        Message::setCompressionEnabled(enabled);
+    }
+
+    ~CompressionSwitch()
+    {
+        Message::setCompressionEnabled(wasEnabled);
+    }
+
+    bool wasEnabled;
+};
+
+// Process events until @p receiver got @p count messages in total.
+bool waitForMessages(const BenchMessageReceiver &receiver, int count)
+{
+    QElapsedTimer timeout;
+    timeout.start();
+    while (receiver.messageCount < count) {
+        if (timeout.elapsed() > 30000)
+            return false;
+        QCoreApplication::processEvents();
+    }
+    return true;
+}
+}
+
+BenchMessageReceiver::BenchMessageReceiver(MessageChannel *channel, bool acknowledge)
+    : QObject(nullptr)
+    , messageCount(0)
+    , byteCount(0)
+    , m_channel(channel)
+    , m_acknowledge(acknowledge)
+{
+    connect(channel, SIGNAL(messageReceived(GammaRay::Message)),
+            this, SLOT(messageReceived(GammaRay::Message)), Qt::DirectConnection);
+    connect(channel, SIGNAL(messagesReceived()),
+            this, SLOT(dispatchReceivedMessages()), Qt::QueuedConnection);
+}
+
+void BenchMessageReceiver::messageReceived(const Message &msg)
+{
+    ++messageCount;
+    byteCount += msg.size();
+    if (m_acknowledge) {
+        Message ack(benchAddress, Protocol::ModelContentRequest);
+        ack << quint32(messageCount);
+        m_channel->send(ack);
+        m_channel->flush();
+    }
+}
+
+void BenchMessageReceiver::dispatchReceivedMessages()
+{
+    m_channel->dispatchReceivedMessages();
+}
+
+// All transport benchmarks send from the probe to the client side. To get machine-readable results,
+// run them with e.g. "benchsuite -csv transport_bandwidth" or "benchsuite -o results.xml,xml".
+void BenchSuite::transportData()
+{
+    QTest::addColumn<QString>("transport");
+    QTest::addColumn<QString>("content");
+    QTest::addColumn<bool>("lz4");
+    QTest::addColumn<bool>("ioThread");
+
+    const QStringList transports = QStringList() << QStringLiteral("tcp") << QStringLiteral("local");
+    const QStringList contents = QStringList() << QStringLiteral("model content")
+                                               << QStringLiteral("property sync")
+                                               << QStringLiteral("remote view frame");
+    foreach (const QString &transport, transports) {
+        foreach (const QString &content, contents) {
+            for (int lz4 = 1; lz4 >= 0; --lz4) {
+                for (int ioThread = 0; ioThread <= 1; ++ioThread) {
+                    const QString name = transport + QStringLiteral(", ") + content
+                                         + (lz4 ? QStringLiteral(", lz4") : QStringLiteral(", uncompressed"))
+                                         + (ioThread ? QStringLiteral(", I/O thread") : QString());
+                    QTest::newRow(qPrintable(name)) << transport << content << bool(lz4) << bool(ioThread);
+                }
+            }
+        }
+    }
+}
+
+void BenchSuite::transport_latency_data()
+{
+    transportData();
+}
+
+void BenchSuite::transport_latency()
+{
+    QFETCH(QString, transport);
+    QFETCH(QString, content);
+    QFETCH(bool, lz4);
+    QFETCH(bool, ioThread);
+
+    CompressionSwitch compression(lz4);
+    Protocol::MessageType type;
+    const QByteArray payload = transportPayload(content, &type);
+
+    ChannelPair channels;
+    QVERIFY(channels.connect(transport, ioThread));
+    channels.probe->setStreamCompressionEnabled(lz4);
+    channels.client->setStreamCompressionEnabled(lz4);
+    BenchMessageReceiver probeReceiver(channels.probe.get(), false);
+    BenchMessageReceiver clientReceiver(channels.client.get(), true);
+
+    // round trip time of a message and its acknowledgment
+    QBENCHMARK {
+        const int expected = probeReceiver.messageCount + 1;
+        channels.probe->send(Message(benchAddress, type, payload));
+        channels.probe->flush();
+        QVERIFY(waitForMessages(probeReceiver, expected));
+    }
+}
+
+void BenchSuite::transport_messageRate_data()
+{
+    transportData();
+}
+
+void BenchSuite::transport_messageRate()
+{
+    QFETCH(QString, transport);
+    QFETCH(QString, content);
+    QFETCH(bool, lz4);
+    QFETCH(bool, ioThread);
+
+    CompressionSwitch compression(lz4);
+    Protocol::MessageType type;
+    const QByteArray payload = transportPayload(content, &type);
+
+    ChannelPair channels;
+    QVERIFY(channels.connect(transport, ioThread));
+    channels.probe->setStreamCompressionEnabled(lz4);
+    BenchMessageReceiver receiver(channels.client.get(), false);
+
+    // messages/sec = NUM_MESSAGES / time
+    static const int NUM_MESSAGES = 1000;
+    QBENCHMARK {
+        const int expected = receiver.messageCount + NUM_MESSAGES;
+        for (int i = 0; i < NUM_MESSAGES; ++i)
+            channels.probe->send(Message(benchAddress, type, payload));
+        channels.probe->flush();
+        QVERIFY(waitForMessages(receiver, expected));
+    }
+}
+
+void BenchSuite::transport_bandwidth_data()
+{
+    transportData();
+}
+
+void BenchSuite::transport_bandwidth()
+{
+    QFETCH(QString, transport);
+    QFETCH(QString, content);
+    QFETCH(bool, lz4);
+    QFETCH(bool, ioThread);
+
+    CompressionSwitch compression(lz4);
+    Protocol::MessageType type;
+    const QByteArray payload = transportPayload(content, &type);
+
+    ChannelPair channels;
+    QVERIFY(channels.connect(transport, ioThread));
+    channels.probe->setStreamCompressionEnabled(lz4);
+    BenchMessageReceiver receiver(channels.client.get(), false);
+
+    // uncompressed payload bytes delivered per second, for about 64 MB of messages
+    const int numMessages = qMax(16, (64 << 20) / payload.size());
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < numMessages; ++i) {
+        channels.probe->send(Message(benchAddress, type, payload));
+        if (i % 64 == 0)
+            QCoreApplication::processEvents();
+    }
+    channels.probe->flush();
+    QVERIFY(waitForMessages(receiver, numMessages));
+    const qint64 elapsed = qMax<qint64>(1, timer.nsecsElapsed());
+
+    QTest::setBenchmarkResult(qreal(receiver.byteCount) * 1000000000 / elapsed, QTest::BytesPerSecond);
+}
+
 void BenchSuite::iconForObject()
 {
     QWidget widget;
@@ -77,3 +435,140 @@ void BenchSuite::probe_objectAdded()
     qDeleteAll(objects);
     delete Probe::instance();
 }
+
+void BenchSuite::objectSearchIndex_find_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::newRow("name") << QStringLiteral("object4242");
+    QTest::newRow("short name") << QStringLiteral("t4");
+    QTest::newRow("class") << QStringLiteral("timer");
+    QTest::newRow("no match") << QStringLiteral("nothing");
+}
+
+void BenchSuite::objectSearchIndex_find()
+{
+    QFETCH(QString, text);
+
+    static const int NUM_OBJECTS = 100000;
+    QVector<QObject *> objects;
+    objects.reserve(NUM_OBJECTS);
+    ObjectSearchIndex index;
+    for (int i = 0; i < NUM_OBJECTS; ++i) {
+        auto *obj = i % 100 ? new QObject : new QTimer;
+        obj->setObjectName(QStringLiteral("object%1").arg(i));
+        objects << obj;
+        index.objectAdded(obj);
+    }
+
+    QBENCHMARK {
+        index.find(text, 1000);
+    }
+
+    qDeleteAll(objects);
+}
+
+void BenchSuite::remoteModelServer_content()
+{
+    FakeRemoteModelServer::setup();
+
+    // a property model like screen full, mostly values that need canSerialize() checks
+    static const int ROWS = 64;
+    QStandardItemModel model(ROWS, 2);
+    for (int row = 0; row < ROWS; ++row) {
+        QVariant value;
+        switch (row % 8) {
+        case 0: value = QStringLiteral("objectName"); break;
+        case 1: value = QVariantList() << 1 << QStringLiteral("two") << 3.0; break;
+        case 2: {
+            QVariantMap map;
+            map.insert(QStringLiteral("x"), 23);
+            map.insert(QStringLiteral("y"), QStringLiteral("42"));
+            value = map;
+            break;
+        }
+        case 3: value = QUrl(QStringLiteral("qrc:/main.qml")); break;
+        case 4: value = QStringList() << QStringLiteral("a") << QStringLiteral("b"); break;
+        case 5: value = QVariant::fromValue(QList<int>() << 1 << 2 << 3); break;
+        case 6: value = QVariant::fromValue<QObject *>(this); break;
+        case 7: value = QSize(23, 42); break;
+        }
+        model.setData(model.index(row, 0), QStringLiteral("property") + QString::number(row));
+        model.setData(model.index(row, 1), value);
+        model.setData(model.index(row, 1), value, Qt::EditRole + 256);
+        model.setData(model.index(row, 1), QStringLiteral("type of property"), Qt::ToolTipRole);
+    }
+
+    FakeRemoteModelServer server;
+    server.setModel(&model);
+
+    QVector<Protocol::ModelIndex> indexes;
+    for (int row = 0; row < ROWS; ++row) {
+        for (int column = 0; column < model.columnCount(); ++column)
+            indexes.push_back(Protocol::fromQModelIndex(model.index(row, column)));
+    }
+
+    QBENCHMARK {
+        Message msg(42, Protocol::ModelContentRequest);
+        ModelIndexWriter(msg).writeList(indexes);
+        server.newRequest(msg);
+    }
+    QVERIFY(server.byteCount > 0);
+}
+
+void BenchSuite::message_write_data()
+{
+    QTest::addColumn<QString>("transport");
+    QTest::addColumn<bool>("coalesced");
+
+    QTest::newRow("tcp, per message") << QStringLiteral("tcp") << false;
+    QTest::newRow("tcp, coalesced") << QStringLiteral("tcp") << true;
+    QTest::newRow("local, per message") << QStringLiteral("local") << false;
+    QTest::newRow("local, coalesced") << QStringLiteral("local") << true;
+}
+
+void BenchSuite::message_write()
+{
+    QFETCH(QString, transport);
+    QFETCH(bool, coalesced);
+
+    SocketPair sockets;
+    QVERIFY(sockets.connect(transport));
+    std::unique_ptr<QIODevice> receiver(sockets.clientSide);
+    std::unique_ptr<QIODevice> sender(sockets.serverSide);
+
+    // typical burst of small model change notifications, messages/sec = NUM_MESSAGES / time
+    static const int NUM_MESSAGES = 10000;
+    Protocol::ModelIndex index;
+    index.push_back(Protocol::ModelIndexData(2, 0));
+    index.push_back(Protocol::ModelIndexData(42, 0));
+    const QVector<int> roles = QVector<int>() << Qt::DisplayRole << Qt::ToolTipRole;
+
+    QByteArray queue;
+    QBENCHMARK {
+        for (int i = 0; i < NUM_MESSAGES; ++i) {
+            Message msg(23, Protocol::ModelContentChanged);
+            msg << index << index << roles;
+            if (coalesced)
+                msg.appendTo(queue);
+            else
+                msg.write(sender.get());
+        }
+        if (coalesced) {
+            sender->write(queue);
+            queue.resize(0);
+        }
+
+        int received = 0;
+        QElapsedTimer timeout;
+        timeout.start();
+        while (received < NUM_MESSAGES) {
+            QVERIFY(timeout.elapsed() < 30000);
+            sender->waitForBytesWritten(10);
+            receiver->waitForReadyRead(10);
+            while (Message::canReadMessage(receiver.get())) {
+                Message::readMessage(receiver.get());
+                ++received;
+            }
+        }
+    }
+}
@@ -32,13 +32,49 @@
 #include <QObject>
 
 namespace GammaRay {
+class Message;
+class MessageChannel;
+
+/** Counts the messages received by a MessageChannel, and optionally acknowledges each. */
+class BenchMessageReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchMessageReceiver(MessageChannel *channel, bool acknowledge);
+
+    int messageCount;
+    qint64 byteCount;
+
+private slots:
+    void messageReceived(const GammaRay::Message &msg);
+    void dispatchReceivedMessages();
+
+private:
+    MessageChannel *m_channel;
+    bool m_acknowledge;
+};
+
 class BenchSuite : public QObject
 {
     Q_OBJECT
 
+private:
+    void transportData();
+
 private slots:
     void iconForObject();
     void probe_objectAdded();
+    void objectSearchIndex_find_data();
+    void objectSearchIndex_find();
+    void message_write_data();
+    void message_write();
+    void remoteModelServer_content();
+    void transport_latency_data();
+    void transport_latency();
+    void transport_messageRate_data();
+    void transport_messageRate();
+    void transport_bandwidth_data();
+    void transport_bandwidth();
 };
 }
 
@@ -0,0 +1,326 @@
+/*
+  krecursivefilterproxymodeltest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <3rdparty/kde/krecursivefilterproxymodel.h>
+
+#include <3rdparty/qt/modeltest.h>
+
+#include <QStandardItemModel>
+#include <QStringList>
+#include <QtTest/qtest.h>
+
+// QStandardItemModel doesn't support moving rows, so we need our own source model for that
+class MoveTreeModel : public QAbstractItemModel
+{
+public:
+    struct Node
+    {
+        explicit Node(const QString &name = QString(), Node *parent = nullptr)
+            : name(name)
+            , parent(parent)
+        {
+            if (parent)
+                parent->children.push_back(this);
+        }
+        ~Node() { qDeleteAll(children); }
+
+        QString name;
+        Node *parent;
+        QVector<Node *> children;
+    };
+
+    explicit MoveTreeModel(QObject *parent = nullptr)
+        : QAbstractItemModel(parent)
+    {
+    }
+
+    Node *root() { return &m_root; }
+
+    QModelIndex indexForNode(Node *node) const
+    {
+        if (node == &m_root)
+            return QModelIndex();
+        return createIndex(node->parent->children.indexOf(node), 0, node);
+    }
+
+    void moveRow(Node *sourceParent, int row, Node *destinationParent, int destinationRow)
+    {
+        const bool canMove = beginMoveRows(indexForNode(sourceParent), row, row,
+                                           indexForNode(destinationParent), destinationRow);
+        Q_ASSERT(canMove);
+        Q_UNUSED(canMove);
+        Node *node = sourceParent->children.at(row);
+        sourceParent->children.remove(row);
+        if (sourceParent == destinationParent && destinationRow > row)
+            --destinationRow;
+        destinationParent->children.insert(destinationRow, node);
+        node->parent = destinationParent;
+        endMoveRows();
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        if (parent.column() > 0)
+            return 0;
+        return nodeForIndex(parent)->children.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        Q_UNUSED(parent);
+        return 1;
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || role != Qt::DisplayRole)
+            return QVariant();
+        return nodeForIndex(index)->name;
+    }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override
+    {
+        const Node *parentNode = nodeForIndex(parent);
+        if (row < 0 || column != 0 || row >= parentNode->children.size())
+            return QModelIndex();
+        return createIndex(row, column, parentNode->children.at(row));
+    }
+
+    QModelIndex parent(const QModelIndex &child) const override
+    {
+        if (!child.isValid())
+            return QModelIndex();
+        return indexForNode(nodeForIndex(child)->parent);
+    }
+
+private:
+    Node *nodeForIndex(const QModelIndex &index) const
+    {
+        if (!index.isValid())
+            return const_cast<Node *>(&m_root);
+        return static_cast<Node *>(index.internalPointer());
+    }
+
+    Node m_root;
+};
+
+class KRecursiveFilterProxyModelTest : public QObject
+{
+    Q_OBJECT
+private:
+    static QStandardItem *createItem(const QString &name, const QStringList &children = QStringList())
+    {
+        QStandardItem *item = new QStandardItem(name);
+        foreach (const QString &child, children)
+            item->appendRow(new QStandardItem(child));
+        return item;
+    }
+
+    // - A
+    // - B
+    // - - C
+    // - - D
+    // - - - E
+    // - - - F
+    // - H
+    static void fillModel(QStandardItemModel *model)
+    {
+        model->appendRow(createItem(QStringLiteral("A")));
+        QStandardItem *b = createItem(QStringLiteral("B"), QStringList() << QStringLiteral("C"));
+        b->appendRow(createItem(QStringLiteral("D"), QStringList() << QStringLiteral("E") << QStringLiteral("F")));
+        model->appendRow(b);
+        model->appendRow(createItem(QStringLiteral("H")));
+    }
+
+    // what the proxy shows, e.g. "B[D[F]]"
+    static QString dump(const QAbstractItemModel *model, const QModelIndex &parent = QModelIndex())
+    {
+        QStringList rows;
+        for (int row = 0; row < model->rowCount(parent); ++row) {
+            const QModelIndex index = model->index(row, 0, parent);
+            QString s = index.data().toString();
+            if (model->rowCount(index) > 0)
+                s += QLatin1Char('[') + dump(model, index) + QLatin1Char(']');
+            rows.push_back(s);
+        }
+        return rows.join(QStringLiteral(","));
+    }
+
+    static bool waitForFilter(KRecursiveFilterProxyModel *proxy)
+    {
+        for (int i = 0; i < 500 && proxy->isFilterPending(); ++i)
+            QTest::qWait(10);
+        return !proxy->isFilterPending();
+    }
+
+private slots:
+    void testFilter()
+    {
+        QStandardItemModel source;
+        fillModel(&source);
+
+        KRecursiveFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        QCOMPARE(dump(&proxy), QStringLiteral("A,B[C,D[E,F]],H"));
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("F")));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[D[F]]"));
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("[AE]")));
+        QCOMPARE(dump(&proxy), QStringLiteral("A,B[D[E]]"));
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("X")));
+        QCOMPARE(dump(&proxy), QString());
+
+        proxy.setFilterRegExp(QRegExp());
+        QCOMPARE(dump(&proxy), QStringLiteral("A,B[C,D[E,F]],H"));
+    }
+
+    void testSourceChanges()
+    {
+        QStandardItemModel source;
+        fillModel(&source);
+
+        KRecursiveFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("F|L")));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[D[F]]"));
+
+        // insert a matching subtree below a hidden row
+        QStandardItem *h = source.item(2);
+        h->appendRow(createItem(QStringLiteral("J")));
+        h->appendRow(createItem(QStringLiteral("K"), QStringList() << QStringLiteral("L")));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[D[F]],H[K[L]]"));
+
+        // data changes hiding and showing entire chains
+        QStandardItem *f = source.item(1)->child(1)->child(1);
+        f->setText(QStringLiteral("G"));
+        QCOMPARE(dump(&proxy), QStringLiteral("H[K[L]]"));
+        source.item(1)->child(0)->setText(QStringLiteral("F"));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[F],H[K[L]]"));
+        f->setText(QStringLiteral("F"));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[F,D[F]],H[K[L]]"));
+
+        // remove the last match below a visible row
+        source.item(2)->child(1)->removeRow(0);
+        QCOMPARE(dump(&proxy), QStringLiteral("B[F,D[F]]"));
+        source.item(1)->removeRow(1);
+        QCOMPARE(dump(&proxy), QStringLiteral("B[F]"));
+        source.item(1)->removeRow(0);
+        QCOMPARE(dump(&proxy), QString());
+
+        source.clear();
+        QCOMPARE(proxy.rowCount(), 0);
+        fillModel(&source);
+        QCOMPARE(dump(&proxy), QStringLiteral("B[D[F]]"));
+    }
+
+    void testBackgroundFilter()
+    {
+        QStandardItemModel source;
+        fillModel(&source);
+
+        KRecursiveFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setBackgroundFilteringEnabled(true);
+        proxy.setSourceModel(&source);
+
+        // nothing changes before the background evaluation is done
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("F|L")));
+        QVERIFY(proxy.isFilterPending());
+        QCOMPARE(dump(&proxy), QStringLiteral("A,B[C,D[E,F]],H"));
+
+        // source changes in the mean time are applied on top of the result
+        source.item(2)->appendRow(createItem(QStringLiteral("K"), QStringList() << QStringLiteral("L")));
+        source.item(0)->setText(QStringLiteral("AF"));
+        QVERIFY(waitForFilter(&proxy));
+        QCOMPARE(dump(&proxy), QStringLiteral("AF,B[D[F]],H[K[L]]"));
+
+        // the last filter wins
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("E")));
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("C")));
+        QVERIFY(waitForFilter(&proxy));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[C]"));
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("h"), Qt::CaseInsensitive));
+        QVERIFY(waitForFilter(&proxy));
+        QCOMPARE(dump(&proxy), QStringLiteral("H"));
+        proxy.setFilterCaseSensitivity(Qt::CaseSensitive);
+        QVERIFY(waitForFilter(&proxy));
+        QCOMPARE(dump(&proxy), QString());
+
+        // matches keep being updated from the source while filtering
+        source.item(1)->child(0)->setText(QStringLiteral("h"));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[h]"));
+
+        proxy.setFilterRegExp(QRegExp());
+        QVERIFY(!proxy.isFilterPending());
+        QCOMPARE(dump(&proxy), QStringLiteral("AF,B[h,D[E,F]],H[K[L]]"));
+    }
+
+    void testMoves()
+    {
+        MoveTreeModel source;
+        MoveTreeModel::Node *a = new MoveTreeModel::Node(QStringLiteral("A"), source.root());
+        MoveTreeModel::Node *b = new MoveTreeModel::Node(QStringLiteral("B"), source.root());
+        new MoveTreeModel::Node(QStringLiteral("C"), b);
+        MoveTreeModel::Node *d = new MoveTreeModel::Node(QStringLiteral("D"), b);
+        new MoveTreeModel::Node(QStringLiteral("E"), d);
+        MoveTreeModel::Node *h = new MoveTreeModel::Node(QStringLiteral("H"), source.root());
+
+        KRecursiveFilterProxyModel proxy;
+        ModelTest modelTest(&proxy);
+        proxy.setSourceModel(&source);
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("E")));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[D[E]]"));
+
+        // move the only match to another parent
+        source.moveRow(b, 1, h, 0);
+        QCOMPARE(dump(&proxy), QStringLiteral("H[D[E]]"));
+        source.moveRow(h, 0, a, 0);
+        QCOMPARE(dump(&proxy), QStringLiteral("A[D[E]]"));
+
+        // moves within the same parent
+        source.moveRow(source.root(), 0, source.root(), 3);
+        QCOMPARE(dump(&proxy), QStringLiteral("A[D[E]]"));
+        QCOMPARE(source.index(2, 0).data().toString(), QStringLiteral("A"));
+        source.moveRow(source.root(), 2, source.root(), 0);
+        QCOMPARE(dump(&proxy), QStringLiteral("A[D[E]]"));
+
+        proxy.setFilterRegExp(QRegExp(QStringLiteral("[CH]")));
+        QCOMPARE(dump(&proxy), QStringLiteral("B[C],H"));
+        source.moveRow(b, 0, d, 1);
+        QCOMPARE(dump(&proxy), QStringLiteral("A[D[C]],H"));
+    }
+};
+
+QTEST_MAIN(KRecursiveFilterProxyModelTest)
+
+#include "krecursivefilterproxymodeltest.moc"
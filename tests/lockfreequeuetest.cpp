@@ -0,0 +1,102 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/lockfreequeue.h>
+
+#include <QtTest/qtest.h>
+#include <QObject>
+#include <QThread>
+
+using namespace GammaRay;
+
+namespace {
+class Producer : public QThread
+{
+public:
+    Producer(LockFreeQueue<QByteArray> *queue, int count)
+        : m_queue(queue)
+        , m_count(count) {}
+
+protected:
+    void run() override
+    {
+        for (int i = 0; i < m_count; ++i)
+            m_queue->push(QByteArray::number(i));
+    }
+
+private:
+    LockFreeQueue<QByteArray> *m_queue;
+    int m_count;
+};
+}
+
+class LockFreeQueueTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testSingleThread()
+    {
+        LockFreeQueue<QByteArray> queue;
+        QByteArray value;
+        QVERIFY(!queue.pop(value));
+
+        // interleaved, so nodes get recycled
+        for (int i = 0; i < 100; ++i) {
+            queue.push(QByteArray::number(i));
+            queue.push(QByteArray::number(-i));
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, QByteArray::number(i));
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, QByteArray::number(-i));
+            QVERIFY(!queue.pop(value));
+        }
+    }
+
+    void testTwoThreads()
+    {
+        static const int count = 100000;
+        LockFreeQueue<QByteArray> queue;
+        Producer producer(&queue, count);
+        producer.start();
+
+        QByteArray value;
+        int next = 0;
+        while (next < count) {
+            if (!queue.pop(value)) {
+                QThread::yieldCurrentThread();
+                continue;
+            }
+            QCOMPARE(value, QByteArray::number(next));
+            ++next;
+        }
+        QVERIFY(producer.wait(5000));
+        QVERIFY(!queue.pop(value));
+    }
+};
+
+QTEST_MAIN(LockFreeQueueTest)
+
+#include "lockfreequeuetest.moc"
@@ -0,0 +1,127 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/message.h>
+
+#include <QtTest/qtest.h>
+#include <QBuffer>
+#include <QObject>
+
+using namespace GammaRay;
+
+class MessageParserTest : public QObject
+{
+    Q_OBJECT
+private:
+    static QByteArray encode(Protocol::ObjectAddress address, Protocol::MessageType type,
+                             const QByteArray &payload)
+    {
+        QByteArray wire;
+        QBuffer buffer(&wire);
+        buffer.open(QIODevice::WriteOnly);
+        Message msg(address, type, payload);
+        msg.write(&buffer);
+        return wire;
+    }
+
+    static void feed(MessageParser &parser, const QByteArray &data)
+    {
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+        QCOMPARE(parser.readFrom(&buffer), qint64(data.size()));
+    }
+
+private slots:
+    void testFragmented()
+    {
+        const QByteArray large(4096, 'x'); // compressible, sent compressed
+        const QByteArray small("abc");
+        QByteArray wire;
+        wire += encode(2, 3, large);
+        wire += encode(4, 5, small);
+        wire += encode(6, 7, QByteArray());
+
+        MessageParser parser;
+        QVector<QByteArray> payloads;
+        QVector<int> addresses;
+        for (int i = 0; i < wire.size(); i += 7) {
+            feed(parser, wire.mid(i, 7));
+            while (parser.hasMessage()) {
+                const auto msg = parser.takeMessage();
+                addresses.push_back(msg.address());
+                payloads.push_back(msg.rawPayload());
+            }
+        }
+
+        QCOMPARE(addresses.size(), 3);
+        QCOMPARE(addresses.at(0), 2);
+        QCOMPARE(payloads.at(0), large);
+        QCOMPARE(addresses.at(1), 4);
+        QCOMPARE(payloads.at(1), small);
+        QCOMPARE(addresses.at(2), 6);
+        QVERIFY(payloads.at(2).isEmpty());
+        QVERIFY(!parser.hasMessage());
+    }
+
+    void testPayloadOutlivesBuffer()
+    {
+        MessageParser parser;
+        feed(parser, encode(2, 3, QByteArray("first")));
+        QVERIFY(parser.hasMessage());
+        const auto first = parser.takeMessage();
+
+        // more data than the current buffer can take, while the first message still refers to it
+        // (incompressible, so the payloads are not copied either)
+        QByteArray noise(1000, Qt::Uninitialized);
+        quint32 seed = 42;
+        QByteArray wire;
+        for (int i = 0; i < 100; ++i) {
+            for (int j = 0; j < noise.size(); ++j) {
+                seed = seed * 1103515245 + 12345;
+                noise[j] = char(seed >> 24);
+            }
+            wire += encode(4, 5, noise);
+        }
+        feed(parser, wire);
+
+        int count = 0;
+        while (parser.hasMessage()) {
+            const auto msg = parser.takeMessage();
+            QCOMPARE(msg.address(), Protocol::ObjectAddress(4));
+            QCOMPARE(msg.size(), noise.size());
+            ++count;
+        }
+        QCOMPARE(count, 100);
+
+        QCOMPARE(first.address(), Protocol::ObjectAddress(2));
+        QCOMPARE(first.rawPayload(), QByteArray("first"));
+    }
+};
+
+QTEST_MAIN(MessageParserTest)
+
+#include "messageparsertest.moc"
@@ -0,0 +1,111 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/message.h>
+
+#include <common/message.h>
+#include <common/messagescheduler.h>
+
+#include <QtTest/qtest.h>
+#include <QBuffer>
+#include <QObject>
+
+#include <limits>
+
+using namespace GammaRay;
+
+typedef QPair<Protocol::ObjectAddress, Protocol::MessageType> SentMessage;
+
+class MessageSchedulerTest : public QObject
+{
+    Q_OBJECT
+private:
+    static QVector<SentMessage> dequeueAll(MessageScheduler &scheduler)
+    {
+        QByteArray wire;
+        scheduler.dequeue(wire, std::numeric_limits<int>::max(), nullptr);
+        QBuffer buffer(&wire);
+        buffer.open(QIODevice::ReadOnly);
+        MessageParser parser;
+        parser.readFrom(&buffer);
+
+        QVector<SentMessage> sent;
+        while (parser.hasMessage()) {
+            const auto msg = parser.takeMessage();
+            sent.push_back(SentMessage(msg.address(), msg.type()));
+        }
+        return sent;
+    }
+
+private slots:
+    void testCrossAddressOrdering()
+    {
+        MessageScheduler scheduler(1);
+        scheduler.enqueue(Message(6, Protocol::PropertyValuesChanged));
+        scheduler.enqueue(Message(5, Protocol::SelectionModelSelect));
+        scheduler.enqueue(Message(4, Protocol::ModelContentChanged));
+        scheduler.enqueue(Message(4, Protocol::ModelRowsRemoved));
+        scheduler.enqueue(Message(8, Protocol::ModelContentChanged));
+        scheduler.enqueue(Message(4, Protocol::ModelContentReply));
+        scheduler.enqueue(Message(7, Protocol::ModelContentReply));
+        QVERIFY(!scheduler.isEmpty());
+
+        // the selection refers to the rows before the removal, and neither is overtaken by
+        // the replies queued later, or overtakes the bulk data queued before them
+        QVector<SentMessage> expected;
+        expected << SentMessage(6, Protocol::PropertyValuesChanged)
+                 << SentMessage(5, Protocol::SelectionModelSelect)
+                 << SentMessage(4, Protocol::ModelContentChanged)
+                 << SentMessage(4, Protocol::ModelRowsRemoved)
+                 << SentMessage(4, Protocol::ModelContentReply)
+                 << SentMessage(7, Protocol::ModelContentReply)
+                 << SentMessage(8, Protocol::ModelContentChanged);
+        QCOMPARE(dequeueAll(scheduler), expected);
+        QVERIFY(scheduler.isEmpty());
+        QCOMPARE(scheduler.size(), 0);
+    }
+
+    void testRepliesBeforeBulkData()
+    {
+        MessageScheduler scheduler(1);
+        scheduler.enqueue(Message(4, Protocol::ModelContentChanged));
+        scheduler.enqueue(Message(5, Protocol::ModelContentChanged));
+        scheduler.enqueue(Message(6, Protocol::ModelContentReply));
+        scheduler.enqueue(Message(5, Protocol::ModelContentReply));
+
+        // the reply to 5 takes the bulk data queued before it along, as those are never reordered
+        QVector<SentMessage> expected;
+        expected << SentMessage(5, Protocol::ModelContentChanged)
+                 << SentMessage(6, Protocol::ModelContentReply)
+                 << SentMessage(5, Protocol::ModelContentReply)
+                 << SentMessage(4, Protocol::ModelContentChanged);
+        QCOMPARE(dequeueAll(scheduler), expected);
+    }
+};
+
+QTEST_MAIN(MessageSchedulerTest)
+
+#include "messageschedulertest.moc"
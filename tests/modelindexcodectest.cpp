@@ -0,0 +1,160 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/message.h>
+#include <common/modelindexcodec.h>
+
+#include <QBuffer>
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+Q_DECLARE_METATYPE(QVector<GammaRay::Protocol::ModelIndex>)
+
+static Protocol::ModelIndex makeIndex(std::initializer_list<std::pair<int, int> > levels)
+{
+    Protocol::ModelIndex index;
+    for (const auto &level : levels)
+        index.push_back(Protocol::ModelIndexData(level.first, level.second));
+    return index;
+}
+
+static bool isEqual(const Protocol::ModelIndex &lhs, const Protocol::ModelIndex &rhs)
+{
+    if (lhs.size() != rhs.size())
+        return false;
+    for (int i = 0; i < lhs.size(); ++i) {
+        if (lhs.at(i).row != rhs.at(i).row || lhs.at(i).column != rhs.at(i).column)
+            return false;
+    }
+    return true;
+}
+
+class ModelIndexCodecTest : public QObject
+{
+    Q_OBJECT
+private:
+    static Message roundTrip(const Message &msg)
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::ReadWrite);
+        msg.write(&buffer);
+        buffer.seek(0);
+        return Message::readMessage(&buffer);
+    }
+
+private slots:
+    void cleanup()
+    {
+        Message::resetNegotiatedDataVersion();
+    }
+
+    void testRoundTrip_data()
+    {
+        QTest::addColumn<bool>("compact");
+        QTest::addColumn<QVector<Protocol::ModelIndex> >("indexes");
+
+        QVector<Protocol::ModelIndex> indexes;
+        indexes.push_back(Protocol::ModelIndex());
+        indexes.push_back(makeIndex({ { 0, 0 } }));
+        indexes.push_back(makeIndex({ { 0, 0 }, { 3, 0 }, { 7, 0 } }));
+        indexes.push_back(makeIndex({ { 0, 0 }, { 3, 0 }, { 7, 1 } }));
+        indexes.push_back(makeIndex({ { 0, 0 }, { 3, 0 }, { 7, 2 } }));
+        indexes.push_back(makeIndex({ { 0, 0 }, { 3, 0 }, { 2, 0 } }));
+        indexes.push_back(makeIndex({ { 0, 0 }, { 3, 0 } }));
+        indexes.push_back(makeIndex({ { 1, 0 }, { 100000, 4 } }));
+        indexes.push_back(makeIndex({ { 1, 0 }, { 5, 0 }, { 0, 0 }, { 0, 0 } }));
+
+        QTest::newRow("plain") << false << indexes;
+        QTest::newRow("compact") << true << indexes;
+    }
+
+    void testRoundTrip()
+    {
+        QFETCH(bool, compact);
+        QFETCH(QVector<Protocol::ModelIndex>, indexes);
+        Message::setCompactModelIndexesEnabled(compact);
+
+        Message msg(1, Protocol::ModelContentRequest);
+        ModelIndexWriter writer(msg);
+        writer.writeList(indexes);
+        for (const auto &index : indexes) {
+            writer.write(index);
+            msg << qint32(42);
+        }
+
+        const auto received = roundTrip(msg);
+        ModelIndexReader reader(received);
+        const auto list = reader.readList();
+        QCOMPARE(list.size(), indexes.size());
+        for (int i = 0; i < indexes.size(); ++i)
+            QVERIFY(isEqual(list.at(i), indexes.at(i)));
+        for (const auto &index : indexes) {
+            QVERIFY(isEqual(reader.read(), index));
+            qint32 value;
+            received >> value;
+            QCOMPARE(value, 42);
+        }
+    }
+
+    void testSize()
+    {
+        QVector<Protocol::ModelIndex> indexes;
+        for (int row = 0; row < 100; ++row) {
+            for (int column = 0; column < 4; ++column)
+                indexes.push_back(makeIndex({ { 0, 0 }, { 2, 0 }, { 5, 0 }, { row, column } }));
+        }
+
+        Message plain(1, Protocol::ModelContentRequest);
+        ModelIndexWriter(plain).writeList(indexes);
+
+        Message::setCompactModelIndexesEnabled(true);
+        Message compact(1, Protocol::ModelContentRequest);
+        ModelIndexWriter(compact).writeList(indexes);
+
+        QVERIFY(compact.size() * 10 < plain.size());
+    }
+
+    void testRowRuns()
+    {
+        // a reversed viewport of 100 rows, and a block that stayed in place
+        QVector<qint32> runs;
+        for (int row = 0; row < 100; ++row)
+            runs << 5000 + row << 9999 - row << 1;
+        runs << 6000 << 6000 << 400;
+
+        Message msg(1, Protocol::ModelLayoutChanged);
+        ModelIndexWriter(msg).writeRowRuns(runs);
+        QVERIFY(msg.size() < runs.size() * 2);
+
+        const auto received = roundTrip(msg);
+        QCOMPARE(ModelIndexReader(received).readRowRuns(), runs);
+    }
+};
+
+QTEST_MAIN(ModelIndexCodecTest)
+
+#include "modelindexcodectest.moc"
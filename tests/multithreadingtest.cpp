@@ -27,6 +27,7 @@
 #include "baseprobetest.h"
 
 #include <QDebug>
+#include <QSemaphore>
 #include <QThread>
 #include <QSignalSpy>
 
@@ -60,6 +61,31 @@ public:
     int iterations;
 };
 
+// creates objects, and destroys them once told to, so the probe can announce them meanwhile
+class AnnouncedObjectsThread : public QThread
+{
+    Q_OBJECT
+public:
+    AnnouncedObjectsThread()
+        : batchSize(1) {}
+
+    void run() override
+    {
+        objects.reserve(batchSize);
+        for (int i = 0; i < batchSize; ++i)
+            objects.push_back(new QObject);
+        created.release();
+        destroy.acquire();
+        qDeleteAll(objects);
+        objects.clear();
+    }
+
+    QVector<QObject *> objects;
+    int batchSize;
+    QSemaphore created;
+    QSemaphore destroy;
+};
+
 class MultiThreadingTest : public BaseProbeTest
 {
     Q_OBJECT
@@ -96,6 +122,124 @@ private slots:
         t.start();
         QVERIFY(spy.wait(30000));
     }
+
+    void testBatchedNotifications()
+    {
+        createProbe();
+
+        QSignalSpy createdSpy(Probe::instance(), SIGNAL(objectCreated(QObject*)));
+        QVERIFY(createdSpy.isValid());
+        QSignalSpy batchCreatedSpy(Probe::instance(), SIGNAL(objectsCreated(QVector<QObject*>)));
+        QVERIFY(batchCreatedSpy.isValid());
+        QSignalSpy destroyedSpy(Probe::instance(), SIGNAL(objectDestroyed(QObject*)));
+        QVERIFY(destroyedSpy.isValid());
+        QSignalSpy batchDestroyedSpy(Probe::instance(), SIGNAL(objectsDestroyed(QVector<QObject*>)));
+        QVERIFY(batchDestroyedSpy.isValid());
+
+        Thread t;
+        t.batchSize = 100;
+        t.iterations = 10;
+        QSignalSpy spy(&t, SIGNAL(finished()));
+        QVERIFY(spy.isValid());
+        t.start();
+        QVERIFY(spy.wait(30000));
+        QTest::qWait(10);
+
+        // the batches report exactly the same objects as the individual signals
+        int batchCreatedCount = 0;
+        for (int i = 0; i < batchCreatedSpy.size(); ++i)
+            batchCreatedCount += batchCreatedSpy.at(i).at(0).value<QVector<QObject *> >().size();
+        QCOMPARE(batchCreatedCount, createdSpy.size());
+        int batchDestroyedCount = 0;
+        for (int i = 0; i < batchDestroyedSpy.size(); ++i)
+            batchDestroyedCount += batchDestroyedSpy.at(i).at(0).value<QVector<QObject *> >().size();
+        QCOMPARE(batchDestroyedCount, destroyedSpy.size());
+    }
+
+    void benchmarkContention_data()
+    {
+        QTest::addColumn<int>("threadCount", nullptr);
+        QTest::addColumn<int>("batchSize", nullptr);
+
+        QTest::newRow("1-1000") << 1 << 1000;
+        QTest::newRow("4-1000") << 4 << 1000;
+        QTest::newRow("8-1000") << 8 << 1000;
+    }
+
+    void benchmarkContention()
+    {
+        QFETCH(int, threadCount);
+        QFETCH(int, batchSize);
+
+        createProbe();
+
+        QVector<Thread *> threads;
+        for (int i = 0; i < threadCount; ++i) {
+            Thread *t = new Thread;
+            t->batchSize = batchSize;
+            t->iterations = 10;
+            threads.push_back(t);
+        }
+
+        // the probe thread is blocked meanwhile, so this measures just the cost of the worker
+        // threads tracking their objects concurrently, none of them gets announced
+        // see benchmarkAnnouncedDestruction() for the cost of destroying announced objects
+        QBENCHMARK_ONCE {
+            foreach (Thread *t, threads)
+                t->start();
+            foreach (Thread *t, threads)
+                QVERIFY(t->wait(30000));
+        }
+
+        // let the probe process whatever got queued
+        QTest::qWait(10);
+        qDeleteAll(threads);
+    }
+
+    void benchmarkAnnouncedDestruction_data()
+    {
+        benchmarkContention_data();
+    }
+
+    void benchmarkAnnouncedDestruction()
+    {
+        QFETCH(int, threadCount);
+        QFETCH(int, batchSize);
+
+        createProbe();
+
+        QVector<AnnouncedObjectsThread *> threads;
+        for (int i = 0; i < threadCount; ++i) {
+            AnnouncedObjectsThread *t = new AnnouncedObjectsThread;
+            t->batchSize = batchSize;
+            threads.push_back(t);
+            t->start();
+        }
+        foreach (AnnouncedObjectsThread *t, threads)
+            t->created.acquire();
+
+        // once announced, destroying an object takes the object lock and queues the
+        // notification for the probe thread
+        QTest::qWait(10);
+        int announcedCount = 0;
+        foreach (AnnouncedObjectsThread *t, threads) {
+            foreach (QObject *obj, t->objects) {
+                if (Probe::instance()->isValidObject(obj))
+                    ++announcedCount;
+            }
+        }
+
+        QBENCHMARK_ONCE {
+            foreach (AnnouncedObjectsThread *t, threads)
+                t->destroy.release();
+            foreach (AnnouncedObjectsThread *t, threads)
+                QVERIFY(t->wait(30000));
+        }
+
+        QTest::qWait(10);
+        qDeleteAll(threads);
+        QCOMPARE(announcedCount, threadCount * batchSize);
+    }
 };
 
 QTEST_MAIN(MultiThreadingTest)
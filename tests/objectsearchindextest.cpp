@@ -0,0 +1,163 @@
+/*
+  objectsearchindextest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/objectsearchindex.h>
+#include <core/util.h>
+
+#include <QSignalSpy>
+#include <QTimer>
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+class ObjectSearchIndexTest : public QObject
+{
+    Q_OBJECT
+private:
+    static QObject *createObject(ObjectSearchIndex *index, const QString &name, bool timer = false)
+    {
+        QObject *obj = timer ? new QTimer : new QObject;
+        obj->setObjectName(name);
+        index->objectAdded(obj);
+        return obj;
+    }
+
+    static void destroyObject(ObjectSearchIndex *index, QObject *obj)
+    {
+        delete obj;
+        index->objectRemoved(obj);
+    }
+
+private slots:
+    void testFind()
+    {
+        ObjectSearchIndex index;
+        QObject *a = createObject(&index, QStringLiteral("mainWindow"));
+        QObject *b = createObject(&index, QStringLiteral("refreshTimer"), true);
+        QObject *c = createObject(&index, QString(), true);
+        QCOMPARE(index.size(), 3);
+
+        QCOMPARE(index.find(QStringLiteral("window")), QVector<QObject *>() << a);
+        QCOMPARE(index.find(QStringLiteral("MAINW")), QVector<QObject *>() << a);
+        QCOMPARE(index.find(QStringLiteral("shtime")), QVector<QObject *>() << b);
+        QVERIFY(index.find(QStringLiteral("windows")).isEmpty());
+        QVERIFY(index.find(QString()).isEmpty());
+
+        // short search text, not covered by the index
+        QCOMPARE(index.find(QStringLiteral("n")), QVector<QObject *>() << a);
+        QCOMPARE(index.find(QStringLiteral("sh")), QVector<QObject *>() << b);
+
+        // class names, including base classes
+        auto result = index.find(QStringLiteral("qtime"));
+        QCOMPARE(result.size(), 2);
+        QVERIFY(result.contains(b));
+        QVERIFY(result.contains(c));
+        QCOMPARE(index.find(QStringLiteral("qobject")).size(), 3);
+        // a match on both class and name is only reported once, name matches go first
+        QCOMPARE(index.find(QStringLiteral("timer")), QVector<QObject *>() << b << c);
+        QCOMPARE(index.find(QStringLiteral("timer"), 1), QVector<QObject *>() << b);
+
+        // addresses
+        QCOMPARE(index.find(Util::addressToString(c)), QVector<QObject *>() << c);
+
+        destroyObject(&index, a);
+        destroyObject(&index, b);
+        destroyObject(&index, c);
+        QCOMPARE(index.size(), 0);
+    }
+
+    void testRemoval()
+    {
+        ObjectSearchIndex index;
+        QVector<QObject *> objects;
+        for (int i = 0; i < 10000; ++i)
+            objects.push_back(createObject(&index, QStringLiteral("object%1").arg(i), i % 2));
+        QCOMPARE(index.find(QStringLiteral("object1234")).size(), 1);
+
+        // enough to trigger compaction at least once, and to reuse slots
+        for (int i = 0; i < 9000; ++i)
+            destroyObject(&index, objects.at(i));
+        objects.remove(0, 9000);
+        for (int i = 0; i < 1000; ++i)
+            objects.push_back(createObject(&index, QStringLiteral("item%1").arg(i)));
+        QCOMPARE(index.size(), 2000);
+
+        QVERIFY(index.find(QStringLiteral("object1234")).isEmpty());
+        QCOMPARE(index.find(QStringLiteral("object9234")).size(), 1);
+        QCOMPARE(index.find(QStringLiteral("item12")).size(), 11);
+        QCOMPARE(index.find(QStringLiteral("qtimer")).size(), 500);
+        QCOMPARE(index.find(QStringLiteral("qobject")).size(), 2000);
+        // only partially matching class names are limited
+        QCOMPARE(index.find(QStringLiteral("qobj")).size(), 100);
+
+        qDeleteAll(objects);
+    }
+
+    void testRename()
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+        ObjectSearchIndex index;
+        QObject *obj = createObject(&index, QStringLiteral("oldName"));
+        QCOMPARE(index.find(QStringLiteral("oldname")), QVector<QObject *>() << obj);
+
+        obj->setObjectName(QStringLiteral("newName"));
+        index.objectRenamed(obj);
+        QVERIFY(index.find(QStringLiteral("oldname")).isEmpty());
+        QCOMPARE(index.find(QStringLiteral("newname")), QVector<QObject *>() << obj);
+
+        // renaming back must not report the object twice
+        obj->setObjectName(QStringLiteral("oldName"));
+        index.objectRenamed(obj);
+        QCOMPARE(index.find(QStringLiteral("name")), QVector<QObject *>() << obj);
+
+        destroyObject(&index, obj);
+        QCOMPARE(index.size(), 0);
+#endif
+    }
+
+    void testSearch()
+    {
+        ObjectSearchIndex index;
+        QObject *obj = createObject(&index, QStringLiteral("someObject"));
+
+        QSignalSpy spy(&index, SIGNAL(searchResults(QString,GammaRay::ObjectIds)));
+        QVERIFY(spy.isValid());
+        index.search(QStringLiteral("eob"), 10);
+        QCOMPARE(spy.size(), 1);
+        QCOMPARE(spy.at(0).at(0).toString(), QStringLiteral("eob"));
+        const auto ids = spy.at(0).at(1).value<ObjectIds>();
+        QCOMPARE(ids.size(), 1);
+        QCOMPARE(ids.at(0).asQObject(), obj);
+
+        destroyObject(&index, obj);
+    }
+};
+
+QTEST_MAIN(ObjectSearchIndexTest)
+
+#include "objectsearchindextest.moc"
@@ -0,0 +1,162 @@
+/*
+  objecttreemodeltest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2016-2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "baseprobetest.h"
+#include "testhelpers.h"
+
+#include <common/objectbroker.h>
+#include <common/objectmodel.h>
+
+#include <3rdparty/qt/modeltest.h>
+
+#include <QSignalSpy>
+
+#include <memory>
+
+using namespace GammaRay;
+using namespace TestHelpers;
+
+class ObjectTreeModelTest : public BaseProbeTest
+{
+    Q_OBJECT
+private:
+    static int rangesBelow(const QSignalSpy &spy, const QModelIndex &parent)
+    {
+        int count = 0;
+        for (int i = 0; i < spy.size(); ++i) {
+            if (spy.at(i).at(0).value<QModelIndex>() == parent)
+                ++count;
+        }
+        return count;
+    }
+
+    static bool verifyChildren(QAbstractItemModel *model, const QModelIndex &index, QObject *parent)
+    {
+        const QObjectList children = parent->children();
+        if (model->rowCount(index) != children.size())
+            return false;
+        for (int row = 0; row < children.size(); ++row) {
+            const QModelIndex idx = model->index(row, 0, index);
+            if (idx.data(ObjectModel::ObjectRole).value<QObject *>() != children.at(row))
+                return false;
+            if (idx.parent() != index)
+                return false;
+        }
+        return true;
+    }
+
+private slots:
+    void testBatchedInsert()
+    {
+        createProbe();
+
+        auto model = ObjectBroker::model("com.kdab.GammaRay.ObjectTree");
+        QVERIFY(model);
+        ModelTest modelTest(model);
+
+        std::unique_ptr<QObject> parent(new QObject);
+        parent->setObjectName(QStringLiteral("objectTreeParent"));
+        QTest::qWait(10);
+        const QPersistentModelIndex parentIndex
+            = searchFixedIndex(model, QStringLiteral("objectTreeParent"), Qt::MatchRecursive);
+        QVERIFY(parentIndex.isValid());
+        QCOMPARE(model->rowCount(parentIndex), 0);
+
+        QSignalSpy spy(model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+        QVERIFY(spy.isValid());
+        for (int i = 0; i < 100; ++i)
+            new QObject(parent.get());
+        QTest::qWait(10);
+
+        // all in one go
+        QCOMPARE(rangesBelow(spy, parentIndex), 1);
+        QVERIFY(verifyChildren(model, parentIndex, parent.get()));
+
+        // rows stay in sync when removing children in between
+        const QObjectList children = parent->children();
+        for (int i = 0; i < children.size(); i += 3)
+            delete children.at(i);
+        QTest::qWait(10);
+        QVERIFY(verifyChildren(model, parentIndex, parent.get()));
+
+        // adjacent children destroyed together go in one go as well
+        QSignalSpy removeSpy(model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+        QVERIFY(removeSpy.isValid());
+        const QObjectList remaining = parent->children();
+        for (int i = 10; i < 30; ++i)
+            delete remaining.at(i);
+        QTest::qWait(10);
+        QCOMPARE(rangesBelow(removeSpy, parentIndex), 1);
+        QVERIFY(verifyChildren(model, parentIndex, parent.get()));
+
+        spy.clear();
+        for (int i = 0; i < 10; ++i)
+            new QObject(parent.get());
+        QTest::qWait(10);
+        QCOMPARE(rangesBelow(spy, parentIndex), 1);
+        QVERIFY(verifyChildren(model, parentIndex, parent.get()));
+    }
+
+    void testReparent()
+    {
+        createProbe();
+
+        auto model = ObjectBroker::model("com.kdab.GammaRay.ObjectTree");
+        QVERIFY(model);
+        ModelTest modelTest(model);
+
+        std::unique_ptr<QObject> parent1(new QObject);
+        parent1->setObjectName(QStringLiteral("objectTreeParent1"));
+        std::unique_ptr<QObject> parent2(new QObject);
+        parent2->setObjectName(QStringLiteral("objectTreeParent2"));
+        for (int i = 0; i < 50; ++i)
+            new QObject(parent1.get());
+        QTest::qWait(10);
+
+        const QPersistentModelIndex index1
+            = searchFixedIndex(model, QStringLiteral("objectTreeParent1"), Qt::MatchRecursive);
+        const QPersistentModelIndex index2
+            = searchFixedIndex(model, QStringLiteral("objectTreeParent2"), Qt::MatchRecursive);
+        QVERIFY(index1.isValid());
+        QVERIFY(index2.isValid());
+        QVERIFY(verifyChildren(model, index1, parent1.get()));
+
+        // enough to leave more holes than children behind
+        const QObjectList children = parent1->children();
+        for (int i = 0; i < 40; ++i)
+            children.at(i)->setParent(parent2.get());
+        QTest::qWait(10);
+
+        QVERIFY(verifyChildren(model, index1, parent1.get()));
+        QVERIFY(verifyChildren(model, index2, parent2.get()));
+    }
+};
+
+QTEST_MAIN(ObjectTreeModelTest)
+
+#include "objecttreemodeltest.moc"
@@ -82,6 +82,32 @@ private:
     }
 };
 
+/** Records the types of the messages sent by a remote model (server), and the content changes among them. */
+class MessageRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    struct Change
+    {
+        Protocol::ModelIndex begin;
+        Protocol::ModelIndex end;
+        QVector<int> roles;
+    };
+    QVector<Change> changes;
+    QVector<Protocol::MessageType> types;
+
+public slots:
+    void record(const GammaRay::Message &msg)
+    {
+        types.push_back(msg.type());
+        if (msg.type() != Protocol::ModelContentChanged)
+            return;
+        Change change;
+        msg >> change.begin >> change.end >> change.roles;
+        changes.push_back(change);
+    }
+};
+
 class FakeRemoteModel : public RemoteModel
 {
     Q_OBJECT
@@ -268,6 +294,321 @@ private slots:
         QCOMPARE(i11.data().toString(), QStringLiteral("entry11"));
     }
 
+    void testDataChangedCoalescing()
+    {
+        QScopedPointer<QStandardItemModel> treeModel(new QStandardItemModel(this));
+        for (int i = 0; i < 10; ++i)
+            treeModel->appendRow(QList<QStandardItem *>() << new QStandardItem(QStringLiteral("entry"))
+                                                          << new QStandardItem(QStringLiteral("value")));
+        auto e0 = treeModel->item(0);
+        e0->appendRow(new QStandardItem(QStringLiteral("entry00")));
+        e0->appendRow(new QStandardItem(QStringLiteral("entry01")));
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.ChangeModel"), this);
+        server.setModel(treeModel.data());
+        server.modelMonitored(true);
+
+        MessageRecorder recorder;
+        connect(&server, SIGNAL(message(GammaRay::Message)), &recorder,
+                SLOT(record(GammaRay::Message)));
+
+        // adjacent and overlapping changes in one parent, a separate region and one in a child
+        for (int i = 0; i < 5; ++i)
+            treeModel->item(i, 0)->setText(QStringLiteral("changed"));
+        for (int i = 3; i < 6; ++i)
+            treeModel->item(i, 1)->setText(QStringLiteral("changed"));
+        treeModel->item(9, 0)->setText(QStringLiteral("changed"));
+        e0->child(1)->setText(QStringLiteral("changed"));
+        e0->child(0)->setText(QStringLiteral("changed"));
+        QTest::qWait(10);
+
+        QCOMPARE(recorder.changes.size(), 3);
+        auto change = recorder.changes.at(0);
+        QCOMPARE(change.begin.size(), 1);
+        QCOMPARE(change.begin.last().row, 0);
+        QCOMPARE(change.begin.last().column, 0);
+        QCOMPARE(change.end.last().row, 5);
+        QCOMPARE(change.end.last().column, 1);
+        change = recorder.changes.at(1);
+        QCOMPARE(change.begin.last().row, 9);
+        QCOMPARE(change.end.last().row, 9);
+        change = recorder.changes.at(2);
+        QCOMPARE(change.begin.size(), 2);
+        QCOMPARE(change.begin.first().row, 0);
+        QCOMPARE(change.begin.last().row, 0);
+        QCOMPARE(change.end.last().row, 1);
+
+        // pending changes are sent before a structural change invalidating their indexes
+        recorder.changes.clear();
+        recorder.types.clear();
+        treeModel->item(2, 0)->setText(QStringLiteral("changed again"));
+        treeModel->removeRow(0);
+        QTest::qWait(10);
+        QCOMPARE(recorder.types.size(), 2);
+        QCOMPARE(recorder.types.at(0), Protocol::MessageType(Protocol::ModelContentChanged));
+        QCOMPARE(recorder.types.at(1), Protocol::MessageType(Protocol::ModelRowsRemoved));
+        QCOMPARE(recorder.changes.at(0).begin.last().row, 2);
+    }
+
+    void testViewportPrefetch()
+    {
+        QScopedPointer<QStandardItemModel> listModel(new QStandardItemModel(this));
+        for (int i = 0; i < 100; ++i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.ViewportModel"), this);
+        server.setModel(listModel.data());
+        server.setPrefetchRowCount(10);
+        server.modelMonitored(true);
+
+        FakeRemoteModel client(QStringLiteral("com.kdab.GammaRay.UnitTest.ViewportModel"), this);
+        connect(&server, SIGNAL(message(GammaRay::Message)), &client,
+                SLOT(newMessage(GammaRay::Message)));
+        connect(&client, SIGNAL(message(GammaRay::Message)), &server,
+                SLOT(newRequest(GammaRay::Message)));
+        MessageRecorder requests;
+        connect(&client, SIGNAL(message(GammaRay::Message)), &requests,
+                SLOT(record(GammaRay::Message)));
+
+        QCOMPARE(client.rowCount(), 0);
+        QTest::qWait(10);
+        QCOMPARE(client.rowCount(), 100);
+
+        // "show" rows 20 to 24
+        for (int row = 20; row < 25; ++row)
+            client.index(row, 0).data();
+        QTest::qWait(10);
+        for (int row = 20; row < 25; ++row)
+            QCOMPARE(client.index(row, 0).data().toString(), QStringLiteral("entry%1").arg(row));
+
+        // the rows around them are already there without asking
+        const auto loaded = [&client](int row) {
+            return client.index(row, 0).data(RemoteModelRole::LoadingState).value<RemoteModelNodeState::NodeStates>()
+                   == RemoteModelNodeState::NoState;
+        };
+        QVERIFY(loaded(10));
+        QVERIFY(loaded(34));
+        QVERIFY(!loaded(9));
+        QVERIFY(!loaded(35));
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelViewportRequest)), 1);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelContentRequest)), 0);
+
+        // scrolling within the prefetched rows needs no requests at all
+        requests.types.clear();
+        for (int row = 28; row < 33; ++row)
+            QCOMPARE(client.index(row, 0).data().toString(), QStringLiteral("entry%1").arg(row));
+        QTest::qWait(10);
+        QVERIFY(requests.types.isEmpty());
+
+        // scrolling further only pushes what's not there yet
+        client.index(36, 0).data();
+        QTest::qWait(10);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelViewportRequest)), 1);
+        QVERIFY(loaded(46));
+        QVERIFY(!loaded(47));
+
+        // scattered rows are asked for separately, rather than everything in between
+        requests.types.clear();
+        client.index(60, 0).data();
+        client.index(90, 0).data();
+        QTest::qWait(10);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelViewportRequest)), 2);
+        QVERIFY(loaded(60));
+        QVERIFY(loaded(90));
+        QVERIFY(!loaded(75));
+    }
+
+    void testRoleSelection()
+    {
+        QScopedPointer<QStandardItemModel> listModel(new QStandardItemModel(this));
+        for (int i = 0; i < 3; ++i) {
+            auto item = new QStandardItem(QStringLiteral("entry%1").arg(i));
+            item->setToolTip(QStringLiteral("tooltip%1").arg(i));
+            item->setStatusTip(QStringLiteral("statustip%1").arg(i));
+            listModel->appendRow(item);
+        }
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.RoleModel"), this);
+        server.setModel(listModel.data());
+        server.modelMonitored(true);
+
+        FakeRemoteModel client(QStringLiteral("com.kdab.GammaRay.UnitTest.RoleModel"), this);
+        connect(&server, SIGNAL(message(GammaRay::Message)), &client,
+                SLOT(newMessage(GammaRay::Message)));
+        connect(&client, SIGNAL(message(GammaRay::Message)), &server,
+                SLOT(newRequest(GammaRay::Message)));
+        client.setEagerRoles(-1, QVector<int>() << Qt::DisplayRole);
+        client.setLazyRoles(-1, QVector<int>() << Qt::ToolTipRole);
+        QTest::qWait(10);
+        QCOMPARE(client.rowCount(), 3);
+
+        client.index(1, 0).data();
+        QTest::qWait(10);
+        const auto index = client.index(1, 0);
+        QCOMPARE(index.data().toString(), QStringLiteral("entry1"));
+        QVERIFY(!index.data(Qt::StatusTipRole).isValid()); // neither eager nor lazy
+
+        // lazy roles arrive on first access
+        QSignalSpy changeSpy(&client, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+        QVERIFY(changeSpy.isValid());
+        QVERIFY(!index.data(Qt::ToolTipRole).isValid());
+        QTest::qWait(10);
+        QCOMPARE(changeSpy.size(), 1);
+        QCOMPARE(index.data(Qt::ToolTipRole).toString(), QStringLiteral("tooltip1"));
+        QVERIFY(!client.index(0, 0).data(Qt::ToolTipRole).isValid());
+
+        // displayed cells get their lazy roles right away, so the first tooltip request succeeds
+        QCOMPARE(client.index(2, 0).data().toString(), QStringLiteral("entry2"));
+        QTest::qWait(10);
+        QCOMPARE(client.index(2, 0).data(Qt::ToolTipRole).toString(), QStringLiteral("tooltip2"));
+    }
+
+    void testContentRevalidation()
+    {
+        QScopedPointer<QStandardItemModel> listModel(new QStandardItemModel(this));
+        for (int i = 0; i < 10; ++i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.RevalidationModel"), this);
+        server.setModel(listModel.data());
+        server.modelMonitored(true);
+
+        FakeRemoteModel client(QStringLiteral("com.kdab.GammaRay.UnitTest.RevalidationModel"), this);
+        connect(&server, SIGNAL(message(GammaRay::Message)), &client,
+                SLOT(newMessage(GammaRay::Message)));
+        connect(&client, SIGNAL(message(GammaRay::Message)), &server,
+                SLOT(newRequest(GammaRay::Message)));
+        MessageRecorder requests;
+        connect(&client, SIGNAL(message(GammaRay::Message)), &requests,
+                SLOT(record(GammaRay::Message)));
+
+        const auto loadAll = [&client]() {
+            client.rowCount();
+            QTest::qWait(10);
+            for (int row = 0; row < client.rowCount(); ++row)
+                client.index(row, 0).data();
+            QTest::qWait(10);
+        };
+        loadAll();
+        QCOMPARE(client.rowCount(), 10);
+
+        // content the client still knows from before a reset is reused
+        requests.types.clear();
+        listModel->clear();
+        for (int i = 9; i >= 0; --i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+        loadAll();
+        QCOMPARE(client.rowCount(), 10);
+        for (int row = 0; row < 10; ++row)
+            QCOMPARE(client.index(row, 0).data().toString(), QStringLiteral("entry%1").arg(9 - row));
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelContentHashRequest)), 1);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelViewportRequest)), 0);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelContentRequest)), 0);
+
+        // only changed cells are transferred again
+        requests.types.clear();
+        listModel->clear();
+        listModel->appendRow(new QStandardItem(QStringLiteral("changed")));
+        for (int i = 0; i < 9; ++i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+        loadAll();
+        QCOMPARE(client.rowCount(), 10);
+        QCOMPARE(client.index(0, 0).data().toString(), QStringLiteral("changed"));
+        for (int row = 1; row < 10; ++row)
+            QCOMPARE(client.index(row, 0).data().toString(), QStringLiteral("entry%1").arg(row - 1));
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelContentHashRequest)), 1);
+        QCOMPARE(requests.types.count(Protocol::MessageType(Protocol::ModelViewportRequest)), 1);
+    }
+
+    void testLayoutPermutation()
+    {
+        QScopedPointer<QStandardItemModel> listModel(new QStandardItemModel(this));
+        for (int i = 0; i < 10; ++i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.PermutationModel"), this);
+        server.setModel(listModel.data());
+        server.modelMonitored(true);
+
+        FakeRemoteModel client(QStringLiteral("com.kdab.GammaRay.UnitTest.PermutationModel"), this);
+        connect(&server, SIGNAL(message(GammaRay::Message)), &client,
+                SLOT(newMessage(GammaRay::Message)));
+        connect(&client, SIGNAL(message(GammaRay::Message)), &server,
+                SLOT(newRequest(GammaRay::Message)));
+        MessageRecorder requests;
+        connect(&client, SIGNAL(message(GammaRay::Message)), &requests,
+                SLOT(record(GammaRay::Message)));
+
+        QCOMPARE(client.rowCount(), 0);
+        QTest::qWait(10);
+        QCOMPARE(client.rowCount(), 10);
+        for (int row = 0; row < 10; ++row)
+            client.index(row, 0).data();
+        QTest::qWait(10);
+        const QPersistentModelIndex persistentIndex = client.index(2, 0);
+        QCOMPARE(persistentIndex.data().toString(), QStringLiteral("entry2"));
+
+        // the rows are reordered in place, nothing needs to be transferred again
+        requests.types.clear();
+        listModel->sort(0, Qt::DescendingOrder);
+        QTest::qWait(10);
+        QCOMPARE(client.rowCount(), 10);
+        for (int row = 0; row < 10; ++row)
+            QCOMPARE(client.index(row, 0).data().toString(), QStringLiteral("entry%1").arg(9 - row));
+        QVERIFY(persistentIndex.isValid());
+        QCOMPARE(persistentIndex.row(), 7);
+        QCOMPARE(persistentIndex.data().toString(), QStringLiteral("entry2"));
+        QTest::qWait(10);
+        QVERIFY(requests.types.isEmpty());
+    }
+
+    void testCacheEviction()
+    {
+        QScopedPointer<QStandardItemModel> listModel(new QStandardItemModel(this));
+        for (int i = 0; i < 100; ++i)
+            listModel->appendRow(new QStandardItem(QStringLiteral("entry%1").arg(i)));
+
+        FakeRemoteModelServer server(QStringLiteral("com.kdab.GammaRay.UnitTest.EvictionModel"), this);
+        server.setModel(listModel.data());
+        server.setPrefetchRowCount(0);
+        server.modelMonitored(true);
+
+        FakeRemoteModel client(QStringLiteral("com.kdab.GammaRay.UnitTest.EvictionModel"), this);
+        client.setMaximumCachedCells(20);
+        connect(&server, SIGNAL(message(GammaRay::Message)), &client,
+                SLOT(newMessage(GammaRay::Message)));
+        connect(&client, SIGNAL(message(GammaRay::Message)), &server,
+                SLOT(newRequest(GammaRay::Message)));
+
+        QCOMPARE(client.rowCount(), 0);
+        QTest::qWait(10);
+        QCOMPARE(client.rowCount(), 100);
+
+        const auto loaded = [&client](int row) {
+            return client.index(row, 0).data(RemoteModelRole::LoadingState).value<RemoteModelNodeState::NodeStates>()
+                   == RemoteModelNodeState::NoState;
+        };
+        // "scroll" through the model, ten rows at a time
+        for (int first = 0; first < 30; first += 10) {
+            for (int row = first; row < first + 10; ++row)
+                client.index(row, 0).data();
+            QTest::qWait(10);
+            for (int row = first; row < first + 10; ++row)
+                QVERIFY(loaded(row));
+        }
+
+        // the least recently used rows got dropped, the ones used since the previous batch are kept
+        for (int row = 0; row < 10; ++row)
+            QVERIFY(!loaded(row));
+        for (int row = 10; row < 30; ++row)
+            QVERIFY(loaded(row));
+
+        // and dropped rows are simply loaded again
+        client.index(0, 0).data();
+        QTest::qWait(10);
+        QCOMPARE(client.index(0, 0).data().toString(), QStringLiteral("entry0"));
+    }
+
     // this should not make a difference if the above works, however it broke massively with Qt 5.4...
     void testSortProxy()
     {
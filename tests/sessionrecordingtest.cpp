@@ -0,0 +1,143 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/message.h>
+#include <common/sessionrecording.h>
+
+#include <QtTest/qtest.h>
+#include <QBuffer>
+#include <QObject>
+#include <QTemporaryFile>
+
+using namespace GammaRay;
+
+class SessionRecordingTest : public QObject
+{
+    Q_OBJECT
+private:
+    static Message decode(const SessionRecordingReader::Entry &entry)
+    {
+        QBuffer buffer;
+        buffer.setData(entry.data, entry.size);
+        buffer.open(QIODevice::ReadOnly);
+        MessageParser parser;
+        parser.readFrom(&buffer);
+        return parser.takeMessage();
+    }
+
+private slots:
+    void testRoundTrip()
+    {
+        QTemporaryFile tmp;
+        QVERIFY(tmp.open());
+        const QString fileName = tmp.fileName();
+        tmp.close();
+
+        {
+            SessionRecordingWriter writer(true);
+            QVERIFY(writer.open(fileName));
+            Message out(23, 2, QByteArray("request"));
+            writer.record(SessionRecording::Outgoing, out);
+            Message in(42, 3, QByteArray(1024, 'r'));
+            writer.record(SessionRecording::Incoming, in);
+        }
+
+        SessionRecordingReader reader;
+        QVERIFY(reader.open(fileName));
+        QVERIFY(reader.isClientRecording());
+        QCOMPARE(reader.protocolVersion(), Protocol::version());
+
+        SessionRecordingReader::Entry entry;
+        QVERIFY(reader.readNext(entry));
+        QCOMPARE(entry.direction, SessionRecording::Outgoing);
+        {
+            const auto msg = decode(entry);
+            QCOMPARE(msg.address(), Protocol::ObjectAddress(23));
+            QCOMPARE(msg.rawPayload(), QByteArray("request"));
+        }
+
+        const qint64 firstTimestamp = entry.timestamp;
+        QVERIFY(reader.readNext(entry));
+        QCOMPARE(entry.direction, SessionRecording::Incoming);
+        QVERIFY(entry.timestamp >= firstTimestamp);
+        {
+            const auto msg = decode(entry);
+            QCOMPARE(msg.address(), Protocol::ObjectAddress(42));
+            QCOMPARE(msg.type(), Protocol::MessageType(3));
+            QCOMPARE(msg.rawPayload(), QByteArray(1024, 'r'));
+        }
+        QVERIFY(!reader.readNext(entry));
+
+        reader.rewind();
+        QVERIFY(reader.readNext(entry));
+        QCOMPARE(entry.direction, SessionRecording::Outgoing);
+    }
+
+    void testTruncated()
+    {
+        QTemporaryFile tmp;
+        QVERIFY(tmp.open());
+        const QString fileName = tmp.fileName();
+        tmp.close();
+
+        {
+            SessionRecordingWriter writer(false);
+            QVERIFY(writer.open(fileName));
+            Message msg(23, 2, QByteArray("complete"));
+            writer.record(SessionRecording::Outgoing, msg);
+            Message cut(23, 2, QByteArray("cut off"));
+            writer.record(SessionRecording::Outgoing, cut);
+        }
+        QFile file(fileName);
+        QVERIFY(file.open(QFile::ReadWrite));
+        QVERIFY(file.resize(file.size() - 3));
+        file.close();
+
+        SessionRecordingReader reader;
+        QVERIFY(reader.open(fileName));
+        QVERIFY(!reader.isClientRecording());
+        SessionRecordingReader::Entry entry;
+        QVERIFY(reader.readNext(entry));
+        QVERIFY(!reader.readNext(entry));
+    }
+
+    void testInvalidFile()
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.write("not a recording");
+        file.close();
+        const QString fileName = file.fileName();
+
+        SessionRecordingReader reader;
+        QVERIFY(!reader.open(fileName));
+        QVERIFY(!reader.errorString().isEmpty());
+    }
+};
+
+QTEST_MAIN(SessionRecordingTest)
+
+#include "sessionrecordingtest.moc"
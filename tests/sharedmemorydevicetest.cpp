@@ -0,0 +1,109 @@
+/*
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/sharedmemorydevice.h>
+
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSignalSpy>
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+class SharedMemoryDeviceTest : public QObject
+{
+    Q_OBJECT
+private:
+    bool setupConnection()
+    {
+        const QString name = QStringLiteral("gammaray-shmtest-%1").arg(QCoreApplication::applicationPid());
+        QLocalServer::removeServer(name);
+        if (!m_server.listen(name))
+            return false;
+        m_clientSocket.connectToServer(name);
+        if (!m_server.waitForNewConnection(5000))
+            return false;
+        m_serverSocket = m_server.nextPendingConnection();
+        return m_clientSocket.waitForConnected(5000);
+    }
+
+    QLocalServer m_server;
+    QLocalSocket *m_serverSocket;
+    QLocalSocket m_clientSocket;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(setupConnection());
+    }
+
+    void testTransfer()
+    {
+        SharedMemoryDevice serverDevice(m_serverSocket);
+        if (!serverDevice.create())
+            QSKIP("shared memory not available");
+        SharedMemoryDevice clientDevice(&m_clientSocket);
+        QVERIFY(clientDevice.attach(serverDevice.key()));
+        QVERIFY(serverDevice.open(QIODevice::ReadWrite));
+        QVERIFY(clientDevice.open(QIODevice::ReadWrite));
+        QVERIFY(clientDevice.isSequential());
+
+        QSignalSpy readSpy(&clientDevice, SIGNAL(readyRead()));
+        QVERIFY(readSpy.isValid());
+        QCOMPARE(serverDevice.write("hello"), 5ll);
+        QVERIFY(readSpy.wait(5000));
+        QCOMPARE(clientDevice.bytesAvailable(), 5ll);
+        QCOMPARE(clientDevice.readAll(), QByteArray("hello"));
+
+        clientDevice.write("world");
+        QVERIFY(serverDevice.waitForReadyRead(5000));
+        QCOMPARE(serverDevice.readAll(), QByteArray("world"));
+
+        // more than fits into the ring at once
+        QByteArray data(10 * 1024 * 1024, Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(i % 251);
+        QCOMPARE(serverDevice.write(data), (qint64)data.size());
+        QVERIFY(serverDevice.bytesToWrite() > 0);
+
+        // both ends share one event loop here, so no blocking waits
+        QByteArray received;
+        QElapsedTimer timer;
+        timer.start();
+        while (received.size() < data.size() && timer.elapsed() < 10000) {
+            received += clientDevice.readAll();
+            QTest::qWait(1);
+        }
+        QCOMPARE(received.size(), data.size());
+        QVERIFY(received == data);
+        QCOMPARE(serverDevice.bytesToWrite(), 0ll);
+    }
+};
+
+QTEST_MAIN(SharedMemoryDeviceTest)
+
+#include "sharedmemorydevicetest.moc"
@@ -0,0 +1,122 @@
+/*
+  trackedobjectsettest.cpp
+
+  This file is part of GammaRay, the Qt application inspection and
+  manipulation tool.
+
+  Copyright (C) 2017 Klarälvdalens Datakonsult AB, a KDAB Group company, info@kdab.com
+  Author: Volker Krause <volker.krause@kdab.com>
+
+  Licensees holding valid commercial KDAB GammaRay licenses may use this file in
+  accordance with GammaRay Commercial License Agreement provided with the Software.
+
+  Contact info@kdab.com if any conditions of this licensing are not clear to you.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/trackedobjectset.h>
+
+#include <QtTest/qtest.h>
+
+using namespace GammaRay;
+
+static QObject *object(quintptr addr)
+{
+    return reinterpret_cast<QObject *>(addr);
+}
+
+class TrackedObjectSetTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testStates()
+    {
+        TrackedObjectSet set;
+        QObject *obj = object(0x1000);
+        const quint32 generation = TrackedObjectSet::nextGeneration();
+        QVERIFY(generation != 0);
+
+        QCOMPARE(set.state(obj), TrackedObjectSet::Untracked);
+        QCOMPARE(set.generation(obj), 0u);
+        QVERIFY(set.insertPending(obj, generation));
+        QVERIFY(!set.insertPending(obj, TrackedObjectSet::nextGeneration()));
+        QCOMPARE(set.state(obj), TrackedObjectSet::Pending);
+        QCOMPARE(set.generation(obj), generation);
+        QVERIFY(!set.isAnnounced(obj, generation));
+
+        QVERIFY(!set.announce(obj, generation + 1));
+        QVERIFY(set.announce(obj, generation));
+        QVERIFY(!set.announce(obj, generation));
+        QCOMPARE(set.state(obj), TrackedObjectSet::Announced);
+        QCOMPARE(set.generation(obj), generation);
+        QVERIFY(set.isAnnounced(obj, generation));
+        QVERIFY(!set.isAnnounced(obj, generation + 1));
+
+        QCOMPARE(set.removePending(obj), TrackedObjectSet::Announced);
+        QCOMPARE(set.size(), 1);
+        QCOMPARE(set.remove(obj), TrackedObjectSet::Announced);
+        QCOMPARE(set.remove(obj), TrackedObjectSet::Untracked);
+        QCOMPARE(set.size(), 0);
+
+        // same address, new object
+        const quint32 newGeneration = TrackedObjectSet::nextGeneration();
+        QVERIFY(set.insertPending(obj, newGeneration));
+        QVERIFY(set.announce(obj, 0));
+        QVERIFY(!set.isAnnounced(obj, generation));
+        QVERIFY(set.isAnnounced(obj, newGeneration));
+        QCOMPARE(set.removePending(obj), TrackedObjectSet::Announced);
+        QCOMPARE(set.remove(obj), TrackedObjectSet::Announced);
+
+        QVERIFY(set.insertPending(obj, generation));
+        QCOMPARE(set.removePending(obj), TrackedObjectSet::Pending);
+        QCOMPARE(set.state(obj), TrackedObjectSet::Untracked);
+        QVERIFY(!set.announce(obj, generation));
+    }
+
+    void testGrowAndErase()
+    {
+        // enough objects to grow the tables a few times and produce collisions
+        TrackedObjectSet set;
+        const int count = 20000;
+        QVector<quint32> generations(count);
+        for (int i = 0; i < count; ++i) {
+            generations[i] = TrackedObjectSet::nextGeneration();
+            QVERIFY(set.insertPending(object(0x1000 + i * 16), generations[i]));
+        }
+        QCOMPARE(set.size(), count);
+
+        // remove every other object, the rest has to remain reachable
+        for (int i = 0; i < count; i += 2)
+            QCOMPARE(set.remove(object(0x1000 + i * 16)), TrackedObjectSet::Pending);
+        QCOMPARE(set.size(), count / 2);
+        for (int i = 0; i < count; ++i) {
+            QObject *obj = object(0x1000 + i * 16);
+            if (i % 2) {
+                QCOMPARE(set.generation(obj), generations[i]);
+                QVERIFY(set.announce(obj, generations[i]));
+            } else {
+                QCOMPARE(set.state(obj), TrackedObjectSet::Untracked);
+            }
+        }
+
+        for (int i = 1; i < count; i += 2)
+            QCOMPARE(set.remove(object(0x1000 + i * 16)), TrackedObjectSet::Announced);
+        QCOMPARE(set.size(), 0);
+    }
+};
+
+QTEST_MAIN(TrackedObjectSetTest)
+
+#include "trackedobjectsettest.moc"